@@ -29,6 +29,10 @@
 # a single line command that runs all three programs:
 idfetch -t 5 -c 1 -G sample.1.in | id_fasta.pl | extract_fasta_multi_exon sample.2.in > sample.out
 #
+# or, letting extract_fasta_multi_exon name the sequences the way
+# id_fasta.pl would (only the names differ, output is the same):
+# idfetch -t 5 -c 1 -G sample.1.in | extract_fasta_multi_exon --id-fasta sample.2.in > sample.out
+#
 ######################
 # Programs
 # (idfetch and id_fasta.pl sections copied from ../programs/15_0213_extract_fasta_richa/00NOTES.sh)
@@ -77,7 +81,120 @@ idfetch -t 5 -c 1 -G sample.1.in | id_fasta.pl | extract_fasta_multi_exon sample
 #
 # Usage:
 # > ./extract_fasta_multi_exon
-# extract_fasta_multi_exon <interval_list> [<fa_file>]
+# extract_fasta_multi_exon [options] <interval_list> [<fa_file> ...]
+# extract_fasta_multi_exon --build-index <fa_file>
+# extract_fasta_multi_exon --build-cache <fa_file> <cache_file>
+# extract_fasta_multi_exon --serve [options] [--socket <path>] <fa_file> [<fa_file> ...]
+# <fa_file> may be a 2-bit cache written by --build-cache, or gzip compressed
+# (BGZF compressed, by bgzip, to index it).
+# With more than one <fa_file>, each sequence is from the first that has it.
+#
+# Options:
+#   -i             read only the needed parts of <fa_file> using its index <fa_file>.fai
+#   -g <n>         with -i, read pieces less than <n> bytes apart together [16384]
+#   -o <file>      write output to <file> instead of stdout
+#   -t <n>         extract with <n> worker threads, output is the same
+#                  [1, or one per CPU with more than one <fa_file>]
+#   -w <n>         write <n> residues per output line, 0 for one line per sequence [80]
+#   --write-index  with -o, also write the index <file>.fai of the output
+#   --binary       write length-prefixed binary records (see extractfasta.h), not fasta
+#   --sort-memory <n>  sort the interval list in about <n> bytes (K, M or G suffix),
+#                  with temporary files; <fa_file> must be in name order, or use -i
+#   --tmpdir <dir>  with --sort-memory, write temporary files in <dir> [$TMPDIR or /tmp]
+#   --id-fasta     name sequences as id_fasta.pl does: by the 4th '|' field of
+#                  their header if there are 4 or more, else by the 2nd
+#   --id-field <n> name sequences by the <n>th '|' field of their header, if it has one
+#   --translate <n>  output the protein of each interval, with NCBI genetic code <n>
+#   --fasta-list <file>  extract from the fasta files listed in <file>, one per line
+#   --unordered    with more than one <fa_file>, write each file's output as soon as
+#                  it is extracted; a sequence in several is from any of them
+#   --stats[=<file>]  write the time of each phase, bytes read and written and other
+#                  counts as JSON to stderr, or to <file>
+#   --progress <n>  write a progress line to stderr every <n> seconds
+#   --build-index  write the index <fa_file>.fai for <fa_file> (and <fa_file>.gzi if
+#                  it is BGZF) and exit
+#   --build-cache  write <fa_file> 2-bit packed to <cache_file> and exit
+#   --serve        keep the <fa_file>s open and answer requests from stdin (see serve.h)
+#   --socket <path>  with --serve, answer requests on the Unix domain socket <path>
+#
+# For large <fa_file>s that are fetched from repeatedly, build a
+# samtools-compatible index (<fa_file>.fai) once with --build-index
+# and then use -i, so that only the parts of <fa_file> that cover
+# the requested intervals are read:
+# > ./extract_fasta_multi_exon --build-index genome.fa
+# > ./extract_fasta_multi_exon -i sample.2.in genome.fa
+# With -i, the pieces wanted from each sequence are sorted and those
+# less than 16384 bytes apart (change with -g) are read with one read,
+# so many exons of transcripts at the same locus aren't read one by one.
+#
+# If genome.fa has only A, C, G, T and N (in either case), it can
+# instead be cached with --build-cache in the UCSC .2bit format, about
+# a quarter of its size; the cache is given in place of genome.fa and
+# gives the same output (see twobit.h):
+# > ./extract_fasta_multi_exon --build-cache genome.fa genome.2bit
+# > ./extract_fasta_multi_exon sample.2.in genome.2bit
+#
+# A genome split into several files (one per chromosome, say) can be
+# given as all of them, or as a file listing them one per line; they
+# are read at the same time, one per thread (one per CPU unless -t is
+# given), and the output is the same as from the files put together
+# one after another. With --unordered, each file's output is written
+# as soon as it has been extracted, in whatever order they finish:
+# > ./extract_fasta_multi_exon sample.2.in chr*.fa
+# > ls chr*.fa > genome.list
+# > ./extract_fasta_multi_exon --fasta-list genome.list --unordered sample.2.in
+#
+# A gzip compressed genome.fa.gz can be given as it is, it is inflated
+# as it is read. If it was compressed with bgzip (BGZF), its blocks are
+# inflated by the -t threads, and --build-index also writes the index
+# of its blocks, genome.fa.gz.gzi, so that -i inflates only the blocks
+# covering the requested intervals:
+# > ./extract_fasta_multi_exon -t 4 sample.2.in genome.fa.gz
+# > ./extract_fasta_multi_exon --build-index genome.fa.gz
+# > ./extract_fasta_multi_exon -i sample.2.in genome.fa.gz
+#
+# To extract many small batches without reading genome.fa each time,
+# keep it open in a server and send it requests, each one an interval
+# list ended by a line with just a '.'. Each response is a line
+# 'OK <nbytes> <nmissing>', the names not found, and then <nbytes> of
+# the usual output (or a line 'ERROR <message>'); see serve.h:
+# > ./extract_fasta_multi_exon --serve --socket /tmp/genome.sock genome.fa &
+# > (cat sample.2.in; echo .) | nc -U /tmp/genome.sock
+#
+# To get the proteins the intervals code for instead of their
+# nucleotides, give the NCBI genetic code to translate with (1 is the
+# standard code, 11 bacterial, 2 vertebrate mitochondrial); codons can
+# span exons and - strand intervals are reverse complemented first:
+# > ./extract_fasta_multi_exon --translate 1 sample.2.in genome.fa
+#
+# To see where the time of a slow run goes, --stats writes (to stderr,
+# or with --stats=<file> to <file>) the wall and CPU seconds spent
+# reading the interval list, sorting it, scanning the fasta file and
+# extracting, with bytes read and written, records seen and matched,
+# intervals on each strand, sequence buffers grown and bytes copied,
+# and the peak RSS, as JSON; --progress <n> writes a line every <n>
+# seconds meanwhile:
+# > ./extract_fasta_multi_exon --stats=run.json --progress 600 sample.2.in genome.fa
+#
+# If what you extract is itself fetched from at random, --write-index
+# writes the index of the -o file as it is written, so it needn't be
+# read again with --build-index. With --binary each sequence is a
+# length-prefixed record with its sequence on one line (the format is
+# in extractfasta.h), that a program can map into memory and use in
+# place; its index gives each sequence's offset and length, and -i
+# reads it like any other indexed file:
+# > ./extract_fasta_multi_exon --binary --write-index -o cds.bin sample.2.in genome.fa
+# > ./extract_fasta_multi_exon -i cds.in cds.bin
+#
+# An interval list too big to hold in memory can be sorted externally
+# with --sort-memory: it is parsed and sorted in runs that fit in the
+# given memory (the -t threads sort several at once), kept in temporary
+# files in --tmpdir, and merged one sequence name at a time as the
+# fasta file is read. The sequences wanted must then come in name
+# order, so either genome.fa is sorted by name (as LC_ALL=C sort sorts)
+# or it is read with -i (or is a 2-bit cache); output is in name order:
+# > ./extract_fasta_multi_exon --sort-memory 4G --tmpdir /scratch -t 4 -i all.in genome.fa
+#
 # Format of <interval_list>, each line must look like this:
 #
 # <accession/id> <num-pieces (n)> <start_1> <end_1> <start_2> <end_2> ... <start_n> <end_n> <strand>
@@ -91,7 +208,10 @@ idfetch -t 5 -c 1 -G sample.1.in | id_fasta.pl | extract_fasta_multi_exon sample
 # intervals on either strand.
 #
 # Compilation:
-#  > gcc -o extract_fasta_multi_exon extract_fasta_multi_exon.c
+#  > sh build.sh
+# (or: gcc -O3 -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz)
+# build.sh also makes libextractfasta.a, the extraction as a library
+# for other programs, see extractfasta.h.
 #
 # Source of 'extract_fasta_multi_exon':
 # /home/nawrocke/notebook/15_0303_dnaorg_extract_fasta_multiple_exons/
@@ -156,4 +276,30 @@ perl test_extract_fasta_multi_exon.pl . test-files 1
 # If all tests pass, final line of output is:
 # PASS [11 tests failed as expected and 12 tests succeeded as expected]
 #
+# test_revcomp.c: unit tests for the reverse complement kernels
+# (scalar, SSE4.1 and AVX2) in revcomp.c. test.sh compiles and runs
+# it before the test script above:
+# > gcc -O2 -o test_revcomp test_revcomp.c revcomp.c && ./test_revcomp
+#
+# test_translate.c: unit tests for the translation kernels (scalar and
+# SSE4.1) in translate.c, also run by test.sh:
+# > gcc -O2 -o test_translate test_translate.c translate.c revcomp.c && ./test_translate
+#
+# test_extractfasta.c: tests of the library API in extractfasta.h,
+# also run by test.sh:
+# > gcc -O2 -o test_extractfasta test_extractfasta.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c -lpthread -lz && ./test_extractfasta
+#
+# bench_extractfasta.c: benchmarks of the library on synthetic
+# workloads made by a seeded generator (a few huge chromosomes, very
+# many tiny contigs, soft-masked and IUPAC sequence), timing reading
+# the intervals, extracting from the fasta file with and without its
+# index, and from a reference kept open. It prints JSON: seconds, MB/s
+# and intervals/s for each phase, and the peak RSS and a hash of the
+# output for each workload. bench.sh compiles and runs it, passing on
+# its options: -s <seed>, -x <scale> (1 is about 100Mb of reference
+# in all), -t <threads>, -r <repeats>, -d <dir> and -k to keep the
+# generated files; and workload names (chromosomes, contigs, masked)
+# to run only those:
+# > sh bench.sh -x 0.5 > bench.json
+#
 # last updated [EPN, Mon Mar  9 09:37:55 2015]
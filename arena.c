@@ -0,0 +1,105 @@
+/* arena.c:
+ *
+ * String arena, see arena.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+arena_t *arena_create(void) {
+  arena_t *a = (arena_t *) malloc(sizeof(arena_t));
+
+  if (a == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  a->block = NULL;
+  return a;
+}
+
+/* Function: arena_strdup()
+ * Args:     a:   arena
+ *           s:   string to copy
+ *           len: number of characters of <s> to copy
+ * Returns:  '\0'-terminated copy of s[0..len-1] in the arena
+ */
+char *arena_strdup(arena_t *a, const char *s, long len) {
+  arena_block *block;
+  long         size;
+  char        *copy;
+
+  if ((a->block == NULL) || (a->block->n + len + 1 > a->block->size))
+    {
+      size  = (len + 1 > ARENA_BLOCKSIZE) ? len + 1 : ARENA_BLOCKSIZE;
+      block = (arena_block *) malloc(sizeof(arena_block) + size);
+      if (block == NULL)
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+      block->prev = a->block;
+      block->size = size;
+      block->n    = 0;
+      a->block    = block;
+    }
+  copy = a->block->data + a->block->n;
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  a->block->n += len + 1;
+  return copy;
+}
+
+/* Function: arena_merge()
+ * Args:     dst: arena to take over the strings of <src>
+ *           src: arena, freed, its strings stay valid until <dst> is freed
+ */
+void arena_merge(arena_t *dst, arena_t *src) {
+  arena_block *oldest;
+
+  if (src->block != NULL)
+    {
+      for (oldest = src->block; oldest->prev != NULL; oldest = oldest->prev)
+        ;
+      oldest->prev = dst->block;
+      dst->block   = src->block; /* strings go into the last block of <src> from now on */
+    }
+  free(src);
+}
+
+/* arena_clear(): drop every string in <a>, keeping the block being
+ * filled (not one of a single long string) for the strings to come */
+void arena_clear(arena_t *a) {
+  arena_block *block, *prev;
+
+  if (a->block == NULL)
+    return;
+  for (block = a->block->prev; block != NULL; block = prev)
+    {
+      prev = block->prev;
+      free(block);
+    }
+  a->block->prev = NULL;
+  a->block->n    = 0;
+  if (a->block->size > ARENA_BLOCKSIZE)
+    {
+      free(a->block);
+      a->block = NULL;
+    }
+}
+
+void arena_free(arena_t *a) {
+  arena_block *block, *prev;
+
+  if (a == NULL)
+    return;
+  for (block = a->block; block != NULL; block = prev)
+    {
+      prev = block->prev;
+      free(block);
+    }
+  free(a);
+}
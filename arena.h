@@ -0,0 +1,30 @@
+/* arena.h:
+ *
+ * A string arena: strings are copied into large blocks instead of
+ * being malloc'ed one at a time, and are all freed together. Blocks
+ * never move, so pointers into the arena stay valid until it is freed.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_BLOCKSIZE (1024 * 1024)
+
+typedef struct arena_block_s {
+  struct arena_block_s *prev; /* previously filled block, or NULL */
+  long                  size; /* number of bytes in data */
+  long                  n;    /* number of bytes of data in use */
+  char                  data[];
+} arena_block;
+
+typedef struct {
+  arena_block *block; /* block being filled, or NULL */
+} arena_t;
+
+arena_t *arena_create(void);
+char    *arena_strdup(arena_t *a, const char *s, long len);
+void     arena_merge(arena_t *dst, arena_t *src);
+void     arena_clear(arena_t *a);
+void     arena_free(arena_t *a);
+
+#endif /* ARENA_H */
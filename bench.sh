@@ -0,0 +1 @@
+gcc -O3 -o bench_extractfasta bench_extractfasta.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c -lpthread -lz && ./bench_extractfasta "$@"
@@ -0,0 +1,515 @@
+/* bench_extractfasta.c:
+ *
+ * Benchmarks of libextractfasta (see extractfasta.h) on synthetic
+ * workloads, reported as JSON so runs can be compared across commits.
+ *
+ * Each workload is a reference and an interval list made by a seeded
+ * generator (the same seed and scale give the same files on any
+ * machine), written to a temporary directory:
+ *
+ *   chromosomes  a few huge chromosomes, 60 residues per line
+ *   contigs      very many tiny contigs, some asked for whole
+ *   masked       soft-masked (lower case) runs, N runs and other
+ *                IUPAC codes, 80 residues per line
+ *
+ * Intervals are on both strands, have from 1 to well over the 150
+ * pieces the original program allowed (MAXPIECES), and some are
+ * isoforms that share pieces with the one before, or duplicates.
+ *
+ * Each workload runs in its own process, so its peak RSS is its own,
+ * and each phase is timed -r times, keeping the fastest:
+ *
+ *   read_intervals         ef_read_intervals()
+ *   process_fasta          ef_extract() from the fasta file (mapped)
+ *   process_fasta_indexed  ef_extract() with the .fai index (-i)
+ *   open_reference         ef_open_reference(), scanning the file once
+ *   print_fasta            ef_extract() from the reference kept open,
+ *                          so only looking up and formatting
+ *
+ * For each phase: wall and CPU seconds, MB/s (of the interval list, the
+ * fasta file, or the output for print_fasta) and intervals/s; for each
+ * workload the output size and an FNV-1a hash of it (to check that two
+ * builds extract the same thing) and the peak RSS in kb.
+ *
+ * To compile and run (see bench.sh):
+ *    gcc -O3 -o bench_extractfasta bench_extractfasta.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c -lpthread -lz
+ *    ./bench_extractfasta [-s <seed>] [-x <scale>] [-t <threads>] [-r <repeats>] [-d <dir>] [-k] [<workload> ...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "extractfasta.h"
+
+#define OLD_MAXPIECES 150 /* most pieces an interval could have before they were stored in arenas */
+
+typedef struct {
+  const char *name;
+  long   nseqs;      /* number of sequences, at scale 1 */
+  long   min_len;    /* their lengths */
+  long   max_len;
+  int    width;      /* residues per line */
+  double masked;     /* fraction of residues in soft-masked runs */
+  double iupac;      /* fraction of residues that are IUPAC codes other than ACGT, half of them in N runs */
+  long   nintervals; /* number of intervals, at scale 1 */
+  double whole;      /* fraction of intervals that are whole sequences */
+} workload;
+
+static const workload workloadA[] = {
+  { "chromosomes",      4, 16000000, 16000000, 60, 0.0,  0.0,   200000, 0.0  },
+  { "contigs",     200000,       50,      500, 70, 0.0,  0.0,   200000, 0.05 },
+  { "masked",           8,  4000000,  4000000, 80, 0.3,  0.01,  100000, 0.0  }
+};
+#define NWORKLOADS ((int) (sizeof(workloadA) / sizeof(workload)))
+
+typedef struct {
+  uint64_t seed;
+  double   scale;
+  int      nthreads;
+  int      repeats;
+  char    *dir;
+  int      keep;      /* TRUE to leave the files in <dir> */
+} options;
+
+/* what a workload's files hold */
+typedef struct {
+  long nseqs;
+  long residues;
+  long fasta_bytes;
+  long nintervals;
+  long npieces;
+  long interval_bytes;
+} workload_files;
+
+/* ef_write_fn state: counts and hashes the output */
+typedef struct {
+  long     n;
+  int      hash;      /* TRUE to hash, outside the timed phases */
+  uint64_t fnv;
+} output_sum;
+
+static uint64_t rng_state;
+
+static void     die(const char *msg);
+static uint64_t rng_next(void);
+static long     rng_range(long lo, long hi);
+static double   rng_unit(void);
+static void     make_fasta(const workload *w, double scale, const char *filename, workload_files *wf, long *lenA);
+static void     make_intervals(const workload *w, double scale, const char *filename, workload_files *wf, const long *lenA);
+static void     run_workload(const workload *w, const options *opt, int first);
+static double   now(void);
+static double   cpu_now(void);
+static int      sum_output(void *arg, const char *buf, long len);
+static void     print_phase(const char *phase, double secs, double cpu, long bytes, long nintervals, int last);
+
+int main(int argc, char **argv) {
+  options opt;
+  char   *endp;
+  int     c, i, w, nrun = 0;
+  pid_t   pid;
+  int     status;
+
+  opt.seed     = 1;
+  opt.scale    = 1.0;
+  opt.nthreads = 1;
+  opt.repeats  = 3;
+  opt.dir      = NULL;
+  opt.keep     = 0;
+  while ((c = getopt(argc, argv, "s:x:t:r:d:k")) != -1)
+    {
+      switch (c) {
+      case 's': opt.seed     = strtoull(optarg, &endp, 10); break;
+      case 'x': opt.scale    = strtod(optarg, &endp);       break;
+      case 't': opt.nthreads = (int) strtol(optarg, &endp, 10); break;
+      case 'r': opt.repeats  = (int) strtol(optarg, &endp, 10); break;
+      case 'd': opt.dir      = optarg; endp = ""; break;
+      case 'k': opt.keep = 1; endp = ""; break;
+      default:  endp = "bad";
+      }
+      if ((*endp != '\0') || (opt.scale <= 0) || (opt.nthreads < 1) || (opt.repeats < 1))
+        {
+          fprintf(stderr, "Usage: bench_extractfasta [-s <seed>] [-x <scale>] [-t <threads>] [-r <repeats>] [-d <dir>] [-k] [<workload> ...]\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  for (i = optind; i < argc; i++)
+    {
+      for (w = 0; (w < NWORKLOADS) && (strcmp(argv[i], workloadA[w].name) != 0); w++)
+        ;
+      if (w == NWORKLOADS)
+        {
+          fprintf(stderr, "Unknown workload %s (chromosomes, contigs or masked)\n", argv[i]);
+          exit(EXIT_FAILURE);
+        }
+    }
+  if (opt.dir == NULL)
+    {
+      opt.dir = strdup("/tmp/bench_extractfastaXXXXXX");
+      if ((opt.dir == NULL) || (mkdtemp(opt.dir) == NULL))
+        die("Cannot make a temporary directory");
+    }
+
+  printf("{\n  \"benchmark\": \"extractfasta\",\n  \"seed\": %lu,\n  \"scale\": %g,\n"
+         "  \"threads\": %d,\n  \"repeats\": %d,\n  \"workloads\": [",
+         (unsigned long) opt.seed, opt.scale, opt.nthreads, opt.repeats);
+  for (w = 0; w < NWORKLOADS; w++)
+    {
+      for (i = optind; (i < argc) && (strcmp(argv[i], workloadA[w].name) != 0); i++)
+        ;
+      if ((optind < argc) && (i == argc))
+        continue;
+      /* in a process of its own, for its peak RSS */
+      fflush(stdout);
+      if ((pid = fork()) == -1)
+        die("Cannot fork");
+      if (pid == 0)
+        {
+          run_workload(&workloadA[w], &opt, nrun == 0);
+          fflush(stdout);
+          _exit(EXIT_SUCCESS);
+        }
+      if ((waitpid(pid, &status, 0) == -1) || (! WIFEXITED(status)) || (WEXITSTATUS(status) != 0))
+        die("A workload failed");
+      nrun++;
+    }
+  printf("\n  ]\n}\n");
+
+  if (! opt.keep)
+    rmdir(opt.dir); /* each workload removes its files */
+  return 0;
+}
+
+/* run_workload(): make the files for <w>, time each phase and print
+ * its JSON object */
+static void run_workload(const workload *w, const options *opt, int first) {
+  workload_files wf;
+  output_sum     sum;
+  struct rusage  ru;
+  ef_ctx *ctx;
+  char   *fa_file, *iv_file, *fai_file;
+  long   *lenA;
+  double  t, c, best, best_cpu, secs, cpu;
+  int     phase, r;
+  const char *phaseA[] = { "read_intervals", "process_fasta", "process_fasta_indexed", "open_reference", "print_fasta" };
+  long    phase_bytes;
+
+  /* each workload has its own stream of random numbers */
+  rng_state = opt->seed * 0x9e3779b97f4a7c15ULL + (uint64_t) (w - workloadA) + 1;
+  if ((asprintf(&fa_file, "%s/%s.fa", opt->dir, w->name) == -1) ||
+      (asprintf(&iv_file, "%s/%s.in", opt->dir, w->name) == -1) ||
+      (asprintf(&fai_file, "%s/%s.fa.fai", opt->dir, w->name) == -1))
+    die("No space");
+  memset(&wf, 0, sizeof(wf));
+  wf.nseqs = (long) (w->nseqs * ((w->nseqs > 100) ? opt->scale : 1.0));
+  if (wf.nseqs < 1)
+    wf.nseqs = 1;
+  if ((lenA = (long *) malloc(wf.nseqs * sizeof(long))) == NULL)
+    die("No space");
+  make_fasta(w, opt->scale, fa_file, &wf, lenA);
+  make_intervals(w, opt->scale, iv_file, &wf, lenA);
+  free(lenA);
+
+  ctx = ef_create();
+  ef_set_threads(ctx, opt->nthreads);
+  if (ef_build_index(ctx, fa_file) != EF_OK)
+    die(ef_error(ctx));
+
+  printf("%s\n    {\n      \"name\": \"%s\",\n      \"sequences\": %ld,\n      \"residues\": %ld,\n"
+         "      \"fasta_bytes\": %ld,\n      \"intervals\": %ld,\n      \"pieces\": %ld,\n"
+         "      \"interval_bytes\": %ld,\n      \"phases\": [",
+         first ? "" : ",", w->name, wf.nseqs, wf.residues, wf.fasta_bytes, wf.nintervals, wf.npieces, wf.interval_bytes);
+
+  for (phase = 0; phase < 5; phase++)
+    {
+      best = best_cpu = -1;
+      for (r = 0; r < opt->repeats; r++)
+        {
+          if (phase == 0)
+            ef_clear_intervals(ctx);
+          ef_set_index(ctx, phase == 2);
+          sum.n    = 0;
+          sum.hash = 0;
+          t = now();
+          c = cpu_now();
+          switch (phase) {
+          case 0: if (ef_read_intervals(ctx, iv_file) != EF_OK) die(ef_error(ctx)); break;
+          case 1:
+          case 2: if (ef_extract(ctx, fa_file, sum_output, &sum) != EF_OK) die(ef_error(ctx)); break;
+          case 3: if (ef_open_reference(ctx, fa_file) != EF_OK) die(ef_error(ctx)); break;
+          case 4: if (ef_extract(ctx, NULL, sum_output, &sum) != EF_OK) die(ef_error(ctx)); break;
+          }
+          secs = now() - t;
+          cpu  = cpu_now() - c;
+          if ((best < 0) || (secs < best)) best = secs;
+          if ((best_cpu < 0) || (cpu < best_cpu)) best_cpu = cpu;
+        }
+      if (phase == 0)
+        phase_bytes = wf.interval_bytes;
+      else if (phase == 4)
+        phase_bytes = sum.n;
+      else
+        phase_bytes = wf.fasta_bytes;
+      print_phase(phaseA[phase], best, best_cpu, phase_bytes, wf.nintervals, phase == 4);
+    }
+
+  /* once more, untimed, for the hash */
+  sum.n    = 0;
+  sum.hash = 1;
+  sum.fnv  = 0xcbf29ce484222325ULL;
+  if (ef_extract(ctx, NULL, sum_output, &sum) != EF_OK)
+    die(ef_error(ctx));
+
+  getrusage(RUSAGE_SELF, &ru);
+  printf("\n      ],\n      \"output_bytes\": %ld,\n      \"output_fnv\": \"%016lx\",\n"
+         "      \"missing\": %d,\n      \"peak_rss_kb\": %ld\n    }",
+         sum.n, (unsigned long) sum.fnv, ef_nmissing(ctx), ru.ru_maxrss);
+
+  ef_free(ctx);
+  if (! opt->keep)
+    {
+      unlink(fa_file);
+      unlink(iv_file);
+      unlink(fai_file);
+    }
+  free(fa_file);
+  free(iv_file);
+  free(fai_file);
+}
+
+/* make_fasta(): write <w>'s reference to <filename>, wf->nseqs
+ * sequences called s0, s1, ...; sets the other fasta counts of <wf>
+ * and the length of each sequence in <lenA> */
+static void make_fasta(const workload *w, double scale, const char *filename, workload_files *wf, long *lenA) {
+  const char *bases = "ACGT";
+  const char *iupac = "RYSWKMBDHVN";
+  FILE  *fp;
+  char  *line;
+  long   s, len, pos, run_left = 0, n;
+  int    run_kind = 0; /* 0 plain, 1 soft-masked, 2 N */
+  int    i;
+
+  if ((fp = fopen(filename, "w")) == NULL)
+    die("Cannot write a reference");
+  setvbuf(fp, NULL, _IOFBF, 1 << 20);
+  if ((line = (char *) malloc(w->width + 1)) == NULL)
+    die("No space");
+  for (s = 0; s < wf->nseqs; s++)
+    {
+      len = rng_range(w->min_len, w->max_len);
+      if (w->nseqs <= 100) /* few big sequences grow, many small ones get more numerous */
+        len = (long) (len * scale);
+      if (len < 1)
+        len = 1;
+      lenA[s] = len;
+      wf->residues += len;
+      wf->fasta_bytes += fprintf(fp, ">s%ld synthetic sequence %ld\n", s, s);
+      for (pos = 0; pos < len; pos += n)
+        {
+          n = (len - pos < w->width) ? len - pos : w->width;
+          for (i = 0; i < n; i++)
+            {
+              if (run_left == 0)
+                {
+                  /* runs of about 200 residues, masked or N in the given fractions */
+                  run_left = rng_range(50, 350);
+                  if (rng_unit() < w->masked)
+                    run_kind = 1;
+                  else if (rng_unit() < w->iupac / 2)
+                    run_kind = 2;
+                  else
+                    run_kind = 0;
+                }
+              run_left--;
+              if (run_kind == 2)
+                line[i] = 'N';
+              else if ((w->iupac > 0) && (rng_unit() < w->iupac / 2))
+                line[i] = iupac[rng_range(0, 10)];
+              else
+                line[i] = bases[rng_next() & 3];
+              if (run_kind == 1)
+                line[i] |= 0x20; /* lower case */
+            }
+          line[n] = '\n';
+          fwrite(line, 1, n + 1, fp);
+          wf->fasta_bytes += n + 1;
+        }
+    }
+  if (fclose(fp) != 0)
+    die("Cannot write a reference");
+  free(line);
+}
+
+/* make_intervals(): write <w>'s interval list to <filename> for the
+ * sequences of lengths <lenA>, setting the interval counts of <wf>.
+ *
+ * An interval is a gene model: 40% have one piece, 55% 2 to 20, 4% 21
+ * to OLD_MAXPIECES, 1% up to 3 times that; pieces of 30 to 300
+ * residues, 30 to 3000 apart (less on short sequences). Half are on the
+ * - strand. 30% are isoforms of the interval before (the same sequence
+ * and strand, with some of its inner pieces dropped) and 2% are copies
+ * of it with an optional token.
+ */
+static void make_intervals(const workload *w, double scale, const char *filename, workload_files *wf, const long *lenA) {
+  FILE  *fp;
+  long   i, s = 0, len, start, end, gap, exon;
+  int   *startA, *endA, *keptA;
+  int    np = 0, nkept, p, want, strand = 0;
+  double u;
+  long   nintervals = (long) (w->nintervals * scale);
+
+  if ((fp = fopen(filename, "w")) == NULL)
+    die("Cannot write an interval list");
+  setvbuf(fp, NULL, _IOFBF, 1 << 20);
+  startA = (int *) malloc(3 * OLD_MAXPIECES * sizeof(int));
+  endA   = (int *) malloc(3 * OLD_MAXPIECES * sizeof(int));
+  keptA  = (int *) malloc(3 * OLD_MAXPIECES * sizeof(int));
+  if ((startA == NULL) || (endA == NULL) || (keptA == NULL))
+    die("No space");
+  if (nintervals < 1)
+    nintervals = 1;
+
+  for (i = 0; i < nintervals; i++)
+    {
+      u = rng_unit();
+      if ((i > 0) && (np > 0) && (u < 0.02)) /* a copy */
+        {
+          wf->interval_bytes += fprintf(fp, "s%ld %d", s, np);
+          for (p = 0; p < np; p++)
+            wf->interval_bytes += fprintf(fp, " %d %d", startA[p], endA[p]);
+          wf->interval_bytes += fprintf(fp, " %c copy%ld\n", (strand == 0) ? '+' : '-', i);
+          wf->npieces += np;
+          wf->nintervals++;
+          continue;
+        }
+      if ((i > 0) && (np > 2) && (u < 0.32)) /* an isoform, keeping the first and final pieces */
+        {
+          keptA[0] = 0;
+          nkept = 1;
+          for (p = 1; p < np - 1; p++)
+            if (rng_unit() >= 0.3)
+              keptA[nkept++] = p;
+          keptA[nkept++] = np - 1;
+          wf->interval_bytes += fprintf(fp, "s%ld %d", s, nkept);
+          for (p = 0; p < nkept; p++)
+            wf->interval_bytes += fprintf(fp, " %d %d", startA[keptA[p]], endA[keptA[p]]);
+          wf->interval_bytes += fprintf(fp, " %c\n", (strand == 0) ? '+' : '-');
+          wf->npieces += nkept;
+          wf->nintervals++;
+          continue;
+        }
+
+      s   = rng_range(0, wf->nseqs - 1);
+      len = lenA[s];
+      if (rng_unit() < w->whole)
+        {
+          wf->interval_bytes += fprintf(fp, "s%ld\n", s);
+          wf->npieces++;
+          wf->nintervals++;
+          np = 0;
+          continue;
+        }
+      u = rng_unit();
+      if (u < 0.40)      want = 1;
+      else if (u < 0.95) want = (int) rng_range(2, 20);
+      else if (u < 0.99) want = (int) rng_range(21, OLD_MAXPIECES);
+      else               want = (int) rng_range(OLD_MAXPIECES + 1, 3 * OLD_MAXPIECES);
+      strand = (int) (rng_next() & 1);
+
+      /* lay the pieces out from a random start, stopping at the end of the sequence */
+      gap  = (len < 100000) ? 1 + len / (10 * want) : 3000;
+      exon = (len < 100000) ? 1 + len / (4 * want) : 300;
+      start = rng_range(1, (len > 3 * exon) ? len - 3 * exon : 1);
+      np = 0;
+      while ((np < want) && (start <= len))
+        {
+          end = start + rng_range((exon < 30) ? 0 : 29, exon - 1);
+          if (end > len)
+            end = len;
+          startA[np] = (int) start;
+          endA[np]   = (int) end;
+          np++;
+          start = end + 1 + rng_range((gap < 30) ? 0 : 29, gap - 1);
+        }
+      wf->interval_bytes += fprintf(fp, "s%ld %d", s, np);
+      for (p = 0; p < np; p++)
+        wf->interval_bytes += fprintf(fp, " %d %d", startA[p], endA[p]);
+      wf->interval_bytes += fprintf(fp, " %c\n", (strand == 0) ? '+' : '-');
+      wf->npieces += np;
+      wf->nintervals++;
+    }
+  if (fclose(fp) != 0)
+    die("Cannot write an interval list");
+  free(startA);
+  free(endA);
+  free(keptA);
+}
+
+/* print_phase(): print a phase's JSON object */
+static void print_phase(const char *phase, double secs, double cpu, long bytes, long nintervals, int last) {
+  if (secs <= 0)
+    secs = 1e-9;
+  printf("\n        { \"phase\": \"%s\", \"seconds\": %.6f, \"cpu_seconds\": %.6f, "
+         "\"mb_per_s\": %.2f, \"intervals_per_s\": %.0f }%s",
+         phase, secs, cpu, bytes / 1e6 / secs, nintervals / secs, last ? "" : ",");
+}
+
+/* sum_output(): the ef_write_fn, counting (and maybe hashing) what is written */
+static int sum_output(void *arg, const char *buf, long len) {
+  output_sum *sum = (output_sum *) arg;
+  long i;
+
+  if (sum->hash)
+    for (i = 0; i < len; i++)
+      sum->fnv = (sum->fnv ^ (unsigned char) buf[i]) * 0x100000001b3ULL;
+  sum->n += len;
+  return 0;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* cpu_now(): user and system CPU seconds of this process, all threads */
+static double cpu_now(void) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* rng_next(): splitmix64, the same numbers on any machine */
+static uint64_t rng_next(void) {
+  uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* rng_range(): uniform in <lo>..<hi> */
+static long rng_range(long lo, long hi) {
+  if (hi <= lo)
+    return lo;
+  return lo + (long) (rng_next() % (uint64_t) (hi - lo + 1));
+}
+
+/* rng_unit(): uniform in [0,1) */
+static double rng_unit(void) {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void die(const char *msg) {
+  fprintf(stderr, "%s\n", msg);
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,749 @@
+/* bgzf.c:
+ *
+ * Reading gzip compressed files, and random access to BGZF ones, see
+ * bgzf.h.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "bgzf.h"
+
+#define GZ_HEADER 12          /* bytes of a gzip header before the extra field */
+#define READ_BUFSIZE (1024 * 1024) /* compressed bytes read at a time */
+
+#define BATCH_EMPTY 0 /* not in use */
+#define BATCH_READY 1 /* read, not yet being inflated */
+#define BATCH_BUSY  2 /* being inflated by a thread */
+#define BATCH_DONE  3 /* inflated, not yet all read */
+
+/* a batch of BGZF blocks, read and inflated together */
+typedef struct {
+  unsigned char *cdata;  /* the compressed blocks */
+  long  clen;
+  long  calloc;
+  char *udata;  /* the blocks inflated */
+  long  ulen;
+  long  ualloc;
+  int   state;  /* BATCH_EMPTY, BATCH_READY, BATCH_BUSY or BATCH_DONE */
+  char *err;    /* malloc'ed error message, or NULL */
+} batch;
+
+struct bgzf_reader_s {
+  FILE          *fp;
+  char          *filename;
+  int            parallel;  /* TRUE if batches of blocks are inflated by the threads */
+
+  /* if not parallel: gzip inflated as it is read */
+  z_stream       zs;
+  unsigned char *in;        /* compressed bytes read, READ_BUFSIZE */
+  int            in_member; /* TRUE while inside a gzip member */
+  int            at_end;    /* TRUE once all has been read */
+
+  /* if parallel */
+  int            nthreads;
+  pthread_t     *threadA;   /* [0..nthreads-1] */
+  batch         *batchA;    /* ring, batch number b is in batchA[b % nbatches] */
+  int            nbatches;
+  long           head;      /* number of the batch being read from */
+  long           pos;       /* bytes of its udata already read */
+  long           nfilled;   /* number of batches read from the file */
+  int            eof;       /* TRUE once the whole file is in batches */
+  int            stop;      /* TRUE to stop the threads */
+  pthread_mutex_t lock;     /* for the state of batches, nfilled and stop */
+  pthread_cond_t  work_cv;  /* signalled when a batch is ready, or stop is set */
+  pthread_cond_t  done_cv;  /* signalled when a batch is inflated */
+};
+
+static long  block_size(const unsigned char *h, long n);
+static int   read_block(FILE *fp, unsigned char *block, long *ret_size);
+static void  fill_batch(bgzf_reader *r, batch *b);
+static char *inflate_batch(batch *b, z_stream *zs, const char *filename);
+static void *inflate_thread(void *arg);
+static long  read_stream(bgzf_reader *r, char *buf, long len, char **ret_err);
+static ssize_t cookie_read(void *cookie, char *buf, size_t len);
+static int   cookie_close(void *cookie);
+static uint32_t get_le32(const unsigned char *p);
+static uint64_t get_le64(const unsigned char *p);
+static void  put_le64(unsigned char *p, uint64_t v);
+static void *grow(void *p, size_t size);
+static char *gz_error(const char *fmt, ...);
+
+/* bgzf_is_gzip(): TRUE if <filename> is a regular file that starts like gzip */
+int bgzf_is_gzip(const char *filename) {
+  struct stat   st;
+  unsigned char magic[2];
+  int fd, is = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+      (read(fd, magic, 2) == 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b))
+    is = 1;
+  close(fd);
+  return is;
+}
+
+/* bgzf_is_bgzf(): TRUE if <filename> is a regular file that starts with a BGZF block */
+int bgzf_is_bgzf(const char *filename) {
+  struct stat   st;
+  unsigned char h[512];
+  int  fd, is = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (block_size(h, read(fd, h, sizeof(h))) > 0))
+    is = 1;
+  close(fd);
+  return is;
+}
+
+/* Function: bgzf_open()
+ * Args:     filename: gzip file to read
+ *           nthreads: number of threads to inflate a BGZF file with
+ *           ret_err:  set to a malloc'ed error message on failure
+ * Returns:  new reader at the start of the uncompressed data, close it
+ *           with bgzf_close(); NULL if <filename> can't be opened.
+ */
+bgzf_reader *bgzf_open(const char *filename, int nthreads, char **ret_err) {
+  bgzf_reader *r;
+  int          b, t;
+
+  *ret_err = NULL;
+  r = (bgzf_reader *) grow(NULL, sizeof(bgzf_reader));
+  memset(r, 0, sizeof(bgzf_reader));
+  r->fp = fopen(filename, "r");
+  if (r->fp == NULL)
+    {
+      free(r);
+      *ret_err = gz_error("Cannot open %s\n", filename);
+      return NULL;
+    }
+  r->filename = strdup(filename);
+  r->parallel = (nthreads > 1) && bgzf_is_bgzf(filename);
+  setvbuf(r->fp, NULL, _IOFBF, READ_BUFSIZE);
+
+  if (! r->parallel)
+    {
+      r->in = (unsigned char *) grow(NULL, READ_BUFSIZE);
+      if (inflateInit2(&(r->zs), 15 + 16) != Z_OK)
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+      return r;
+    }
+
+  r->nthreads = nthreads;
+  r->nbatches = nthreads * BGZF_BATCHES_PER_THREAD;
+  r->batchA   = (batch *) grow(NULL, r->nbatches * sizeof(batch));
+  memset(r->batchA, 0, r->nbatches * sizeof(batch));
+  for (b = 0; b < r->nbatches; b++)
+    r->batchA[b].state = BATCH_EMPTY;
+  pthread_mutex_init(&(r->lock), NULL);
+  pthread_cond_init(&(r->work_cv), NULL);
+  pthread_cond_init(&(r->done_cv), NULL);
+  r->threadA = (pthread_t *) grow(NULL, nthreads * sizeof(pthread_t));
+  for (t = 0; t < nthreads; t++)
+    if (pthread_create(&(r->threadA[t]), NULL, inflate_thread, r) != 0)
+      {
+        fprintf(stderr, "Cannot start a thread\n");
+        exit(EXIT_FAILURE);
+      }
+  return r;
+}
+
+/* Function: bgzf_read()
+ * Args:     r:       reader
+ *           buf:     where to put the uncompressed bytes
+ *           len:     max number of bytes
+ *           ret_err: set to a malloc'ed error message on failure
+ * Returns:  number of bytes read, 0 at the end of the data, or -1 if
+ *           the file can't be read or isn't valid gzip.
+ */
+long bgzf_read(bgzf_reader *r, char *buf, long len, char **ret_err) {
+  batch *b;
+  long   n = 0, k;
+
+  *ret_err = NULL;
+  if (! r->parallel)
+    return read_stream(r, buf, len, ret_err);
+
+  while (n < len)
+    {
+      /* keep every batch full, the threads inflate them in order */
+      pthread_mutex_lock(&(r->lock));
+      while ((! r->eof) && (r->nfilled - r->head < r->nbatches))
+        {
+          b = &(r->batchA[r->nfilled % r->nbatches]);
+          pthread_mutex_unlock(&(r->lock));
+          fill_batch(r, b);
+          pthread_mutex_lock(&(r->lock));
+          b->state = BATCH_READY;
+          r->nfilled++;
+          pthread_cond_signal(&(r->work_cv));
+        }
+      if (r->head == r->nfilled)
+        {
+          pthread_mutex_unlock(&(r->lock));
+          break;
+        }
+      b = &(r->batchA[r->head % r->nbatches]);
+      while (b->state != BATCH_DONE)
+        pthread_cond_wait(&(r->done_cv), &(r->lock));
+      pthread_mutex_unlock(&(r->lock));
+
+      if (b->err != NULL)
+        {
+          *ret_err = b->err;
+          b->err   = NULL;
+          return -1;
+        }
+      k = b->ulen - r->pos;
+      if (k > len - n)
+        k = len - n;
+      memcpy(buf + n, b->udata + r->pos, k);
+      n      += k;
+      r->pos += k;
+      if (r->pos == b->ulen)
+        {
+          pthread_mutex_lock(&(r->lock));
+          b->state = BATCH_EMPTY;
+          r->head++;
+          r->pos = 0;
+          pthread_mutex_unlock(&(r->lock));
+        }
+    }
+  return n;
+}
+
+/* bgzf_close(): close <r>, stopping its threads */
+void bgzf_close(bgzf_reader *r) {
+  int b, t;
+
+  if (r == NULL)
+    return;
+  if (r->parallel)
+    {
+      pthread_mutex_lock(&(r->lock));
+      r->stop = 1;
+      pthread_cond_broadcast(&(r->work_cv));
+      pthread_mutex_unlock(&(r->lock));
+      for (t = 0; t < r->nthreads; t++)
+        pthread_join(r->threadA[t], NULL);
+      for (b = 0; b < r->nbatches; b++)
+        {
+          free(r->batchA[b].cdata);
+          free(r->batchA[b].udata);
+          free(r->batchA[b].err);
+        }
+      pthread_mutex_destroy(&(r->lock));
+      pthread_cond_destroy(&(r->work_cv));
+      pthread_cond_destroy(&(r->done_cv));
+      free(r->batchA);
+      free(r->threadA);
+    }
+  else
+    {
+      inflateEnd(&(r->zs));
+      free(r->in);
+    }
+  fclose(r->fp);
+  free(r->filename);
+  free(r);
+}
+
+/* Function: bgzf_fopen()
+ * Args:     filename: gzip file to read
+ *           ret_err:  set to a malloc'ed error message on failure
+ * Returns:  stdio stream of the uncompressed data, close it with
+ *           fclose(); NULL if <filename> can't be opened. A file that
+ *           isn't valid gzip is a read error.
+ */
+FILE *bgzf_fopen(const char *filename, char **ret_err) {
+  cookie_io_functions_t io = { cookie_read, NULL, NULL, cookie_close };
+  bgzf_reader *r;
+  FILE        *fp;
+
+  if ((r = bgzf_open(filename, 1, ret_err)) == NULL)
+    return NULL;
+  if ((fp = fopencookie(r, "r", io)) == NULL)
+    {
+      bgzf_close(r);
+      *ret_err = gz_error("Cannot open %s\n", filename);
+    }
+  return fp;
+}
+
+/* Function: bgzf_build_index()
+ * Args:     filename: BGZF file, its index is written to <filename>.gzi
+ * Returns:  NULL on success, or a malloc'ed error message if
+ *           <filename> isn't BGZF or <filename>.gzi can't be written;
+ *           no partial index is left behind.
+ *
+ * Only the block headers and sizes are read, nothing is inflated.
+ */
+char *bgzf_build_index(const char *filename) {
+  FILE          *infile, *outfile;
+  char          *gzi_file;
+  unsigned char *block, entry[16];
+  uint64_t       coff = 0, uoff = 0, nentries = 0;
+  long           size;
+  int            status;
+  char          *err = NULL;
+
+  if ((infile = fopen(filename, "r")) == NULL)
+    return gz_error("Cannot open %s\n", filename);
+  gzi_file = (char *) grow(NULL, strlen(filename) + 5);
+  sprintf(gzi_file, "%s.gzi", filename);
+  if ((outfile = fopen(gzi_file, "w")) == NULL)
+    {
+      fclose(infile);
+      err = gz_error("Cannot open %s for writing\n", gzi_file);
+      free(gzi_file);
+      return err;
+    }
+  block = (unsigned char *) grow(NULL, BGZF_MAX_BLOCK);
+
+  /* the number of entries goes first, once we know it */
+  put_le64(entry, 0);
+  if (fwrite(entry, 8, 1, outfile) != 1)
+    err = gz_error("Error writing %s\n", gzi_file);
+  while ((err == NULL) && ((status = read_block(infile, block, &size)) == 1))
+    {
+      if ((coff > 0) && (get_le32(block + size - 4) > 0)) /* the first block, and empty ones, aren't listed */
+        {
+          put_le64(entry, coff);
+          put_le64(entry + 8, uoff);
+          if (fwrite(entry, 16, 1, outfile) != 1)
+            err = gz_error("Error writing %s\n", gzi_file);
+          nentries++;
+        }
+      coff += size;
+      uoff += get_le32(block + size - 4);
+    }
+  if ((err == NULL) && (status == -1))
+    err = gz_error("%s is not BGZF compressed, so can't be indexed (compress it with bgzip)\n", filename);
+  put_le64(entry, nentries);
+  if ((err == NULL) && ((fseek(outfile, 0, SEEK_SET) != 0) || (fwrite(entry, 8, 1, outfile) != 1)))
+    err = gz_error("Error writing %s\n", gzi_file);
+  if ((fclose(outfile) != 0) && (err == NULL))
+    err = gz_error("Error writing %s\n", gzi_file);
+  if (err != NULL)
+    unlink(gzi_file);
+  fclose(infile);
+  free(block);
+  free(gzi_file);
+  return err;
+}
+
+/* Function: bgzf_index_load()
+ * Args:     filename: BGZF file, its index must be in <filename>.gzi
+ *           ret_err:  set to a malloc'ed error message on failure
+ * Returns:  newly allocated index, with <filename> open for reading;
+ *           free with bgzf_index_free(). NULL if <filename> or
+ *           <filename>.gzi can't be read.
+ */
+bgzf_index *bgzf_index_load(const char *filename, char **ret_err) {
+  FILE          *infile;
+  char          *gzi_file;
+  unsigned char  entry[16];
+  uint64_t       n, i;
+  struct stat    st;
+  bgzf_index    *idx;
+
+  *ret_err = NULL;
+  gzi_file = (char *) grow(NULL, strlen(filename) + 5);
+  sprintf(gzi_file, "%s.gzi", filename);
+  if ((infile = fopen(gzi_file, "r")) == NULL)
+    {
+      *ret_err = gz_error("Cannot open %s (build it with --build-index)\n", gzi_file);
+      free(gzi_file);
+      return NULL;
+    }
+  if ((fread(entry, 8, 1, infile) != 1) || ((n = get_le64(entry)) > (1UL << 40)))
+    {
+      *ret_err = gz_error("Bad index %s\n", gzi_file);
+      fclose(infile);
+      free(gzi_file);
+      return NULL;
+    }
+
+  idx = (bgzf_index *) grow(NULL, sizeof(bgzf_index));
+  idx->nblocks  = n + 1;
+  idx->coffA    = (uint64_t *) grow(NULL, idx->nblocks * sizeof(uint64_t));
+  idx->uoffA    = (uint64_t *) grow(NULL, idx->nblocks * sizeof(uint64_t));
+  idx->coffA[0] = 0;
+  idx->uoffA[0] = 0;
+  for (i = 1; (i <= n) && (*ret_err == NULL); i++)
+    {
+      if (fread(entry, 16, 1, infile) != 1)
+        *ret_err = gz_error("Bad index %s\n", gzi_file);
+      idx->coffA[i] = get_le64(entry);
+      idx->uoffA[i] = get_le64(entry + 8);
+      if ((idx->coffA[i] <= idx->coffA[i-1]) || (idx->uoffA[i] < idx->uoffA[i-1]))
+        *ret_err = gz_error("Bad index %s\n", gzi_file);
+    }
+  fclose(infile);
+
+  idx->fd = -1;
+  if ((*ret_err == NULL) &&
+      (((idx->fd = open(filename, O_RDONLY)) == -1) || (fstat(idx->fd, &st) == -1)))
+    *ret_err = gz_error("Cannot open %s\n", filename);
+  idx->csize = (*ret_err == NULL) ? st.st_size : 0;
+  free(gzi_file);
+  if (*ret_err != NULL)
+    {
+      bgzf_index_free(idx);
+      return NULL;
+    }
+  return idx;
+}
+
+/* Function: bgzf_pread()
+ * Args:     idx: index of the file, from bgzf_index_load()
+ *           buf: where to put the uncompressed bytes
+ *           len: number of bytes to read
+ *           off: offset in the uncompressed data of the first one
+ * Returns:  number of bytes read, less than <len> if the data ends
+ *           before <off> + <len>; -1 if the file can't be read or a
+ *           block is bad.
+ *
+ * Like pread(), several threads can read from one index at a time. The
+ * blocks covering the range are read with one pread(), and inflated.
+ */
+long bgzf_pread(bgzf_index *idx, char *buf, long len, uint64_t off) {
+  z_stream       zs;
+  unsigned char *cdata, *p;
+  char          *ublock = NULL;
+  long           lo, hi, mid, first, last;
+  long           clen, got, size, n = 0;
+  uint64_t       uoff, isize, from, to;
+  ssize_t        r;
+  int            direct; /* TRUE if a block is inflated straight into buf */
+
+  if (len <= 0)
+    return 0;
+  /* blocks first..last cover off..off+len-1 */
+  lo = 0;
+  hi = idx->nblocks - 1;
+  while (lo < hi)
+    {
+      mid = (lo + hi + 1) / 2;
+      if (idx->uoffA[mid] <= off)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+  first = last = lo;
+  while ((last + 1 < idx->nblocks) && (idx->uoffA[last+1] < off + len))
+    last++;
+
+  clen  = ((last + 1 < idx->nblocks) ? idx->coffA[last+1] : idx->csize) - idx->coffA[first];
+  cdata = (unsigned char *) grow(NULL, clen);
+  for (got = 0; got < clen; got += r)
+    {
+      r = pread(idx->fd, cdata + got, clen - got, idx->coffA[first] + got);
+      if ((r == -1) && (errno == EINTR))
+        r = 0;
+      else if (r <= 0)
+        break;
+    }
+  clen = got;
+
+  memset(&zs, 0, sizeof(z_stream));
+  if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  uoff = idx->uoffA[first];
+  for (p = cdata; (p < cdata + clen) && (uoff < off + len); p += size)
+    {
+      if ((size = block_size(p, cdata + clen - p)) <= 0)
+        break; /* the end of the file, or a bad block */
+      isize = get_le32(p + size - 4);
+      from  = (off > uoff) ? off - uoff : 0;
+      to    = (off + len < uoff + isize) ? off + len - uoff : isize;
+      inflateReset(&zs);
+      zs.next_in  = p;
+      zs.avail_in = size;
+      direct = (from == 0) && (to == isize); /* all of the block is wanted */
+      if (direct)
+        zs.next_out = (unsigned char *) buf + n;
+      else
+        {
+          if (ublock == NULL)
+            ublock = (char *) grow(NULL, BGZF_MAX_BLOCK);
+          zs.next_out = (unsigned char *) ublock;
+        }
+      zs.avail_out = isize;
+      if ((isize > BGZF_MAX_BLOCK) || (inflate(&zs, Z_FINISH) != Z_STREAM_END) || (zs.total_out != isize))
+        {
+          n = -1;
+          break;
+        }
+      if (! direct)
+        memcpy(buf + n, ublock + from, to - from);
+      n    += to - from;
+      uoff += isize;
+    }
+  inflateEnd(&zs);
+  free(cdata);
+  free(ublock);
+  return n;
+}
+
+void bgzf_index_free(bgzf_index *idx) {
+  if (idx == NULL)
+    return;
+  if (idx->fd != -1)
+    close(idx->fd);
+  free(idx->coffA);
+  free(idx->uoffA);
+  free(idx);
+}
+
+/* block_size(): size of the BGZF block at <h>, of which <n> bytes are
+ * there; 0 if they aren't enough to tell, -1 if it isn't a BGZF block */
+static long block_size(const unsigned char *h, long n) {
+  long xlen, x, slen;
+
+  if (n < GZ_HEADER)
+    return 0;
+  if ((h[0] != 0x1f) || (h[1] != 0x8b) || (h[2] != 8) || (! (h[3] & 4)))
+    return -1;
+  xlen = h[10] | (h[11] << 8);
+  if (n < GZ_HEADER + xlen)
+    return 0;
+  for (x = GZ_HEADER; x + 4 <= GZ_HEADER + xlen; x += 4 + slen)
+    {
+      slen = h[x+2] | (h[x+3] << 8);
+      if ((h[x] == 'B') && (h[x+1] == 'C') && (slen == 2) && (x + 6 <= GZ_HEADER + xlen))
+        return (h[x+4] | (h[x+5] << 8)) + 1;
+    }
+  return -1;
+}
+
+/* read_block(): read the next BGZF block of <fp> into <block>, which
+ * has room for BGZF_MAX_BLOCK bytes; returns 1 and sets <ret_size>,
+ * 0 at the end of the file, -1 if it isn't a BGZF block or is cut short */
+static int read_block(FILE *fp, unsigned char *block, long *ret_size) {
+  long n, size;
+
+  n = fread(block, 1, GZ_HEADER, fp);
+  if (n == 0)
+    return 0;
+  if ((n < GZ_HEADER) || (block_size(block, n) == -1))
+    return -1;
+  n += fread(block + GZ_HEADER, 1, block[10] | (block[11] << 8), fp);
+  size = block_size(block, n);
+  if ((size <= n) || (size > BGZF_MAX_BLOCK))
+    return -1;
+  if ((long) fread(block + n, 1, size - n, fp) != size - n)
+    return -1;
+  *ret_size = size;
+  return 1;
+}
+
+/* fill_batch(): read the next blocks of <r> into <b>, setting r->eof
+ * at the end of the file */
+static void fill_batch(bgzf_reader *r, batch *b) {
+  long size;
+  int  status = 1;
+
+  b->clen = 0;
+  b->ulen = 0;
+  while ((b->clen < BGZF_BATCH_BYTES) && (status == 1))
+    {
+      if (b->clen + BGZF_MAX_BLOCK > b->calloc)
+        {
+          b->calloc = BGZF_BATCH_BYTES + BGZF_MAX_BLOCK;
+          b->cdata  = (unsigned char *) grow(b->cdata, b->calloc);
+        }
+      if ((status = read_block(r->fp, b->cdata + b->clen, &size)) == 1)
+        b->clen += size;
+    }
+  if (status != 1)
+    r->eof = 1;
+  if (status == -1)
+    b->err = gz_error(ferror(r->fp) ? "Error reading %s\n" : "%s is not valid BGZF, or is cut short\n", r->filename);
+}
+
+/* inflate_batch(): inflate the blocks of <b> into b->udata; returns
+ * NULL, or a malloc'ed error message */
+static char *inflate_batch(batch *b, z_stream *zs, const char *filename) {
+  unsigned char *p;
+  long           size, total = 0;
+
+  for (p = b->cdata; p < b->cdata + b->clen; p += block_size(p, b->cdata + b->clen - p))
+    total += get_le32(p + block_size(p, b->cdata + b->clen - p) - 4);
+  if (total > b->ualloc)
+    {
+      b->ualloc = total;
+      b->udata  = (char *) grow(b->udata, b->ualloc);
+    }
+
+  for (p = b->cdata; p < b->cdata + b->clen; p += size)
+    {
+      size = block_size(p, b->cdata + b->clen - p);
+      inflateReset(zs);
+      zs->next_in   = p;
+      zs->avail_in  = size;
+      zs->next_out  = (unsigned char *) b->udata + b->ulen;
+      zs->avail_out = total - b->ulen;
+      if ((inflate(zs, Z_FINISH) != Z_STREAM_END) || (zs->total_out != get_le32(p + size - 4)))
+        return gz_error("Bad BGZF block at offset %ld of the data of %s\n", b->ulen, filename);
+      b->ulen += zs->total_out;
+    }
+  return NULL;
+}
+
+/* inflate_thread(): inflate batches of a parallel reader, in order,
+ * until it is closed */
+static void *inflate_thread(void *arg) {
+  bgzf_reader *r = (bgzf_reader *) arg;
+  z_stream     zs;
+  batch       *b = NULL;
+  char        *err;
+  long         i;
+
+  memset(&zs, 0, sizeof(z_stream));
+  if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  pthread_mutex_lock(&(r->lock));
+  while (! r->stop)
+    {
+      for (i = r->head; i < r->nfilled; i++)
+        if ((b = &(r->batchA[i % r->nbatches]))->state == BATCH_READY)
+          break;
+      if (i == r->nfilled)
+        {
+          pthread_cond_wait(&(r->work_cv), &(r->lock));
+          continue;
+        }
+      b->state = BATCH_BUSY;
+      pthread_mutex_unlock(&(r->lock));
+
+      err = (b->err == NULL) ? inflate_batch(b, &zs, r->filename) : NULL;
+
+      pthread_mutex_lock(&(r->lock));
+      if (err != NULL)
+        b->err = err;
+      b->state = BATCH_DONE;
+      pthread_cond_broadcast(&(r->done_cv));
+    }
+  pthread_mutex_unlock(&(r->lock));
+  inflateEnd(&zs);
+  return NULL;
+}
+
+/* read_stream(): bgzf_read() of a reader that isn't parallel, any gzip
+ * file of one or more members */
+static long read_stream(bgzf_reader *r, char *buf, long len, char **ret_err) {
+  int ret;
+
+  r->zs.next_out  = (unsigned char *) buf;
+  r->zs.avail_out = len;
+  while ((r->zs.avail_out > 0) && (! r->at_end))
+    {
+      if (r->zs.avail_in == 0)
+        {
+          r->zs.next_in  = r->in;
+          r->zs.avail_in = fread(r->in, 1, READ_BUFSIZE, r->fp);
+          if (r->zs.avail_in == 0)
+            {
+              if (ferror(r->fp) || r->in_member)
+                {
+                  *ret_err = gz_error(ferror(r->fp) ? "Error reading %s\n" : "%s is cut short\n", r->filename);
+                  return -1;
+                }
+              r->at_end = 1;
+              break;
+            }
+        }
+      ret = inflate(&(r->zs), Z_NO_FLUSH);
+      r->in_member = 1;
+      if (ret == Z_STREAM_END)
+        {
+          inflateReset(&(r->zs)); /* another member may follow */
+          r->in_member = 0;
+        }
+      else if ((ret != Z_OK) && (ret != Z_BUF_ERROR))
+        {
+          *ret_err = gz_error("%s is not valid gzip\n", r->filename);
+          return -1;
+        }
+    }
+  return len - r->zs.avail_out;
+}
+
+/* cookie_read(), cookie_close(): the stdio stream of bgzf_fopen() */
+static ssize_t cookie_read(void *cookie, char *buf, size_t len) {
+  char *err;
+  long  n;
+
+  n = bgzf_read((bgzf_reader *) cookie, buf, len, &err);
+  free(err);
+  return n;
+}
+
+static int cookie_close(void *cookie) {
+  bgzf_close((bgzf_reader *) cookie);
+  return 0;
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+  return (uint64_t) get_le32(p) | ((uint64_t) get_le32(p + 4) << 32);
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+  int i;
+
+  for (i = 0; i < 8; i++)
+    p[i] = (unsigned char) (v >> (8 * i));
+}
+
+/* grow(): realloc() or die */
+static void *grow(void *p, size_t size) {
+  p = realloc(p, size);
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
+
+/* gz_error(): return a malloc'ed error message */
+static char *gz_error(const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return msg;
+}
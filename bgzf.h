@@ -0,0 +1,58 @@
+/* bgzf.h:
+ *
+ * Reading gzip compressed FASTA files, and random access to BGZF ones.
+ *
+ * BGZF (the format of bgzip and samtools) is gzip made of independent
+ * members, "blocks", each at most 64kb uncompressed, with the size of
+ * the compressed block in an extra header field (subfield 'BC'). So
+ * blocks can be found without inflating them, and inflated at the same
+ * time by different threads.
+ *
+ * A bgzf_reader reads a gzip file from start to end: a BGZF file with
+ * more than one thread is read a batch of blocks at a time, and
+ * BGZF_BATCHES_PER_THREAD batches per thread are inflated by a pool
+ * of threads ahead of the reader; anything else gzip (or BGZF with one
+ * thread) is inflated as it is read.
+ *
+ * A bgzf_index reads any byte range of the uncompressed data of a BGZF
+ * file, using its .gzi index (as samtools writes it: the number of
+ * blocks after the first, then for each of them its compressed and
+ * uncompressed offset, all 64-bit little-endian), inflating only the
+ * blocks that cover the range. A .fai index of the uncompressed data
+ * and the .gzi index are built together, see faidx_build().
+ */
+
+#ifndef BGZF_H
+#define BGZF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define BGZF_MAX_BLOCK (64 * 1024)     /* max size of a block, compressed or not */
+#define BGZF_BATCH_BYTES (1024 * 1024) /* a batch of blocks is at least this many compressed bytes */
+#define BGZF_BATCHES_PER_THREAD 4
+
+typedef struct bgzf_reader_s bgzf_reader;
+
+typedef struct {
+  int       fd;       /* descriptor open on the file, for pread() */
+  uint64_t *coffA;    /* [0..nblocks-1] compressed offset of each block */
+  uint64_t *uoffA;    /* [0..nblocks-1] uncompressed offset of each block */
+  long      nblocks;
+  uint64_t  csize;    /* size of the file */
+} bgzf_index;
+
+int          bgzf_is_gzip(const char *filename);
+int          bgzf_is_bgzf(const char *filename);
+
+bgzf_reader *bgzf_open(const char *filename, int nthreads, char **ret_err);
+long         bgzf_read(bgzf_reader *r, char *buf, long len, char **ret_err);
+void         bgzf_close(bgzf_reader *r);
+FILE        *bgzf_fopen(const char *filename, char **ret_err);
+
+char        *bgzf_build_index(const char *filename);
+bgzf_index  *bgzf_index_load(const char *filename, char **ret_err);
+long         bgzf_pread(bgzf_index *idx, char *buf, long len, uint64_t off);
+void         bgzf_index_free(bgzf_index *idx);
+
+#endif /* BGZF_H */
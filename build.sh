@@ -1,3 +1,4 @@
-gcc -O3 -o extract_fasta_multi_exon extract_fasta_multi_exon.c
-#gcc -o extract_fasta_multi_exon extract_fasta_multi_exon.c
-#gcc -Wall -g -o extract_fasta_multi_exon extract_fasta_multi_exon.c
+gcc -O3 -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz
+gcc -O3 -c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c && ar rcs libextractfasta.a extractfasta.o faidx.o seqout.o revcomp.o pipeline.o seqhash.o arena.o intervals.o twobit.o ioplan.o memo.o translate.o bgzf.o extsort.o
+#gcc -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz
+#gcc -Wall -g -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz
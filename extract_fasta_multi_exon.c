@@ -19,7 +19,105 @@
  * In the second case of line formatting, the full sequence called <defline_token>
  * will be output, on the + strand.
  *
+ * On the - strand all IUPAC nucleotide codes are complemented (case is
+ * kept), any other character is output as 'N'.
+ *
+ * The interval list is read once, mapped into memory and parsed by
+ * the -t threads if it is a regular file, read a block at a time if
+ * it is '-' (stdin, then <fa_file> must be given) or a named pipe.
+ *
  * If a fasta file name is not given, then the file is assumed to be <stdin>
+ * and it is streamed, keeping only the residues still needed by intervals
+ * not yet extracted. A fasta file given by name is mapped into memory
+ * instead, and sequence is only copied for the requested pieces.
+ *
+ * If the fasta file has been indexed (see below), the -i option makes
+ * us read only the parts of it that cover the requested intervals,
+ * using the samtools-compatible index <fa_file>.fai, instead of
+ * reading through the full file:
+ *   extract_fasta_multi_exon --build-index <fa_file>
+ *   extract_fasta_multi_exon -i <interval_list> <fa_file>
+ * The pieces of each sequence are sorted, and pieces less than -g bytes
+ * apart are read together with one read.
+ *
+ * A fasta file of A, C, G, T and N only can be cached with 2 bits per
+ * residue (in the UCSC .2bit format, see twobit.h), and the cache given
+ * instead of <fa_file>; it is mapped into memory and unpacked only for
+ * the requested pieces, with the same output:
+ *   extract_fasta_multi_exon --build-cache <fa_file> <fa_file>.2bit
+ *   extract_fasta_multi_exon <interval_list> <fa_file>.2bit
+ *
+ * A fasta file may be gzip compressed, and is then inflated as it is
+ * read (no need to zcat it into stdin). If it is BGZF compressed (by
+ * bgzip), -t threads inflate its blocks ahead of the reading, and it
+ * can be indexed: --build-index writes <fa_file>.gzi, the index of its
+ * blocks, along with <fa_file>.fai, and -i then inflates only the
+ * blocks that cover the requested intervals. See bgzf.h.
+ *
+ * Output goes to stdout, or to the file given with -o, with 80
+ * residues per line (change with -w). With --write-index, the index
+ * <out_file>.fai of the -o file is written as the output is, so the
+ * output can be read with -i (or samtools faidx) straight away. With
+ * --binary, each sequence is written as a length-prefixed binary record
+ * with the sequence on one line, for programs that map the output into
+ * memory (the format is described in extractfasta.h); its .fai gives
+ * the offset and length of each sequence.
+ *
+ * Several fasta files (the shards of a genome, say) can be given, or
+ * listed one per line in a file given with --fasta-list; they are read
+ * at the same time, one per thread (-t, by default one per CPU), and
+ * the output is what extracting from them put together one after
+ * another would be, each sequence from the first file that has it.
+ * With --unordered each file's output is written as soon as it has
+ * been extracted instead:
+ *   extract_fasta_multi_exon -t 8 <interval_list> chr*.fa
+ *
+ * With --translate <n>, each interval (typically the exons of a CDS) is
+ * translated with NCBI genetic code <n> as it is extracted, and its
+ * protein is output instead; codons may span exons, and on the - strand
+ * the reverse complement is translated. See translate.h.
+ *
+ * With --serve, the fasta files are opened once and kept open, and
+ * requests (interval lines ended by a '.' line) are answered from stdin
+ * or, with --socket, over a Unix domain socket; see serve.h:
+ *   extract_fasta_multi_exon --serve [--socket <path>] <fa_file> [<fa_file> ...]
+ *
+ * With -t <n>, <n> worker threads extract and format the intervals
+ * (split into tasks of about TASK_RESIDUES residues, so one long
+ * sequence can keep several threads busy) while this thread reads,
+ * and a writer thread writes the output in the original order.
+ *
+ * With --stats, the time taken by each phase (reading the interval
+ * list, sorting it, scanning the fasta files and extracting), bytes
+ * read and written, records seen and matched, intervals on each strand,
+ * sequence buffers grown and bytes copied, and peak memory are written
+ * as JSON to stderr, or with --stats=<file> to <file>, once extraction
+ * is done. --progress <n> also writes a line to stderr every <n>
+ * seconds or so, for runs that take hours. Without them nothing is
+ * counted or timed; with them, each record extracted costs a couple of
+ * clock reads.
+ *
+ * With --sort-memory <n> (bytes, or with a K, M or G suffix), an
+ * interval list too big for memory is sorted externally in about <n>
+ * bytes: it is parsed into runs, sorted (by -t threads at once) and
+ * written to temporary files in --tmpdir (or $TMPDIR, or /tmp), and
+ * the runs are merged one sequence name at a time as the fasta file is
+ * read. The sequences wanted must then come in name order (as LC_ALL=C
+ * sort sorts), unless it is read with -i or is a 2-bit cache; output is
+ * in name order, so for a fasta file sorted by name it is the same as
+ * without --sort-memory. A list that fits in a single run is sorted in
+ * memory, with no temporary file. Only one <fa_file> can be given:
+ *   extract_fasta_multi_exon --sort-memory 2G -t 4 <interval_list> <fa_file>
+ *
+ * Only the first sequence in the fasta file with each name is used,
+ * and reading stops once one has been found for every name in the
+ * interval list; a warning is printed for any name that wasn't found.
+ *
+ * A sequence is named by the first word of its header line. With
+ * --id-fasta it is named as id_fasta.pl would rename it, by the 4th
+ * '|'-separated field of the header's first word if there are 4 or
+ * more, else by the 2nd (so idfetch output needn't go through
+ * id_fasta.pl first), or with --id-field <n> by the <n>th field.
  *
  * Optionally a single token can exist after the '+/-'. If one exists it will
  * be appended to the end of the new name for the extracted sequence.
@@ -27,12 +125,18 @@
  * Original author: Richa Argawal
  * Modified by:     Eric Nawrocki (modified to allow multiple pieces per interval)
  * 
+ * The extraction itself is done by libextractfasta (extractfasta.c, see
+ * extractfasta.h), this file only handles the command line.
+ *
  * To compile:
  *  'Optimized' for speed (not sure if 'optimization' is significant):
- *    gcc -O3 -o extract_fasta_multi_exon extract_fasta_multi_exon.c
+ *    gcc -O3 -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz
  * 
  *  For debugging:
- *    gcc -Wall -g -o extract_fasta_multi_exon extract_fasta_multi_exon.c
+ *    gcc -Wall -g -o extract_fasta_multi_exon extract_fasta_multi_exon.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz
+ *
+ *  The library alone, see build.sh:
+ *    ar rcs libextractfasta.a extractfasta.o faidx.o seqout.o revcomp.o pipeline.o seqhash.o arena.o intervals.o twobit.o ioplan.o memo.o translate.o bgzf.o extsort.o
  *
  * [Tue Mar  3 16:05:41 2015]
  */
@@ -40,7 +144,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extractfasta.h"
+#include "serve.h"
 
 /* TRUE and FALSE may be already defined, */
 /* let's not get in the way of other definitions. */
@@ -55,544 +166,508 @@
  
 typedef enum {FALSE = 0, TRUE = 1} bool; /* boolean type */
 
-#define PRINT_CUTOFF 80 
-
-#define MAXLINELEN 500000
-#define MAXPIECES 150 /* max number of allowed exons */
-#define UNKNOWN -2
-#define WHITE_SPACE     " \n\r\t\v" 
-
-#define PLUS   1
-#define MINUS  2
-
+/* what print_progress() and print_stats() need */
 typedef struct {
-  char *name;               /* sequence name */
-  int   npieces;            /* number of 'pieces' subsequences we will join in final output of the sequence */
-  int   start;              /* start position of full region (same as pstart[0], first piece) */
-  int   end;                /* end position of full region (same as pend[npieces-1], final piece) */
-  /* note: for pstart and pend we hardcode the size (MAXPIECES) so we can easily use qsort() */
-  int   pstartA[MAXPIECES]; /* [0..p..npieces-1], start position of each piece (e.g. exon) */
-  int   pendA[MAXPIECES];   /* [0..p..npieces-1], end position of each piece (e.g. exon) */
-  int   strand;             /* PLUS or MINUS, applies to all pieces */
-  char *opttok;             /* optional token to append to end of the name we assign this sequence, read from input */
-} interval_record;
-
-void read_intervals(char *);
-int  compare_entries(const void *, const void *);
-
-void process_fasta(char *);
-int  find_index(char *);
-void print_fasta(int, char *, char *);
-
-/* EPN added functions */
-void dump_intervals(interval_record *interval_data, int interval_count);     /* for debugging only */
-void free_intervals(interval_record *interval_data, int interval_count);     /* for cleanup only */
-
-interval_record *interval_data;
-int interval_count;
+  double start;     /* CLOCK_MONOTONIC seconds when we started */
+  int    nthreads;
+} run_info;
+
+int write_fd(void *, const char *, long);
+char **read_fasta_list(char *, int *);
+double wall_seconds(void);
+void print_progress(void *, const ef_stats *);
+int print_stats(char *, run_info *, ef_stats *);
+
+static char *usage = 
+  "Usage: extract_fasta_multi_exon [options] <interval_list> [<fa_file> ...]\n"
+  "       extract_fasta_multi_exon --build-index <fa_file>\n"
+  "       extract_fasta_multi_exon --build-cache <fa_file> <cache_file>\n"
+  "       extract_fasta_multi_exon --serve [options] [--socket <path>] <fa_file> [<fa_file> ...]\n"
+  "<interval_list> may be '-' for stdin, if <fa_file> is given.\n"
+  "<fa_file> may be a 2-bit cache written by --build-cache, or gzip compressed\n"
+  "(BGZF compressed, by bgzip, to index it).\n"
+  "With more than one <fa_file>, each sequence is from the first that has it.\n"
+  "Options:\n"
+  "  -i             read only the needed parts of <fa_file> using its index <fa_file>.fai\n"
+  "  -g <n>         with -i, read pieces less than <n> bytes apart together [16384]\n"
+  "  -o <file>      write output to <file> instead of stdout\n"
+  "  -t <n>         extract with <n> worker threads, output is the same\n"
+  "                 [1, or one per CPU with more than one <fa_file>]\n"
+  "  -w <n>         write <n> residues per output line, 0 for one line per sequence [80]\n"
+  "  --write-index  with -o, also write the index <file>.fai of the output\n"
+  "  --binary       write length-prefixed binary records (see extractfasta.h), not fasta\n"
+  "  --sort-memory <n>  sort the interval list in about <n> bytes (K, M or G suffix),\n"
+  "                 with temporary files; <fa_file> must be in name order, or use -i\n"
+  "  --tmpdir <dir>  with --sort-memory, write temporary files in <dir> [$TMPDIR or /tmp]\n"
+  "  --id-fasta     name sequences as id_fasta.pl does: by the 4th '|' field of\n"
+  "                 their header if there are 4 or more, else by the 2nd\n"
+  "  --id-field <n> name sequences by the <n>th '|' field of their header, if it has one\n"
+  "  --translate <n>  output the protein of each interval, with NCBI genetic code <n>\n"
+  "  --fasta-list <file>  extract from the fasta files listed in <file>, one per line\n"
+  "  --unordered    with more than one <fa_file>, write each file's output as soon as\n"
+  "                 it is extracted; a sequence in several is from any of them\n"
+  "  --stats[=<file>]  write the time of each phase, bytes read and written and other\n"
+  "                 counts as JSON to stderr, or to <file>\n"
+  "  --progress <n>  write a progress line to stderr every <n> seconds\n"
+  "  --build-index  write the index <fa_file>.fai for <fa_file> (and <fa_file>.gzi if\n"
+  "                 it is BGZF) and exit\n"
+  "  --build-cache  write <fa_file> 2-bit packed to <cache_file> and exit\n"
+  "  --serve        keep the <fa_file>s open and answer requests from stdin (see serve.h)\n"
+  "  --socket <path>  with --serve, answer requests on the Unix domain socket <path>\n";
 
 int main(int argc, char *argv[])
 {
-  if ((argc != 2) && (argc != 3))
+  static struct option long_options[] = {
+    { "build-index", no_argument,       NULL, 'I' },
+    { "build-cache", no_argument,       NULL, 'C' },
+    { "serve",       no_argument,       NULL, 'S' },
+    { "socket",      required_argument, NULL, 'U' },
+    { "id-fasta",    no_argument,       NULL, 'D' },
+    { "id-field",    required_argument, NULL, 'F' },
+    { "translate",   required_argument, NULL, 'P' },
+    { "fasta-list",  required_argument, NULL, 'L' },
+    { "unordered",   no_argument,       NULL, 'R' },
+    { "stats",       optional_argument, NULL, 'T' },
+    { "progress",    required_argument, NULL, 'Q' },
+    { "write-index", no_argument,       NULL, 'W' },
+    { "binary",      no_argument,       NULL, 'B' },
+    { "sort-memory", required_argument, NULL, 'M' },
+    { "tmpdir",      required_argument, NULL, 'X' },
+    { NULL,          0,           NULL, 0   }
+  };
+  bool do_build_index = FALSE; /* TRUE to build an index and exit */
+  bool do_build_cache = FALSE; /* TRUE to build a 2-bit cache and exit */
+  bool do_serve       = FALSE; /* TRUE to answer requests, see serve.h */
+  char *socket_path   = NULL;  /* with do_serve, socket to listen on, NULL for stdin */
+  bool use_index      = FALSE; /* TRUE to read <fa_file> using its index */
+  char *out_file      = NULL;  /* file to write output to, NULL for stdout */
+  int   width         = 80;
+  int   nthreads      = 0;     /* 0 until -t is given */
+  long  read_gap      = -1;    /* with use_index, -1 for the default */
+  int   id_field      = 0;     /* header field that names a sequence, see ef_set_id_field() */
+  int   genetic_code  = 0;     /* to output proteins, see ef_set_genetic_code(), 0 for nucleotides */
+  int   fd            = 1;     /* where output is written */
+  char *fasta_list    = NULL;  /* file listing fasta files, or NULL */
+  bool  unordered     = FALSE; /* TRUE to write each file's output as soon as it is extracted */
+  bool  do_stats      = FALSE; /* TRUE to write stats once done */
+  char *stats_file    = NULL;  /* with do_stats, file to write them to, NULL for stderr */
+  double progress     = 0;     /* seconds between progress lines, 0 for none */
+  bool  write_index   = FALSE; /* TRUE to write <out_file>.fai */
+  bool  binary        = FALSE; /* TRUE to write binary records */
+  long  sort_memory   = 0;     /* memory to sort the intervals externally in, 0 to keep them in memory */
+  char *tmpdir        = NULL;  /* with sort_memory, directory for temporary files, NULL for the default */
+  char *out_fai;
+  run_info run;
+  ef_stats stats;
+  char **fa_fileA;             /* [0..nfiles-1] fasta files to extract from */
+  int   nfiles;
+  char *endp;
+  ef_status status;
+  int   c, i;
+  ef_ctx *ctx;
+
+  while ((c = getopt_long(argc, argv, "g:io:t:w:", long_options, NULL)) != -1)
     {
-      fprintf(stderr,"extract_fa <interval_list> [<fa_file>]\n");
-      exit(EXIT_FAILURE);
+      switch (c) {
+      case 'g':
+        read_gap = strtol(optarg, &endp, 10);
+        if ((*endp != '\0') || (read_gap < 0))
+          {
+            fprintf(stderr, "Bad read gap %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 'i': use_index      = TRUE; break;
+      case 'I': do_build_index = TRUE; break;
+      case 'C': do_build_cache = TRUE; break;
+      case 'S': do_serve       = TRUE; break;
+      case 'U': socket_path    = optarg; break;
+      case 'D': id_field       = EF_ID_FASTA; break;
+      case 'F':
+        id_field = (int) strtol(optarg, &endp, 10);
+        if ((*endp != '\0') || (id_field < 1))
+          {
+            fprintf(stderr, "Bad header field %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 'o': out_file       = optarg; break;
+      case 'L': fasta_list     = optarg; break;
+      case 'R': unordered      = TRUE; break;
+      case 'W': write_index    = TRUE; break;
+      case 'B': binary         = TRUE; break;
+      case 'X': tmpdir         = optarg; break;
+      case 'M':
+        sort_memory = strtol(optarg, &endp, 10);
+        switch (*endp) {
+        case 'K': case 'k': sort_memory <<= 10; endp++; break;
+        case 'M': case 'm': sort_memory <<= 20; endp++; break;
+        case 'G': case 'g': sort_memory <<= 30; endp++; break;
+        }
+        if ((*endp != '\0') || (sort_memory < 1))
+          {
+            fprintf(stderr, "Bad sort memory %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 'T': do_stats       = TRUE; stats_file = optarg; break;
+      case 'Q':
+        progress = strtod(optarg, &endp);
+        if ((*endp != '\0') || (! (progress > 0)))
+          {
+            fprintf(stderr, "Bad progress interval %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 'P':
+        genetic_code = (int) strtol(optarg, &endp, 10);
+        if ((*endp != '\0') || (genetic_code < 1))
+          {
+            fprintf(stderr, "Bad genetic code %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 't': 
+        nthreads = (int) strtol(optarg, &endp, 10);
+        if ((*endp != '\0') || (nthreads < 1))
+          {
+            fprintf(stderr, "Bad number of threads %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      case 'w': 
+        width = (int) strtol(optarg, &endp, 10);
+        if ((*endp != '\0') || (width < 0))
+          {
+            fprintf(stderr, "Bad line width %s\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        break;
+      default:
+        fprintf(stderr, "%s", usage);
+        exit(EXIT_FAILURE);
+      }
     }
+  argc -= optind - 1;
+  argv += optind - 1;
+  run.start = wall_seconds();
 
-  read_intervals(argv[1]);
-
-  if (interval_count > 0)
+  if ((do_stats || (progress > 0) || write_index || binary || (sort_memory > 0) || (tmpdir != NULL)) &&
+      (do_serve || do_build_index || do_build_cache))
     {
-      qsort(interval_data, interval_count, sizeof(interval_record), compare_entries);
-
-      if (argc == 2)
-        process_fasta("stdin");
-      else
-        process_fasta(argv[2]);
-    }
-
-  /* clean up */
-  free_intervals(interval_data, interval_count);
-
-  exit(EXIT_SUCCESS);
-}
-
-void read_intervals(filename)
-     char *filename;
-{
-  char descriptions[MAXLINELEN+1];
-  FILE *infile;
-  char *token;
-  int   p; /* counter over pieces of an interval */
-  int  np; /* number of pieces in current interval */
-
-  infile = fopen(filename, "r"); 
-  if (infile == NULL)
-    { 
-      fprintf(stderr, "Cannot open %s\n", filename); 
+      fprintf(stderr, "%s", usage);
       exit(EXIT_FAILURE);
     }
-
-  interval_count = 0;
-  while(fgets(descriptions, MAXLINELEN, infile) != NULL) 
-    interval_count++;
-
-  if (interval_count == 0)
+  if (do_serve)
     {
-      fclose(infile);
-      interval_data = NULL;
-      return;
+      if ((argc < 2) || do_build_index || do_build_cache || (out_file != NULL))
+        {
+          fprintf(stderr, "%s", usage);
+          exit(EXIT_FAILURE);
+        }
+      exit(serve(argv + 1, argc - 1, socket_path, (nthreads == 0) ? 1 : nthreads, width, use_index, id_field, genetic_code));
     }
-  else
-    rewind(infile);
-
-  interval_data = (interval_record *) malloc(interval_count * sizeof(interval_record));
-  if (interval_data == NULL)
+  if ((socket_path != NULL) || ((fasta_list != NULL) && (do_build_index || do_build_cache)))
     {
-      fprintf(stderr,"No space for %d contigs\n", interval_count);
+      fprintf(stderr, "%s", usage);
       exit(EXIT_FAILURE);
     }
 
-  /* Read each line of the interval file and store its info in interval_data[] */
-  /* Example lines:
-   * 
-   * JRHK01000002.1 1 961815 964505 -
-   * JOQW01000002.1 1 101803 104475 +
-   * KN275973.1 2 226623 226774 226854 229725 -
-   * KN275973.1 3 1 50 70 100 130 2000 +
-   *
-   * First token is sequence name, second is number of 'pieces' <np>, then 
-   * comes <np*2> tokens, the start/end position of each piece. These must
-   * be in ascending order. Final token is '+' or '-' specifying positive
-   * or negative strand.
-   */
-  interval_count = 0;
-  while(fgets(descriptions, MAXLINELEN, infile) != NULL) 
+  ctx = ef_create();
+  if (do_build_cache)
     {
-      token = strtok(descriptions, WHITE_SPACE);
-      if (token == NULL)
+      if ((argc != 3) || do_build_index)
         {
-          fprintf(stderr,"No contig on line %d of %s\n", interval_count+1, filename);
+          fprintf(stderr, "%s", usage);
           exit(EXIT_FAILURE);
         }
-        
-      interval_data[interval_count].name = (char *) strdup(token);
-      interval_data[interval_count].opttok = NULL; /* initialize optional extra token to NULL */
-      if (interval_data[interval_count].name == NULL)
+      if (ef_build_cache(ctx, argv[1], argv[2]) != EF_OK)
         {
-          fprintf(stderr,"Can't store %s\n", token);
+          fprintf(stderr, "%s\n", ef_error(ctx));
           exit(EXIT_FAILURE);
         }
-
-      token = strtok(NULL, WHITE_SPACE);
-      if (token == NULL)
+      ef_free(ctx);
+      exit(EXIT_SUCCESS);
+    }
+  if (do_build_index)
+    {
+      if (argc != 2)
         {
-          interval_data[interval_count].strand     = PLUS;
-          interval_data[interval_count].pstartA[0] = UNKNOWN;
-          interval_data[interval_count].pendA[0]   = UNKNOWN;
-          interval_data[interval_count].npieces    = 1;
-          interval_data[interval_count].start      = UNKNOWN;
-          interval_data[interval_count].end        = UNKNOWN;
+          fprintf(stderr, "%s", usage);
+          exit(EXIT_FAILURE);
         }
-      else
+      if (ef_build_index(ctx, argv[1]) != EF_OK)
         {
-          interval_data[interval_count].npieces = atoi(token);
-          np = interval_data[interval_count].npieces; /* for convenience only */
-
-          /* Some error checking: */
-          /* make sure we have a positive number of pieces */
-          if(np < 1) { 
-            fprintf(stderr,"Less than one piece specified (interval %d), this is not allowed\n", interval_count+1);
-            exit(EXIT_FAILURE);
-          }            
-          /* make sure we haven't exceeded our hardcoded maximum */
-          if(np > MAXPIECES) { 
-            fprintf(stderr,"Maximum number of pieces exceeded (interval %d) %d > %d\n", interval_count+1, np, MAXPIECES);
-            exit(EXIT_FAILURE);
-          }            
-
-          /* read start and end positions for each piece */
-          for(p = 0; p < np; p++) { 
-            /* read the start position for this piece */
-            token = strtok(NULL, WHITE_SPACE);
-            if (token == NULL)
-              {
-                fprintf(stderr,"No interval start for piece %d (interval %d) in file %s \n", p+1, interval_count+1, filename);
-                exit(EXIT_FAILURE);
-              }
-            interval_data[interval_count].pstartA[p] = atoi(token);
-            /* check to make sure the start position is positive if we're in a multi-piece interval */
-            if((np > 1) &&  /* multi-piece interval */
-               (interval_data[interval_count].pstartA[p] < 1)) { /* with a start value < 1 */
-              fprintf(stderr, "Start position in multi-piece interval < 1; this is not allowed (%s)\n", interval_data[interval_count].name);
-              exit(EXIT_FAILURE);
-            }
-
-            /* read the end position for this piece */
-            token = strtok(NULL, WHITE_SPACE);
-            if (token == NULL)
-              {
-                fprintf(stderr,"No interval end for piece %d (interval %d) in file %s \n", p+1, interval_count+1, filename);
-                exit(EXIT_FAILURE);
-              }
-            interval_data[interval_count].pendA[p] = atoi(token);
-            /* check to make sure the end position is positive */
-            if(interval_data[interval_count].pendA[p] < 1) { /* end value < 1 */
-              fprintf(stderr, "End position < 1; this is not allowed (%s)\n", interval_data[interval_count].name);
-              exit(EXIT_FAILURE);
-            }
-
-            /* make sure that this piece's start <= end */
-            if(interval_data[interval_count].pstartA[p] > interval_data[interval_count].pendA[p]) { 
-              fprintf(stderr,"Interval %d, piece %d, start > end (%d > %d)\n", interval_count+1, p+1, 
-                      interval_data[interval_count].pstartA[p], 
-                      interval_data[interval_count].pendA[p]);
-              exit(EXIT_FAILURE);
-            }
-            /* make sure that this piece's start > previous piece's end */
-            if((p > 0) && (interval_data[interval_count].pendA[p-1] >= interval_data[interval_count].pstartA[p])) { 
-              fprintf(stderr,"Interval %d, piece %d (%d..%d) does not come after piece %d (%d..%d)\n", interval_count+1, 
-                      p+1, interval_data[interval_count].pstartA[p],   interval_data[interval_count].pendA[p],
-                      p,   interval_data[interval_count].pstartA[p-1], interval_data[interval_count].pendA[p-1]);
-              exit(EXIT_FAILURE);
-            }
-          }
-          /* done reading all pieces, set interval 'start' and 'end' */
-          interval_data[interval_count].start = interval_data[interval_count].pstartA[0];  /* start of first piece */
-          interval_data[interval_count].end   = interval_data[interval_count].pendA[np-1]; /* end of final piece */
-
-          /* read the strand for this interval (it will apply to all pieces) */
-          token = strtok(NULL, WHITE_SPACE);
-          if (token == NULL)
-            {
-              fprintf(stderr,"No interval strand for interval %d of %s\n", interval_count+1, filename);
-              exit(EXIT_FAILURE);
-            }
-
-          if (strcmp(token, "+") == 0)
-            interval_data[interval_count].strand = PLUS;
-          else
-            interval_data[interval_count].strand = MINUS;
-
-          /* we allow one additional token, but its optional */
-          token = strtok(NULL, WHITE_SPACE);
-          if (token != NULL)
-            {
-              interval_data[interval_count].opttok = (char *) strdup(token);
-              /* should be final token */
-              token = strtok(NULL, WHITE_SPACE);
-              if (token != NULL) {
-                fprintf(stderr,"Extra token for interval %d of %s\n", interval_count+1, filename);
-                exit(EXIT_FAILURE);
-              }
-            }
+          fprintf(stderr, "%s\n", ef_error(ctx));
+          exit(EXIT_FAILURE);
         }
-      interval_count++;
+      ef_free(ctx);
+      exit(EXIT_SUCCESS);
     }
-  fclose(infile);
-}
-
-int compare_entries(const void *f1, const void *f2)
-{    
-  interval_record *first;
-  interval_record *second;
-  int value;
-
-  first = (interval_record *) f1;
-  second = (interval_record *) f2;
-
-  value = strcmp(first->name, second->name);
-  if (value != 0)
-    return(value);
-
-  if (first->start < second->start)
-    return(-1);
-  if (first->start > second->start)
-    return(1);
-
-  if (first->end < second->end)
-    return(-1);
-  if (first->end > second->end)
-    return(1);
-
-  if (first->strand < second->strand)
-    return(-1);
-  if (first->strand > second->strand)
-    return(1);
-
-  return(0);
-}
-
-int find_index(name)
-     char *name;
-{
-  int index, left, right;
-  int temp;
 
-  left = 0;
-  right = interval_count - 1;
-
-  while (left <= right)
+  if (fasta_list != NULL)
     {
-      index = (int)((left+right)/2);
-      temp = strcmp(name, interval_data[index].name);
-      if (temp == 0)
+      if (argc != 2)
         {
-          index--;
-          while ((index >= 0) &&
-                 (strcmp(name, interval_data[index].name) == 0))
-            index--;
-          return(index+1);
+          fprintf(stderr, "%s", usage);
+          exit(EXIT_FAILURE);
         }
-      if (temp < 0)
-        right = index-1;
-      if (temp > 0)
-        left = index+1;
+      fa_fileA = read_fasta_list(fasta_list, &nfiles);
+    }
+  else
+    {
+      fa_fileA = argv + 2;
+      nfiles   = argc - 2;
+    }
+  if (write_index && (out_file == NULL))
+    {
+      fprintf(stderr, "--write-index requires -o <file>\n");
+      exit(EXIT_FAILURE);
+    }
+  if ((argc < 2) || (use_index && (nfiles == 0)) ||
+      ((sort_memory > 0) && (nfiles > 1)) || ((tmpdir != NULL) && (sort_memory == 0)) ||
+      ((nfiles == 0) && (strcmp(argv[1], "-") == 0))) /* both can't come from stdin */
+    {
+      fprintf(stderr, "%s", usage);
+      exit(EXIT_FAILURE);
+    }
+  if (nthreads == 0)
+    {
+      nthreads = (nfiles > 1) ? (int) sysconf(_SC_NPROCESSORS_ONLN) : 1;
+      if (nthreads < 1)
+        nthreads = 1;
     }
 
-  return(UNKNOWN);
-}
+  run.nthreads = nthreads;
+  if (do_stats)
+    ef_set_stats(ctx, TRUE);
+  if (progress > 0)
+    ef_set_progress(ctx, progress, print_progress, &run);
+  ef_set_threads(ctx, nthreads);
+  ef_set_unordered(ctx, unordered);
+  ef_set_width(ctx, width);
+  ef_set_format(ctx, binary ? EF_FORMAT_BINARY : EF_FORMAT_FASTA);
+  ef_set_index(ctx, use_index);
+  ef_set_id_field(ctx, id_field);
+  if (ef_set_genetic_code(ctx, genetic_code) != EF_OK)
+    {
+      fprintf(stderr, "%s\n", ef_error(ctx));
+      exit(EXIT_FAILURE);
+    }
+  if (read_gap != -1)
+    ef_set_read_gap(ctx, read_gap);
+  if ((sort_memory > 0) && (ef_set_sort_memory(ctx, sort_memory, tmpdir) != EF_OK))
+    {
+      fprintf(stderr, "%s\n", ef_error(ctx));
+      exit(EXIT_FAILURE);
+    }
 
-void process_fasta(filename)
-     char *filename;
-{
-  char descriptions[MAXLINELEN+1];
-  char copy_line[MAXLINELEN+1];
-  char defline[MAXLINELEN+1];
-  char name[MAXLINELEN+1];
-  char *fasta, *current;
-  FILE *infile;
-  char *token;
-  int max, line, interval_index;
-  int len, current_length;
-  int CHUNK = 1000000;
+  if (ef_read_intervals(ctx, argv[1]) != EF_OK)
+    {
+      fprintf(stderr, "%s\n", ef_error(ctx));
+      exit(EXIT_FAILURE);
+    }
 
-  if (strcmp(filename,"stdin") == 0)
-    infile = stdin;
-  else
+  if (out_file != NULL)
     {
-      infile = fopen(filename, "r"); 
-      if (infile == NULL)
-        { 
-          fprintf(stderr, "Cannot open %s\n", filename); 
-          exit(0);
+      fd = open(out_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (fd == -1)
+        {
+          fprintf(stderr, "Cannot open %s for writing\n", out_file);
+          exit(EXIT_FAILURE);
         }
     }
-
-  line = 0;
-  interval_index = UNKNOWN;
-  fasta = NULL;
-  max = 0;
-  current_length = 0;
-  while(fgets(descriptions, MAXLINELEN, infile) != NULL) 
+  if (write_index)
     {
-      line++;
-      strcpy(copy_line, descriptions);
-
-      token = strtok(descriptions, WHITE_SPACE);
-      if (token != NULL)
+      out_fai = (char *) malloc(strlen(out_file) + 5);
+      if (out_fai == NULL)
         {
-          strcpy(name, token);
-
-          if (name[0] == '>')
-            {
-              /* at new sequence, print previous (sub)sequence if necessary */
-              if (interval_index != UNKNOWN)
-                {
-                  print_fasta(interval_index, fasta, defline);
-                  if (fasta != NULL)
-                    fasta[0] = '\0';
-                  current_length = 0;
-                }
-
-              interval_index = find_index(&(name[1]));
-              strcpy(defline, copy_line);
-            }
-          else
-            {
-              if (interval_index != UNKNOWN)
-                {
-                  copy_line[strlen(copy_line)-1] = '\0';
-
-                  len = current_length + strlen(copy_line);
-                  if (len < max) /* still have space in 'fasta' string */
-                    strcpy(&(fasta[current_length]), copy_line);
-                  else /* out of space 'fasta' string, realloc */
-                    {
-                      max = ((len/CHUNK)+1) * CHUNK;
-                      current = (char *) malloc((max+1) * sizeof(char));
-                      if (current == NULL)
-                        {
-                          fprintf(stderr,"No space\n");
-                          exit(EXIT_FAILURE);
-                        }
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+      sprintf(out_fai, "%s.fai", out_file);
+      ef_set_output_index(ctx, out_fai);
+      free(out_fai);
+    }
 
-                      if (current_length > 0)
-                        strcpy(current, fasta);
-                      strcpy(&(current[current_length]), copy_line);
-                      if(fasta != NULL) free(fasta);
-                      fasta = current;
-                    }
-                  current_length = len;
-                }
-            }
+  /* output before an error has been written, so report it and stop */
+  if (nfiles > 1)
+    status = ef_extract_files(ctx, (const char **) fa_fileA, nfiles, write_fd, &fd);
+  else
+    status = ef_extract(ctx, (nfiles == 0) ? "-" : fa_fileA[0], write_fd, &fd);
+  if (do_stats)
+    {
+      ef_get_stats(ctx, &stats);
+      if (print_stats(stats_file, &run, &stats) != 0)
+        {
+          fprintf(stderr, "Cannot write %s\n", stats_file);
+          exit(EXIT_FAILURE);
         }
     }
-  /* finished final sequence, print previous (sub)sequence if necessary */
-  if (interval_index != UNKNOWN)
-    print_fasta(interval_index, fasta, defline);
+  if (status != EF_OK)
+    {
+      fprintf(stderr, "%s\n", ef_error(ctx));
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < ef_nmissing(ctx); i++)
+    if (nfiles > 1)
+      fprintf(stderr, "Warning: sequence %s not found in any of the %d fasta files\n", ef_missing_name(ctx, i), nfiles);
+    else
+      fprintf(stderr, "Warning: sequence %s not found in %s\n", ef_missing_name(ctx, i), (nfiles == 0) ? "stdin" : fa_fileA[0]);
 
-  if (fasta != NULL) free(fasta);
+  /* clean up */
+  if ((out_file != NULL) && (close(fd) == -1))
+    {
+      fprintf(stderr, "Error writing output\n");
+      exit(EXIT_FAILURE);
+    }
+  ef_free(ctx);
+  if (fasta_list != NULL)
+    {
+      for (i = 0; i < nfiles; i++)
+        free(fa_fileA[i]);
+      free(fa_fileA);
+    }
 
-  if (strcmp(filename,"stdin") != 0)
-    fclose(infile);
+  exit(EXIT_SUCCESS);
 }
 
-void print_fasta(given_index, given_fasta, given_defline)
-     int given_index;
-     char *given_fasta;
-     char *given_defline;
+/* Function: read_fasta_list()
+ * Args:     filename: file listing fasta files, one per line
+ *           ret_n:    RETURN: number of files
+ * Returns:  [0..*ret_n-1] the file names, each malloc'ed.
+ *
+ * Blank lines, and whitespace around a name, are ignored. Exits if
+ * <filename> can't be read or lists no files.
+ */
+char **read_fasta_list(filename, ret_n)
+     char *filename;
+     int *ret_n;
 {
-  int index, strand, temp, count, interval_length;
-  int np;     /* number of pieces for current interval */
-  int p;      /* counter over pieces */
-  int pp;     /* p prime, allows us to reverse traversal order over p for negative strand */
-  int start;  /* start for current piece */
-  int end;    /* end for current piece */
+  FILE  *fp;
+  char   line[4096];
+  char  *s, *e;
+  char **nameA = NULL;
+  int    n = 0, alloc = 0;
 
-  if (given_fasta == NULL)
+  if ((fp = fopen(filename, "r")) == NULL)
     {
-      fprintf(stderr,"No sequence for %s\n", interval_data[given_index].name);
+      fprintf(stderr, "Cannot open %s\n", filename);
       exit(EXIT_FAILURE);
     }
-
-  interval_length = strlen(given_fasta);
-  for (index = given_index;
-       ((index < interval_count) &&
-        (strcmp(interval_data[index].name, interval_data[given_index].name) == 0));
-       index++)
+  while (fgets(line, sizeof(line), fp) != NULL)
     {
-      np     = interval_data[index].npieces;
-      strand = interval_data[index].strand;
-
-      if (interval_data[index].pstartA[0] == UNKNOWN) 
+      for (s = line; (*s == ' ') || (*s == '\t'); s++)
+        ;
+      for (e = s + strlen(s); (e > s) && ((e[-1] == '\n') || (e[-1] == '\r') || (e[-1] == ' ') || (e[-1] == '\t')); e--)
+        ;
+      if (e == s)
+        continue;
+      *e = '\0';
+      if (n == alloc)
         {
-          /* two sanity checks */
-          if(np != 1) { 
-            fprintf(stderr, "Problem parsing intervals, start set as unknown for multipiece interval (%s)\n", interval_data[index].name);
-            exit(EXIT_FAILURE);
-          }
-          if(interval_data[index].pendA[0] != UNKNOWN) { 
-            fprintf(stderr, "Problem parsing intervals, start set as unknown, but end is not: (%s)\n", interval_data[index].name);
-            exit(EXIT_FAILURE);
-          }
-
-          interval_data[index].pstartA[0] = 1;
-          interval_data[index].pendA[0]   = interval_length;
+          alloc = (alloc == 0) ? 16 : 2 * alloc;
+          nameA = (char **) realloc(nameA, alloc * sizeof(char *));
         }
-      else if (interval_data[index].end > interval_length) { 
-        fprintf(stderr, "End position exceeds sequence length (%d > %d) for sequence %s\n", interval_data[index].end, interval_length, interval_data[index].name);
-        exit(EXIT_FAILURE);
-      }        
-      
-      /* output defline */
-      printf(">%s:", interval_data[index].name);
-      for(p = 0; p < np; p++) { 
-        printf("%s%d_%s%d:", 
-               interval_data[index].pstartA[p] == 1 ? "<" : "", 
-               interval_data[index].pstartA[p], 
-               interval_data[index].pendA[p] == interval_length ? ">" : "", 
-               interval_data[index].pendA[p]);
-      }
-      if (strand == PLUS) { 
-        printf("+");
-      }
-      else {
-        printf("-"); 
-      }
-      if(interval_data[given_index].opttok != NULL) { 
-        printf(":%s\n", interval_data[index].opttok);
-      }
-      else { 
-        printf("\n");
-      }
-      
-      count = 0;
-      for(p = 0; p < np; p++) { /* for each piece... */
-        /* if we're on the opposite strand, we need to do this in the reverse order */
-        pp = (strand == PLUS) ? p : (np - 1) - p; 
-        
-        /* Make input based on offset 0 */
-        start = interval_data[index].pstartA[pp] - 1;
-        end   = interval_data[index].pendA[pp] - 1;
-
-        if (strand == PLUS)
-          {
-            for (temp = start; temp <= end; temp++)
-              {
-                count++;
-                printf("%c", given_fasta[temp]);
-                if ((count%PRINT_CUTOFF) == 0)
-                  printf("\n");
-              }
-            if ((p == (np-1)) && (count%PRINT_CUTOFF) != 0)
-              printf("\n");
-          }
-        else
-          {
-            for (temp = end ; temp >= start; temp--)
-              {
-                count++;
-                switch(given_fasta[temp]) {
-                case 'A': printf("T"); break;
-                case 'C': printf("G"); break;
-                case 'G': printf("C"); break;
-                case 'T': printf("A"); break;
-                case 'a': printf("t"); break;
-                case 'c': printf("g"); break;
-                case 'g': printf("c"); break;
-                case 't': printf("a"); break;
-                default: printf("N");
-                }
-                if ((count%PRINT_CUTOFF) == 0)
-                  printf("\n");
-              }
-            if ((p == (np-1)) && (count%PRINT_CUTOFF) != 0)
-              printf("\n");
-          }
-      } /* end of 'for(p = 0; p < np; p++)' */
+      if ((nameA == NULL) || ((nameA[n++] = strdup(s)) == NULL))
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  if (ferror(fp) || (n == 0))
+    {
+      fprintf(stderr, ferror(fp) ? "Error reading %s\n" : "No fasta files listed in %s\n", filename);
+      exit(EXIT_FAILURE);
     }
+  fclose(fp);
+  *ret_n = n;
+  return nameA;
 }
 
-/* EPN added functions 
- * Tue Mar  3 09:59:25 2015
- */
-
-void dump_intervals(interval_record *interval_data, int interval_count) { 
-  int i, p;
+/* write_fd(): ef_write_fn that writes to the file descriptor *<arg> */
+int write_fd(arg, s, len)
+     void *arg;
+     const char *s;
+     long len;
+{
+  int     fd = *((int *) arg);
+  ssize_t n;
 
-  for(i = 0; i < interval_count; i++) { 
-    printf("interval_data[%d]: %s %d pieces (%d..%d) strand: %d\n", i+1, interval_data[i].name, interval_data[i].npieces, interval_data[i].start, interval_data[i].end, interval_data[i].strand);
-    for(p = 0; p < interval_data[i].npieces; p++) { 
-      printf("\tpiece %d: %d..%d\n", p+1, interval_data[i].pstartA[p], interval_data[i].pendA[p]);
+  while (len > 0)
+    {
+      n = write(fd, s, len);
+      if (n == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return -1;
+        }
+      s   += n;
+      len -= n;
     }
-    printf("\n");
-  }
+  return 0;
 }
 
-void free_intervals(interval_record *interval_data, int interval_count) { 
-  int i;
+/* wall_seconds(): seconds of CLOCK_MONOTONIC */
+double wall_seconds()
+{
+  struct timespec ts;
 
-  if(interval_data != NULL) { 
-    for(i = 0; i < interval_count; i++) { 
-      if(interval_data[i].name != NULL) { 
-        free(interval_data[i].name); 
-        interval_data[i].name = NULL;
-      }
-    }
-  }
-  free(interval_data);
-  interval_data = NULL;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* print_progress(): ef_progress_fn that writes a line to stderr, <arg> is the run_info */
+void print_progress(arg, stats)
+     void *arg;
+     const ef_stats *stats;
+{
+  run_info *run = (run_info *) arg;
+  long      secs = (long) (wall_seconds() - run->start);
 
-  return;
+  fprintf(stderr, "[%ld:%02ld:%02ld] %ld records seen, %ld matched; %.1f MB of fasta read; "
+          "%ld intervals extracted; peak RSS %.1f MB\n",
+          secs / 3600, (secs / 60) % 60, secs % 60, stats->records_seen, stats->records_matched,
+          stats->fasta_bytes / 1e6, stats->intervals_plus + stats->intervals_minus, stats->peak_rss_kb / 1024.0);
+}
+
+/* Function: print_stats()
+ * Args:     filename: file to write to, NULL for stderr
+ *           run:      the run
+ *           stats:    from ef_get_stats()
+ * Returns:  0, or -1 if <filename> can't be written.
+ */
+int print_stats(filename, run, stats)
+     char *filename;
+     run_info *run;
+     ef_stats *stats;
+{
+  FILE *fp = stderr;
+
+  if ((filename != NULL) && ((fp = fopen(filename, "w")) == NULL))
+    return -1;
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"seconds\": %.6f,\n", wall_seconds() - run->start);
+  fprintf(fp, "  \"threads\": %d,\n", run->nthreads);
+  fprintf(fp, "  \"phases\": {\n");
+  fprintf(fp, "    \"read_intervals\": { \"seconds\": %.6f, \"cpu_seconds\": %.6f },\n", stats->read_seconds, stats->read_cpu);
+  fprintf(fp, "    \"sort\": { \"seconds\": %.6f, \"cpu_seconds\": %.6f },\n", stats->sort_seconds, stats->sort_cpu);
+  fprintf(fp, "    \"scan\": { \"seconds\": %.6f, \"cpu_seconds\": %.6f },\n", stats->scan_seconds, stats->scan_cpu);
+  fprintf(fp, "    \"extract\": { \"seconds\": %.6f, \"cpu_seconds\": %.6f }\n", stats->extract_seconds, stats->extract_cpu);
+  fprintf(fp, "  },\n");
+  fprintf(fp, "  \"interval_bytes\": %ld,\n", stats->interval_bytes);
+  fprintf(fp, "  \"fasta_bytes\": %ld,\n", stats->fasta_bytes);
+  fprintf(fp, "  \"bytes_written\": %ld,\n", stats->bytes_written);
+  fprintf(fp, "  \"records_seen\": %ld,\n", stats->records_seen);
+  fprintf(fp, "  \"records_matched\": %ld,\n", stats->records_matched);
+  fprintf(fp, "  \"intervals_plus\": %ld,\n", stats->intervals_plus);
+  fprintf(fp, "  \"intervals_minus\": %ld,\n", stats->intervals_minus);
+  fprintf(fp, "  \"buffer_grows\": %ld,\n", stats->buffer_grows);
+  fprintf(fp, "  \"bytes_copied\": %ld,\n", stats->bytes_copied);
+  fprintf(fp, "  \"peak_rss_kb\": %ld\n", stats->peak_rss_kb);
+  fprintf(fp, "}\n");
+  if (fp == stderr)
+    return 0;
+  return (fclose(fp) == 0) ? 0 : -1;
 }
@@ -0,0 +1,3528 @@
+/* extractfasta.c:
+ *
+ * libextractfasta, see extractfasta.h; extract_fasta_multi_exon.c is
+ * the command line tool, and describes what is extracted and how.
+ *
+ * Everything one extraction needs (the grouped interval list, which
+ * names have been found, the output and the pipeline) is kept in the
+ * ef_ctx, so several contexts can extract at the same time. Functions
+ * that can fail return an ef_status, and record the message with
+ * set_error() where the error is found; messages from the other
+ * modules (intervals.c, faidx.c, the pipeline) come back as malloc'ed
+ * strings, which take_error() records.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "extractfasta.h"
+#include "faidx.h"
+#include "seqout.h"
+#include "pipeline.h"
+#include "seqhash.h"
+#include "arena.h"
+#include "intervals.h"
+#include "twobit.h"
+#include "ioplan.h"
+#include "memo.h"
+#include "translate.h"
+#include "bgzf.h"
+#include "extsort.h"
+
+/* TRUE and FALSE may be already defined, */
+/* let's not get in the way of other definitions. */
+
+#if     defined(TRUE)
+#undef TRUE
+#endif
+
+#if     defined(FALSE)
+#undef FALSE
+#endif
+
+typedef enum {FALSE = 0, TRUE = 1} bool; /* boolean type */
+
+#define PRINT_CUTOFF 80 /* default number of residues per output line */
+#define OUTPUT_WIDTH(ctx) ((ctx)->binary ? 0 : (ctx)->width) /* residues per output line, binary records have none */
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+#define ALL_SERVED(ctx) (((ctx)->ext != NULL) ? ext_served(ctx) : \
+                         ((ctx)->nserved == (ctx)->intervals->names->nnames)) /* TRUE once a sequence has been found for every name */
+#define INTERVAL_BYTES(ctx) (((ctx)->ext != NULL) ? extsort_nbytes((ctx)->ext) : (ctx)->intervals->nbytes)
+#define STREAM_START(rec) (((rec).start == UNKNOWN) ? 0L : (long) (rec).start - 1) /* first residue (0-based) an interval needs */
+
+#define STREAM_BUFSIZE (1 << 20) /* number of bytes process_fasta() reads at a time */
+#define STREAM_GAP     4096      /* process_fasta() keeps the residues between pieces less than this far apart */
+#define WHITE_SPACE     " \n\r\t\v"
+
+#define TASK_RESIDUES (1 << 20) /* with threads, intervals of one sequence are split into tasks of about this many residues */
+#define TASKS_PER_THREAD 16     /* with threads, max number of tasks in flight per worker thread */
+#define FILES_PER_THREAD 2      /* with several fasta files, max number of files extracted and not yet written per thread */
+
+/* with stats, add <n> to the counter <field>; atomically, as worker threads count too */
+#define STAT_ADD(ctx, field, n)                                                 \
+  do {                                                                          \
+    if ((ctx)->stats != NULL) __sync_fetch_and_add(&((ctx)->stats->field), (long) (n)); \
+  } while (0)
+
+/* with stats, set <t> to now (see stats_start()) for STATS_STOP() */
+#define STATS_START(ctx, t)                                                     \
+  do {                                                                          \
+    if ((ctx)->stats != NULL) stats_start(&(t));                                \
+    else (t).wall = (t).cpu = 0;                                                \
+  } while (0)
+
+/* with stats, add the time since STATS_START() to phase <phase> */
+#define STATS_STOP(ctx, t, phase)                                               \
+  do {                                                                          \
+    if ((ctx)->stats != NULL)                                                   \
+      stats_stop(&(t), &((ctx)->stats->phase##_seconds), &((ctx)->stats->phase##_cpu)); \
+  } while (0)
+
+/* a stretch of a sequence kept in a window, see stream_append() */
+typedef struct {
+  long pos; /* position (0-based) of its first residue in the sequence */
+  long off; /* offset of its first residue in the window */
+  long len; /* number of residues */
+} fasta_seg;
+
+/* a sequence we are extracting from, either fully in memory, a view
+ * into a memory mapped file, packed in a 2-bit cache, or read piece by
+ * piece using an index */
+typedef struct {
+  int      length;     /* number of residues in the sequence, -1 in a reference if it has too many */
+  char    *fasta;      /* sequence without newlines, if it is in memory, else NULL */
+  fasta_seg *segA;     /* if fasta is a window: [0..nsegs-1] the stretches of the sequence in it, in order, else NULL */
+  int      nsegs;
+  char    *data;       /* if fasta is NULL: first residue of the sequence in a mapped file, or NULL */
+  int      line_bases; /* if data is non-NULL: number of residues per line */
+  int      line_bytes; /* if data is non-NULL: number of bytes per line, including the newline */
+  twobit_seq packed;   /* if fasta and data are NULL: the sequence in a mapped 2-bit cache, if packed.dna is non-NULL */
+  faidx_t *fai;        /* if fasta, data and packed.dna are NULL: index to read pieces with */
+  int      e;          /* if fasta, data and packed.dna are NULL: index of this sequence in fai->entryA */
+  ioplan_t *plan;      /* with fai, while print_fasta() runs: the pieces read, see plan_reads() */
+  memo_t  *memo;       /* while print_fasta() runs, for more than one interval: pieces and intervals done, or NULL */
+  translator_t *tr;    /* while print_fasta() runs, with a genetic code: translates the intervals, else NULL */
+  char    *buf;        /* buffer pieces are unwrapped or read into */
+  long     buf_alloc;  /* allocated size of buf */
+} fasta_seq;
+
+/* a reference FASTA file (or 2-bit cache) kept open by ef_open_reference(),
+ * shared by the contexts given it with ef_share_reference(); read only once open */
+typedef struct {
+  int        nusers;   /* number of contexts using it, changed atomically */
+  char      *map;      /* the mapped file, or NULL if it is read with an index or is a cache */
+  long       map_size;
+  faidx_t   *fai;      /* the index, or NULL if the file is not read with one */
+  twobit_t  *tb;       /* the 2-bit cache, or NULL */
+  arena_t   *strings;  /* names of the sequences */
+  seqhash_t *names;    /* sequence names, the first sequence with each name gets id 0, 1, 2... in file order */
+  fasta_seq *seqA;     /* [0..names->nnames-1] the sequence with each name id */
+} reference;
+
+/* with ef_extract_files(): a sequence extracted from one of the files */
+typedef struct {
+  int  id;   /* its name id */
+  long off;  /* offset of its output in the file's output */
+} file_chunk;
+
+struct ef_ctx_s {
+  int             width;        /* number of residues per output line, 0 for no line wrapping */
+  bool            binary;       /* TRUE to write binary records, see ef_set_format() */
+  char           *out_fai;      /* file to write the .fai of the output to, see ef_set_output_index(), or NULL */
+  faidx_writer_t *out_index;    /* during an extraction with out_fai: writes it */
+  int             nthreads;     /* number of worker threads */
+  bool            use_index;    /* TRUE to read fasta files using their .fai index */
+  long            read_gap;     /* with an index, pieces less than this many bytes apart are read together */
+  int             id_field;     /* '|' field of a header that is the sequence name, see ef_set_id_field() */
+  const char     *code_table;   /* genetic code to translate intervals with, see translate.h, or NULL */
+  interval_list  *intervals;    /* every interval added so far; with ext, those of the sequence being extracted */
+  bool            grouped;      /* TRUE if intervals->recordA is grouped by name, see group_intervals() */
+  int            *group_startA; /* [0..names->nnames-1] first interval for each name */
+  int            *group_endA;   /* [0..names->nnames-1] one past the final interval for each name */
+  unsigned long  *servedA;      /* bitmap, bit <id> is set once a sequence called names->nameA[id] has been found */
+  int             nserved;      /* number of bits set in servedA */
+  long            sort_memory;  /* memory budget to sort the intervals externally with, see ef_set_sort_memory(), or 0 */
+  char           *sort_tmpdir;  /* directory for its temporary files, or NULL */
+  extsort_t      *ext;          /* with sort_memory, once intervals are added: every interval added so far */
+  ef_status       ext_status;   /* during an extraction with ext: the error find_index() stopped at, or EF_OK */
+  char           *prev_name;    /* during an extraction with ext: name of the previous sequence, or NULL */
+  long            prev_alloc;
+  seqout_t       *output;       /* during an extraction: where extracted sequences are written */
+  pipeline_t     *pipeline;     /* during an extraction with threads: runs extract_tasks, else NULL */
+  ef_status       task_status;  /* status of the first extract_task (in output order) that failed, or EF_OK */
+  long            task_ns;      /* with stats: wall nanoseconds extract_tasks have taken, summed over them, see run_task() */
+  long            task_cpu_ns;  /* with stats: CPU nanoseconds of the threads running them, while they did */
+  reference      *ref;          /* reference kept open, or NULL */
+  const char    **missingA;     /* [0..nmissing-1] names the last extraction didn't find */
+  int             nmissing;
+  bool            unordered;    /* with ef_extract_files(): TRUE to write each file's output as soon as it is extracted */
+  bool            chunked;      /* TRUE for a context extracting one of ef_extract_files()'s files */
+  file_chunk     *chunkA;       /* if chunked: [0..nchunks-1] each sequence extracted, in output order */
+  int             nchunks;
+  int             chunk_alloc;
+  ef_stats       *stats;        /* counters, after ef_set_stats(), else NULL */
+  ef_progress_fn  progress;     /* with stats: called every progress_every seconds during an extraction, or NULL */
+  void           *progress_arg;
+  double          progress_every;
+  double          progress_next; /* stats_wall() time the progress function is next due */
+  int             progress_busy; /* TRUE while a thread is in stats_progress(), see there */
+  char           *err;          /* message for the last error, or NULL */
+};
+
+/* a moment, for timing a phase with stats, see stats_start() */
+typedef struct {
+  double    wall;  /* seconds of CLOCK_MONOTONIC */
+  double    cpu;   /* seconds of CPU used by the process, or by the thread */
+  clockid_t clock; /* CLOCK_PROCESS_CPUTIME_ID, or CLOCK_THREAD_CPUTIME_ID for the thread's own */
+} stats_time;
+
+/* process_fasta()'s state while reading a record */
+typedef struct {
+  ef_ctx *ctx;
+  int   first;      /* next interval to extract, or UNKNOWN if we aren't extracting from this record */
+  int   last;       /* one past the final interval for this record */
+  long  seen;       /* number of residues of the record read so far */
+  int   next;       /* next interval whose pieces aren't in needA yet */
+  piece *needA;     /* [0..nneed-1] pieces of intervals first..next-1, in order and merged, see stream_need() */
+  int   nneed;
+  int   need_alloc;
+  int   need;       /* first of needA not read all of yet */
+  char *win;        /* the window, residues of needA from the first one an interval left to extract needs */
+  long  win_off;    /* offset of the first residue of the window in win */
+  long  win_n;      /* offset of the end of the window in win */
+  long  win_alloc;  /* allocated size of win */
+  fasta_seg *segA;  /* [seg_first..nsegs-1] the stretches of the record in the window, in order */
+  int   seg_first;
+  int   nsegs;
+  int   seg_alloc;
+  char *lead;       /* whitespace at the start of the current line, kept until we know if the line is blank */
+  long  lead_n;
+  long  lead_alloc;
+  bool  in_line;    /* TRUE once the current line has a non-whitespace character */
+  bool  cr;         /* TRUE if the current line so far ends with a '\r' that we haven't added */
+} stream_state;
+
+/* with threads: a sequence that tasks extract from, freed once all of its tasks are written */
+typedef struct {
+  char      *fasta;  /* sequence buffer the tasks use, owned by this record, or NULL */
+  fasta_seg *segA;   /* if fasta is a window, its stretches, owned by this record, or NULL */
+  int        ntasks; /* number of tasks not yet written */
+} shared_record;
+
+/* with threads: extraction of intervals <first>..<last>-1 from one sequence */
+typedef struct {
+  ef_ctx        *ctx;
+  shared_record *rec;
+  fasta_seq      seq;    /* this task's copy, with its own buf */
+  int            first;
+  int            last;
+  ef_status      status; /* set by run_task() */
+} extract_task;
+
+/* where ef_extract_buffer() puts the output */
+typedef struct {
+  char *buf;
+  long  size;
+  long  n;  /* number of bytes of output, even if more than size */
+} output_buffer;
+
+/* with ef_extract_files(): one of the files */
+typedef struct {
+  ef_ctx   *ctx;    /* context it is extracted in, see file_context(), or NULL until it is started */
+  ef_status status;
+  bool      done;   /* TRUE once it is extracted */
+  bool      merged; /* TRUE once its output is written */
+} file_job;
+
+/* with ef_extract_files(): shared by the file threads and the thread that writes */
+typedef struct {
+  ef_ctx         *ctx;      /* the caller's context */
+  const char    **fa_fileA; /* [0..nfiles-1] */
+  int             nfiles;
+  file_job       *jobA;     /* [0..nfiles-1] */
+  int             next;     /* next file to start */
+  int             nmerged;  /* number of files written */
+  int             max_ahead; /* max number of files started and not yet written */
+  bool            stop;     /* TRUE once no more files are to be started */
+  pthread_mutex_t lock;     /* for all of the above, and ctx->servedA */
+  pthread_cond_t  cond;     /* broadcast when a file is done or written, or stop is set */
+} files_state;
+
+/* with the intervals sorted externally: a sequence to visit, see name_order() */
+typedef struct {
+  const char *name; /* not '\0'-terminated */
+  long        len;
+  int         e;    /* its entry */
+} name_entry;
+
+static void group_intervals(ef_ctx *);
+static int  compare_entries(const void *, const void *);
+static int  compare_names(const void *, const void *);
+static int  compare_skipped(const void *, const void *);
+static int  find_index(ef_ctx *, char *, int *);
+static int  next_group(ef_ctx *, char *, int *);
+static bool ext_served(ef_ctx *);
+static int *name_order(ef_ctx *, const void *, size_t, int, bool);
+static char *seq_name(ef_ctx *, char *, long, long *);
+static char *copy_name(char **, long *, const char *, long);
+
+static void begin_extract(ef_ctx *);
+static ef_status open_output(ef_ctx *, ef_write_fn, void *);
+static ef_status close_output(ef_ctx *, ef_status);
+static ef_status process_file(ef_ctx *, const char *);
+static void *file_thread(void *);
+static ef_ctx *file_context(files_state *);
+static void merge_file(files_state *, int);
+static void free_file_context(ef_ctx *);
+static void add_chunk(ef_ctx *, int);
+static ef_status process_fasta(ef_ctx *, const char *);
+static ef_status process_fasta_mapped(ef_ctx *, const char *, bool *);
+static ef_status process_fasta_indexed(ef_ctx *, const char *);
+static ef_status process_twobit(ef_ctx *, const char *);
+static ef_status process_reference(ef_ctx *);
+static long map_record(char *, char *, fasta_seq *, char **);
+static ef_status extract_record(ef_ctx *, int, int, fasta_seq *, bool);
+static char *next_record(char *, char *);
+static void drain_input(int);
+static void stream_need(stream_state *);
+static long stream_keep(stream_state *);
+static void stream_drop(stream_state *, long);
+static void stream_add(stream_state *, const char *, long);
+static void stream_append(stream_state *, const char *, long);
+static void stream_line_bytes(stream_state *, const char *, long);
+static ef_status stream_residues(stream_state *, const char *, long, bool);
+static ef_status stream_extract(stream_state *, int, bool);
+static ef_status stream_end_record(stream_state *);
+static void find_missing(ef_ctx *);
+static char *print_fasta(ef_ctx *, int, int, fasta_seq *, seqout_t *, ef_status *);
+static char *print_intervals(ef_ctx *, int, int, fasta_seq *, seqout_t *, ef_status *);
+static long  defline_length(interval_record *, piece *, int, int);
+static int   ndigits(long);
+static int   plan_reads(ef_ctx *, int, int, fasta_seq *);
+static uint64_t interval_hash(ef_ctx *, int);
+static bool  same_pieces(ef_ctx *, int, int);
+static bool  residues_copied(fasta_seq *, int, int);
+static char *get_residues(ef_ctx *, fasta_seq *, int, int);
+static ef_status extract_intervals(ef_ctx *, int, int, fasta_seq *, bool);
+static char *run_task(void *, seqout_t *);
+static void  done_task(void *);
+static int   write_buffer(void *, const char *, long);
+static void  release_reference(reference *);
+static double stats_wall(void);
+static void  stats_start(stats_time *);
+static void  stats_start_clock(stats_time *, clockid_t);
+static void  stats_stop(stats_time *, double *, double *);
+static void  stats_add(ef_stats *, const ef_stats *);
+static void  stats_progress(ef_ctx *);
+static char *error_message(const char *, ...);
+static ef_status set_error(ef_ctx *, ef_status, const char *, ...);
+static ef_status take_error(ef_ctx *, ef_status, char *);
+
+/* Function: ef_create()
+ * Returns:  a new context, with no intervals and no reference, writing
+ *           80 residues per line with one thread; free with ef_free().
+ */
+ef_ctx *ef_create(void) {
+  ef_ctx *ctx;
+
+  ctx = (ef_ctx *) calloc(1, sizeof(ef_ctx));
+  if (ctx == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  ctx->width     = PRINT_CUTOFF;
+  ctx->nthreads  = 1;
+  ctx->use_index = FALSE;
+  ctx->read_gap  = IOPLAN_GAP;
+  ctx->id_field  = 0;
+  ctx->intervals = intervals_create();
+  return ctx;
+}
+
+/* ef_free(): free <ctx>, and its reference unless another context shares it */
+void ef_free(ef_ctx *ctx) {
+  if (ctx == NULL)
+    return;
+  ef_clear_intervals(ctx);
+  intervals_free(ctx->intervals);
+  ef_close_reference(ctx);
+  free(ctx->out_fai);
+  free(ctx->sort_tmpdir);
+  free(ctx->prev_name);
+  free(ctx->stats);
+  free(ctx->err);
+  free(ctx);
+}
+
+/* ef_error(): message for the last error, without a final newline */
+const char *ef_error(ef_ctx *ctx) {
+  return (ctx->err != NULL) ? ctx->err : "No error";
+}
+
+/* ef_set_width(): set the number of residues per output line, 0 for no line wrapping [80] */
+ef_status ef_set_width(ef_ctx *ctx, int width) {
+  if (width < 0)
+    return set_error(ctx, EF_ERR_USAGE, "Bad line width %d", width);
+  ctx->width = width;
+  return EF_OK;
+}
+
+/* ef_set_threads(): set the number of threads to parse and extract with,
+ * output is the same with any number [1] */
+ef_status ef_set_threads(ef_ctx *ctx, int nthreads) {
+  if (nthreads < 1)
+    return set_error(ctx, EF_ERR_USAGE, "Bad number of threads %d", nthreads);
+  ctx->nthreads = nthreads;
+  return EF_OK;
+}
+
+/* ef_set_index(): if <use_index> is non-zero, read fasta files through
+ * their .fai index, only the parts that cover the intervals [0] */
+void ef_set_index(ef_ctx *ctx, int use_index) {
+  ctx->use_index = use_index ? TRUE : FALSE;
+}
+
+/* ef_set_read_gap(): with an index, read pieces of a sequence less than
+ * <gap> bytes apart with one read, along with the bytes between them [16384] */
+ef_status ef_set_read_gap(ef_ctx *ctx, long gap) {
+  if (gap < 0)
+    return set_error(ctx, EF_ERR_USAGE, "Bad read gap %ld", gap);
+  ctx->read_gap = gap;
+  return EF_OK;
+}
+
+/* Function: ef_set_genetic_code()
+ * Args:     ctx:  context
+ *           code: NCBI genetic code (1 is the standard code) to output
+ *                 the protein each interval codes for, or 0 to output
+ *                 its nucleotides [0]
+ * Returns:  EF_OK, or EF_ERR_USAGE for a code we don't have.
+ *
+ * Pieces are translated one after another, so a codon can span two of
+ * them; on the - strand the reverse complement is translated. Bases
+ * at the end of an interval that don't make up a codon are dropped.
+ */
+ef_status ef_set_genetic_code(ef_ctx *ctx, int code) {
+  const char *table = NULL;
+
+  if ((code != 0) && ((table = translate_table(code)) == NULL))
+    return set_error(ctx, EF_ERR_USAGE, "Unknown genetic code %d", code);
+  ctx->code_table = table;
+  return EF_OK;
+}
+
+/* Function: ef_set_id_field()
+ * Args:     ctx:   context
+ *           field: 0 to name sequences by the first word of their header
+ *                  line [default]; n > 0 to name them by the nth
+ *                  '|'-separated field instead, keeping the first word
+ *                  if there are fewer fields; or EF_ID_FASTA to name them
+ *                  as id_fasta.pl does (the 4th field if there are 4 or
+ *                  more, else the 2nd, else nothing)
+ * Returns:  EF_OK, or EF_ERR_USAGE for a bad <field>.
+ *
+ * Only header lines are read differently, so idfetch output can be
+ * given as <fa_file> without id_fasta.pl. An index or 2-bit cache only
+ * has the first word of each header, so there the fields are of that
+ * word. A reference is named with the setting it is opened with.
+ */
+ef_status ef_set_id_field(ef_ctx *ctx, int field) {
+  if (field < EF_ID_FASTA)
+    return set_error(ctx, EF_ERR_USAGE, "Bad header field %d", field);
+  ctx->id_field = field;
+  return EF_OK;
+}
+
+/* Function: ef_add_intervals()
+ * Args:     ctx:    context
+ *           text:   interval lines, the final one needn't end in a newline
+ *           len:    number of bytes in <text>
+ *           source: name of <text> for error messages, like a file name
+ * Returns:  EF_OK, or EF_ERR_INTERVAL if a line is bad, and then all
+ *           intervals of <ctx> are cleared.
+ */
+ef_status ef_add_intervals(ef_ctx *ctx, const char *text, long len, const char *source) {
+  char      *err;
+  int        io = FALSE; /* TRUE if the error is a temporary file, not a bad line */
+  long       nbytes;
+  stats_time t;
+
+  STATS_START(ctx, t);
+  ctx->grouped = FALSE;
+  if ((ctx->sort_memory > 0) && (ctx->ext == NULL))
+    ctx->ext = extsort_create(ctx->sort_memory, ctx->nthreads, ctx->sort_tmpdir);
+  nbytes = INTERVAL_BYTES(ctx);
+  if (ctx->ext != NULL)
+    err = extsort_add(ctx->ext, text, len, source, &io);
+  else
+    err = intervals_add(ctx->intervals, text, len, ctx->nthreads, source);
+  STATS_STOP(ctx, t, read);
+  STAT_ADD(ctx, interval_bytes, INTERVAL_BYTES(ctx) - nbytes);
+  if (err != NULL)
+    {
+      ef_clear_intervals(ctx);
+      return take_error(ctx, io ? EF_ERR_IO : EF_ERR_INTERVAL, err);
+    }
+  return EF_OK;
+}
+
+/* Function: ef_read_intervals()
+ * Args:     ctx:      context
+ *           filename: interval list to add, "-" for stdin
+ * Returns:  EF_OK; EF_ERR_IO if <filename> can't be read, or
+ *           EF_ERR_INTERVAL if a line is bad. On error all intervals of
+ *           <ctx> are cleared.
+ */
+ef_status ef_read_intervals(ef_ctx *ctx, const char *filename) {
+  char      *err;
+  int        io;   /* TRUE if the error is reading <filename> or a temporary file, not a bad line */
+  long       nbytes;
+  stats_time t;
+
+  STATS_START(ctx, t);
+  ctx->grouped = FALSE;
+  if ((ctx->sort_memory > 0) && (ctx->ext == NULL))
+    ctx->ext = extsort_create(ctx->sort_memory, ctx->nthreads, ctx->sort_tmpdir);
+  nbytes = INTERVAL_BYTES(ctx);
+  if (ctx->ext != NULL)
+    err = extsort_read(ctx->ext, (char *) filename, &io);
+  else
+    err = intervals_read(ctx->intervals, (char *) filename, ctx->nthreads, &io);
+  STATS_STOP(ctx, t, read);
+  STAT_ADD(ctx, interval_bytes, INTERVAL_BYTES(ctx) - nbytes);
+  if (err != NULL)
+    {
+      ef_clear_intervals(ctx);
+      return take_error(ctx, io ? EF_ERR_IO : EF_ERR_INTERVAL, err);
+    }
+  return EF_OK;
+}
+
+/* ef_interval_count(): number of intervals added */
+int ef_interval_count(ef_ctx *ctx) {
+  return (ctx->ext != NULL) ? (int) extsort_count(ctx->ext) : ctx->intervals->nrecords;
+}
+
+/* ef_clear_intervals(): remove all intervals, and the list of missing names */
+void ef_clear_intervals(ef_ctx *ctx) {
+  if (ctx->intervals->nrecords > 0)
+    {
+      intervals_free(ctx->intervals);
+      ctx->intervals = intervals_create();
+    }
+  extsort_free(ctx->ext);
+  ctx->ext = NULL;
+  free(ctx->group_startA);
+  free(ctx->group_endA);
+  free(ctx->servedA);
+  free(ctx->missingA);
+  ctx->group_startA = NULL;
+  ctx->group_endA   = NULL;
+  ctx->servedA      = NULL;
+  ctx->missingA     = NULL;
+  ctx->nmissing     = 0;
+  ctx->grouped      = FALSE;
+}
+
+/* Function: ef_open_reference()
+ * Args:     ctx:     context
+ *           fa_file: fasta file to keep open, for ef_extract() with no file
+ * Returns:  EF_OK; EF_ERR_IO if <fa_file> can't be mapped into memory,
+ *           or EF_ERR_FASTA if an index is used (see ef_set_index()) or
+ *           <fa_file> is a 2-bit cache, and it can't be read.
+ *
+ * A 2-bit cache (see ef_build_cache()) is mapped into memory and only
+ * its index is read, with or without ef_set_index(). Without an index,
+ * <fa_file> is mapped into memory and scanned once for its records; a
+ * record whose lines aren't all the same length is copied, without its
+ * newlines. With an index, only the index is kept in memory, which is
+ * the only way to keep a BGZF compressed file open. Either way an
+ * extraction then only looks up the names in the interval list,
+ * instead of reading through <fa_file>. Replaces the reference <ctx>
+ * had, if any.
+ */
+ef_status ef_open_reference(ef_ctx *ctx, const char *fa_file) {
+  reference  *ref;
+  struct stat st;
+  int         fd, id, e;
+  long        nalloc = 0;
+  char       *p, *eol, *next, *file_end, *name;
+  long        name_len, nres;
+  char       *err;
+  fasta_seq  *seq;
+
+  ef_close_reference(ctx);
+  ref = (reference *) calloc(1, sizeof(reference));
+  if (ref == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  ref->nusers  = 1;
+  ref->names   = seqhash_create(1024);
+  ref->strings = arena_create();
+
+  if (twobit_is_file(fa_file))
+    {
+      ref->tb = twobit_open(fa_file, &err);
+      if (ref->tb == NULL)
+        {
+          release_reference(ref);
+          return take_error(ctx, EF_ERR_FASTA, err);
+        }
+      ref->seqA = (fasta_seq *) calloc(ref->tb->nentries + 1, sizeof(fasta_seq));
+      if (ref->seqA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      for (e = 0; e < ref->tb->nentries; e++)
+        {
+          name = seq_name(ctx, ref->tb->entryA[e].name, strlen(ref->tb->entryA[e].name), &name_len);
+          name = arena_strdup(ref->strings, name, name_len);
+          if (seqhash_lookup(ref->names, name) != -1)
+            continue; /* only the first sequence with each name is used */
+          id  = seqhash_insert(ref->names, name);
+          seq = &(ref->seqA[id]);
+          if ((err = twobit_get(ref->tb, e, &(seq->packed))) != NULL)
+            {
+              release_reference(ref);
+              return take_error(ctx, EF_ERR_FASTA, err);
+            }
+          seq->length = (seq->packed.length > INT_MAX) ? -1 : (int) seq->packed.length;
+        }
+      ctx->ref = ref;
+      return EF_OK;
+    }
+
+  if (ctx->use_index)
+    {
+      ref->fai = faidx_load((char *) fa_file, &err);
+      if (ref->fai == NULL)
+        {
+          release_reference(ref);
+          return take_error(ctx, EF_ERR_FASTA, err);
+        }
+      ref->seqA = (fasta_seq *) calloc(ref->fai->nentries + 1, sizeof(fasta_seq));
+      if (ref->seqA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      for (e = 0; e < ref->fai->nentries; e++)
+        {
+          name = seq_name(ctx, ref->fai->entryA[e].name, strlen(ref->fai->entryA[e].name), &name_len);
+          name = arena_strdup(ref->strings, name, name_len);
+          if (seqhash_lookup(ref->names, name) != -1)
+            continue; /* only the first sequence with each name is used */
+          id  = seqhash_insert(ref->names, name);
+          seq = &(ref->seqA[id]);
+          seq->fai    = ref->fai;
+          seq->e      = e;
+          seq->length = (ref->fai->entryA[e].length > INT_MAX) ? -1 : (int) ref->fai->entryA[e].length;
+        }
+      ctx->ref = ref;
+      return EF_OK;
+    }
+
+  if (bgzf_is_gzip(fa_file))
+    {
+      release_reference(ref);
+      return set_error(ctx, EF_ERR_FASTA, "%s is compressed, it can only be kept open through its index", fa_file);
+    }
+  fd = open(fa_file, O_RDONLY);
+  if (fd == -1)
+    {
+      release_reference(ref);
+      return set_error(ctx, EF_ERR_IO, "Cannot open %s", fa_file);
+    }
+  if ((fstat(fd, &st) == -1) || (! S_ISREG(st.st_mode)) || (st.st_size == 0) ||
+      ((ref->map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED))
+    {
+      ref->map = NULL;
+      close(fd);
+      release_reference(ref);
+      return set_error(ctx, EF_ERR_IO, "Cannot map %s into memory", fa_file);
+    }
+  close(fd);
+  ref->map_size = st.st_size;
+  madvise(ref->map, ref->map_size, MADV_SEQUENTIAL);
+
+  file_end = ref->map + ref->map_size;
+  p = ref->map;
+  while (p < file_end)
+    {
+      eol  = (char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      if (*p != '>') /* text before the first header line */
+        {
+          p = next;
+          continue;
+        }
+      name = seq_name(ctx, p + 1, ((eol == NULL) ? file_end : eol) - (p + 1), &name_len);
+      name = arena_strdup(ref->strings, name, name_len);
+      if (seqhash_lookup(ref->names, name) != -1) /* only the first sequence with each name is used */
+        {
+          p = next_record(next, file_end);
+          continue;
+        }
+      id = seqhash_insert(ref->names, name);
+      if (id >= nalloc)
+        {
+          nalloc = (nalloc == 0) ? 1024 : 2 * nalloc;
+          ref->seqA = (fasta_seq *) realloc(ref->seqA, nalloc * sizeof(fasta_seq));
+          if (ref->seqA == NULL)
+            {
+              fprintf(stderr,"No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      seq = &(ref->seqA[id]);
+      memset(seq, 0, sizeof(fasta_seq));
+      nres = map_record(next, file_end, seq, &p);
+      if (nres > INT_MAX)
+        seq->length = -1;
+    }
+  madvise(ref->map, ref->map_size, MADV_RANDOM);
+
+  ctx->ref = ref;
+  return EF_OK;
+}
+
+/* Function: ef_share_reference()
+ * Args:     ctx:  context to give the reference to, replacing its own
+ *           from: context with a reference open
+ * Returns:  EF_OK, or EF_ERR_USAGE if <from> has no reference.
+ * Note:     the reference is freed when the last context using it is.
+ */
+ef_status ef_share_reference(ef_ctx *ctx, ef_ctx *from) {
+  if (from->ref == NULL)
+    return set_error(ctx, EF_ERR_USAGE, "No reference to share");
+  if (ctx->ref == from->ref)
+    return EF_OK;
+  ef_close_reference(ctx);
+  __sync_fetch_and_add(&(from->ref->nusers), 1);
+  ctx->ref = from->ref;
+  return EF_OK;
+}
+
+/* ef_close_reference(): stop using <ctx>'s reference, if it has one */
+void ef_close_reference(ef_ctx *ctx) {
+  if (ctx->ref == NULL)
+    return;
+  if (__sync_sub_and_fetch(&(ctx->ref->nusers), 1) == 0)
+    release_reference(ctx->ref);
+  ctx->ref = NULL;
+}
+
+/* Function: ef_extract()
+ * Args:     ctx:     context
+ *           fa_file: fasta file (gzip compressed or not, or a 2-bit cache)
+ *                    to read, "-" for stdin, or NULL for the reference
+ *                    opened with ef_open_reference()
+ *           write:   called with the output, in order, a block at a time
+ *           arg:     passed to <write>
+ * Returns:  EF_OK, or the error that stopped the extraction; all output
+ *           before the error has been written.
+ *
+ * Extracts every interval, exactly as extract_fasta_multi_exon would;
+ * afterwards ef_nmissing() and ef_missing_name() tell which names
+ * weren't found. The intervals are kept, so they can be extracted
+ * again (from another file, say) or added to.
+ */
+ef_status ef_extract(ef_ctx *ctx, const char *fa_file, ef_write_fn write, void *arg) {
+  ef_status  status = EF_OK;
+  char      *err;
+  stats_time t;
+
+  free(ctx->missingA);
+  ctx->missingA = NULL;
+  ctx->nmissing = 0;
+  if ((fa_file == NULL) && (ctx->ref == NULL))
+    return set_error(ctx, EF_ERR_USAGE, "No fasta file given, and no reference open");
+  if (open_output(ctx, write, arg) != EF_OK)
+    return EF_ERR_IO;
+  if (ef_interval_count(ctx) == 0)
+    return close_output(ctx, EF_OK); /* still writes an (empty) index */
+
+  begin_extract(ctx);
+  if (ctx->nthreads > 1)
+    ctx->pipeline = pipeline_start(ctx->nthreads, ctx->nthreads * TASKS_PER_THREAD, ctx->output, run_task, done_task);
+
+  if ((ctx->ext == NULL) || (ctx->ext_status == EF_OK))
+    status = process_file(ctx, fa_file);
+  if ((ctx->ext != NULL) && (status == EF_OK))
+    status = ctx->ext_status; /* what stopped find_index(), if anything did */
+
+  STATS_START(ctx, t);
+  if (ctx->pipeline != NULL)
+    {
+      /* a task that failed came before anything the reading stopped at */
+      err = pipeline_finish(ctx->pipeline);
+      ctx->pipeline = NULL;
+      if (err != NULL)
+        status = take_error(ctx, ctx->task_status, err);
+    }
+  status = close_output(ctx, status);
+  STATS_STOP(ctx, t, extract);
+
+  find_missing(ctx);
+  return status;
+}
+
+/* Function: ef_extract_buffer()
+ * Args:     ctx:     context
+ *           fa_file: as for ef_extract()
+ *           buf:     where to put the output, not '\0'-terminated
+ *           size:    size of <buf>
+ *           ret_len: set to the number of bytes of output
+ * Returns:  as ef_extract(), or EF_ERR_NOSPACE if the output doesn't
+ *           fit, then *ret_len is the size <buf> needs to be.
+ */
+ef_status ef_extract_buffer(ef_ctx *ctx, const char *fa_file, char *buf, long size, long *ret_len) {
+  output_buffer ob;
+  ef_status     status;
+
+  ob.buf  = buf;
+  ob.size = size;
+  ob.n    = 0;
+  status = ef_extract(ctx, fa_file, write_buffer, &ob);
+  *ret_len = ob.n;
+  if ((status == EF_OK) && (ob.n > size))
+    return set_error(ctx, EF_ERR_NOSPACE, "Output is %ld bytes, the buffer is %ld", ob.n, size);
+  return status;
+}
+
+/* Function: ef_extract_files()
+ * Args:     ctx:      context
+ *           fa_fileA: [0..nfiles-1] fasta files (or 2-bit caches) to
+ *                     extract from, not stdin
+ *           nfiles:   number of files
+ *           write:    called with the output, a block at a time
+ *           arg:      passed to <write>
+ * Returns:  EF_OK, or the error that stopped the extraction.
+ *
+ * Like ef_extract() from all of the files, each sequence from the first
+ * file that has it: output is what extracting from the files put
+ * together one after another would be. With ef_set_unordered(), each
+ * file's output is written as soon as it has been extracted instead,
+ * and a sequence in more than one file is from whichever is done first.
+ *
+ * The files are extracted by the ef_set_threads() threads, one file
+ * per thread at a time, all sharing the interval list; each file's
+ * output is kept in memory until it is written, and at most
+ * FILES_PER_THREAD files per thread are extracted ahead of the writing.
+ * A file that fails stops the extraction once the output of the files
+ * before it (and its output before the error) has been written.
+ */
+ef_status ef_extract_files(ef_ctx *ctx, const char **fa_fileA, int nfiles, ef_write_fn write, void *arg) {
+  files_state fs;
+  pthread_t  *threadA;
+  ef_status   status = EF_OK;
+  int         nthreads, f, t;
+
+  free(ctx->missingA);
+  ctx->missingA = NULL;
+  ctx->nmissing = 0;
+  for (f = 0; f < nfiles; f++)
+    if (strcmp(fa_fileA[f], "-") == 0)
+      return set_error(ctx, EF_ERR_USAGE, "Cannot read stdin along with other fasta files");
+  if (nfiles == 1)
+    return ef_extract(ctx, fa_fileA[0], write, arg);
+  if (ctx->ext != NULL)
+    return set_error(ctx, EF_ERR_USAGE, "Cannot extract from several fasta files with the intervals sorted externally");
+  if (open_output(ctx, write, arg) != EF_OK)
+    return EF_ERR_IO;
+  if ((nfiles == 0) || (ctx->intervals->nrecords == 0))
+    return close_output(ctx, EF_OK);
+
+  begin_extract(ctx);
+  nthreads = (ctx->nthreads < nfiles) ? ctx->nthreads : nfiles;
+
+  fs.ctx       = ctx;
+  fs.fa_fileA  = fa_fileA;
+  fs.nfiles    = nfiles;
+  fs.jobA      = (file_job *) calloc(nfiles, sizeof(file_job));
+  threadA      = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  if ((fs.jobA == NULL) || (threadA == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  fs.next      = 0;
+  fs.nmerged   = 0;
+  fs.max_ahead = nthreads * FILES_PER_THREAD;
+  fs.stop      = FALSE;
+  pthread_mutex_init(&fs.lock, NULL);
+  pthread_cond_init(&fs.cond, NULL);
+  for (t = 0; t < nthreads; t++)
+    if (pthread_create(&threadA[t], NULL, file_thread, &fs) != 0)
+      {
+        fprintf(stderr, "Cannot start a thread\n");
+        exit(EXIT_FAILURE);
+      }
+
+  /* write each file's output as it is done, in file order unless unordered */
+  pthread_mutex_lock(&fs.lock);
+  while ((fs.nmerged < nfiles) && (status == EF_OK) && (! ALL_SERVED(ctx)))
+    {
+      if (ctx->unordered)
+        for (f = 0; (f < fs.next) && ((! fs.jobA[f].done) || fs.jobA[f].merged); f++)
+          ;
+      else
+        f = fs.nmerged;
+      if ((f == fs.next) || (! fs.jobA[f].done))
+        {
+          pthread_cond_wait(&fs.cond, &fs.lock);
+          continue;
+        }
+      merge_file(&fs, f); /* unlocks while writing */
+      if (((status = fs.jobA[f].status) != EF_OK) && (fs.jobA[f].ctx->err != NULL))
+        {
+          take_error(ctx, status, fs.jobA[f].ctx->err);
+          fs.jobA[f].ctx->err = NULL;
+        }
+      if (ctx->stats != NULL)
+        {
+          stats_add(ctx->stats, fs.jobA[f].ctx->stats);
+          stats_progress(ctx);
+        }
+      free_file_context(fs.jobA[f].ctx);
+      fs.jobA[f].ctx    = NULL;
+      fs.jobA[f].merged = TRUE;
+      fs.nmerged++;
+      pthread_cond_broadcast(&fs.cond);
+    }
+  fs.stop = TRUE;
+  pthread_cond_broadcast(&fs.cond);
+  pthread_mutex_unlock(&fs.lock);
+
+  for (t = 0; t < nthreads; t++)
+    pthread_join(threadA[t], NULL);
+  for (f = 0; f < nfiles; f++) /* files not written, after an error or once all are found */
+    if (fs.jobA[f].ctx != NULL)
+      free_file_context(fs.jobA[f].ctx);
+  pthread_mutex_destroy(&fs.lock);
+  pthread_cond_destroy(&fs.cond);
+  free(fs.jobA);
+  free(threadA);
+
+  status = close_output(ctx, status);
+
+  find_missing(ctx);
+  return status;
+}
+
+/* ef_set_unordered(): if <unordered> is non-zero, ef_extract_files()
+ * writes the output of each file as soon as it is extracted, rather than
+ * in the order of the files [0] */
+void ef_set_unordered(ef_ctx *ctx, int unordered) {
+  ctx->unordered = unordered ? TRUE : FALSE;
+}
+
+/* Function: ef_set_format()
+ * Args:     ctx:    context
+ *           format: EF_FORMAT_FASTA, or EF_FORMAT_BINARY for the
+ *                   length-prefixed records described in extractfasta.h
+ * Returns:  EF_OK, or EF_ERR_USAGE for any other format.
+ *
+ * Binary records are written whatever ef_set_width() says, with the
+ * sequence on one line and nothing between records [EF_FORMAT_FASTA].
+ */
+ef_status ef_set_format(ef_ctx *ctx, int format) {
+  if ((format != EF_FORMAT_FASTA) && (format != EF_FORMAT_BINARY))
+    return set_error(ctx, EF_ERR_USAGE, "Bad output format %d", format);
+  ctx->binary = (format == EF_FORMAT_BINARY) ? TRUE : FALSE;
+  return EF_OK;
+}
+
+/* ef_set_output_index(): also write a samtools-compatible index of the
+ * output of each extraction to <fai_file>, built as the output is
+ * written (offsets are from the start of each extraction's output, so
+ * it indexes a file the output is all of), or NULL to stop [NULL] */
+void ef_set_output_index(ef_ctx *ctx, const char *fai_file) {
+  free(ctx->out_fai);
+  ctx->out_fai = NULL;
+  if ((fai_file != NULL) && ((ctx->out_fai = strdup(fai_file)) == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+}
+
+/* Function: ef_set_sort_memory()
+ * Args:     ctx:    context, with no intervals yet
+ *           bytes:  memory budget for the interval list, at least
+ *                   EXTSORT_MIN_BUDGET (64K), or 0 to keep it all in memory [0]
+ *           tmpdir: directory for temporary files, NULL for $TMPDIR or /tmp
+ * Returns:  EF_OK, or EF_ERR_USAGE for a bad budget, or if <ctx> has intervals.
+ *
+ * Intervals added are then sorted a run at a time into temporary files
+ * (see extsort.h), and an extraction merges them one sequence name at a
+ * time, so a list bigger than memory can be extracted. The sequences
+ * wanted must then come in (strcmp()) name order: in a fasta file read
+ * through, one that comes after a later name stops the extraction with
+ * EF_ERR_FASTA (others can be anywhere), while an index (see
+ * ef_set_index()), a 2-bit cache or a reference is visited in name
+ * order. Output, and the missing names, are in name order, so for a
+ * file sorted by name output is the same as without a budget.
+ * ef_extract_files() can't be used.
+ */
+ef_status ef_set_sort_memory(ef_ctx *ctx, long bytes, const char *tmpdir) {
+  if ((bytes != 0) && (bytes < EXTSORT_MIN_BUDGET))
+    return set_error(ctx, EF_ERR_USAGE, "Sort memory %ld is less than the smallest, %d", bytes, EXTSORT_MIN_BUDGET);
+  if (ef_interval_count(ctx) > 0)
+    return set_error(ctx, EF_ERR_USAGE, "Sort memory must be set before intervals are added");
+  ctx->sort_memory = bytes;
+  free(ctx->sort_tmpdir);
+  ctx->sort_tmpdir = NULL;
+  if ((tmpdir != NULL) && ((ctx->sort_tmpdir = strdup(tmpdir)) == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  extsort_free(ctx->ext); /* one made for no intervals */
+  ctx->ext = NULL;
+  return EF_OK;
+}
+
+/* ef_set_stats(): if <on> is non-zero, count and time what <ctx> does
+ * from now on (from zero, if it already was), see ef_get_stats(); else
+ * stop, and stop calling the progress function [0] */
+void ef_set_stats(ef_ctx *ctx, int on) {
+  free(ctx->stats);
+  ctx->stats    = NULL;
+  ctx->progress = NULL;
+  if (! on)
+    return;
+  ctx->stats = (ef_stats *) calloc(1, sizeof(ef_stats));
+  if (ctx->stats == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+}
+
+/* Function: ef_set_progress()
+ * Args:     ctx:     context
+ *           seconds: how often to call <fn>
+ *           fn:      called with what ef_get_stats() would return, or
+ *                    NULL to stop calling it
+ *           arg:     passed to <fn>
+ * Returns:  EF_OK, or EF_ERR_USAGE if <seconds> isn't positive.
+ *
+ * Turns on stats, if they aren't. During an extraction <fn> is called
+ * at most every <seconds>, between records, blocks read or intervals
+ * written (with ef_extract_files(), as each file is written), so for a
+ * long run it can say how far it has got, even within one record. With
+ * threads it may be called by the writing thread, but never by two
+ * threads at once. The time of a phase is only added once the phase is
+ * over, while the counts go up as it goes.
+ */
+ef_status ef_set_progress(ef_ctx *ctx, double seconds, ef_progress_fn fn, void *arg) {
+  if ((fn != NULL) && (! (seconds > 0)))
+    return set_error(ctx, EF_ERR_USAGE, "Bad progress interval %g", seconds);
+  if (ctx->stats == NULL)
+    ef_set_stats(ctx, TRUE);
+  ctx->progress       = fn;
+  ctx->progress_arg   = arg;
+  ctx->progress_every = seconds;
+  return EF_OK;
+}
+
+/* ef_get_stats(): set <stats> to what <ctx> has done since ef_set_stats(),
+ * all zero if stats are off */
+void ef_get_stats(ef_ctx *ctx, ef_stats *stats) {
+  struct rusage ru;
+
+  memset(stats, 0, sizeof(ef_stats));
+  if (ctx->stats == NULL)
+    return;
+  /* worker threads may be counting */
+  stats_add(stats, ctx->stats);
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    stats->peak_rss_kb = ru.ru_maxrss;
+}
+
+/* ef_nmissing(): number of names in the interval list the last extraction found no sequence for */
+int ef_nmissing(ef_ctx *ctx) {
+  return ctx->nmissing;
+}
+
+/* ef_missing_name(): the <i>th of those names, in the order they are
+ * first in the interval list; valid until the intervals are cleared */
+const char *ef_missing_name(ef_ctx *ctx, int i) {
+  if ((i < 0) || (i >= ctx->nmissing))
+    return NULL;
+  return ctx->missingA[i];
+}
+
+/* ef_build_cache(): write the 2-bit cache <cache_file> for <fa_file>, see
+ * twobit.h; returns EF_OK, or EF_ERR_FASTA if it can't be built (and none
+ * is left behind), which it can't if <fa_file> has residues other than ACGTN */
+ef_status ef_build_cache(ef_ctx *ctx, const char *fa_file, const char *cache_file) {
+  char *err;
+
+  err = twobit_build((char *) fa_file, (char *) cache_file);
+  if (err != NULL)
+    return take_error(ctx, EF_ERR_FASTA, err);
+  return EF_OK;
+}
+
+/* ef_build_index(): write the index <fa_file>.fai for <fa_file>; returns
+ * EF_OK, or EF_ERR_FASTA if it can't be built (and none is left behind) */
+ef_status ef_build_index(ef_ctx *ctx, const char *fa_file) {
+  char *err;
+
+  err = faidx_build((char *) fa_file);
+  if (err != NULL)
+    return take_error(ctx, EF_ERR_FASTA, err);
+  return EF_OK;
+}
+
+static int compare_entries(const void *f1, const void *f2)
+{
+  interval_record *first;
+  interval_record *second;
+  int value;
+
+  first = (interval_record *) f1;
+  second = (interval_record *) f2;
+
+  if (first->name != second->name) /* intervals with the same name share it */
+    {
+      value = strcmp(first->name, second->name);
+      if (value != 0)
+        return(value);
+    }
+
+  if (first->start < second->start)
+    return(-1);
+  if (first->start > second->start)
+    return(1);
+
+  if (first->end < second->end)
+    return(-1);
+  if (first->end > second->end)
+    return(1);
+
+  if (first->strand < second->strand)
+    return(-1);
+  if (first->strand > second->strand)
+    return(1);
+
+  return(0);
+}
+
+/* Function: group_intervals()
+ *
+ * Makes the intervals for each sequence name contiguous in
+ * ctx->intervals->recordA, sorted with compare_entries() within each
+ * name, and sets up group_startA and group_endA so find_index() is one
+ * lookup in the name hash per sequence. intervals.c has already put
+ * each distinct name into the hash, and set each interval's name_id.
+ * Does nothing if nothing was added since the last time.
+ */
+static void group_intervals(ctx)
+     ef_ctx *ctx;
+{
+  interval_record *interval_data = ctx->intervals->recordA;
+  int interval_count = ctx->intervals->nrecords;
+  interval_record *grouped;
+  int *group_startA, *group_endA;
+  int  i, id, nnames;
+
+  if (ctx->grouped)
+    return;
+
+  /* count intervals per name, then place each at the end of its name's group so far */
+  nnames = ctx->intervals->names->nnames;
+  free(ctx->group_startA);
+  free(ctx->group_endA);
+  group_startA = (int *) calloc(nnames, sizeof(int));
+  group_endA   = (int *) malloc(nnames * sizeof(int));
+  grouped      = (interval_record *) malloc(interval_count * sizeof(interval_record));
+  if ((group_startA == NULL) || (group_endA == NULL) || (grouped == NULL))
+    {
+      fprintf(stderr,"No space for %d contigs\n", interval_count);
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < interval_count; i++)
+    group_startA[interval_data[i].name_id]++; /* for now, number of intervals */
+  for (id = 0, i = 0; id < nnames; id++)
+    {
+      group_endA[id]   = i;
+      i               += group_startA[id];
+      group_startA[id] = group_endA[id];
+    }
+  for (i = 0; i < interval_count; i++)
+    grouped[group_endA[interval_data[i].name_id]++] = interval_data[i];
+  free(interval_data);
+  interval_data = ctx->intervals->recordA = grouped;
+  ctx->intervals->ralloc = interval_count;
+
+  for (id = 0; id < nnames; id++)
+    if (group_endA[id] - group_startA[id] > 1)
+      qsort(interval_data + group_startA[id], group_endA[id] - group_startA[id], sizeof(interval_record), compare_entries);
+
+  ctx->group_startA = group_startA;
+  ctx->group_endA   = group_endA;
+  ctx->grouped      = TRUE;
+}
+
+/* find_index(): return the first interval for sequence <name>, and set
+ * <ret_last> to one past its final interval; UNKNOWN if there are none,
+ * or if a sequence called <name> has already been found (only the first
+ * one in the fasta file is used). Marks <name> as found. */
+static int find_index(ctx, name, ret_last)
+     ef_ctx *ctx;
+     char *name;
+     int *ret_last;
+{
+  int id;
+
+  if (ctx->stats != NULL)
+    {
+      ctx->stats->records_seen++; /* only this thread counts records */
+      stats_progress(ctx);
+    }
+  if (ctx->ext != NULL)
+    return(next_group(ctx, name, ret_last));
+  id = seqhash_lookup(ctx->intervals->names, name);
+
+  if (id == -1)
+    return(UNKNOWN);
+  if (ctx->servedA[id / BITS_PER_LONG] & (1UL << (id % BITS_PER_LONG)))
+    return(UNKNOWN);
+  ctx->servedA[id / BITS_PER_LONG] |= (1UL << (id % BITS_PER_LONG));
+  ctx->nserved++;
+  if (ctx->stats != NULL)
+    ctx->stats->records_matched++;
+  *ret_last = ctx->group_endA[id];
+  return(ctx->group_startA[id]);
+}
+
+/* next_group(): find_index() with the intervals sorted externally. The
+ * names before <name> are skipped as missing, and if <name> is next its
+ * intervals are read into ctx->intervals, in place of the previous
+ * sequence's, so the tasks extracting those must be done first. A name
+ * before the latest one so far has been found already, or has no
+ * intervals, unless it was skipped: then it came too late, and the
+ * extraction stops (see ALL_SERVED()), as it does if a temporary file
+ * can't be read. */
+static int next_group(ctx, name, ret_last)
+     ef_ctx *ctx;
+     char *name;
+     int *ret_last;
+{
+  const char **skippedA;
+  const char *next;
+  char *err;
+  int value = 1, nskipped;
+
+  if ((ctx->prev_name != NULL) && (strcmp(name, ctx->prev_name) <= 0))
+    {
+      skippedA = extsort_missing(ctx->ext, &nskipped); /* in sorted order */
+      if (bsearch(name, skippedA, nskipped, sizeof(char *), compare_skipped) != NULL)
+        ctx->ext_status = set_error(ctx, EF_ERR_FASTA, "Sequence %s comes after %s, but with the intervals sorted externally "
+                                    "the sequences wanted must come in name order, or be read with an index", name, ctx->prev_name);
+      return(UNKNOWN);
+    }
+  copy_name(&(ctx->prev_name), &(ctx->prev_alloc), name, strlen(name));
+
+  while (((next = extsort_name(ctx->ext)) != NULL) && ((value = strcmp(next, name)) < 0))
+    extsort_skip(ctx->ext);
+  if (value == 0)
+    {
+      if (ctx->pipeline != NULL)
+        pipeline_wait(ctx->pipeline);
+      extsort_group(ctx->ext, ctx->intervals);
+    }
+  if ((err = extsort_error(ctx->ext)) != NULL)
+    {
+      ctx->ext_status = take_error(ctx, EF_ERR_IO, err);
+      return(UNKNOWN);
+    }
+  if (value != 0)
+    return(UNKNOWN);
+  ctx->nserved++;
+  if (ctx->stats != NULL)
+    ctx->stats->records_matched++;
+  *ret_last = ctx->intervals->nrecords;
+  return(0);
+}
+
+/* ext_served(): ALL_SERVED() with the intervals sorted externally. A name
+ * skipped as missing may yet come, out of order, so once one has been
+ * the rest of the file is read to find out; TRUE after an error. */
+static bool ext_served(ctx)
+     ef_ctx *ctx;
+{
+  int nskipped;
+
+  if (ctx->ext_status != EF_OK)
+    return(TRUE);
+  extsort_missing(ctx->ext, &nskipped);
+  return((extsort_name(ctx->ext) == NULL) && (nskipped == 0));
+}
+
+/* name_order(): with the intervals sorted externally, the order to visit
+ * <n> sequences in so their names come in sorted order, those with the
+ * same name in file order; NULL, for file order, if they aren't. The
+ * first sequence's name is at <first>, the next's <stride> bytes on, and
+ * so on; with <header> the names are by seq_name(). Free it with free(). */
+static int *name_order(ctx, first, stride, n, header)
+     ef_ctx *ctx;
+     const void *first;
+     size_t stride;
+     int n;
+     bool header;
+{
+  name_entry *entryA;
+  char *name;
+  int *orderA;
+  int  i;
+
+  if (ctx->ext == NULL)
+    return(NULL);
+  entryA = (name_entry *) malloc((n + 1) * sizeof(name_entry));
+  orderA = (int *) malloc((n + 1) * sizeof(int));
+  if ((entryA == NULL) || (orderA == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < n; i++)
+    {
+      name = *((char * const *) ((const char *) first + i * stride));
+      entryA[i].len  = strlen(name);
+      entryA[i].name = header ? seq_name(ctx, name, entryA[i].len, &(entryA[i].len)) : name;
+      entryA[i].e    = i;
+    }
+  qsort(entryA, n, sizeof(name_entry), compare_names);
+  for (i = 0; i < n; i++)
+    orderA[i] = entryA[i].e;
+  free(entryA);
+  return(orderA);
+}
+
+/* Function: seq_name()
+ * Args:     ctx:     context, for its id_field (see ef_set_id_field())
+ *           header:  header line, after the '>'
+ *           len:     number of bytes in <header>, without the newline
+ *           ret_len: RETURN: length of the name
+ * Returns:  the sequence name, which is in <header> and not '\0'-terminated.
+ *
+ * The name is the first word of the header, or with id_field set the
+ * first word of one of the '|'-separated fields of its accession. The
+ * accession is the header up to its first space that isn't the final
+ * character, and trailing empty fields don't count, just as in
+ * id_fasta.pl's split(/\|/).
+ */
+static char *seq_name(ctx, header, len, ret_len)
+     ef_ctx *ctx;
+     char *header;
+     long len;
+     long *ret_len;
+{
+  long acc_len, i, n;
+  int  nfields, field;
+
+  if (ctx->id_field != 0)
+    {
+      for (acc_len = 0; (acc_len < len - 1) && (header[acc_len] != ' '); acc_len++)
+        ;
+      if (acc_len >= len - 1)
+        acc_len = len;
+      while ((acc_len > 0) && (header[acc_len-1] == '|'))
+        acc_len--;
+      nfields = (acc_len > 0) ? 1 : 0;
+      for (i = 0; i < acc_len; i++)
+        if (header[i] == '|')
+          nfields++;
+
+      if (ctx->id_field == EF_ID_FASTA)
+        field = (nfields >= 4) ? 4 : 2;
+      else
+        field = ctx->id_field;
+      if (field <= nfields)
+        {
+          for (i = 0; field > 1; i++)
+            if (header[i] == '|')
+              field--;
+          header += i;
+          for (len = 0; (i + len < acc_len) && (header[len] != '|'); len++)
+            ;
+        }
+      else if (ctx->id_field == EF_ID_FASTA)
+        len = 0; /* id_fasta.pl names it with an undefined field */
+    }
+
+  for (n = 0; (n < len) && (strchr(WHITE_SPACE, header[n]) == NULL); n++)
+    ;
+  *ret_len = n;
+  return header;
+}
+
+/* copy_name(): copy <len> bytes of <name> into *buf, growing it (to
+ * *alloc bytes) as needed, and return it '\0'-terminated */
+static char *copy_name(buf, alloc, name, len)
+     char **buf;
+     long *alloc;
+     const char *name;
+     long len;
+{
+  if (*alloc < len + 1)
+    {
+      *alloc = len + 1;
+      *buf = (char *) realloc(*buf, *alloc);
+      if (*buf == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  memcpy(*buf, name, len);
+  (*buf)[len] = '\0';
+  return *buf;
+}
+
+/* open_output(): set up ctx->output to write with <write>, through
+ * ctx->out_index if the output is to be indexed; returns EF_OK, or
+ * EF_ERR_IO if the index can't be opened */
+static ef_status open_output(ctx, write, arg)
+     ef_ctx *ctx;
+     ef_write_fn write;
+     void *arg;
+{
+  char *err;
+
+  ctx->out_index = NULL;
+  if (ctx->out_fai != NULL)
+    {
+      ctx->out_index = faidx_writer_create(ctx->out_fai, ctx->binary, write, arg, &err);
+      if (ctx->out_index == NULL)
+        return take_error(ctx, EF_ERR_IO, err);
+      write = faidx_writer_write;
+      arg   = ctx->out_index;
+    }
+  ctx->output = seqout_create_fn(write, arg, OUTPUT_WIDTH(ctx));
+  return EF_OK;
+}
+
+/* close_output(): finish writing ctx->output (and its index) after an
+ * extraction that returns <status>; returns <status>, or EF_ERR_IO if
+ * it was EF_OK and the output or index can't be written */
+static ef_status close_output(ctx, status)
+     ef_ctx *ctx;
+     ef_status status;
+{
+  char *err;
+
+  STAT_ADD(ctx, bytes_written, seqout_tell(ctx->output));
+  if ((seqout_close(ctx->output) != 0) && (status == EF_OK))
+    status = set_error(ctx, EF_ERR_IO, "Error writing output");
+  ctx->output = NULL;
+  if (ctx->out_index != NULL)
+    {
+      err = faidx_writer_close(ctx->out_index);
+      ctx->out_index = NULL;
+      if ((err != NULL) && (status == EF_OK))
+        status = take_error(ctx, EF_ERR_IO, err);
+      else
+        free(err);
+    }
+  return status;
+}
+
+/* begin_extract(): set up <ctx> for an extraction, nothing found yet */
+static void begin_extract(ctx)
+     ef_ctx *ctx;
+{
+  int        nnames;
+  char      *err;
+  stats_time t;
+
+  ctx->nserved     = 0;
+  ctx->task_status = EF_OK;
+  if (ctx->progress != NULL)
+    ctx->progress_next = stats_wall() + ctx->progress_every;
+  if (ctx->ext != NULL)
+    {
+      /* merged a name at a time by find_index(), see next_group() */
+      free(ctx->prev_name);
+      ctx->prev_name  = NULL;
+      ctx->prev_alloc = 0;
+      STATS_START(ctx, t);
+      err = extsort_start(ctx->ext);
+      STATS_STOP(ctx, t, sort);
+      ctx->ext_status = (err != NULL) ? take_error(ctx, EF_ERR_IO, err) : EF_OK;
+      return;
+    }
+
+  STATS_START(ctx, t);
+  group_intervals(ctx);
+  STATS_STOP(ctx, t, sort);
+  nnames = ctx->intervals->names->nnames;
+  free(ctx->servedA);
+  ctx->servedA = (unsigned long *) calloc(nnames / BITS_PER_LONG + 1, sizeof(unsigned long));
+  if (ctx->servedA == NULL)
+    {
+      fprintf(stderr,"No space for %d contigs\n", nnames);
+      exit(EXIT_FAILURE);
+    }
+}
+
+/* process_file(): extract from <fa_file> however it is to be read, see ef_extract() */
+static ef_status process_file(ctx, fa_file)
+     ef_ctx *ctx;
+     const char *fa_file;
+{
+  ef_status  status;
+  bool       mapped;
+  stats_time t;
+  double     extract_seconds = 0, extract_cpu = 0;
+  long       task_ns = 0, task_cpu_ns = 0;
+
+  STATS_START(ctx, t);
+  if (ctx->stats != NULL)
+    {
+      extract_seconds = ctx->stats->extract_seconds;
+      extract_cpu     = ctx->stats->extract_cpu;
+      task_ns         = __atomic_load_n(&(ctx->task_ns), __ATOMIC_RELAXED);
+      task_cpu_ns     = __atomic_load_n(&(ctx->task_cpu_ns), __ATOMIC_RELAXED);
+    }
+
+  if (fa_file == NULL)
+    status = process_reference(ctx);
+  else if (strcmp(fa_file, "-") == 0)
+    status = process_fasta(ctx, fa_file);
+  else if (twobit_is_file(fa_file))
+    status = process_twobit(ctx, fa_file);
+  else if (ctx->use_index)
+    status = process_fasta_indexed(ctx, fa_file);
+  else if (bgzf_is_gzip(fa_file))
+    status = process_fasta(ctx, fa_file);
+  else if (((status = process_fasta_mapped(ctx, fa_file, &mapped)) == EF_OK) && (! mapped))
+    status = process_fasta(ctx, fa_file); /* not a regular file, read it a block at a time */
+
+  /* the scan is all of it but what extract_record() and, with threads,
+   * the tasks took; the tasks' wall time is summed over them, and ran
+   * alongside the scan rather than in it */
+  if (ctx->stats != NULL)
+    {
+      stats_stop(&t, &(ctx->stats->scan_seconds), &(ctx->stats->scan_cpu));
+      ctx->stats->scan_seconds -= ctx->stats->extract_seconds - extract_seconds;
+      ctx->stats->scan_cpu     -= ctx->stats->extract_cpu - extract_cpu;
+      task_ns     = __atomic_load_n(&(ctx->task_ns), __ATOMIC_RELAXED) - task_ns;
+      task_cpu_ns = __atomic_load_n(&(ctx->task_cpu_ns), __ATOMIC_RELAXED) - task_cpu_ns;
+      ctx->stats->scan_cpu        -= task_cpu_ns / 1e9;
+      ctx->stats->extract_seconds += task_ns / 1e9;
+      ctx->stats->extract_cpu     += task_cpu_ns / 1e9;
+    }
+  return status;
+}
+
+/* file_thread(): with ef_extract_files(), extract files until there are
+ * none left to start */
+static void *file_thread(arg)
+     void *arg;
+{
+  files_state *fs = (files_state *) arg;
+  ef_ctx   *fctx;
+  ef_status status;
+  int       f;
+
+  pthread_mutex_lock(&fs->lock);
+  for (;;)
+    {
+      while ((! fs->stop) && (fs->next < fs->nfiles) && (fs->next - fs->nmerged >= fs->max_ahead))
+        pthread_cond_wait(&fs->cond, &fs->lock);
+      if (fs->stop || (fs->next == fs->nfiles))
+        break;
+      f    = fs->next++;
+      fctx = fs->jobA[f].ctx = file_context(fs);
+      pthread_mutex_unlock(&fs->lock);
+
+      status = process_file(fctx, fs->fa_fileA[f]);
+
+      pthread_mutex_lock(&fs->lock);
+      fs->jobA[f].status = status;
+      fs->jobA[f].done   = TRUE;
+      pthread_cond_broadcast(&fs->cond);
+    }
+  pthread_mutex_unlock(&fs->lock);
+  return NULL;
+}
+
+/* Function: file_context()
+ * Args:     fs: files being extracted, locked
+ * Returns:  a new context to extract one of them in, free with
+ *           free_file_context().
+ *
+ * The context shares the caller's (grouped) interval list and settings,
+ * with its output kept in memory and one thread. The names already
+ * written are marked found, so they aren't extracted again.
+ */
+static ef_ctx *file_context(fs)
+     files_state *fs;
+{
+  ef_ctx *ctx = fs->ctx;
+  ef_ctx *fctx;
+  int     nwords = ctx->intervals->names->nnames / BITS_PER_LONG + 1;
+
+  fctx = (ef_ctx *) malloc(sizeof(ef_ctx));
+  if (fctx == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  *fctx = *ctx;
+  fctx->servedA = (unsigned long *) malloc(nwords * sizeof(unsigned long));
+  if (fctx->servedA == NULL)
+    {
+      fprintf(stderr,"No space for %d contigs\n", ctx->intervals->names->nnames);
+      exit(EXIT_FAILURE);
+    }
+  memcpy(fctx->servedA, ctx->servedA, nwords * sizeof(unsigned long));
+  fctx->nthreads    = 1;
+  fctx->output      = seqout_create(-1, OUTPUT_WIDTH(ctx));
+  fctx->out_fai     = NULL;
+  fctx->out_index   = NULL;
+  fctx->pipeline    = NULL;
+  fctx->task_status = EF_OK;
+  fctx->ref         = NULL;
+  fctx->missingA    = NULL;
+  fctx->nmissing    = 0;
+  fctx->chunked     = TRUE;
+  fctx->chunkA      = NULL;
+  fctx->nchunks     = 0;
+  fctx->chunk_alloc = 0;
+  fctx->stats       = NULL;
+  fctx->progress    = NULL; /* the writing thread calls it */
+  fctx->err         = NULL;
+  if (ctx->stats != NULL)
+    ef_set_stats(fctx, TRUE);
+  return fctx;
+}
+
+/* Function: merge_file()
+ * Args:     fs: files being extracted, locked
+ *           f:  file to write the output of, extracted
+ *
+ * Writes each sequence of file <f>'s output that no file written
+ * before it has, and marks them found. Unlocks <fs> while writing.
+ */
+static void merge_file(fs, f)
+     files_state *fs;
+     int f;
+{
+  ef_ctx     *ctx  = fs->ctx;
+  ef_ctx     *fctx = fs->jobA[f].ctx;
+  file_chunk *chunkA = fctx->chunkA;
+  long        end;
+  int         c, id;
+
+  for (c = 0; c < fctx->nchunks; c++)
+    {
+      id = chunkA[c].id;
+      if (ctx->servedA[id / BITS_PER_LONG] & (1UL << (id % BITS_PER_LONG)))
+        chunkA[c].id = UNKNOWN; /* an earlier file had it */
+      else
+        {
+          ctx->servedA[id / BITS_PER_LONG] |= (1UL << (id % BITS_PER_LONG));
+          ctx->nserved++;
+        }
+    }
+  pthread_mutex_unlock(&fs->lock);
+
+  for (c = 0; c < fctx->nchunks; c++)
+    if (chunkA[c].id != UNKNOWN)
+      {
+        end = (c + 1 < fctx->nchunks) ? chunkA[c+1].off : seqout_tell(fctx->output);
+        seqout_write(ctx->output, fctx->output->buf + chunkA[c].off, end - chunkA[c].off);
+      }
+
+  pthread_mutex_lock(&fs->lock);
+}
+
+/* free_file_context(): free a context from file_context(), but not the
+ * intervals it shares */
+static void free_file_context(fctx)
+     ef_ctx *fctx;
+{
+  seqout_close(fctx->output);
+  free(fctx->servedA);
+  free(fctx->missingA);
+  free(fctx->chunkA);
+  free(fctx->stats);
+  free(fctx->err);
+  free(fctx);
+}
+
+/* add_chunk(): with ef_extract_files(), note that sequence <id>'s output
+ * starts here, unless it is the sequence already being written */
+static void add_chunk(ctx, id)
+     ef_ctx *ctx;
+     int id;
+{
+  if ((ctx->nchunks > 0) && (ctx->chunkA[ctx->nchunks-1].id == id))
+    return;
+  if (ctx->nchunks == ctx->chunk_alloc)
+    {
+      ctx->chunk_alloc = (ctx->chunk_alloc == 0) ? 64 : 2 * ctx->chunk_alloc;
+      ctx->chunkA = (file_chunk *) realloc(ctx->chunkA, ctx->chunk_alloc * sizeof(file_chunk));
+      if (ctx->chunkA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  ctx->chunkA[ctx->nchunks].id  = id;
+  ctx->chunkA[ctx->nchunks].off = seqout_tell(ctx->output);
+  ctx->nchunks++;
+}
+
+/* Function: process_fasta()
+ * Args:     ctx:      context
+ *           filename: fasta file to read, "-" for stdin
+ * Returns:  EF_OK, or the error that stopped us.
+ *
+ * Reads the fasta file a block at a time, for stdin and anything else
+ * that can't be mapped into memory; a gzip compressed file is inflated
+ * as it is read, a BGZF one by ctx->nthreads threads ahead of us (see
+ * bgzf.h). Residues of a requested record that are in a piece of one
+ * of its intervals are kept in a window that starts at the first one
+ * needed by an interval not yet extracted; an interval is extracted as
+ * soon as the residue after its end has been read (so we know whether
+ * it ends at the end of the sequence), and the ones left at the end of
+ * the record once it is complete. So memory is proportional to the
+ * residues in the pieces, not to the span of an interval or to the
+ * record, except that a '<defline_token>' only interval keeps its whole
+ * record.
+ */
+static ef_status process_fasta(ctx, filename)
+     ef_ctx *ctx;
+     const char *filename;
+{
+  stream_state st;
+  char   *buf;         /* block read from the file */
+  char   *p;           /* next byte of buf to look at */
+  char   *end;         /* end of the bytes in buf */
+  char   *eol;         /* '\n' at end of current line, or NULL */
+  char   *line = NULL; /* header line so far, when a header line spans blocks */
+  long    line_n = 0, line_alloc = 0;
+  char   *name;        /* sequence name in the header line */
+  long    name_len;
+  long    i;
+  bool    at_line_start = TRUE;
+  bool    in_header = FALSE;  /* TRUE while reading a header line */
+  bool    stop = FALSE;       /* TRUE once we don't need anything more */
+  ef_status status = EF_OK;
+  ssize_t nread;
+  int     fd;
+  bgzf_reader *gz = NULL; /* if the file is gzip compressed */
+  char   *gz_err = NULL;
+
+  if (strcmp(filename,"-") == 0)
+    fd = 0;
+  else if (bgzf_is_gzip(filename))
+    {
+      fd = -1;
+      if ((gz = bgzf_open(filename, ctx->nthreads, &gz_err)) == NULL)
+        return take_error(ctx, EF_ERR_IO, gz_err);
+    }
+  else
+    {
+      fd = open(filename, O_RDONLY);
+      if (fd == -1)
+        return set_error(ctx, EF_ERR_IO, "Cannot open %s", filename);
+    }
+
+  buf = (char *) malloc(STREAM_BUFSIZE);
+  if (buf == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  memset(&st, 0, sizeof(stream_state));
+  st.ctx   = ctx;
+  st.first = UNKNOWN;
+
+  while ((! stop) &&
+         ((nread = (gz != NULL) ? bgzf_read(gz, buf, STREAM_BUFSIZE, &gz_err) : read(fd, buf, STREAM_BUFSIZE)) > 0))
+    {
+      STAT_ADD(ctx, fasta_bytes, nread);
+      stats_progress(ctx);
+      p   = buf;
+      end = buf + nread;
+      while (p < end)
+        {
+          if (at_line_start && (*p == '>'))
+            in_header = TRUE;
+          at_line_start = FALSE;
+          eol = (char *) memchr(p, '\n', end - p);
+
+          if (in_header)
+            {
+              /* collect the header line, it may span blocks */
+              i = ((eol == NULL) ? end : eol) - p;
+              if (line_n + i + 1 > line_alloc)
+                {
+                  line_alloc = 2 * (line_n + i + 1);
+                  line = (char *) realloc(line, line_alloc);
+                  if (line == NULL)
+                    {
+                      fprintf(stderr,"No space\n");
+                      exit(EXIT_FAILURE);
+                    }
+                }
+              memcpy(line + line_n, p, i);
+              line_n += i;
+              if (eol == NULL)
+                break;
+              name = seq_name(ctx, line + 1, line_n - 1, &name_len);
+              name[name_len] = '\0';
+
+              /* at new sequence, extract what's left of the previous one */
+              status = stream_end_record(&st);
+              if ((status != EF_OK) || ALL_SERVED(ctx)) /* nothing more to extract */
+                {
+                  stop = TRUE;
+                  break;
+                }
+              st.first = find_index(ctx, name, &(st.last));
+              st.next  = st.first;
+              line_n    = 0;
+              in_header = FALSE;
+            }
+          else
+            {
+              if (st.first != UNKNOWN)
+                status = stream_residues(&st, p, ((eol == NULL) ? end : eol) - p, (eol != NULL));
+              if ((status != EF_OK) || ((st.first == UNKNOWN) && ALL_SERVED(ctx))) /* nothing more to extract */
+                {
+                  stop = TRUE;
+                  break;
+                }
+              if (st.first == UNKNOWN) /* a record we don't want, skip to the next header */
+                {
+                  if (eol == NULL)
+                    break;
+                  if ((eol = next_record(eol + 1, end)) == end)
+                    {
+                      at_line_start = (end[-1] == '\n');
+                      break;
+                    }
+                  eol--; /* to the '\n' before the header */
+                }
+            }
+
+          if (eol == NULL)
+            break;
+          p = eol + 1;
+          at_line_start = TRUE;
+        }
+    }
+  if ((! stop) && (nread == -1))
+    {
+      if (gz_err != NULL)
+        status = take_error(ctx, EF_ERR_IO, gz_err);
+      else
+        status = set_error(ctx, EF_ERR_IO, "Cannot read %s", (fd == 0) ? "stdin" : filename);
+      stop = TRUE;
+    }
+  /* finished final sequence, extract what's left of it */
+  if (! stop)
+    status = stream_end_record(&st);
+  else if (gz == NULL)
+    drain_input(fd);
+
+  if (st.win != NULL) free(st.win);
+  if (st.segA != NULL) free(st.segA);
+  if (st.needA != NULL) free(st.needA);
+  if (st.lead != NULL) free(st.lead);
+  if (line != NULL) free(line);
+  free(buf);
+  if (gz != NULL)
+    bgzf_close(gz);
+  else if (fd != 0)
+    close(fd);
+  return status;
+}
+
+/* stream_need(): merge the pieces of interval st->next into st->needA,
+ * once the stream reaches it. Pieces less than STREAM_GAP apart are
+ * merged, what is between them is kept too, rather than the window
+ * being split into many short stretches. The intervals are sorted by
+ * start, so each piece usually goes at or near the end, which is where
+ * we look first. */
+static void stream_need(st)
+     stream_state *st;
+{
+  interval_record *rec = &(st->ctx->intervals->recordA[st->next++]);
+  piece *pc = st->ctx->intervals->pieceA + rec->pieces;
+  piece *need;
+  int p, lo, hi, mid, step, j, k;
+  int start, end;
+
+  /* forget the pieces read all of, once they are half of them */
+  if (st->need > st->nneed / 2)
+    {
+      memmove(st->needA, st->needA + st->need, (st->nneed - st->need) * sizeof(piece));
+      st->nneed -= st->need;
+      st->need   = 0;
+    }
+  if (st->nneed + rec->npieces > st->need_alloc)
+    {
+      st->need_alloc = 2 * (st->nneed + rec->npieces);
+      st->needA = (piece *) realloc(st->needA, st->need_alloc * sizeof(piece));
+      if (st->needA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+
+  need = st->needA;
+  for (p = 0; p < rec->npieces; p++)
+    {
+      start = (pc[p].start == UNKNOWN) ? 1 : pc[p].start; /* UNKNOWN is the whole record */
+      end   = (pc[p].start == UNKNOWN) ? INT_MAX : pc[p].end;
+
+      /* usually it carries on the final one */
+      if ((st->nneed > st->need) && (start >= need[st->nneed-1].start) &&
+          ((long) start <= (long) need[st->nneed-1].end + STREAM_GAP))
+        {
+          if (end > need[st->nneed-1].end)
+            need[st->nneed-1].end = end;
+          continue;
+        }
+
+      /* j is the first piece not read all of that doesn't end too far
+       * before this one starts, searched for back from the end, need[lo]
+       * does (or is read) */
+      hi = st->nneed;
+      for (lo = hi - 1, step = 1; (lo >= st->need) && ((long) need[lo].end + STREAM_GAP >= start); step *= 2)
+        {
+          hi = lo;
+          lo = hi - step;
+        }
+      if (lo < st->need - 1)
+        lo = st->need - 1;
+
+      while (hi - lo > 1)
+        {
+          mid = (lo + hi) / 2;
+          if ((long) need[mid].end + STREAM_GAP < start)
+            lo = mid;
+          else
+            hi = mid;
+        }
+      j = hi;
+      if ((j == st->nneed) || ((long) end + STREAM_GAP < need[j].start))
+        {
+          memmove(need + j + 1, need + j, (st->nneed - j) * sizeof(piece));
+          need[j].start = start;
+          need[j].end   = end;
+          st->nneed++;
+          continue;
+        }
+
+      /* it is near need[j], and maybe the ones after it */
+      if (start < need[j].start)
+        need[j].start = start;
+      if (end > need[j].end)
+        need[j].end = end;
+      for (k = j + 1; (k < st->nneed) && ((long) need[k].start <= (long) need[j].end + STREAM_GAP); k++)
+        if (need[k].end > need[j].end)
+          need[j].end = need[k].end;
+      if (k > j + 1)
+        {
+          memmove(need + j + 1, need + k, (st->nneed - k) * sizeof(piece));
+          st->nneed -= k - j - 1;
+        }
+    }
+}
+
+/* stream_keep(): first residue (0-based) the next interval to extract needs */
+static long stream_keep(st)
+     stream_state *st;
+{
+  return(STREAM_START(st->ctx->intervals->recordA[st->first]));
+}
+
+/* stream_drop(): drop the residues of the window before <keep> */
+static void stream_drop(st, keep)
+     stream_state *st;
+     long keep;
+{
+  fasta_seg *seg;
+  long drop;
+
+  while ((st->seg_first < st->nsegs) && (st->segA[st->seg_first].pos + st->segA[st->seg_first].len <= keep))
+    st->seg_first++;
+  if (st->seg_first == st->nsegs)
+    {
+      st->seg_first = st->nsegs = 0;
+      st->win_off   = st->win_n = 0;
+      return;
+    }
+  seg = &(st->segA[st->seg_first]);
+  if (seg->pos < keep)
+    {
+      drop = keep - seg->pos;
+      seg->pos += drop;
+      seg->off += drop;
+      seg->len -= drop;
+    }
+  st->win_off = seg->off;
+}
+
+/* stream_add(): add residues st->seen.. of the record to the window */
+static void stream_add(st, s, n)
+     stream_state *st;
+     const char *s;
+     long n;
+{
+  fasta_seg *seg;
+  long used = st->win_n - st->win_off;
+  int  i;
+
+  if (st->win_n + n > st->win_alloc)
+    {
+      if (st->win_off > 0)
+        {
+          memmove(st->win, st->win + st->win_off, used);
+          STAT_ADD(st->ctx, bytes_copied, used);
+          for (i = st->seg_first; i < st->nsegs; i++)
+            st->segA[i].off -= st->win_off;
+          st->win_off = 0;
+          st->win_n   = used;
+        }
+      if (2 * (used + n) > st->win_alloc) /* keep it at most half full, so we don't move it too often */
+        {
+          STAT_ADD(st->ctx, buffer_grows, 1);
+          st->win_alloc = 2 * (used + n);
+          st->win = (char *) realloc(st->win, st->win_alloc);
+          if (st->win == NULL)
+            {
+              fprintf(stderr,"No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+  /* a new stretch, unless these residues carry on the last one */
+  if ((st->seg_first == st->nsegs) ||
+      (st->segA[st->nsegs-1].pos + st->segA[st->nsegs-1].len != st->seen))
+    {
+      if (st->nsegs == st->seg_alloc)
+        {
+          if (st->seg_first > 0)
+            {
+              memmove(st->segA, st->segA + st->seg_first, (st->nsegs - st->seg_first) * sizeof(fasta_seg));
+              st->nsegs    -= st->seg_first;
+              st->seg_first = 0;
+            }
+          if (2 * (st->nsegs + 1) > st->seg_alloc)
+            {
+              st->seg_alloc = 2 * (st->nsegs + 1);
+              st->segA = (fasta_seg *) realloc(st->segA, st->seg_alloc * sizeof(fasta_seg));
+              if (st->segA == NULL)
+                {
+                  fprintf(stderr,"No space\n");
+                  exit(EXIT_FAILURE);
+                }
+            }
+        }
+      seg = &(st->segA[st->nsegs++]);
+      seg->pos = st->seen;
+      seg->off = st->win_n;
+      seg->len = 0;
+    }
+  seg = &(st->segA[st->nsegs-1]);
+  memcpy(st->win + st->win_n, s, n);
+  STAT_ADD(st->ctx, bytes_copied, n);
+  st->win_n += n;
+  seg->len  += n;
+  st->seen  += n;
+}
+
+/* stream_append(): append residues to the window, dropping those that no
+ * interval left to extract needs: those before its start, and those
+ * between the pieces */
+static void stream_append(st, s, n)
+     stream_state *st;
+     const char *s;
+     long n;
+{
+  interval_record *interval_data = st->ctx->intervals->recordA;
+  long keep, next, skip, take;
+
+  if (n == 0)
+    return;
+  keep = stream_keep(st);
+  stream_drop(st, keep);
+
+  /* usually they are all in the piece we are in */
+  if ((st->need < st->nneed) && (st->seen >= keep) &&
+      (st->needA[st->need].start - 1 <= st->seen) && (st->needA[st->need].end >= st->seen + n))
+    {
+      stream_add(st, s, n);
+      return;
+    }
+
+  while (n > 0)
+    {
+      /* the pieces of the intervals that start by here */
+      while ((st->next < st->last) && (STREAM_START(interval_data[st->next]) <= st->seen))
+        stream_need(st);
+      while ((st->need < st->nneed) && (st->needA[st->need].end <= st->seen))
+        st->need++;
+
+      /* skip to the next residue that may be needed, in a piece or an
+       * interval that we haven't reached yet */
+      next = (st->need < st->nneed) ? st->needA[st->need].start - 1 : LONG_MAX;
+      if ((st->next < st->last) && (STREAM_START(interval_data[st->next]) < next))
+        next = STREAM_START(interval_data[st->next]);
+      if (next == LONG_MAX) /* no more are needed */
+        {
+          st->seen += n;
+          return;
+        }
+      skip = ((next > keep) ? next : keep) - st->seen;
+      if (skip > 0)
+        {
+          if (skip > n)
+            skip = n;
+          s        += skip;
+          n        -= skip;
+          st->seen += skip;
+          continue;
+        }
+
+      take = st->needA[st->need].end - st->seen;
+      if (take > n)
+        take = n;
+      stream_add(st, s, take);
+      s += take;
+      n -= take;
+    }
+}
+
+/* stream_line_bytes(): add bytes of a sequence line, a line with
+ * nothing but whitespace adds nothing */
+static void stream_line_bytes(st, s, n)
+     stream_state *st;
+     const char *s;
+     long n;
+{
+  long i;
+
+  if (! st->in_line)
+    {
+      for (i = 0; (i < n) && (strchr(WHITE_SPACE, s[i]) != NULL); i++)
+        ;
+      if (i == n) /* still only whitespace, keep it until we know */
+        {
+          if (st->lead_n + n > st->lead_alloc)
+            {
+              st->lead_alloc = 2 * (st->lead_n + n);
+              st->lead = (char *) realloc(st->lead, st->lead_alloc);
+              if (st->lead == NULL)
+                {
+                  fprintf(stderr,"No space\n");
+                  exit(EXIT_FAILURE);
+                }
+            }
+          memcpy(st->lead + st->lead_n, s, n);
+          st->lead_n += n;
+          return;
+        }
+      st->in_line = TRUE;
+      stream_append(st, st->lead, st->lead_n);
+      st->lead_n = 0;
+    }
+  stream_append(st, s, n);
+}
+
+/* Function: stream_residues()
+ * Args:     st:        streaming state, st->first is not UNKNOWN
+ *           s:         bytes of a sequence line, without the '\n'
+ *           len:       number of bytes
+ *           line_ends: TRUE if s is the end of the line
+ * Returns:  EF_OK, or the error extracting stopped at.
+ *
+ * Adds the residues to the window like process_fasta_mapped() would
+ * (a line's final '\r' is dropped, blank lines are skipped) and
+ * extracts the intervals that can be.
+ */
+static ef_status stream_residues(st, s, len, line_ends)
+     stream_state *st;
+     const char *s;
+     long len;
+     bool line_ends;
+{
+  interval_record *interval_data = st->ctx->intervals->recordA;
+  ef_status status = EF_OK;
+  int last;
+
+  if (st->cr) /* the '\r' that ended the previous part of this line */
+    {
+      if (! (line_ends && (len == 0)))
+        stream_line_bytes(st, "\r", 1);
+      st->cr = FALSE;
+    }
+  if ((len > 0) && (s[len-1] == '\r'))
+    {
+      st->cr = (! line_ends);
+      len--;
+    }
+  stream_line_bytes(st, s, len);
+  if (line_ends)
+    {
+      st->in_line = FALSE;
+      st->lead_n  = 0;
+    }
+
+  /* intervals are sorted by start, extract those up to the first one
+   * that we haven't read the residue after the end of yet */
+  for (last = st->first;
+       (last < st->last) && (interval_data[last].start != UNKNOWN) && (interval_data[last].end < st->seen);
+       last++)
+    ;
+  if (last > st->first)
+    {
+      status = stream_extract(st, last, FALSE);
+      st->first = (last == st->last) ? UNKNOWN : last; /* skip the rest of the record if we're done */
+    }
+  return status;
+}
+
+/* stream_extract(): extract intervals st->first..last-1 from the window,
+ * at_end is TRUE if the record is complete */
+static ef_status stream_extract(st, last, at_end)
+     stream_state *st;
+     int last;
+     bool at_end;
+{
+  ef_ctx *ctx = st->ctx;
+  ef_status status;
+  fasta_seq seq;
+  long used  = st->win_n - st->win_off;
+  int  nsegs = st->nsegs - st->seg_first;
+  int  i;
+
+  if (st->seen > INT_MAX)
+    return set_error(ctx, EF_ERR_RANGE, "Sequence %s is too long (%ld residues)",
+                     ctx->intervals->recordA[st->first].name, st->seen);
+  seq.length      = (int) st->seen; /* at the end, or more than the end of all of the intervals */
+  seq.nsegs       = nsegs;
+  seq.data        = NULL;
+  seq.packed.dna  = NULL;
+  seq.fai         = NULL;
+  seq.buf         = NULL;
+  seq.buf_alloc   = 0;
+
+  if (ctx->pipeline == NULL)
+    {
+      seq.fasta = st->win;
+      seq.segA  = st->segA + st->seg_first;
+      status = extract_record(ctx, st->first, last, &seq, FALSE);
+    }
+  else if (at_end && (st->win != NULL))
+    {
+      /* the tasks can have the window */
+      if (st->seg_first > 0)
+        memmove(st->segA, st->segA + st->seg_first, nsegs * sizeof(fasta_seg));
+      seq.fasta = st->win;
+      seq.segA  = st->segA;
+      st->win       = NULL;
+      st->win_alloc = 0;
+      st->segA      = NULL;
+      st->seg_alloc = 0;
+      status = extract_record(ctx, st->first, last, &seq, TRUE);
+    }
+  else
+    {
+      /* the tasks get a copy of the window */
+      seq.fasta = (char *) malloc(used + 1);
+      seq.segA  = (fasta_seg *) malloc((nsegs + 1) * sizeof(fasta_seg));
+      if ((seq.fasta == NULL) || (seq.segA == NULL))
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      if (used > 0)
+        memcpy(seq.fasta, st->win + st->win_off, used);
+      for (i = 0; i < nsegs; i++)
+        {
+          seq.segA[i] = st->segA[st->seg_first + i];
+          seq.segA[i].off -= st->win_off;
+        }
+      STAT_ADD(ctx, buffer_grows, 1);
+      STAT_ADD(ctx, bytes_copied, used);
+      status = extract_record(ctx, st->first, last, &seq, TRUE);
+    }
+  return status;
+}
+
+/* stream_end_record(): at the end of a record, extract the intervals
+ * not extracted yet, and get ready for the next record */
+static ef_status stream_end_record(st)
+     stream_state *st;
+{
+  ef_status status = EF_OK;
+
+  if (st->first != UNKNOWN)
+    status = stream_extract(st, st->last, TRUE);
+  st->first     = UNKNOWN;
+  st->seen      = 0;
+  st->nneed     = 0;
+  st->need      = 0;
+  st->win_off   = 0;
+  st->win_n     = 0;
+  st->seg_first = 0;
+  st->nsegs     = 0;
+  st->in_line   = FALSE;
+  st->lead_n    = 0;
+  st->cr        = FALSE;
+  return status;
+}
+
+/* Function: process_fasta_mapped()
+ * Args:     ctx:        context
+ *           filename:   fasta file to read
+ *           ret_mapped: set to FALSE if <filename> is not a regular file
+ *                       that we can map into memory, and nothing has been
+ *                       done; TRUE if it has been processed.
+ * Returns:  EF_OK, or the error that stopped us.
+ *
+ * Like process_fasta(), but the file is mapped into memory and record
+ * and line boundaries are found with memchr(), see map_record(). Records
+ * we don't want are skipped with next_record(), and we stop once every
+ * name in the interval list has been found.
+ */
+static ef_status process_fasta_mapped(ctx, filename, ret_mapped)
+     ef_ctx *ctx;
+     const char *filename;
+     bool *ret_mapped;
+{
+  struct stat st;
+  int    fd;
+  char  *map;         /* the mapped file */
+  char  *p;           /* start of current line */
+  char  *file_end;    /* end of the mapped file */
+  char  *eol;         /* '\n' at end of current line, or NULL */
+  char  *next;        /* start of the next line */
+  char  *header;      /* sequence name in the header line */
+  char  *name = NULL; /* name of current record, '\0'-terminated */
+  long   name_alloc = 0;
+  char  *counted;     /* with stats, bytes before this have been added to fasta_bytes */
+  long   name_len;
+  long   nres;        /* number of residues in current record */
+  int    interval_index, interval_last;
+  ef_status status = EF_OK;
+  fasta_seq seq;
+
+  *ret_mapped = FALSE;
+  fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return EF_OK; /* let process_fasta() report it */
+  if ((fstat(fd, &st) == -1) || (! S_ISREG(st.st_mode)) || (st.st_size == 0))
+    {
+      close(fd);
+      return EF_OK;
+    }
+  map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      close(fd);
+      return EF_OK;
+    }
+  *ret_mapped = TRUE;
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  seq.segA      = NULL;
+  seq.nsegs     = 0;
+  seq.packed.dna = NULL;
+  seq.fai       = NULL;
+  seq.buf       = NULL;
+  seq.buf_alloc = 0;
+
+  file_end = map + st.st_size;
+  p = counted = map;
+  while (p < file_end)
+    {
+      eol  = (char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      if (*p != '>') /* text before the first header line */
+        {
+          p = next;
+          continue;
+        }
+
+      /* header line, get the name */
+      if (ctx->stats != NULL)
+        {
+          STAT_ADD(ctx, fasta_bytes, p - counted);
+          counted = p;
+        }
+      header = seq_name(ctx, p + 1, ((eol == NULL) ? file_end : eol) - (p + 1), &name_len);
+      interval_index = find_index(ctx, copy_name(&name, &name_alloc, header, name_len), &interval_last);
+      if (interval_index == UNKNOWN)
+        {
+          if (ALL_SERVED(ctx)) /* find_index() stopped, see next_group() */
+            break;
+          p = next_record(next, file_end);
+          continue;
+        }
+
+      nres = map_record(next, file_end, &seq, &p);
+      if (nres > INT_MAX)
+        {
+          status = set_error(ctx, EF_ERR_RANGE, "Sequence %s is too long (%ld residues)", name, nres);
+          break;
+        }
+      if (seq.fasta != NULL) /* its lines weren't all the same length, so it was copied */
+        {
+          STAT_ADD(ctx, buffer_grows, 1);
+          STAT_ADD(ctx, bytes_copied, nres);
+        }
+      status = extract_record(ctx, interval_index, interval_last, &seq, (seq.fasta != NULL));
+      if ((status != EF_OK) || ALL_SERVED(ctx)) /* nothing more to extract */
+        break;
+    }
+
+  if (ctx->pipeline != NULL)
+    pipeline_wait(ctx->pipeline); /* tasks are using views into the map */
+  STAT_ADD(ctx, fasta_bytes, ((p < file_end) ? p : file_end) - counted);
+  if (seq.buf != NULL) free(seq.buf);
+  if (name != NULL) free(name);
+  munmap(map, st.st_size);
+  close(fd);
+
+  return status;
+}
+
+/* Function: map_record()
+ * Args:     seq_start: first byte after the header line of a record, in a mapped file
+ *           file_end:  end of the mapped file
+ *           seq:       set to the record's sequence, its buf is not touched
+ *           ret_next:  set to the start of the next header line, or file_end
+ * Returns:  number of residues in the record. If it is more than INT_MAX
+ *           nothing else is set but *ret_next.
+ *
+ * When all lines of the record (except maybe the final one) are the
+ * same length, seq->data is a view into the mapped file and newlines
+ * are only removed from the pieces print_fasta() asks for; otherwise
+ * seq->fasta is a malloc'ed copy of the residues, without newlines.
+ */
+static long map_record(seq_start, file_end, seq, ret_next)
+     char *seq_start;
+     char *file_end;
+     fasta_seq *seq;
+     char **ret_next;
+{
+  char  *p;           /* start of current line */
+  char  *eol;         /* '\n' at end of current line, or NULL */
+  char  *next;        /* start of the next line */
+  long   clen;        /* number of residues on current line */
+  long   nres;        /* number of residues in the record */
+  long   nlines;      /* number of non-blank lines in the record */
+  long   i;
+  bool   uniform;     /* TRUE while all lines of the record are the same length */
+  bool   short_seen;  /* TRUE once a short or blank line has been seen in the record */
+
+  /* read the sequence lines, checking if they are all the same length */
+  p          = seq_start;
+  nres       = 0;
+  nlines     = 0;
+  uniform    = TRUE;
+  short_seen = FALSE;
+  while ((p < file_end) && (*p != '>'))
+    {
+      eol  = (char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      clen = ((eol == NULL) ? file_end : eol) - p;
+      if ((clen > 0) && (p[clen-1] == '\r')) clen--;
+      for (i = 0; (i < clen) && (strchr(WHITE_SPACE, p[i]) != NULL); i++)
+        ;
+      if (i == clen) /* blank line */
+        {
+          if (nlines == 0)
+            uniform = FALSE;
+          short_seen = TRUE;
+        }
+      else
+        {
+          if (short_seen)
+            uniform = FALSE;
+          else if (nlines == 0)
+            {
+              seq->line_bases = clen;
+              seq->line_bytes = next - p;
+            }
+          else if ((clen > seq->line_bases) ||
+                   ((eol != NULL) && (clen == seq->line_bases) && ((next - p) != seq->line_bytes)))
+            uniform = FALSE;
+          else if (clen < seq->line_bases)
+            short_seen = TRUE;
+          nres += clen;
+          nlines++;
+        }
+      p = next;
+    }
+  *ret_next = p;
+
+  if (nres > INT_MAX)
+    return nres;
+  seq->length = (int) nres;
+  if (uniform || (nlines == 0))
+    {
+      seq->fasta = NULL;
+      seq->data  = seq_start;
+      return nres;
+    }
+
+  /* copy the residues of each non-blank line into a buffer */
+  seq->data  = NULL;
+  seq->fasta = (char *) malloc(nres + 1);
+  if (seq->fasta == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  nres = 0;
+  for (p = seq_start; (p < file_end) && (*p != '>'); p = next)
+    {
+      eol  = (char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      clen = ((eol == NULL) ? file_end : eol) - p;
+      if ((clen > 0) && (p[clen-1] == '\r')) clen--;
+      for (i = 0; (i < clen) && (strchr(WHITE_SPACE, p[i]) != NULL); i++)
+        ;
+      if (i < clen)
+        {
+          memcpy(seq->fasta + nres, p, clen);
+          nres += clen;
+        }
+    }
+  seq->fasta[nres] = '\0';
+  return nres;
+}
+
+static ef_status process_fasta_indexed(ctx, filename)
+     ef_ctx *ctx;
+     const char *filename;
+{
+  faidx_t  *fai;
+  fasta_seq seq;
+  int       i, e, interval_index, interval_last;
+  int      *orderA; /* order to visit the entries in, or NULL for file order */
+  ef_status status = EF_OK;
+  char     *name, *name_buf = NULL; /* sequence name, and a '\0'-terminated copy */
+  long      name_len, name_alloc = 0;
+  char     *err;
+
+  fai = faidx_load((char *) filename, &err);
+  if (fai == NULL)
+    return take_error(ctx, EF_ERR_FASTA, err);
+  orderA = name_order(ctx, &(fai->entryA[0].name), sizeof(faidx_entry), fai->nentries, TRUE);
+
+  seq.fasta     = NULL;
+  seq.segA      = NULL;
+  seq.nsegs     = 0;
+  seq.data      = NULL;
+  seq.packed.dna = NULL;
+  seq.fai       = fai;
+  seq.buf       = NULL;
+  seq.buf_alloc = 0;
+
+  /* visit sequences in file order so output order is the same as
+   * when reading through the whole file (in name order if sorted externally) */
+  for (i = 0; (i < fai->nentries) && (! ALL_SERVED(ctx)) && (status == EF_OK); i++)
+    {
+      e = (orderA != NULL) ? orderA[i] : i;
+      name = seq_name(ctx, fai->entryA[e].name, strlen(fai->entryA[e].name), &name_len);
+      interval_index = find_index(ctx, copy_name(&name_buf, &name_alloc, name, name_len), &interval_last);
+      if (interval_index != UNKNOWN)
+        {
+          if (fai->entryA[e].length > INT_MAX)
+            {
+              status = set_error(ctx, EF_ERR_RANGE, "Sequence %s is too long (%ld residues)",
+                                 fai->entryA[e].name, fai->entryA[e].length);
+              break;
+            }
+          seq.e      = e;
+          seq.length = (int) fai->entryA[e].length;
+          status = extract_record(ctx, interval_index, interval_last, &seq, FALSE);
+        }
+    }
+
+  if (ctx->pipeline != NULL)
+    pipeline_wait(ctx->pipeline); /* tasks are reading with fai */
+  if (seq.buf != NULL) free(seq.buf);
+  if (name_buf != NULL) free(name_buf);
+  if (orderA != NULL) free(orderA);
+  faidx_free(fai);
+  return status;
+}
+
+/* Function: process_twobit()
+ * Args:     ctx:      context
+ *           filename: 2-bit cache to read, see twobit.h
+ * Returns:  EF_OK, or the error that stopped us.
+ *
+ * Like process_fasta_indexed(), the cache's index is read and the
+ * sequences visited in file order (or name order, with the intervals
+ * sorted externally); pieces are unpacked by get_residues().
+ */
+static ef_status process_twobit(ctx, filename)
+     ef_ctx *ctx;
+     const char *filename;
+{
+  twobit_t *tb;
+  fasta_seq seq;
+  int       i, e, interval_index, interval_last;
+  int      *orderA; /* order to visit the entries in, or NULL for file order */
+  ef_status status = EF_OK;
+  char     *name, *name_buf = NULL; /* sequence name, and a '\0'-terminated copy */
+  long      name_len, name_alloc = 0;
+  char     *err;
+
+  tb = twobit_open(filename, &err);
+  if (tb == NULL)
+    return take_error(ctx, EF_ERR_FASTA, err);
+  orderA = name_order(ctx, &(tb->entryA[0].name), sizeof(twobit_entry), tb->nentries, TRUE);
+
+  memset(&seq, 0, sizeof(fasta_seq));
+  for (i = 0; (i < tb->nentries) && (! ALL_SERVED(ctx)) && (status == EF_OK); i++)
+    {
+      e = (orderA != NULL) ? orderA[i] : i;
+      name = seq_name(ctx, tb->entryA[e].name, strlen(tb->entryA[e].name), &name_len);
+      interval_index = find_index(ctx, copy_name(&name_buf, &name_alloc, name, name_len), &interval_last);
+      if (interval_index != UNKNOWN)
+        {
+          if ((err = twobit_get(tb, e, &(seq.packed))) != NULL)
+            {
+              status = take_error(ctx, EF_ERR_FASTA, err);
+              break;
+            }
+          if (seq.packed.length > INT_MAX)
+            {
+              status = set_error(ctx, EF_ERR_RANGE, "Sequence %s is too long (%ld residues)",
+                                 tb->entryA[e].name, seq.packed.length);
+              break;
+            }
+          seq.length = (int) seq.packed.length;
+          status = extract_record(ctx, interval_index, interval_last, &seq, FALSE);
+        }
+    }
+
+  if (ctx->pipeline != NULL)
+    pipeline_wait(ctx->pipeline); /* tasks are using the mapped cache */
+  if (seq.buf != NULL) free(seq.buf);
+  if (name_buf != NULL) free(name_buf);
+  if (orderA != NULL) free(orderA);
+
+  twobit_free(tb);
+  return status;
+}
+
+/* compare_ids(): sort ints, for process_reference() */
+static int compare_ids(const void *a, const void *b) {
+  int x = *((const int *) a);
+  int y = *((const int *) b);
+
+  return (x > y) - (x < y);
+}
+
+/* compare_skipped(): bsearch() a name in extsort_missing()'s names */
+static int compare_skipped(const void *name, const void *skipped) {
+  return strcmp((const char *) name, *((const char * const *) skipped));
+}
+
+/* compare_names(): sort name_entrys by name, as strcmp() would, then by entry */
+static int compare_names(const void *a, const void *b) {
+  const name_entry *x = (const name_entry *) a;
+  const name_entry *y = (const name_entry *) b;
+  int value;
+
+  value = memcmp(x->name, y->name, (x->len < y->len) ? x->len : y->len);
+  if (value == 0)
+    value = (x->len > y->len) - (x->len < y->len);
+  if (value == 0)
+    value = (x->e > y->e) - (x->e < y->e);
+  return value;
+}
+
+/* Function: process_reference()
+ * Args:     ctx: context, with a reference open
+ * Returns:  EF_OK, or the error that stopped us.
+ *
+ * Looks up each name in the interval list in the reference, and extracts
+ * from the sequences found in the order they are in the reference file,
+ * so output is the same as when reading through it. With the intervals
+ * sorted externally the names aren't all known, so every sequence of
+ * the reference is looked up instead, in name order.
+ */
+static ef_status process_reference(ctx)
+     ef_ctx *ctx;
+{
+  reference *ref   = ctx->ref;
+  seqhash_t *names = ctx->intervals->names;
+  int       *orderA; /* [0..n-1] reference ids of the names in the interval list */
+  int        n = 0, i, id, interval_index, interval_last;
+  ef_status  status = EF_OK;
+  fasta_seq  seq;
+
+  if ((orderA = name_order(ctx, ref->names->nameA, sizeof(char *), ref->names->nnames, FALSE)) != NULL)
+    n = ref->names->nnames;
+  else
+    {
+      orderA = (int *) malloc((names->nnames + 1) * sizeof(int));
+      if (orderA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      for (i = 0; i < names->nnames; i++)
+        if ((id = seqhash_lookup(ref->names, names->nameA[i])) != -1)
+          orderA[n++] = id;
+      qsort(orderA, n, sizeof(int), compare_ids);
+    }
+
+  seq.buf       = NULL;
+  seq.buf_alloc = 0;
+  for (i = 0; (i < n) && (! ALL_SERVED(ctx)) && (status == EF_OK); i++)
+    {
+      interval_index = find_index(ctx, (char *) ref->names->nameA[orderA[i]], &interval_last);
+      if (interval_index == UNKNOWN) /* only with the intervals sorted externally */
+        continue;
+      if (ref->seqA[orderA[i]].length == -1)
+        {
+          status = set_error(ctx, EF_ERR_RANGE, "Sequence %s is too long", ref->names->nameA[orderA[i]]);
+          break;
+        }
+      /* a copy, with this extraction's buf, the reference itself is read only */
+      seq = ref->seqA[orderA[i]];
+      seq.buf       = NULL;
+      seq.buf_alloc = 0;
+      status = extract_record(ctx, interval_index, interval_last, &seq, FALSE);
+      if (seq.buf != NULL) free(seq.buf);
+    }
+  free(orderA);
+  return status;
+}
+
+/* next_record(): return start of the first header line at or after <p>,
+ * which is at the start of a line, or <end> if there are none */
+static char *next_record(p, end)
+     char *p;
+     char *end;
+{
+  if ((p < end) && (*p == '>'))
+    return(p);
+  /* '>' is rare within records, so memchr() for it rather than "\n>" */
+  while ((p < end) && ((p = (char *) memchr(p, '>', end - p)) != NULL))
+    {
+      if (p[-1] == '\n')
+        return(p);
+      p++;
+    }
+  return(end);
+}
+
+/* drain_input(): read and discard the rest of <fd> if it is a pipe,
+ * so whatever is writing to it doesn't fail when we stop reading early */
+static void drain_input(fd)
+     int fd;
+{
+  struct stat st;
+  char buf[65536];
+
+  if ((fstat(fd, &st) == 0) && (! S_ISREG(st.st_mode)))
+    while (read(fd, buf, sizeof(buf)) > 0)
+      ;
+}
+
+/* find_missing(): list the names in the interval list that no sequence
+ * was found for, in ctx->missingA */
+static void find_missing(ctx)
+     ef_ctx *ctx;
+{
+  seqhash_t *names = ctx->intervals->names;
+  const char **skippedA;
+  int id;
+
+  if (ctx->ext != NULL)
+    {
+      if (ctx->ext_status == EF_OK)
+        while (extsort_name(ctx->ext) != NULL)
+          extsort_skip(ctx->ext);
+      skippedA = extsort_missing(ctx->ext, &(ctx->nmissing));
+      ctx->missingA = (const char **) malloc((ctx->nmissing + 1) * sizeof(char *));
+      if (ctx->missingA == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      memcpy(ctx->missingA, skippedA, ctx->nmissing * sizeof(char *));
+      return;
+    }
+  if (ALL_SERVED(ctx))
+    return;
+
+  ctx->missingA = (const char **) malloc((names->nnames - ctx->nserved) * sizeof(char *));
+  if (ctx->missingA == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  for (id = 0; id < names->nnames; id++)
+    if (! (ctx->servedA[id / BITS_PER_LONG] & (1UL << (id % BITS_PER_LONG))))
+      ctx->missingA[ctx->nmissing++] = names->nameA[id];
+}
+
+/* get_residues(): return pointer to residues start..end (0-based) of <seq>,
+ * only pieces that span more than one line of a mapped file or of what
+ * was read with an index, or that are packed, are copied (and counted,
+ * with stats); NULL if they couldn't be read with an index */
+static char *get_residues(ctx, seq, start, end)
+     ef_ctx *ctx;
+     fasta_seq *seq;
+     int start;
+     int end;
+{
+  char *residues;
+  long  buf_alloc;
+  int   lo, hi, mid;
+
+  if ((seq->fasta != NULL) && (seq->segA == NULL))
+    return(&(seq->fasta[start]));
+
+  if (seq->fasta != NULL)
+    {
+      /* the stretch of the window <start> is in, which has all of the piece */
+      lo = 0;
+      hi = seq->nsegs - 1;
+      while (lo < hi)
+        {
+          mid = (lo + hi + 1) / 2;
+          if (seq->segA[mid].pos <= start)
+            lo = mid;
+          else
+            hi = mid - 1;
+        }
+      return(seq->fasta + seq->segA[lo].off + (start - seq->segA[lo].pos));
+    }
+
+  if (seq->data != NULL)
+    {
+      if ((seq->line_bytes == seq->line_bases) ||
+          ((start / seq->line_bases) == (end / seq->line_bases)))
+        return(seq->data + FAIDX_OFFSET(start, seq->line_bases, seq->line_bytes));
+
+      if (seq->buf_alloc < (end - start + 1))
+        {
+          STAT_ADD(ctx, buffer_grows, 1);
+          seq->buf_alloc = end - start + 1;
+          seq->buf = (char *) realloc(seq->buf, seq->buf_alloc);
+          if (seq->buf == NULL)
+            {
+              fprintf(stderr,"No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      faidx_unwrap(seq->buf, seq->data + FAIDX_OFFSET(start, seq->line_bases, seq->line_bytes),
+                   start, end - start + 1, seq->line_bases, seq->line_bytes);
+      STAT_ADD(ctx, bytes_copied, end - start + 1);
+      return(seq->buf);
+    }
+
+  if (seq->packed.dna != NULL)
+    {
+      if (seq->buf_alloc < (end - start + 1))
+        {
+          STAT_ADD(ctx, buffer_grows, 1);
+          seq->buf_alloc = end - start + 1;
+          seq->buf = (char *) realloc(seq->buf, seq->buf_alloc);
+          if (seq->buf == NULL)
+            {
+              fprintf(stderr,"No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      twobit_unpack(seq->buf, &(seq->packed), start, end - start + 1);
+      STAT_ADD(ctx, bytes_copied, end - start + 1);
+      return(seq->buf);
+    }
+
+  buf_alloc = seq->buf_alloc;
+  residues  = ioplan_get(seq->plan, start, end, &(seq->buf), &(seq->buf_alloc));
+  if (seq->buf_alloc != buf_alloc)
+    STAT_ADD(ctx, buffer_grows, 1);
+  if ((residues != NULL) && (residues == seq->buf))
+    STAT_ADD(ctx, bytes_copied, end - start + 1);
+  return(residues);
+}
+
+/* extract_record(): extract_intervals(), timed and counted with stats;
+ * with threads, only this thread's CPU, the tasks time themselves */
+static ef_status extract_record(ctx, interval_index, last, seq, owns_fasta)
+     ef_ctx *ctx;
+     int interval_index;
+     int last;
+     fasta_seq *seq;
+     bool owns_fasta;
+{
+  ef_status  status;
+  stats_time t;
+  int        index;
+
+  if (ctx->stats == NULL)
+    return extract_intervals(ctx, interval_index, last, seq, owns_fasta);
+
+  stats_start_clock(&t, (ctx->pipeline != NULL) ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID);
+  for (index = interval_index; index < last; index++)
+    if (ctx->intervals->recordA[index].strand == MINUS)
+      ctx->stats->intervals_minus++;
+    else
+      ctx->stats->intervals_plus++;
+  status = extract_intervals(ctx, interval_index, last, seq, owns_fasta);
+  stats_stop(&t, &(ctx->stats->extract_seconds), &(ctx->stats->extract_cpu));
+  return status;
+}
+
+/* Function: extract_intervals()
+ * Args:     ctx:            context
+ *           interval_index: first interval for the sequence, from find_index()
+ *           last:           one past the final interval for the sequence
+ *           seq:            the sequence
+ *           owns_fasta:     TRUE if seq->fasta (and seq->segA) was malloc'ed
+ *                           by the caller, it is ours now, to free or hand
+ *                           over to tasks
+ * Returns:  EF_OK, or the error that stopped us; with threads, the error
+ *           is only known once the pipeline is finished.
+ *
+ * Without threads, prints all intervals for the sequence with print_fasta().
+ * With threads, splits them into tasks of about TASK_RESIDUES residues and
+ * submits them to the pipeline. A copy of <seq> goes with each task, so
+ * whatever seq->data or seq->fai refers to must stay valid until
+ * pipeline_wait() returns.
+ */
+static ef_status extract_intervals(ctx, interval_index, last, seq, owns_fasta)
+     ef_ctx *ctx;
+     int interval_index;
+     int last;
+     fasta_seq *seq;
+     bool owns_fasta;
+{
+  interval_record *interval_data = ctx->intervals->recordA;
+  shared_record *rec;
+  extract_task  *task;
+  int  index, first, p, ntasks;
+  long cost;   /* residues in the current task */
+  int *splitA; /* [0..ntasks] interval index each task starts at */
+  piece *pc;
+  char *err;
+  ef_status status = EF_OK;
+
+  if (ctx->chunked)
+    add_chunk(ctx, interval_data[interval_index].name_id);
+  if (ctx->pipeline == NULL)
+    {
+      err = print_fasta(ctx, interval_index, last, seq, ctx->output, &status);
+      if (owns_fasta)
+        {
+          free(seq->fasta);
+          if (seq->segA != NULL) free(seq->segA);
+        }
+      if (err != NULL)
+        return take_error(ctx, status, err);
+      if (ctx->output->failed)
+        return EF_ERR_IO; /* ef_extract() reports it */
+      return EF_OK;
+    }
+
+  /* split intervals into tasks */
+  splitA = (int *) malloc((last - interval_index + 1) * sizeof(int));
+  rec    = (shared_record *) malloc(sizeof(shared_record));
+  if ((splitA == NULL) || (rec == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  ntasks = 0;
+  cost   = 0;
+  splitA[ntasks++] = interval_index;
+  for (index = interval_index; index < last; index++)
+    {
+      if (cost >= TASK_RESIDUES)
+        {
+          splitA[ntasks++] = index;
+          cost = 0;
+        }
+      pc = ctx->intervals->pieceA + interval_data[index].pieces;
+      if (pc[0].start == UNKNOWN)
+        cost += seq->length;
+      else
+        for (p = 0; p < interval_data[index].npieces; p++)
+          cost += pc[p].end - pc[p].start + 1;
+    }
+  splitA[ntasks] = last;
+
+  rec->fasta  = owns_fasta ? seq->fasta : NULL;
+  rec->segA   = owns_fasta ? seq->segA : NULL;
+  rec->ntasks = ntasks; /* set before any task is submitted, only the writer changes it after */
+  for (first = 0; first < ntasks; first++)
+    {
+      task = (extract_task *) malloc(sizeof(extract_task));
+      if (task == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      task->ctx           = ctx;
+      task->rec           = rec;
+      task->seq           = *seq;
+      task->seq.buf       = NULL;
+      task->seq.buf_alloc = 0;
+      task->first         = splitA[first];
+      task->last          = splitA[first+1];
+      task->status        = EF_OK;
+      /* after a failure, tasks still go in (and aren't run) so rec is freed */
+      if (pipeline_submit(ctx->pipeline, task) != 0)
+        status = EF_ERR_IO; /* ef_extract() reports what it was */
+    }
+  free(splitA);
+
+  return status;
+}
+
+/* run_task(): pipeline_run_fn for extract_tasks; with stats, adds the
+ * time it takes to ctx->task_ns and task_cpu_ns, for process_file() */
+static char *run_task(arg, out)
+     void *arg;
+     seqout_t *out;
+{
+  extract_task *task = (extract_task *) arg;
+  ef_ctx *ctx = task->ctx;
+  stats_time t;
+  double seconds = 0, cpu = 0;
+  char *err;
+
+  if (ctx->stats == NULL)
+    return(print_fasta(ctx, task->first, task->last, &(task->seq), out, &(task->status)));
+
+  stats_start_clock(&t, CLOCK_THREAD_CPUTIME_ID);
+  err = print_fasta(ctx, task->first, task->last, &(task->seq), out, &(task->status));
+  stats_stop(&t, &seconds, &cpu);
+  __sync_fetch_and_add(&(ctx->task_ns), (long) (seconds * 1e9));
+  __sync_fetch_and_add(&(ctx->task_cpu_ns), (long) (cpu * 1e9));
+  return(err);
+}
+
+/* done_task(): pipeline_done_fn for extract_tasks, only called by the writer thread */
+static void done_task(arg)
+     void *arg;
+{
+  extract_task *task = (extract_task *) arg;
+
+  stats_progress(task->ctx);
+  if ((task->status != EF_OK) && (task->ctx->task_status == EF_OK))
+    task->ctx->task_status = task->status;
+  if (--(task->rec->ntasks) == 0)
+    {
+      if (task->rec->fasta != NULL) free(task->rec->fasta);
+      if (task->rec->segA != NULL) free(task->rec->segA);
+      free(task->rec);
+    }
+  if (task->seq.buf != NULL) free(task->seq.buf);
+  free(task);
+}
+
+/* Function: print_fasta()
+ * Args:     ctx:        context
+ *           first:      first interval to print
+ *           last:       one past the final interval to print, all intervals
+ *                       first..last-1 are for the same sequence
+ *           seq:        the sequence
+ *           out:        where to print
+ *           ret_status: set to the error's status, if there is one
+ * Returns:  NULL on success, or a malloc'ed error message.
+ *
+ * With an index, pieces are read in batches by plan_reads(), as the
+ * intervals are printed by print_intervals(). With more than one
+ * interval, pieces and intervals that come up again are taken from a
+ * memo (see memo.h) instead of being copied and formatted again.
+ * With a genetic code, the pieces of each interval are translated (see
+ * translate.h) as they are printed, instead of being output as they are.
+ */
+static char *print_fasta(ctx, first, last, seq, out, ret_status)
+     ef_ctx *ctx;
+     int first;
+     int last;
+     fasta_seq *seq;
+     seqout_t *out;
+     ef_status *ret_status;
+{
+  char *err;
+
+  seq->plan = (seq->fai != NULL) ? ioplan_create(seq->fai, seq->e, ctx->read_gap) : NULL;
+  seq->memo = (last - first > 1) ? memo_create(last - first) : NULL;
+  seq->tr   = (ctx->code_table != NULL) ? translator_create(ctx->code_table) : NULL;
+  err = print_intervals(ctx, first, last, seq, out, ret_status);
+  ioplan_free(seq->plan);
+  memo_free(seq->memo);
+  translator_free(seq->tr);
+  seq->plan = NULL;
+  seq->memo = NULL;
+  seq->tr   = NULL;
+  return(err);
+}
+
+/* Function: plan_reads()
+ * Args:     ctx:   context
+ *           first: first interval to read the pieces of
+ *           last:  one past the final interval of the sequence
+ *           seq:   the sequence, read with an index
+ * Returns:  one past the final interval whose pieces were read.
+ *
+ * Reads the pieces of intervals <first>.. with seq->plan, stopping after
+ * the interval that takes them to IOPLAN_MAX_BYTES. Pieces of an interval
+ * past the end of the sequence aren't read, print_intervals() reports it.
+ */
+static int plan_reads(ctx, first, last, seq)
+     ef_ctx *ctx;
+     int first;
+     int last;
+     fasta_seq *seq;
+{
+  interval_record *interval_data = ctx->intervals->recordA;
+  int   index, p;
+  bool  full = FALSE; /* TRUE once the plan has IOPLAN_MAX_BYTES */
+  piece *pc;
+  long  buf_alloc = seq->plan->buf_alloc;
+
+  ioplan_clear(seq->plan);
+  for (index = first; (index < last) && (! full); index++)
+    {
+      pc = ctx->intervals->pieceA + interval_data[index].pieces;
+      if (pc[0].start == UNKNOWN)
+        full = ioplan_add(seq->plan, 0, seq->length - 1);
+      else if (interval_data[index].end <= seq->length)
+        for (p = 0; p < interval_data[index].npieces; p++)
+          if (ioplan_add(seq->plan, pc[p].start - 1, pc[p].end - 1))
+            full = TRUE;
+    }
+  ioplan_read(seq->plan);
+  if (ctx->stats != NULL)
+    {
+      for (p = 0; p < seq->plan->nranges; p++)
+        STAT_ADD(ctx, fasta_bytes, seq->plan->rangeA[p].nread);
+      if (seq->plan->buf_alloc != buf_alloc)
+        STAT_ADD(ctx, buffer_grows, 1);
+    }
+  return index;
+}
+
+/* interval_hash(): hash of the strand and pieces of interval <index>, for seq->memo */
+static uint64_t interval_hash(ctx, index)
+     ef_ctx *ctx;
+     int index;
+{
+  interval_record *rec = &(ctx->intervals->recordA[index]);
+  piece   *pc = ctx->intervals->pieceA + rec->pieces;
+  uint64_t hash;
+  int      p;
+
+  hash = memo_hash(0, rec->strand);
+  for (p = 0; p < rec->npieces; p++)
+    hash = memo_hash(memo_hash(hash, pc[p].start), pc[p].end);
+  return hash;
+}
+
+/* same_pieces(): TRUE if intervals <i1> and <i2> have the same strand and pieces */
+static bool same_pieces(ctx, i1, i2)
+     ef_ctx *ctx;
+     int i1;
+     int i2;
+{
+  interval_record *r1 = &(ctx->intervals->recordA[i1]);
+  interval_record *r2 = &(ctx->intervals->recordA[i2]);
+
+  return((r1->strand == r2->strand) && (r1->npieces == r2->npieces) &&
+         (memcmp(ctx->intervals->pieceA + r1->pieces, ctx->intervals->pieceA + r2->pieces,
+                 r1->npieces * sizeof(piece)) == 0));
+}
+
+/* residues_copied(): TRUE if get_residues() copies residues start..end of <seq>,
+ * so it is worth keeping them in seq->memo */
+static bool residues_copied(seq, start, end)
+     fasta_seq *seq;
+     int start;
+     int end;
+{
+  int line_bases, line_bytes;
+
+  if (seq->fasta != NULL)
+    return FALSE;
+  if (seq->packed.dna != NULL)
+    return TRUE;
+  line_bases = (seq->data != NULL) ? seq->line_bases : seq->fai->entryA[seq->e].line_bases;
+  line_bytes = (seq->data != NULL) ? seq->line_bytes : seq->fai->entryA[seq->e].line_bytes;
+  return((line_bytes != line_bases) && ((start / line_bases) != (end / line_bases)));
+}
+
+/* print_intervals(): print_fasta() once its plan, memo and translator are set up */
+static char *print_intervals(ctx, first, last, seq, out, ret_status)
+     ef_ctx *ctx;
+     int first;
+     int last;
+     fasta_seq *seq;
+     seqout_t *out;
+     ef_status *ret_status;
+{
+  interval_record *interval_data = ctx->intervals->recordA;
+  int index, strand, interval_length;
+  long count; /* number of residues output for current interval */
+  int np;     /* number of pieces for current interval */
+  int p;      /* counter over pieces */
+  int pp;     /* p prime, allows us to reverse traversal order over p for negative strand */
+  int start;  /* start for current piece */
+  int end;    /* end for current piece */
+  piece *pc;    /* pieces of current interval */
+  piece whole;  /* the full sequence, for '<defline_token>' only intervals */
+  const char *residues; /* residues start..end of current piece */
+  const char *protein;  /* with a genetic code, amino acids of the codons finished in current piece */
+  long nprotein;
+  long nres;            /* with binary records, number of residues in the current interval */
+  int planned = first; /* with an index, one past the final interval whose pieces have been read */
+  uint64_t hash = 0;   /* with a memo, of the current interval */
+  long from = 0;       /* with a memo, output position of the current interval's sequence lines */
+  memo_interval *done; /* with a memo, an earlier interval with the same hash */
+
+  *ret_status = EF_ERR_RANGE;
+  if (seq->length == 0)
+    return(error_message("No sequence for %s\n", interval_data[first].name));
+
+  interval_length = seq->length;
+  for (index = first; index < last; index++)
+    {
+      if (ctx->pipeline == NULL)
+        stats_progress(ctx); /* else done_task() calls it */
+      np      = interval_data[index].npieces;
+      strand  = interval_data[index].strand;
+      pc      = ctx->intervals->pieceA + interval_data[index].pieces;
+      if ((seq->plan != NULL) && (index == planned))
+        planned = plan_reads(ctx, index, last, seq);
+
+      if (pc[0].start == UNKNOWN)
+        {
+          /* two sanity checks */
+          if(np != 1)
+            return(error_message("Problem parsing intervals, start set as unknown for multipiece interval (%s)\n", interval_data[index].name));
+          if(pc[0].end != UNKNOWN)
+            return(error_message("Problem parsing intervals, start set as unknown, but end is not: (%s)\n", interval_data[index].name));
+
+          whole.start = 1;
+          whole.end   = interval_length;
+          pc          = &whole;
+        }
+      else if (interval_data[index].end > interval_length)
+        return(error_message("End position exceeds sequence length (%d > %d) for sequence %s\n", interval_data[index].end, interval_length, interval_data[index].name));
+
+      /* output defline; a binary record's header and sequence are preceded by their lengths */
+      if (ctx->binary)
+        seqout_uint(out, defline_length(&interval_data[index], pc, np, interval_length), 4);
+      else
+        seqout_putc(out, '>');
+      seqout_puts(out, interval_data[index].name);
+      seqout_putc(out, ':');
+      for(p = 0; p < np; p++) {
+        if(pc[p].start == 1) seqout_putc(out, '<');
+        seqout_int(out, pc[p].start);
+        seqout_putc(out, '_');
+        if(pc[p].end == interval_length) seqout_putc(out, '>');
+        seqout_int(out, pc[p].end);
+        seqout_putc(out, ':');
+      }
+      seqout_putc(out, (strand == PLUS) ? '+' : '-');
+      if(interval_data[index].opttok != NULL) {
+        seqout_putc(out, ':');
+        seqout_puts(out, interval_data[index].opttok);
+      }
+      if (ctx->binary)
+        {
+          for (nres = 0, p = 0; p < np; p++)
+            nres += pc[p].end - pc[p].start + 1;
+          seqout_uint(out, (seq->tr != NULL) ? nres / 3 : nres, 8);
+        }
+      else
+        seqout_putc(out, '\n');
+
+      /* the same strand and pieces as an earlier interval: repeat its sequence lines */
+      if ((seq->memo != NULL) && seq->memo->use_intervals)
+        {
+          hash = interval_hash(ctx, index);
+          done = memo_get_interval(seq->memo, hash);
+          if ((done != NULL) && same_pieces(ctx, done->index, index) &&
+              (seqout_repeat(out, done->from, done->len) == 0))
+            continue;
+          from = seqout_tell(out);
+        }
+
+      count = 0;
+      if (seq->tr != NULL)
+        translator_start(seq->tr);
+      for(p = 0; p < np; p++) { /* for each piece... */
+        /* if we're on the opposite strand, we need to do this in the reverse order */
+        pp = (strand == PLUS) ? p : (np - 1) - p;
+
+        /* Make input based on offset 0 */
+        start = pc[pp].start - 1;
+        end   = pc[pp].end - 1;
+        if ((seq->memo != NULL) && seq->memo->use_pieces && residues_copied(seq, start, end))
+          {
+            residues = memo_get_piece(seq->memo, start, end);
+            if ((residues == NULL) && ((residues = get_residues(ctx, seq, start, end)) != NULL))
+              memo_add_piece(seq->memo, start, end, residues);
+          }
+        else
+          residues = get_residues(ctx, seq, start, end);
+        if (residues == NULL)
+          {
+            *ret_status = EF_ERR_IO;
+            return(error_message("Error reading sequence %s from %s (index out of date?)\n",
+                                 seq->fai->entryA[seq->e].name, seq->fai->fa_file));
+          }
+
+        if (seq->tr != NULL)
+          {
+            protein = translator_add(seq->tr, residues, end - start + 1, (strand != PLUS), &nprotein);
+            seqout_residues(out, protein, nprotein, &count);
+          }
+        else if (strand == PLUS)
+          seqout_residues(out, residues, end - start + 1, &count);
+        else
+          seqout_revcomp(out, residues, end - start + 1, &count);
+      } /* end of 'for(p = 0; p < np; p++)' */
+      if (! ctx->binary)
+        seqout_end_record(out, count);
+      if ((seq->memo != NULL) && seq->memo->use_intervals)
+        memo_add_interval(seq->memo, hash, index, from, seqout_tell(out) - from);
+    }
+  *ret_status = EF_OK;
+  return(NULL);
+}
+
+/* defline_length(): number of bytes in the defline print_intervals() writes
+ * for <rec>, whose pieces are <pc>, without the '>' and newline */
+static long defline_length(rec, pc, np, interval_length)
+     interval_record *rec;
+     piece *pc;
+     int np;
+     int interval_length;
+{
+  long len;
+  int  p;
+
+  len = strlen(rec->name) + 2; /* ':' after the name, and the strand */
+  for (p = 0; p < np; p++)
+    len += ndigits(pc[p].start) + ndigits(pc[p].end) + 2 +
+      (pc[p].start == 1) + (pc[p].end == interval_length);
+  if (rec->opttok != NULL)
+    len += strlen(rec->opttok) + 1;
+  return len;
+}
+
+/* ndigits(): number of characters seqout_int() writes for <value> */
+static int ndigits(value)
+     long value;
+{
+  int n = (value < 0) ? 2 : 1;
+
+  while ((value /= 10) != 0)
+    n++;
+  return n;
+}
+
+/* write_buffer(): ef_write_fn for ef_extract_buffer(), copies what fits */
+static int write_buffer(void *arg, const char *s, long len) {
+  output_buffer *ob = (output_buffer *) arg;
+  long           n  = len;
+
+  if (ob->n + n > ob->size)
+    n = (ob->n < ob->size) ? ob->size - ob->n : 0;
+  if (n > 0)
+    memcpy(ob->buf + ob->n, s, n);
+  ob->n += len;
+  return 0;
+}
+
+/* release_reference(): free a reference no context uses */
+static void release_reference(reference *ref) {
+  int id;
+
+  if (ref->map != NULL)
+    munmap(ref->map, ref->map_size);
+  if (ref->seqA != NULL)
+    for (id = 0; id < ref->names->nnames; id++)
+      free(ref->seqA[id].fasta);
+  free(ref->seqA);
+  seqhash_free(ref->names);
+  arena_free(ref->strings);
+  faidx_free(ref->fai);
+  twobit_free(ref->tb);
+  free(ref);
+}
+
+/* stats_wall(): seconds of CLOCK_MONOTONIC, cheaper to get than CPU time */
+static double stats_wall(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* stats_start(): set <t> to now */
+static void stats_start(stats_time *t) {
+  stats_start_clock(t, CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/* stats_start_clock(): set <t> to now, its CPU by <clock> */
+static void stats_start_clock(stats_time *t, clockid_t clock) {
+  struct timespec ts;
+
+  t->wall  = stats_wall();
+  t->clock = clock;
+  clock_gettime(clock, &ts);
+  t->cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* stats_stop(): add the wall and CPU time since stats_start(<t>) to
+ * *<seconds> and *<cpu> */
+static void stats_stop(stats_time *t, double *seconds, double *cpu) {
+  stats_time now;
+
+  stats_start_clock(&now, t->clock);
+  *seconds += now.wall - t->wall;
+  *cpu     += now.cpu - t->cpu;
+}
+
+/* stats_add(): add the counts and times of <from> to <to>; worker
+ * threads may still be adding to <from>'s counts */
+static void stats_add(ef_stats *to, const ef_stats *from) {
+  to->read_seconds    += from->read_seconds;
+  to->read_cpu        += from->read_cpu;
+  to->sort_seconds    += from->sort_seconds;
+  to->sort_cpu        += from->sort_cpu;
+  to->scan_seconds    += from->scan_seconds;
+  to->scan_cpu        += from->scan_cpu;
+  to->extract_seconds += from->extract_seconds;
+  to->extract_cpu     += from->extract_cpu;
+  to->interval_bytes  += __atomic_load_n(&(from->interval_bytes), __ATOMIC_RELAXED);
+  to->fasta_bytes     += __atomic_load_n(&(from->fasta_bytes), __ATOMIC_RELAXED);
+  to->bytes_written   += __atomic_load_n(&(from->bytes_written), __ATOMIC_RELAXED);
+  to->records_seen    += __atomic_load_n(&(from->records_seen), __ATOMIC_RELAXED);
+  to->records_matched += __atomic_load_n(&(from->records_matched), __ATOMIC_RELAXED);
+  to->intervals_plus  += __atomic_load_n(&(from->intervals_plus), __ATOMIC_RELAXED);
+  to->intervals_minus += __atomic_load_n(&(from->intervals_minus), __ATOMIC_RELAXED);
+  to->buffer_grows    += __atomic_load_n(&(from->buffer_grows), __ATOMIC_RELAXED);
+  to->bytes_copied    += __atomic_load_n(&(from->bytes_copied), __ATOMIC_RELAXED);
+}
+
+/* stats_progress(): call the progress function, if there is one and it is due;
+ * with threads both the reading and the writing thread call it, whoever
+ * gets progress_busy first goes, the other one skips this time */
+static void stats_progress(ef_ctx *ctx) {
+  ef_stats stats;
+  double   now;
+
+  if ((ctx->progress == NULL) || (! __sync_bool_compare_and_swap(&(ctx->progress_busy), 0, 1)))
+    return;
+  if ((now = stats_wall()) >= ctx->progress_next)
+    {
+      ctx->progress_next = now + ctx->progress_every;
+      ef_get_stats(ctx, &stats);
+      ctx->progress(ctx->progress_arg, &stats);
+    }
+  __sync_lock_release(&(ctx->progress_busy));
+}
+
+/* error_message(): return a malloc'ed, printf-formatted error message */
+static char *error_message(const char *fmt, ...)
+{
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return(msg);
+}
+
+/* set_error(): record a printf-formatted message for an error, returns <status> */
+static ef_status set_error(ef_ctx *ctx, ef_status status, const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return take_error(ctx, status, msg);
+}
+
+/* take_error(): record the malloc'ed message <msg> for an error, without
+ * its final newline if it has one; returns <status> */
+static ef_status take_error(ef_ctx *ctx, ef_status status, char *msg) {
+  size_t len = strlen(msg);
+
+  if ((len > 0) && (msg[len-1] == '\n'))
+    msg[len-1] = '\0';
+  free(ctx->err);
+  ctx->err = msg;
+  return status;
+}
+
+/* EPN added functions
+ * Tue Mar  3 09:59:25 2015
+ */
+
+void ef_dump_intervals(ef_ctx *ctx) {
+  interval_record *interval_data = ctx->intervals->recordA;
+  piece *pieceA = ctx->intervals->pieceA;
+  int i, p;
+
+  for(i = 0; i < ctx->intervals->nrecords; i++) {
+    printf("interval_data[%d]: %s %d pieces (%d..%d) strand: %d\n", i+1, interval_data[i].name, interval_data[i].npieces, interval_data[i].start, interval_data[i].end, interval_data[i].strand);
+    for(p = 0; p < interval_data[i].npieces; p++) {
+      printf("\tpiece %d: %d..%d\n", p+1, pieceA[interval_data[i].pieces + p].start, pieceA[interval_data[i].pieces + p].end);
+    }
+    printf("\n");
+  }
+}
@@ -0,0 +1,170 @@
+/* extractfasta.h:
+ *
+ * libextractfasta, the extraction done by extract_fasta_multi_exon as
+ * a library, for programs that extract many times and don't want to
+ * start a process and write a temporary interval file each time.
+ *
+ * Everything is kept in an opaque context: the settings, the interval
+ * list (in the format described in extract_fasta_multi_exon.c, read
+ * from a file or added from memory), the message for the last error
+ * and, optionally, a reference FASTA file kept open (mapped into
+ * memory and scanned once, read through its .fai index, or a 2-bit
+ * cache built with ef_build_cache()) for as long as the context lives:
+ *
+ *   ef_ctx *ctx = ef_create();
+ *   ef_open_reference(ctx, "genome.fa");
+ *   ...
+ *   ef_add_intervals(ctx, "chr1 1 100 200 +\n", 17, "request");
+ *   if (ef_extract(ctx, NULL, write_fn, arg) != EF_OK)
+ *     fprintf(stderr, "%s\n", ef_error(ctx));
+ *   ef_clear_intervals(ctx);
+ *   ...
+ *   ef_free(ctx);
+ *
+ * FASTA files may be gzip compressed; BGZF ones (bgzip's) are inflated
+ * by several threads, and can be indexed, see bgzf.h.
+ *
+ * ef_extract_files() extracts from several files (the shards of a
+ * genome, say) at once, a file per thread.
+ *
+ * An interval list too big for memory can be sorted externally, see
+ * ef_set_sort_memory(): it is kept in sorted runs in temporary files,
+ * and merged one name at a time as the sequences come, so the sequences
+ * wanted must then be in name order in a fasta file read through (an
+ * index, a 2-bit cache or a reference is visited in name order).
+ *
+ * With ef_set_stats(), a context counts what it reads, copies and
+ * writes, and times each phase, see ef_stats; without, the only cost
+ * is a test of a NULL pointer here and there.
+ *
+ * With ef_set_format(ctx, EF_FORMAT_BINARY) each extracted sequence is
+ * written as a binary record instead, for programs that map the output
+ * into memory and index straight into it:
+ *
+ *   4 bytes  n, the length of the header
+ *   n bytes  the header, what FASTA output has after the '>'
+ *   8 bytes  m, the length of the sequence
+ *   m bytes  the sequence, on one line with no newline
+ *
+ * with the lengths unsigned and little-endian, and no padding between
+ * fields or records (so outputs can be put together with cat). With
+ * ef_set_output_index(), a samtools-compatible .fai of the output
+ * (FASTA or binary, see faidx.h) is written along with it.
+ *
+ * Output is exactly what extract_fasta_multi_exon writes. Functions
+ * return EF_OK or an error code, and ef_error() describes the error;
+ * the only errors that still end the program are running out of
+ * memory or failing to start a thread.
+ *
+ * A context must only be used by one thread at a time. Contexts that
+ * share a reference with ef_share_reference() can be used at the same
+ * time by different threads.
+ *
+ * To build, see build.sh, which also makes libextractfasta.a.
+ */
+
+#ifndef EXTRACTFASTA_H
+#define EXTRACTFASTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  EF_OK = 0,
+  EF_ERR_IO,       /* a file can't be opened, read or written, or the write function failed */
+  EF_ERR_INTERVAL, /* a bad line in the interval list */
+  EF_ERR_FASTA,    /* a .fai index or 2-bit cache that can't be built, read or used */
+  EF_ERR_RANGE,    /* an interval doesn't fit in its sequence, or a sequence is too long */
+  EF_ERR_NOSPACE,  /* the caller's buffer is too small for the output */
+  EF_ERR_USAGE     /* a bad argument */
+} ef_status;
+
+typedef struct ef_ctx_s ef_ctx;
+
+/* for ef_set_id_field(): name sequences by the header field id_fasta.pl takes */
+#define EF_ID_FASTA (-1)
+
+/* for ef_set_format() */
+#define EF_FORMAT_FASTA  0
+#define EF_FORMAT_BINARY 1
+
+/* writes <len> bytes of output, returns 0 on success, anything else
+ * stops the extraction with EF_ERR_IO */
+typedef int (*ef_write_fn)(void *arg, const char *buf, long len);
+
+/* what a context has done since ef_set_stats(), see ef_get_stats().
+ * Times are wall and CPU seconds, CPU of the whole process (all of its
+ * threads) while in the phase. With ef_set_threads(), the extracting
+ * done by worker threads while the fasta file is scanned is timed in
+ * each of them (wall and that thread's CPU) and summed into the extract
+ * phase. With ef_extract_files(), the scan and extract phases of the
+ * files are summed over their threads. */
+typedef struct {
+  double read_seconds;     /* reading and parsing interval lists */
+  double read_cpu;
+  double sort_seconds;     /* grouping and sorting the intervals by name, before an extraction */
+  double sort_cpu;
+  double scan_seconds;     /* reading fasta files and finding the records wanted */
+  double scan_cpu;
+  double extract_seconds;  /* extracting and writing the intervals of the records found */
+  double extract_cpu;
+  long   interval_bytes;   /* bytes of interval lists parsed */
+  long   fasta_bytes;      /* bytes of fasta files read (uncompressed), or looked through if mapped */
+  long   bytes_written;    /* bytes of output */
+  long   records_seen;     /* records of fasta files (or of an index, cache or reference) looked at */
+  long   records_matched;  /* records with intervals to extract */
+  long   intervals_plus;   /* intervals extracted on the + strand */
+  long   intervals_minus;  /* intervals extracted on the - strand */
+  long   buffer_grows;     /* times a sequence buffer was allocated or made larger */
+  long   bytes_copied;     /* bytes of sequence copied into buffers (unwrapped, unpacked or moved) */
+  long   peak_rss_kb;      /* peak resident memory of the process, when ef_get_stats() is called */
+} ef_stats;
+
+/* called every so often during an extraction, see ef_set_progress() */
+typedef void (*ef_progress_fn)(void *arg, const ef_stats *stats);
+
+ef_ctx     *ef_create(void);
+void        ef_free(ef_ctx *ctx);
+const char *ef_error(ef_ctx *ctx);
+
+ef_status   ef_set_width(ef_ctx *ctx, int width);
+ef_status   ef_set_threads(ef_ctx *ctx, int nthreads);
+void        ef_set_index(ef_ctx *ctx, int use_index);
+ef_status   ef_set_read_gap(ef_ctx *ctx, long gap);
+ef_status   ef_set_id_field(ef_ctx *ctx, int field);
+ef_status   ef_set_genetic_code(ef_ctx *ctx, int code);
+void        ef_set_unordered(ef_ctx *ctx, int unordered);
+ef_status   ef_set_format(ef_ctx *ctx, int format);
+void        ef_set_output_index(ef_ctx *ctx, const char *fai_file);
+ef_status   ef_set_sort_memory(ef_ctx *ctx, long bytes, const char *tmpdir);
+void        ef_set_stats(ef_ctx *ctx, int on);
+ef_status   ef_set_progress(ef_ctx *ctx, double seconds, ef_progress_fn fn, void *arg);
+void        ef_get_stats(ef_ctx *ctx, ef_stats *stats);
+
+ef_status   ef_add_intervals(ef_ctx *ctx, const char *text, long len, const char *source);
+ef_status   ef_read_intervals(ef_ctx *ctx, const char *filename);
+int         ef_interval_count(ef_ctx *ctx);
+void        ef_clear_intervals(ef_ctx *ctx);
+
+ef_status   ef_open_reference(ef_ctx *ctx, const char *fa_file);
+ef_status   ef_share_reference(ef_ctx *ctx, ef_ctx *from);
+void        ef_close_reference(ef_ctx *ctx);
+
+ef_status   ef_extract(ef_ctx *ctx, const char *fa_file, ef_write_fn write, void *arg);
+ef_status   ef_extract_buffer(ef_ctx *ctx, const char *fa_file, char *buf, long size, long *ret_len);
+ef_status   ef_extract_files(ef_ctx *ctx, const char **fa_fileA, int nfiles, ef_write_fn write, void *arg);
+int         ef_nmissing(ef_ctx *ctx);
+const char *ef_missing_name(ef_ctx *ctx, int i);
+
+ef_status   ef_build_index(ef_ctx *ctx, const char *fa_file);
+ef_status   ef_build_cache(ef_ctx *ctx, const char *fa_file, const char *cache_file);
+
+/* for debugging only */
+void        ef_dump_intervals(ef_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXTRACTFASTA_H */
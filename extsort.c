@@ -0,0 +1,859 @@
+/* extsort.c:
+ *
+ * External sort of an interval list, see extsort.h.
+ *
+ * A run file is its records one after another, each a run_head then
+ * the name, the optional token and the pieces; it is only ever read
+ * back by this process, so the fields are written as they are in memory.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "extsort.h"
+
+#define RUN_IOBUF (64 * 1024) /* buffer a run is written through */
+
+typedef struct {
+  int name_len;
+  int opt_len;   /* length of the optional token, -1 if there is none */
+  int strand;
+  int npieces;
+} run_head;
+
+/* what a run is sorted by: ranks of the names, so names are compared once */
+typedef struct {
+  int rank;   /* of the name, in strcmp() order */
+  int start;
+  int end;
+  int strand;
+  int index;  /* of the record, the line order */
+} sort_key;
+
+typedef struct {
+  const char *name;
+  int         id;
+} name_rank;
+
+typedef struct {
+  int            fd;        /* the temporary file, already unlinked, or -1 for a run kept in memory */
+  interval_list *list;      /* while it is sorted and written, or kept in memory: its intervals, else NULL */
+  sort_key      *keyA;      /* if kept in memory: [0..list->nrecords-1] its records in sorted order */
+  int            next;      /* if kept in memory: index in keyA of its next record to merge */
+  pthread_t      thread;
+  int            writing;   /* TRUE until its writing thread has been joined */
+  char          *err;       /* set if it couldn't be written */
+  int            merging;   /* TRUE while it is merged and has records left */
+  FILE          *in;        /* while it is merged, unless kept in memory: reads it, else NULL */
+  run_head       head;      /* while it is merged: its next record */
+  char          *name;
+  long           name_alloc;
+  char          *opt;
+  long           opt_alloc;
+  piece         *pc;
+  long           pc_alloc;
+} run_t;
+
+struct extsort_s {
+  long           run_budget; /* number of bytes each run may take */
+  long           block;      /* number of bytes of lines parsed at a time */
+  int            nthreads;
+  char          *tmpdir;
+  interval_list *list;       /* the run being parsed, or NULL */
+  run_t        **runA;       /* [0..nruns-1] in the order they were parsed */
+  int            nruns;
+  int            run_alloc;
+  int            nwriting;   /* number of runs being written */
+  long           nrecords;   /* number of records in runA */
+  long           nbytes;     /* number of bytes of lines parsed */
+  int           *heapA;      /* [0..nheap-1] runs being merged, by their next record */
+  int            nheap;
+  char          *group;      /* name of the group being read */
+  long           group_alloc;
+  arena_t       *missing;    /* names skipped since extsort_start() */
+  const char   **missingA;
+  int            nmissing;
+  long           missing_alloc;
+  char          *err;        /* first error reading a run, or NULL */
+};
+
+static char *add_block(extsort_t *es, const char *text, long len, const char *filename, int *ret_io);
+static long  run_size(interval_list *list);
+static char *spill(extsort_t *es);
+static void  keep_run(extsort_t *es);
+static void  unkeep_run(extsort_t *es);
+static run_t *new_run(extsort_t *es, char **ret_err);
+static sort_key *sort_run(interval_list *list);
+static void  set_head(run_head *head, interval_record *rec);
+static void *write_run(void *arg);
+static int   write_record(FILE *fp, run_head *head, const char *name, const char *opt, const piece *pc);
+static int   compare_names(const void *a, const void *b);
+static int   compare_keys(const void *a, const void *b);
+static char *join_runs(extsort_t *es, int all);
+static char *merge_pass(extsort_t *es);
+static char *merge_runs(extsort_t *es, int first, int n, run_t **ret_run);
+static void  open_merge(extsort_t *es, int first, int n);
+static void  close_merge(extsort_t *es);
+static void  read_record(extsort_t *es, run_t *run);
+static void  copy_record(run_t *run);
+static void  fit_record(run_t *run);
+static void  advance(extsort_t *es);
+static int   run_less(extsort_t *es, int a, int b);
+static void  free_run(run_t *run);
+static void *xrealloc(void *ptr, long size);
+static char *sort_error(const char *fmt, ...);
+
+/* Function: extsort_create()
+ * Args:     budget:   number of bytes of memory for the runs
+ *           nthreads: number of runs to sort at once
+ *           tmpdir:   directory for the temporary files, NULL for $TMPDIR or /tmp
+ * Returns:  new external sort with no lines, free with extsort_free()
+ */
+extsort_t *extsort_create(long budget, int nthreads, const char *tmpdir) {
+  extsort_t *es;
+
+  if (budget < EXTSORT_MIN_BUDGET)
+    budget = EXTSORT_MIN_BUDGET;
+  if (tmpdir == NULL)
+    tmpdir = (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+  es = (extsort_t *) calloc(1, sizeof(extsort_t));
+  if ((es == NULL) || ((es->tmpdir = strdup(tmpdir)) == NULL))
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  es->nthreads   = (nthreads < 1) ? 1 : nthreads;
+  es->run_budget = budget / (es->nthreads + 1);
+  es->block      = es->run_budget / 4;
+  if (es->block > (16 << 20))
+    es->block = 16 << 20;
+  es->missing    = arena_create();
+  return es;
+}
+
+/* Function: extsort_add()
+ * Args:     es:       external sort
+ *           text:     interval lines, the final one needn't end in a newline
+ *           len:      number of bytes in <text>
+ *           filename: name of the source of <text>, for error messages
+ *           ret_io:   RETURN: TRUE if the error is that a run can't be
+ *                     written, FALSE for a bad line
+ * Returns:  NULL on success, or a malloc'ed error message for the first
+ *           bad line, as intervals_add(), or if a run can't be written.
+ */
+char *extsort_add(extsort_t *es, const char *text, long len, const char *filename, int *ret_io) {
+  const char *end = text + len;
+  const char *eol;
+  char       *err = NULL;
+
+  *ret_io = 0;
+  /* a block at a time, each ending at a newline */
+  while ((text < end) && (err == NULL))
+    {
+      eol = (end - text > es->block) ? text + es->block : end;
+      if (eol < end)
+        {
+          eol = (const char *) memchr(eol, '\n', end - eol);
+          eol = (eol == NULL) ? end : eol + 1;
+        }
+      err = add_block(es, text, eol - text, filename, ret_io);
+      text = eol;
+    }
+  return err;
+}
+
+/* Function: extsort_read()
+ * Args:     es:       external sort
+ *           filename: interval list, "-" for stdin
+ *           ret_io:   RETURN: as for extsort_add(), also TRUE if <filename>
+ *                     can't be read
+ * Returns:  as extsort_add(), also if <filename> can't be read.
+ *
+ * The file is read a block at a time, so only a block of it is ever
+ * in memory besides the runs.
+ */
+char *extsort_read(extsort_t *es, char *filename, int *ret_io) {
+  int     fd;
+  char   *buf;
+  long    alloc = es->block;
+  long    n = 0, parsed;
+  ssize_t nread;
+  char   *err = NULL;
+
+  *ret_io = 0;
+  fd = (strcmp(filename, "-") == 0) ? 0 : open(filename, O_RDONLY);
+  if (fd == -1)
+    {
+      *ret_io = 1;
+      return sort_error("Cannot open %s\n", filename);
+    }
+  buf = (char *) xrealloc(NULL, alloc);
+  do
+    {
+      if (n == alloc) /* a line longer than the buffer */
+        buf = (char *) xrealloc(buf, alloc *= 2);
+      nread = read(fd, buf + n, alloc - n);
+      if (nread == -1)
+        {
+          err = sort_error("Cannot read %s\n", filename);
+          *ret_io = 1;
+          break;
+        }
+      n += nread;
+      if ((nread > 0) && (n < alloc))
+        continue;
+
+      if (nread == 0)
+        parsed = n; /* end of file, the final line may have no newline */
+      else
+        for (parsed = n; (parsed > 0) && (buf[parsed-1] != '\n'); parsed--)
+          ;
+      if (parsed > 0)
+        {
+          err = add_block(es, buf, parsed, filename, ret_io);
+          memmove(buf, buf + parsed, n - parsed);
+          n -= parsed;
+        }
+    }
+  while ((nread > 0) && (err == NULL));
+  free(buf);
+  if (fd != 0)
+    close(fd);
+  return err;
+}
+
+/* extsort_count(): number of intervals added */
+long extsort_count(extsort_t *es) {
+  return es->nrecords + ((es->list != NULL) ? es->list->nrecords : 0);
+}
+
+/* extsort_nbytes(): number of bytes of interval lines parsed */
+long extsort_nbytes(extsort_t *es) {
+  return es->nbytes;
+}
+
+/* Function: extsort_start()
+ * Args:     es: external sort
+ * Returns:  NULL, or a malloc'ed error message if a run can't be written.
+ *
+ * Writes the run being parsed (or, if it is the only one, sorts it and
+ * keeps it in memory), waits for the runs being written, and starts
+ * merging them from the first record; extsort_name() is then the first
+ * name in sorted order.
+ */
+char *extsort_start(extsort_t *es) {
+  char *err = NULL;
+
+  close_merge(es);
+  arena_clear(es->missing);
+  es->nmissing = 0;
+  free(es->err);
+  es->err = NULL;
+  if ((es->list != NULL) && (es->list->nrecords > 0) && (es->nruns == 0))
+    keep_run(es);
+  else if ((es->list != NULL) && (es->list->nrecords > 0))
+    err = spill(es);
+  if (err == NULL)
+    err = join_runs(es, 1);
+  else
+    free(join_runs(es, 1));
+  while ((err == NULL) && (es->nruns > EXTSORT_MAX_RUNS))
+    err = merge_pass(es);
+  if (err != NULL)
+    return err;
+  open_merge(es, 0, es->nruns);
+
+  return NULL;
+}
+
+/* extsort_name(): name of the next group of intervals, NULL once there are no more */
+const char *extsort_name(extsort_t *es) {
+  return (es->nheap > 0) ? es->runA[es->heapA[0]]->name : NULL;
+}
+
+/* extsort_group(): read the next group of intervals into <list>,
+ * emptied first, in sorted order */
+void extsort_group(extsort_t *es, interval_list *list) {
+  run_t *run;
+  long   len = strlen(extsort_name(es)) + 1;
+
+  if (len > es->group_alloc)
+    es->group = (char *) xrealloc(es->group, es->group_alloc = 2 * len);
+  memcpy(es->group, extsort_name(es), len);
+  intervals_clear(list);
+  while ((es->nheap > 0) && (strcmp(extsort_name(es), es->group) == 0))
+    {
+      run = es->runA[es->heapA[0]];
+      intervals_append(list, run->name, run->head.strand, run->pc, run->head.npieces,
+                       (run->head.opt_len >= 0) ? run->opt : NULL);
+      advance(es);
+    }
+}
+
+/* extsort_skip(): skip the next group of intervals, noting its name as missing */
+void extsort_skip(extsort_t *es) {
+  const char *name = arena_strdup(es->missing, extsort_name(es), strlen(extsort_name(es)));
+
+  if (es->nmissing == es->missing_alloc)
+    es->missingA = (const char **) xrealloc(es->missingA, (es->missing_alloc = 2 * es->missing_alloc + 16) * sizeof(char *));
+  es->missingA[es->nmissing++] = name;
+  while ((es->nheap > 0) && (strcmp(extsort_name(es), name) == 0))
+    advance(es);
+}
+
+/* extsort_missing(): the names skipped since extsort_start(), in sorted order */
+const char **extsort_missing(extsort_t *es, int *ret_n) {
+  *ret_n = es->nmissing;
+  return es->missingA;
+}
+
+/* extsort_error(): a malloc'ed message for the first error reading a
+ * run during the merge (the merge ends there), or NULL */
+char *extsort_error(extsort_t *es) {
+  char *err = es->err;
+
+  es->err = NULL;
+  return err;
+}
+
+void extsort_free(extsort_t *es) {
+  int r;
+
+  if (es == NULL)
+    return;
+  free(join_runs(es, 1));
+  close_merge(es);
+  for (r = 0; r < es->nruns; r++)
+    free_run(es->runA[r]);
+  free(es->runA);
+  intervals_free(es->list);
+  free(es->heapA);
+  free(es->group);
+  arena_free(es->missing);
+  free(es->missingA);
+  free(es->err);
+  free(es->tmpdir);
+  free(es);
+}
+
+/* add_block(): parse the complete lines text[0..len-1] into the run being
+ * parsed, and write it out once it has reached its share of the budget;
+ * *ret_io is set TRUE if that fails */
+static char *add_block(extsort_t *es, const char *text, long len, const char *filename, int *ret_io) {
+  char *err;
+
+  if ((es->list == NULL) && (es->nruns == 1) && (es->runA[0]->fd == -1))
+    unkeep_run(es);
+  if (es->list == NULL)
+    {
+      es->list = intervals_create();
+      es->list->nbefore = es->nrecords;
+    }
+  err = intervals_add(es->list, text, len, es->nthreads, filename);
+  es->nbytes += len;
+  if ((err == NULL) && (run_size(es->list) >= es->run_budget))
+    *ret_io = ((err = spill(es)) != NULL);
+  return err;
+}
+
+/* run_size(): number of bytes <list> takes, and will take to be sorted */
+static long run_size(interval_list *list) {
+  return list->ralloc * (long) sizeof(interval_record) + list->palloc * (long) sizeof(piece) +
+    list->nrecords * (long) sizeof(sort_key) + list->nbytes;
+}
+
+/* spill(): sort the run being parsed and write it to a temporary file,
+ * with a thread of its own if there are several; returns NULL, or a
+ * malloc'ed error message */
+static char *spill(extsort_t *es) {
+  run_t *run;
+  char  *err = NULL;
+
+  if (es->nwriting >= es->nthreads)
+    err = join_runs(es, 0);
+  if ((err != NULL) || ((run = new_run(es, &err)) == NULL))
+    return err;
+  if (es->nruns == es->run_alloc)
+    es->runA = (run_t **) xrealloc(es->runA, (es->run_alloc = 2 * es->run_alloc + 16) * sizeof(run_t *));
+  es->runA[es->nruns++] = run;
+  run->list = es->list;
+  es->list  = NULL;
+  es->nrecords += run->list->nrecords;
+  run->writing = 1;
+  es->nwriting++;
+  if (es->nthreads == 1)
+    {
+      write_run(run);
+      return join_runs(es, 1);
+    }
+  if (pthread_create(&(run->thread), NULL, write_run, run) != 0)
+    {
+      fprintf(stderr, "Failed to create thread\n");
+      exit(EXIT_FAILURE);
+    }
+  return NULL;
+}
+
+/* new_run(): return a new run, with an unlinked temporary file, or NULL
+ * and a malloc'ed error message if the file can't be made */
+static run_t *new_run(extsort_t *es, char **ret_err) {
+  run_t *run;
+  char  *path;
+
+  if (asprintf(&path, "%s/extract_fasta_multi_exon.XXXXXX", es->tmpdir) == -1)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  run = (run_t *) calloc(1, sizeof(run_t));
+  if (run == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  if ((run->fd = mkstemp(path)) == -1)
+    {
+      *ret_err = sort_error("Cannot create a temporary file in %s\n", es->tmpdir);
+      free(path);
+      free(run);
+      return NULL;
+    }
+  unlink(path);
+  free(path);
+  return run;
+}
+
+/* keep_run(): sort the run being parsed, the only one, and keep it in
+ * memory as runA[0], to be merged without a temporary file */
+static void keep_run(extsort_t *es) {
+  run_t *run = (run_t *) calloc(1, sizeof(run_t));
+
+  if (run == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  run->fd   = -1;
+  run->list = es->list;
+  run->keyA = sort_run(run->list);
+  es->list  = NULL;
+  es->nrecords += run->list->nrecords;
+  if (es->nruns == es->run_alloc)
+    es->runA = (run_t **) xrealloc(es->runA, (es->run_alloc = 2 * es->run_alloc + 16) * sizeof(run_t *));
+  es->runA[es->nruns++] = run;
+}
+
+/* unkeep_run(): undo keep_run(), lines are being added to the run again */
+static void unkeep_run(extsort_t *es) {
+  run_t *run = es->runA[0];
+
+  close_merge(es);
+  es->list     = run->list;
+  run->list    = NULL;
+  es->nrecords -= es->list->nrecords;
+  es->nruns    = 0;
+  free_run(run);
+}
+
+/* sort_run(): return <list>'s records in sorted order, as a malloc'ed array of their keys */
+static sort_key *sort_run(interval_list *list) {
+  interval_record *rec;
+  name_rank       *nameA;
+  int             *rankA;
+  sort_key        *keyA;
+  int              i;
+
+  /* rank the names, then sort by rank and the rest */
+  nameA = (name_rank *) xrealloc(NULL, (list->names->nnames + 1) * sizeof(name_rank));
+  rankA = (int *) xrealloc(NULL, (list->names->nnames + 1) * sizeof(int));
+  keyA  = (sort_key *) xrealloc(NULL, (list->nrecords + 1) * sizeof(sort_key));
+  for (i = 0; i < list->names->nnames; i++)
+    {
+      nameA[i].name = list->names->nameA[i];
+      nameA[i].id   = i;
+    }
+  qsort(nameA, list->names->nnames, sizeof(name_rank), compare_names);
+  for (i = 0; i < list->names->nnames; i++)
+    rankA[nameA[i].id] = i;
+  for (i = 0; i < list->nrecords; i++)
+    {
+      rec = &(list->recordA[i]);
+      keyA[i].rank   = rankA[rec->name_id];
+      keyA[i].start  = rec->start;
+      keyA[i].end    = rec->end;
+      keyA[i].strand = rec->strand;
+      keyA[i].index  = i;
+    }
+  qsort(keyA, list->nrecords, sizeof(sort_key), compare_keys);
+  free(nameA);
+  free(rankA);
+  return keyA;
+}
+
+/* set_head(): set <head> for the record <rec> */
+static void set_head(run_head *head, interval_record *rec) {
+  head->name_len = strlen(rec->name);
+  head->opt_len  = (rec->opttok != NULL) ? (int) strlen(rec->opttok) : -1;
+  head->strand   = rec->strand;
+  head->npieces  = rec->npieces;
+}
+
+/* write_run(): thread function, sort a run's list and write it to its
+ * file, then free the list; sets run->err if it can't be written */
+static void *write_run(void *arg) {
+  run_t           *run  = (run_t *) arg;
+  interval_list   *list = run->list;
+  interval_record *rec;
+  sort_key        *keyA;
+  run_head         head;
+  FILE            *fp;
+  int              i, ok;
+
+  keyA = sort_run(list);
+  ok = ((fp = fdopen(dup(run->fd), "w")) != NULL);
+  if (ok)
+    setvbuf(fp, NULL, _IOFBF, RUN_IOBUF);
+  for (i = 0; ok && (i < list->nrecords); i++)
+    {
+      rec = &(list->recordA[keyA[i].index]);
+      set_head(&head, rec);
+      ok = (write_record(fp, &head, rec->name, rec->opttok, list->pieceA + rec->pieces) == 0);
+    }
+  if ((fp != NULL) && (fclose(fp) != 0))
+    ok = 0;
+  if (! ok)
+    run->err = sort_error("Cannot write a temporary file (is its file system full?)\n");
+
+  free(keyA);
+  intervals_free(list);
+  run->list = NULL;
+  return NULL;
+}
+
+/* write_record(): write one record of a run file, returns 0, or -1 on error */
+static int write_record(FILE *fp, run_head *head, const char *name, const char *opt, const piece *pc) {
+  if ((fwrite(head, sizeof(run_head), 1, fp) != 1) ||
+      (fwrite(name, 1, head->name_len, fp) != (size_t) head->name_len) ||
+      ((head->opt_len > 0) && (fwrite(opt, 1, head->opt_len, fp) != (size_t) head->opt_len)) ||
+      (fwrite(pc, sizeof(piece), head->npieces, fp) != (size_t) head->npieces))
+    return -1;
+  return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(((const name_rank *) a)->name, ((const name_rank *) b)->name);
+}
+
+static int compare_keys(const void *a, const void *b) {
+  const sort_key *x = (const sort_key *) a;
+  const sort_key *y = (const sort_key *) b;
+
+  if (x->rank != y->rank)
+    return (x->rank < y->rank) ? -1 : 1;
+  if (x->start != y->start)
+    return (x->start < y->start) ? -1 : 1;
+  if (x->end != y->end)
+    return (x->end < y->end) ? -1 : 1;
+  if (x->strand != y->strand)
+    return (x->strand < y->strand) ? -1 : 1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/* join_runs(): wait for the oldest run being written, or with <all> for
+ * all of them; returns NULL, or the first of their error messages */
+static char *join_runs(extsort_t *es, int all) {
+  char *err = NULL;
+  int   r;
+
+  for (r = 0; (r < es->nruns) && (es->nwriting > 0); r++)
+    if (es->runA[r]->writing)
+      {
+        if (es->nthreads > 1)
+          pthread_join(es->runA[r]->thread, NULL);
+        es->runA[r]->writing = 0;
+        es->nwriting--;
+        if (err == NULL)
+          err = es->runA[r]->err;
+        else
+          free(es->runA[r]->err);
+        es->runA[r]->err = NULL;
+        if (! all)
+          break;
+      }
+  return err;
+}
+
+/* merge_pass(): merge each EXTSORT_MAX_RUNS runs into one, keeping
+ * them in order, so each record is written once per pass */
+static char *merge_pass(extsort_t *es) {
+  run_t *merged = NULL;
+  char  *err = NULL;
+  int    first, n, r, nout = 0;
+
+  for (first = 0; first < es->nruns; first += n)
+    {
+      n = (es->nruns - first < EXTSORT_MAX_RUNS) ? es->nruns - first : EXTSORT_MAX_RUNS;
+      if (n == 1)
+        merged = es->runA[first];
+      else if ((err = merge_runs(es, first, n, &merged)) != NULL)
+        break;
+      else
+        for (r = first; r < first + n; r++)
+          {
+            free_run(es->runA[r]);
+            es->runA[r] = NULL;
+          }
+      es->runA[nout++] = merged;
+    }
+  /* after an error, the runs not merged stay as they are */
+  memmove(es->runA + nout, es->runA + first, (es->nruns - first) * sizeof(run_t *));
+  es->nruns = nout + es->nruns - first;
+  return err;
+}
+
+/* merge_runs(): merge runs first..first+n-1 into a new run, *ret_run */
+static char *merge_runs(extsort_t *es, int first, int n, run_t **ret_run) {
+  run_t *merged, *run;
+  FILE  *fp;
+  char  *err = NULL;
+  int    ok;
+
+  if ((merged = new_run(es, &err)) == NULL)
+    return err;
+  open_merge(es, first, n);
+  ok = ((fp = fdopen(dup(merged->fd), "w")) != NULL);
+  if (ok)
+    setvbuf(fp, NULL, _IOFBF, RUN_IOBUF);
+  while (ok && (es->nheap > 0))
+    {
+      run = es->runA[es->heapA[0]];
+      ok = (write_record(fp, &(run->head), run->name, run->opt, run->pc) == 0);
+      advance(es);
+    }
+  if ((fp != NULL) && (fclose(fp) != 0))
+    ok = 0;
+  close_merge(es);
+  if ((err = extsort_error(es)) == NULL)
+    if (! ok)
+      err = sort_error("Cannot write a temporary file (is its file system full?)\n");
+  if (err != NULL)
+    {
+      free_run(merged);
+      return err;
+    }
+  *ret_run = merged;
+  return NULL;
+}
+
+/* open_merge(): start merging runs first..first+n-1, from their first records */
+static void open_merge(extsort_t *es, int first, int n) {
+  run_t *run;
+  long   iobuf;
+  int    r, i;
+
+  /* half the budget is for the merge's buffers */
+  iobuf = (n > 0) ? es->run_budget * (es->nthreads + 1) / (2 * n) : 0;
+  if (iobuf > RUN_IOBUF)
+    iobuf = RUN_IOBUF;
+  if (iobuf < 4096)
+    iobuf = 4096;
+  es->heapA = (int *) xrealloc(es->heapA, (n + 1) * sizeof(int));
+  es->nheap = 0;
+  for (r = first; r < first + n; r++)
+    {
+      run = es->runA[r];
+      if (run->fd == -1)
+        run->next = 0;
+      else
+        {
+          lseek(run->fd, 0, SEEK_SET);
+          if ((run->in = fdopen(dup(run->fd), "r")) == NULL)
+            {
+              if (es->err == NULL)
+                es->err = sort_error("Cannot read a temporary file\n");
+              continue;
+            }
+          setvbuf(run->in, NULL, _IOFBF, iobuf);
+        }
+      run->merging = 1;
+      read_record(es, run);
+      if (! run->merging)
+        continue;
+      /* sift up */
+      for (i = es->nheap++; (i > 0) && run_less(es, r, es->heapA[(i-1)/2]); i = (i-1)/2)
+        es->heapA[i] = es->heapA[(i-1)/2];
+      es->heapA[i] = r;
+    }
+}
+
+/* close_merge(): stop merging, if we are */
+static void close_merge(extsort_t *es) {
+  int r;
+
+  for (r = 0; r < es->nruns; r++)
+    if (es->runA[r] != NULL) /* NULL once merged, in merge_pass() */
+      {
+        if (es->runA[r]->in != NULL)
+          fclose(es->runA[r]->in);
+        es->runA[r]->in      = NULL;
+        es->runA[r]->merging = 0;
+      }
+  es->nheap = 0;
+}
+
+/* read_record(): read the next record of a run being merged, stopping
+ * (run->merging is set to FALSE, and run->in closed) at the end, or on error */
+static void read_record(extsort_t *es, run_t *run) {
+  run_head *h = &(run->head);
+
+  if (run->fd == -1)
+    {
+      copy_record(run);
+      return;
+    }
+  if (fread(h, sizeof(run_head), 1, run->in) != 1)
+    {
+      if (ferror(run->in) && (es->err == NULL))
+        es->err = sort_error("Cannot read a temporary file\n");
+      fclose(run->in);
+      run->in      = NULL;
+      run->merging = 0;
+      return;
+    }
+  fit_record(run);
+  if ((fread(run->name, 1, h->name_len, run->in) != (size_t) h->name_len) ||
+      ((h->opt_len > 0) && (fread(run->opt, 1, h->opt_len, run->in) != (size_t) h->opt_len)) ||
+      (fread(run->pc, sizeof(piece), h->npieces, run->in) != (size_t) h->npieces))
+    {
+      if (es->err == NULL)
+        es->err = sort_error("Cannot read a temporary file\n");
+      fclose(run->in);
+      run->in      = NULL;
+      run->merging = 0;
+      return;
+    }
+  run->name[h->name_len] = '\0';
+  if (h->opt_len >= 0)
+    run->opt[h->opt_len] = '\0';
+}
+
+/* copy_record(): read_record() for a run kept in memory, copying its
+ * next record out of its list */
+static void copy_record(run_t *run) {
+  run_head        *h = &(run->head);
+  interval_record *rec;
+
+  if (run->next == run->list->nrecords)
+    {
+      run->merging = 0;
+      return;
+    }
+  rec = &(run->list->recordA[run->keyA[run->next++].index]);
+  set_head(h, rec);
+  fit_record(run);
+  memcpy(run->name, rec->name, h->name_len + 1);
+  if (h->opt_len >= 0)
+    memcpy(run->opt, rec->opttok, h->opt_len + 1);
+  memcpy(run->pc, run->list->pieceA + rec->pieces, h->npieces * sizeof(piece));
+}
+
+/* fit_record(): make room in <run>'s buffers for the record in run->head */
+static void fit_record(run_t *run) {
+  run_head *h = &(run->head);
+
+  if (h->name_len + 1 > run->name_alloc)
+    run->name = (char *) xrealloc(run->name, run->name_alloc = 2 * (h->name_len + 1));
+  if (h->opt_len + 1 > run->opt_alloc)
+    run->opt = (char *) xrealloc(run->opt, run->opt_alloc = 2 * (h->opt_len + 1));
+  if (h->npieces > run->pc_alloc)
+    run->pc = (piece *) xrealloc(run->pc, (run->pc_alloc = 2 * h->npieces) * sizeof(piece));
+}
+
+/* advance(): move the run at the top of the heap on to its next record */
+static void advance(extsort_t *es) {
+  int top = es->heapA[0];
+  int i, child;
+
+  read_record(es, es->runA[top]);
+  if (es->err != NULL) /* the merge ends at an error */
+    {
+      close_merge(es);
+      return;
+    }
+  if (! es->runA[top]->merging)
+    top = es->heapA[--es->nheap];
+  /* sift down */
+  for (i = 0; (child = 2 * i + 1) < es->nheap; i = child)
+    {
+      if ((child + 1 < es->nheap) && run_less(es, es->heapA[child+1], es->heapA[child]))
+        child++;
+      if (! run_less(es, es->heapA[child], top))
+        break;
+      es->heapA[i] = es->heapA[child];
+    }
+  if (es->nheap > 0)
+    es->heapA[i] = top;
+}
+
+/* run_less(): TRUE if run <a>'s next record comes before run <b>'s,
+ * in the order of compare_keys(); the earlier run's first if they tie */
+static int run_less(extsort_t *es, int a, int b) {
+  run_t *x = es->runA[a];
+  run_t *y = es->runA[b];
+  int    value;
+
+  if ((value = strcmp(x->name, y->name)) != 0)
+    return (value < 0);
+  if (x->pc[0].start != y->pc[0].start)
+    return (x->pc[0].start < y->pc[0].start);
+  if (x->pc[x->head.npieces-1].end != y->pc[y->head.npieces-1].end)
+    return (x->pc[x->head.npieces-1].end < y->pc[y->head.npieces-1].end);
+  if (x->head.strand != y->head.strand)
+    return (x->head.strand < y->head.strand);
+  return (a < b);
+}
+
+static void free_run(run_t *run) {
+  if (run->in != NULL)
+    fclose(run->in);
+  if (run->fd != -1)
+    close(run->fd);
+  intervals_free(run->list);
+  free(run->keyA);
+  free(run->err);
+  free(run->name);
+  free(run->opt);
+  free(run->pc);
+  free(run);
+}
+
+static void *xrealloc(void *ptr, long size) {
+  ptr = realloc(ptr, size);
+  if (ptr == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return ptr;
+}
+
+/* sort_error(): return a malloc'ed, printf-formatted error message */
+static char *sort_error(const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return msg;
+}
@@ -0,0 +1,49 @@
+/* extsort.h:
+ *
+ * An external sort of an interval list too big to keep in memory. Lines
+ * are parsed into a run until the run reaches its share of a memory
+ * budget; the run is then sorted (by name, then start, end and strand,
+ * then line order, like group_intervals() in extractfasta.c) and
+ * written to a temporary file by a thread of its own, while the next
+ * run is parsed. Up to <nthreads> runs are sorted at once, and each
+ * run gets budget / (nthreads + 1) bytes.
+ *
+ * Extraction then merges the runs (reading each through a buffer, with
+ * a heap of the runs' next records), one name at a time: the intervals
+ * for the next name in sorted order are read into an interval_list,
+ * and the caller either extracts them or skips them as missing. Only
+ * one name's intervals are ever in memory, so those must fit. With
+ * more than EXTSORT_MAX_RUNS runs, runs are first merged into bigger
+ * ones, so there are never more than that many files open.
+ *
+ * The temporary files are unlinked as soon as they are created, so
+ * nothing is left behind, and are only closed by extsort_free(); the
+ * runs can be merged again for another extraction, and more lines
+ * added in between. A list that never fills a run is never written:
+ * it is sorted and merged in memory, so no temporary file is made.
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include "intervals.h"
+
+#define EXTSORT_MIN_BUDGET (64 * 1024) /* smallest memory budget, in bytes */
+#define EXTSORT_MAX_RUNS   256         /* max number of runs merged at once */
+
+typedef struct extsort_s extsort_t;
+
+extsort_t  *extsort_create(long budget, int nthreads, const char *tmpdir);
+char       *extsort_add(extsort_t *es, const char *text, long len, const char *filename, int *ret_io);
+char       *extsort_read(extsort_t *es, char *filename, int *ret_io);
+long        extsort_count(extsort_t *es);
+long        extsort_nbytes(extsort_t *es);
+char       *extsort_start(extsort_t *es);
+const char *extsort_name(extsort_t *es);
+void        extsort_group(extsort_t *es, interval_list *list);
+void        extsort_skip(extsort_t *es);
+const char **extsort_missing(extsort_t *es, int *ret_n);
+char       *extsort_error(extsort_t *es);
+void        extsort_free(extsort_t *es);
+
+#endif /* EXTSORT_H */
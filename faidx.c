@@ -0,0 +1,630 @@
+/* faidx.c:
+ *
+ * Building and using samtools-compatible FASTA indices (.fai files),
+ * see faidx.h for a description of the format.
+ *
+ * An index lets us pread() only the bytes of the FASTA file that
+ * cover the requested pieces instead of reading the whole file.
+ * Like samtools we require that all lines of a sequence record,
+ * except possibly the final one, have the same length.
+ *
+ * A BGZF compressed FASTA file is read through bgzf.c, inflating only
+ * the blocks that cover what is wanted.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "faidx.h"
+
+#define FAI_WHITE_SPACE " \n\r\t\v"
+
+/* what a faidx_writer_t is in the middle of */
+typedef enum {
+  FW_LINE_START, /* FASTA: the start of a line */
+  FW_HEADER,     /* FASTA: a header line */
+  FW_SEQUENCE,   /* FASTA: a sequence line */
+  FW_NAME_LEN,   /* binary: a record's 4 byte header length */
+  FW_NAME,       /* binary: its header */
+  FW_SEQ_LEN,    /* binary: its 8 byte sequence length */
+  FW_SEQ         /* binary: its sequence */
+} fw_state;
+
+struct faidx_writer_s {
+  FILE          *fp;         /* the .fai being written */
+  char          *fai_file;
+  faidx_write_fn write;      /* what the output is passed on to */
+  void          *arg;
+  fw_state       state;
+  long           pos;        /* number of bytes of output so far */
+  faidx_entry    entry;      /* the current record */
+  long           name_n;     /* number of bytes in entry.name */
+  long           name_alloc;
+  int            name_done;  /* TRUE once the name has been ended by whitespace */
+  int            have_rec;   /* FASTA: TRUE once there is a record to write an entry for */
+  long           line_n;     /* FASTA: residues on the current line */
+  long           nlines;     /* FASTA: sequence lines ended in the current record */
+  unsigned char  num[8];     /* binary: the bytes of a length read so far */
+  int            nnum;
+  long           left;       /* binary: bytes of the header or sequence still to come */
+  int            failed;     /* TRUE once writing the .fai has failed */
+};
+
+static char *fai_filename(char *fa_file);
+static void  writer_name(faidx_writer_t *w, const char *s, long len);
+static void  writer_entry(faidx_writer_t *w);
+static long  writer_fasta(faidx_writer_t *w, const char *s, long len);
+static long  writer_binary(faidx_writer_t *w, const char *s, long len);
+static int   write_entry(FILE *fp, faidx_entry *entry);
+static char *fai_error(const char *fmt, ...);
+
+/* Function: faidx_build()
+ * Args:     fa_file: FASTA file to index, the index is written to <fa_file>.fai
+ * Returns:  NULL on success, or a malloc'ed error message if <fa_file>
+ *           can't be read or <fa_file>.fai can't be written, or if the
+ *           lines of any sequence record are of inconsistent length; no
+ *           partial index is left behind.
+ */
+char *faidx_build(char *fa_file) {
+  FILE       *infile, *outfile;
+  char       *fai_file;
+  char       *line = NULL;  /* current line, allocated by getline() */
+  size_t      line_alloc = 0;
+  ssize_t     len;          /* number of bytes in current line, including terminator */
+  long        bases;        /* number of residues in current line */
+  long        pos = 0;      /* byte offset of the start of the current line */
+  long        nlines = 0;   /* number of sequence lines read for the current record */
+  int         have_rec = 0;   /* TRUE once we've read the first header line */
+  int         short_seen = 0; /* TRUE once we've seen a line shorter than line_bases in current record */
+  faidx_entry entry;
+  char       *err = NULL;
+
+  if (bgzf_is_gzip(fa_file))
+    {
+      if (! bgzf_is_bgzf(fa_file))
+        return fai_error("%s is gzip compressed but not BGZF, so can't be indexed (compress it with bgzip)\n", fa_file);
+      if ((infile = bgzf_fopen(fa_file, &err)) == NULL)
+        return err;
+    }
+  else if ((infile = fopen(fa_file, "r")) == NULL)
+    return fai_error("Cannot open %s\n", fa_file);
+  fai_file = fai_filename(fa_file);
+  outfile = fopen(fai_file, "w");
+  if (outfile == NULL)
+    {
+      err = fai_error("Cannot open %s for writing\n", fai_file);
+      fclose(infile);
+      free(fai_file);
+      return err;
+    }
+
+  entry.name       = NULL;
+  entry.length     = 0;
+  entry.offset     = 0;
+  entry.line_bases = 0;
+  entry.line_bytes = 0;
+  while ((err == NULL) && ((len = getline(&line, &line_alloc, infile)) != -1))
+    {
+      if (line[0] == '>')
+        {
+          /* at new sequence, write entry for previous one if necessary */
+          if (have_rec && (write_entry(outfile, &entry) != 0))
+            err = fai_error("Error writing %s\n", fai_file);
+          free(entry.name);
+          entry.name       = strndup(line+1, strcspn(line+1, FAI_WHITE_SPACE));
+          entry.length     = 0;
+          entry.offset     = pos + len;
+          entry.line_bases = 0;
+          entry.line_bytes = 0;
+          if (entry.name == NULL)
+            {
+              fprintf(stderr, "No space\n");
+              exit(EXIT_FAILURE);
+            }
+          have_rec   = 1;
+          nlines     = 0;
+          short_seen = 0;
+        }
+      else if (have_rec)
+        {
+          bases = len;
+          if ((bases > 0) && (line[bases-1] == '\n')) bases--;
+          if ((bases > 0) && (line[bases-1] == '\r')) bases--;
+
+          if (bases == 0) /* blank line, only allowed at the end of a record */
+            short_seen = 1;
+          else if (short_seen)
+            err = fai_error("Different line length in sequence %s of %s, cannot index\n", entry.name, fa_file);
+          else
+            {
+              if (nlines == 0)
+                {
+                  entry.line_bases = bases;
+                  entry.line_bytes = len;
+                }
+              else if ((bases > entry.line_bases) ||
+                       ((bases == entry.line_bases) && (len != entry.line_bytes)))
+                err = fai_error("Different line length in sequence %s of %s, cannot index\n", entry.name, fa_file);
+              else if (bases < entry.line_bases)
+                short_seen = 1;
+              entry.length += bases;
+              nlines++;
+            }
+        }
+      pos += len;
+    }
+  /* finished final sequence, write its entry if necessary */
+  if ((err == NULL) && have_rec && (write_entry(outfile, &entry) != 0))
+    err = fai_error("Error writing %s\n", fai_file);
+
+  if ((err == NULL) && ferror(infile))
+    err = fai_error("Error reading %s\n", fa_file);
+  if ((fclose(outfile) != 0) && (err == NULL))
+    err = fai_error("Error writing %s\n", fai_file);
+  if ((err == NULL) && bgzf_is_gzip(fa_file))
+    err = bgzf_build_index(fa_file);
+  if (err != NULL)
+    unlink(fai_file); /* don't leave a partial index behind */
+  fclose(infile);
+  free(entry.name);
+  free(line);
+  free(fai_file);
+  return err;
+}
+
+/* Function: faidx_load()
+ * Args:     fa_file: FASTA file to open, its index must be in <fa_file>.fai
+ *           ret_err: set to a malloc'ed error message on failure
+ * Returns:  newly allocated index, with <fa_file> open for reading;
+ *           caller frees with faidx_free(). NULL if <fa_file> or
+ *           <fa_file>.fai can't be read or the index is malformed.
+ */
+faidx_t *faidx_load(char *fa_file, char **ret_err) {
+  FILE    *infile;
+  char    *fai_file;
+  char    *line = NULL;
+  size_t   line_alloc = 0;
+  char    *token, *endp;
+  long     field[4];
+  int      nalloc = 0;
+  int      f;
+  int      lineno = 0;
+  faidx_t *fai;
+
+  fai = (faidx_t *) malloc(sizeof(faidx_t));
+  if (fai == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  fai->entryA   = NULL;
+  fai->nentries = 0;
+  fai->fa_file  = strdup(fa_file);
+  fai->fd       = -1;
+  fai->gzi      = NULL;
+  *ret_err      = NULL;
+
+  fai_file = fai_filename(fa_file);
+  infile = fopen(fai_file, "r");
+  if (infile == NULL)
+    {
+      *ret_err = fai_error("Cannot open %s (build it with --build-index)\n", fai_file);
+      free(fai_file);
+      faidx_free(fai);
+      return NULL;
+    }
+
+  while ((*ret_err == NULL) && (getline(&line, &line_alloc, infile) != -1))
+    {
+      lineno++;
+      if (fai->nentries == nalloc)
+        {
+          nalloc = (nalloc == 0) ? 1024 : nalloc * 2;
+          fai->entryA = (faidx_entry *) realloc(fai->entryA, nalloc * sizeof(faidx_entry));
+          if (fai->entryA == NULL)
+            {
+              fprintf(stderr, "No space for %d index entries\n", nalloc);
+              exit(EXIT_FAILURE);
+            }
+        }
+
+      token = strtok(line, "\t\n");
+      if (token == NULL)
+        {
+          *ret_err = fai_error("No sequence name on line %d of %s\n", lineno, fai_file);
+          break;
+        }
+      fai->entryA[fai->nentries].name = strdup(token);
+      fai->nentries++; /* so faidx_free() frees the name, even if the rest is bad */
+      for (f = 0; (f < 4) && (*ret_err == NULL); f++)
+        {
+          token = strtok(NULL, "\t\n");
+          if (token != NULL)
+            field[f] = strtol(token, &endp, 10);
+          if ((token == NULL) || (*endp != '\0') || (field[f] < 0))
+            *ret_err = fai_error("Bad or missing field %d on line %d of %s\n", f+2, lineno, fai_file);
+        }
+      if (*ret_err != NULL)
+        break;
+      fai->entryA[fai->nentries-1].length     = field[0];
+      fai->entryA[fai->nentries-1].offset     = field[1];
+      fai->entryA[fai->nentries-1].line_bases = (int) field[2];
+      fai->entryA[fai->nentries-1].line_bytes = (int) field[3];
+      if ((field[0] > 0) && ((field[2] < 1) || (field[3] < field[2])))
+        *ret_err = fai_error("Bad line length on line %d of %s\n", lineno, fai_file);
+    }
+  fclose(infile);
+  free(line);
+  free(fai_file);
+
+  if (*ret_err == NULL)
+    {
+      fai->fd = open(fa_file, O_RDONLY);
+      if (fai->fd == -1)
+        *ret_err = fai_error("Cannot open %s\n", fa_file);
+      else if (bgzf_is_gzip(fa_file))
+        fai->gzi = bgzf_index_load(fa_file, ret_err);
+    }
+  if (*ret_err != NULL)
+    {
+      faidx_free(fai);
+      return NULL;
+    }
+  return fai;
+}
+
+/* Function: faidx_fetch()
+ * Args:     fai:       index, from faidx_load()
+ *           e:         index of the sequence in fai->entryA
+ *           start:     first residue to fetch, 0-based
+ *           end:       final residue to fetch, 0-based, must be < length
+ *           ret_buf:   buffer to read into, grown (realloc'ed) as needed
+ *           ret_alloc: allocated size of *ret_buf
+ * Returns:  *ret_buf, holding residues <start>..<end> without line
+ *           terminators, '\0'-terminated; NULL if the FASTA file can't be
+ *           read or is shorter than the index says.
+ */
+char *faidx_fetch(faidx_t *fai, int e, int start, int end, char **ret_buf, long *ret_alloc) {
+  faidx_entry *entry = &(fai->entryA[e]);
+  long   first, last;  /* byte offsets of residues <start> and <end> */
+  long   nbytes;       /* number of bytes to read */
+  long   nread;        /* number of bytes read so far */
+  ssize_t r;
+  char  *buf;
+
+  first  = entry->offset + FAIDX_OFFSET(start, entry->line_bases, entry->line_bytes);
+  last   = entry->offset + FAIDX_OFFSET(end,   entry->line_bases, entry->line_bytes);
+  nbytes = last - first + 1;
+
+  if (*ret_alloc < nbytes + 1)
+    {
+      *ret_alloc = nbytes + 1;
+      *ret_buf = (char *) realloc(*ret_buf, *ret_alloc);
+      if (*ret_buf == NULL)
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  buf = *ret_buf;
+
+  nread = 0;
+  while (nread < nbytes)
+    {
+      r = faidx_pread(fai, buf + nread, nbytes - nread, first + nread);
+      if ((r == -1) && (errno == EINTR))
+        continue;
+      if (r <= 0)
+        return NULL;
+      nread += r;
+    }
+
+  /* remove line terminators, in place */
+  if (entry->line_bytes > entry->line_bases)
+    nbytes = faidx_unwrap(buf, buf, start, end - start + 1, entry->line_bases, entry->line_bytes);
+  buf[nbytes] = '\0';
+
+  return buf;
+}
+
+/* faidx_pread(): pread() <len> bytes at offset <off> of the FASTA file,
+ * of its uncompressed data if it is BGZF compressed */
+long faidx_pread(faidx_t *fai, char *buf, long len, long off) {
+  if (fai->gzi != NULL)
+    return bgzf_pread(fai->gzi, buf, len, off);
+  return pread(fai->fd, buf, len, off);
+}
+
+/* Function: faidx_unwrap()
+ * Args:     dst:        destination for the residues, may overlap <src> if dst <= src
+ *           src:        pointer to the byte holding residue <start>, in a sequence
+ *                       laid out in lines of <line_bases> residues and <line_bytes> bytes
+ *           start:      0-based position of the first residue to copy
+ *           nres:       number of residues to copy
+ *           line_bases: number of residues per line
+ *           line_bytes: number of bytes per line, including the line terminator
+ * Returns:  number of residues copied to <dst> (nres)
+ */
+long faidx_unwrap(char *dst, const char *src, int start, long nres, int line_bases, int line_bytes) {
+  long left = nres;                            /* number of residues left to copy */
+  long in_line = line_bases - (start % line_bases); /* residues remaining on the current line */
+  int  gap = line_bytes - line_bases;          /* number of line terminator bytes per line */
+  long n;
+
+  while (left > 0)
+    {
+      n = (in_line < left) ? in_line : left;
+      if (src != dst)
+        memmove(dst, src, n);
+      dst  += n;
+      src  += n + gap;
+      left -= n;
+      in_line = line_bases;
+    }
+  return nres;
+}
+
+/* Function: faidx_free()
+ * Args:     fai: index to free, its FASTA file is closed
+ */
+void faidx_free(faidx_t *fai) {
+  int e;
+
+  if (fai == NULL)
+    return;
+  for (e = 0; e < fai->nentries; e++)
+    free(fai->entryA[e].name);
+  free(fai->entryA);
+  if (fai->fd != -1)
+    close(fai->fd);
+  bgzf_index_free(fai->gzi);
+  free(fai->fa_file);
+  free(fai);
+}
+
+/* Function: faidx_writer_create()
+ * Args:     fai_file: index to write
+ *           binary:   TRUE if the output is binary records, FALSE for FASTA
+ *           write:    what faidx_writer_write() passes the output on to
+ *           arg:      passed to <write>
+ *           ret_err:  set to a malloc'ed error message on failure
+ * Returns:  newly allocated writer, or NULL if <fai_file> can't be
+ *           opened; pass it as the <arg> of faidx_writer_write(), and
+ *           finish the index with faidx_writer_close().
+ */
+faidx_writer_t *faidx_writer_create(char *fai_file, int binary, faidx_write_fn write, void *arg, char **ret_err) {
+  faidx_writer_t *w;
+
+  *ret_err = NULL;
+  w = (faidx_writer_t *) calloc(1, sizeof(faidx_writer_t));
+  if ((w == NULL) || ((w->fai_file = strdup(fai_file)) == NULL))
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  if ((w->fp = fopen(fai_file, "w")) == NULL)
+    {
+      *ret_err = fai_error("Cannot open %s for writing\n", fai_file);
+      free(w->fai_file);
+      free(w);
+      return NULL;
+    }
+  w->write = write;
+  w->arg   = arg;
+  w->state = binary ? FW_NAME_LEN : FW_LINE_START;
+  return w;
+}
+
+/* faidx_writer_write(): faidx_write_fn that indexes <len> bytes of output
+ * and passes them on, returns what the writer's write function does */
+int faidx_writer_write(void *arg, const char *s, long len) {
+  faidx_writer_t *w    = (faidx_writer_t *) arg;
+  const char     *from = s;
+  long            left = len;
+  long            n;
+
+  while (left > 0)
+    {
+      n = (w->state < FW_NAME_LEN) ? writer_fasta(w, from, left) : writer_binary(w, from, left);
+      from   += n;
+      w->pos += n;
+      left   -= n;
+    }
+  return w->write(w->arg, s, len);
+}
+
+/* Function: faidx_writer_close()
+ * Args:     w: writer to free, after the final byte of output
+ * Returns:  NULL, or a malloc'ed error message if the index couldn't be
+ *           written.
+ */
+char *faidx_writer_close(faidx_writer_t *w) {
+  char *err = NULL;
+
+  if (w->have_rec)
+    writer_entry(w);
+  if ((fclose(w->fp) != 0) || w->failed)
+    err = fai_error("Error writing %s\n", w->fai_file);
+  free(w->entry.name);
+  free(w->fai_file);
+  free(w);
+  return err;
+}
+
+/* writer_fasta(): index FASTA output up to the end of the line <s> starts in,
+ * returns the number of bytes of <s> that takes */
+static long writer_fasta(faidx_writer_t *w, const char *s, long len) {
+  const char *nl;
+  long        n, bases;
+
+  if (w->state == FW_LINE_START)
+    {
+      if (s[0] != '>')
+        {
+          w->state = FW_SEQUENCE;
+          return 0;
+        }
+      if (w->have_rec)
+        writer_entry(w);
+      w->have_rec  = 1;
+      w->name_n    = 0;
+      w->name_done = 0;
+      w->nlines    = 0;
+      w->line_n    = 0;
+      w->entry.length     = 0;
+      w->entry.line_bases = 0;
+      w->entry.line_bytes = 0;
+      w->state = FW_HEADER;
+      return 1;
+    }
+
+  nl = memchr(s, '\n', len);
+  n  = (nl != NULL) ? (nl - s) + 1 : len;
+  if (w->state == FW_HEADER)
+    {
+      writer_name(w, s, (nl != NULL) ? n - 1 : n);
+      w->entry.offset = w->pos + n;
+    }
+  else if (w->have_rec)
+    {
+      bases = (nl != NULL) ? n - 1 : n;
+      w->line_n       += bases;
+      w->entry.length += bases;
+      if ((nl != NULL) && (w->nlines++ == 0))
+        {
+          w->entry.line_bases = (int) w->line_n;
+          w->entry.line_bytes = (int) w->line_n + 1;
+        }
+      if (nl != NULL)
+        w->line_n = 0;
+    }
+  if (nl != NULL)
+    w->state = FW_LINE_START;
+  return n;
+}
+
+/* writer_binary(): index binary output up to the end of the field <s>
+ * starts in, returns the number of bytes of <s> that takes */
+static long writer_binary(faidx_writer_t *w, const char *s, long len) {
+  int  size = (w->state == FW_SEQ_LEN) ? 8 : 4;
+  long n, value;
+  int  i;
+
+  if ((w->state == FW_NAME_LEN) || (w->state == FW_SEQ_LEN))
+    {
+      n = (size - w->nnum < len) ? size - w->nnum : len;
+      memcpy(w->num + w->nnum, s, n);
+      if ((w->nnum += n) < size)
+        return n;
+      for (value = 0, i = size - 1; i >= 0; i--) /* little-endian */
+        value = (value << 8) | w->num[i];
+      w->nnum = 0;
+      w->left = value;
+      if (w->state == FW_NAME_LEN)
+        {
+          w->name_n    = 0;
+          w->name_done = 0;
+          writer_name(w, "", 0);
+          w->state = (value > 0) ? FW_NAME : FW_SEQ_LEN;
+        }
+      else
+        {
+          w->entry.length     = value;
+          w->entry.offset     = w->pos + n;
+          w->entry.line_bases = (int) value;
+          w->entry.line_bytes = (int) value;
+          writer_entry(w);
+          w->state = (value > 0) ? FW_SEQ : FW_NAME_LEN;
+        }
+      return n;
+    }
+
+  n = (w->left < len) ? w->left : len;
+  if (w->state == FW_NAME)
+    writer_name(w, s, n);
+  if ((w->left -= n) == 0)
+    w->state = (w->state == FW_NAME) ? FW_SEQ_LEN : FW_NAME_LEN;
+  return n;
+}
+
+/* writer_name(): add the bytes of <s> up to the first whitespace to the
+ * current record's name, unless it has been ended already */
+static void writer_name(faidx_writer_t *w, const char *s, long len) {
+  long n = 0;
+
+  if (! w->name_done)
+    {
+      while ((n < len) && (strchr(FAI_WHITE_SPACE, s[n]) == NULL))
+        n++;
+      w->name_done = (n < len);
+    }
+  if (w->name_n + n + 1 > w->name_alloc)
+    {
+      w->name_alloc = 2 * (w->name_n + n + 1);
+      w->entry.name = (char *) realloc(w->entry.name, w->name_alloc);
+      if (w->entry.name == NULL)
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  memcpy(w->entry.name + w->name_n, s, n);
+  w->name_n += n;
+  w->entry.name[w->name_n] = '\0';
+}
+
+/* writer_entry(): write the current record's entry; a FASTA record's
+ * final line may be unterminated (and then is its only one) */
+static void writer_entry(faidx_writer_t *w) {
+  if ((w->state < FW_NAME_LEN) && (w->nlines == 0) && (w->line_n > 0))
+    {
+      w->entry.line_bases = (int) w->line_n;
+      w->entry.line_bytes = (int) w->line_n;
+    }
+  if ((! w->failed) && (write_entry(w->fp, &(w->entry)) != 0))
+    w->failed = 1;
+}
+
+/* fai_filename(): return newly allocated "<fa_file>.fai" */
+static char *fai_filename(char *fa_file) {
+  char *fai_file;
+
+  fai_file = (char *) malloc(strlen(fa_file) + 5);
+  if (fai_file == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  sprintf(fai_file, "%s.fai", fa_file);
+  return fai_file;
+}
+
+/* write_entry(): write one line of a .fai file, returns 0, or -1 on error */
+static int write_entry(FILE *fp, faidx_entry *entry) {
+  if (fprintf(fp, "%s\t%ld\t%ld\t%d\t%d\n", entry->name, entry->length, entry->offset,
+              entry->line_bases, entry->line_bytes) < 0)
+    return -1;
+  return 0;
+}
+
+/* fai_error(): return a malloc'ed, printf-formatted error message */
+static char *fai_error(const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return msg;
+}
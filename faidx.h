@@ -0,0 +1,65 @@
+/* faidx.h:
+ *
+ * Reading and writing samtools-compatible FASTA indices (.fai files)
+ * and random access extraction of subsequences using them.
+ *
+ * Each line of a .fai file describes one sequence record:
+ *   <name> <length> <offset> <line_bases> <line_bytes>
+ * (tab-delimited) where <offset> is the byte offset of the first
+ * residue of the sequence in the FASTA file, <line_bases> is the
+ * number of residues per line and <line_bytes> is the number of
+ * bytes per line including the line terminator.
+ *
+ * A BGZF compressed FASTA file (see bgzf.h) is indexed like samtools
+ * does: offsets in the .fai are in the uncompressed data, and the .gzi
+ * index of its blocks is built and used along with it.
+ *
+ * A faidx_writer_t builds the .fai of a file as it is written, from the
+ * bytes on their way to it, so output needn't be read back to index it.
+ * Besides FASTA it indexes length-prefixed binary records (see
+ * ef_set_format() in extractfasta.h): the offset of each sequence, with
+ * <line_bases> and <line_bytes> both its length, since it has no lines.
+ */
+
+#ifndef FAIDX_H
+#define FAIDX_H
+
+#include "bgzf.h"
+
+typedef struct {
+  char *name;       /* sequence name, first token of the header line after the '>' */
+  long  length;     /* number of residues in the sequence */
+  long  offset;     /* byte offset of the first residue in the FASTA file */
+  int   line_bases; /* number of residues on each (full) line */
+  int   line_bytes; /* number of bytes on each (full) line, including the line terminator */
+} faidx_entry;
+
+typedef struct {
+  faidx_entry *entryA;   /* [0..e..nentries-1] one per sequence record, in file order */
+  int          nentries; /* number of entries */
+  char        *fa_file;  /* name of the indexed FASTA file */
+  int          fd;       /* descriptor open on the FASTA file, for pread() */
+  bgzf_index  *gzi;      /* if it is BGZF compressed: its blocks, read through them, else NULL */
+} faidx_t;
+
+/* writes <len> bytes, returns 0 on success */
+typedef int (*faidx_write_fn)(void *arg, const char *s, long len);
+
+typedef struct faidx_writer_s faidx_writer_t;
+
+char    *faidx_build(char *fa_file);
+faidx_t *faidx_load(char *fa_file, char **ret_err);
+char    *faidx_fetch(faidx_t *fai, int e, int start, int end, char **ret_buf, long *ret_alloc);
+long     faidx_pread(faidx_t *fai, char *buf, long len, long off);
+long     faidx_unwrap(char *dst, const char *src, int start, long nres, int line_bases, int line_bytes);
+void     faidx_free(faidx_t *fai);
+
+faidx_writer_t *faidx_writer_create(char *fai_file, int binary, faidx_write_fn write, void *arg, char **ret_err);
+int             faidx_writer_write(void *arg, const char *s, long len);
+char           *faidx_writer_close(faidx_writer_t *w);
+
+/* byte offset of 0-based residue <pos> from the first residue of a sequence */
+#define FAIDX_OFFSET(pos, line_bases, line_bytes) \
+  (((long) (pos) / (line_bases)) * (long) (line_bytes) + ((pos) % (line_bases)))
+
+#endif /* FAIDX_H */
@@ -0,0 +1,566 @@
+/* intervals.c:
+ *
+ * Reading the interval list, see intervals.h.
+ *
+ * Errors are returned as messages rather than printed, so a program
+ * holding several interval lists (see extractfasta.h) can go on after
+ * a bad one. Each chunk of complete lines is parsed into its own interval_list
+ * (records, pieces and strings, but no name hash), then the chunks
+ * are appended to the result in order and their names are looked up
+ * in, or added to, the result's name hash. A chunk stops at its first
+ * bad line; since every line before it became one record, its line
+ * number is known once the earlier chunks are counted, and the line is
+ * parsed again to report the error with that number.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "intervals.h"
+
+#define CHUNK_MIN    (1 << 20)  /* min number of bytes per parsing thread */
+#define STREAM_BLOCK (16 << 20) /* number of bytes read at a time (per thread) from stdin or a pipe */
+
+typedef struct {
+  const char    *text;     /* complete lines to parse */
+  long           len;      /* number of bytes in text */
+  const char    *filename; /* for error messages */
+  interval_list  part;     /* what has been parsed, names is not used */
+  const char    *err_line; /* start of the first bad line, or NULL */
+  pthread_t      thread;
+} interval_chunk;
+
+static char *parse_text(interval_list *list, const char *text, long len, int nthreads, const char *filename);
+static void *parse_chunk(void *varg);
+static char *parse_line(interval_list *list, const char *p, const char *end, long lineno, const char *filename);
+static char *append_chunk(interval_list *list, interval_chunk *c);
+static void  free_part(interval_list *part);
+static void  init_list(interval_list *list);
+static void  grow(void **ptr, long *alloc, long needed, size_t size);
+static char *parse_error(const char *fmt, ...);
+
+/* intervals_create(): return a new, empty interval list, free with intervals_free() */
+interval_list *intervals_create(void) {
+  interval_list *list;
+
+  list = (interval_list *) malloc(sizeof(interval_list));
+  if (list == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  init_list(list);
+  list->names = seqhash_create(1024);
+  return list;
+}
+
+/* Function: intervals_add()
+ * Args:     list:     where to append the intervals
+ *           text:     interval lines, the final one needn't end in a newline
+ *           len:      number of bytes in <text>
+ *           nthreads: number of threads to parse with
+ *           filename: name of the source of <text>, for error messages
+ * Returns:  NULL on success, or a malloc'ed error message (ending in a
+ *           newline) for the first bad line, the one we've always printed.
+ *           After an error, <list> holds the intervals before some point
+ *           at or before the bad line.
+ */
+char *intervals_add(interval_list *list, const char *text, long len, int nthreads, const char *filename) {
+  if (len <= 0)
+    return NULL;
+  return parse_text(list, text, len, nthreads, filename);
+}
+
+/* Function: intervals_read()
+ * Args:     list:     where to append the intervals
+ *           filename: interval list, "-" for stdin
+ *           nthreads: number of threads to parse a regular file with
+ *           ret_io:   RETURN: TRUE if the error is that <filename> can't
+ *                     be read, FALSE for a bad line
+ * Returns:  NULL on success, or a malloc'ed error message as for
+ *           intervals_add(), also if <filename> can't be read.
+ */
+char *intervals_read(interval_list *list, char *filename, int nthreads, int *ret_io) {
+  struct stat    st;
+  int            fd;
+  char          *map;
+  char          *buf;      /* with a stream: bytes read, not yet parsed */
+  long           alloc;    /* allocated size of buf */
+  long           n;        /* number of bytes in buf */
+  long           parsed;   /* number of bytes of complete lines in buf */
+  ssize_t        nread;
+  char          *err = NULL;
+
+  *ret_io = 0;
+  fd = (strcmp(filename, "-") == 0) ? 0 : open(filename, O_RDONLY);
+  if (fd == -1)
+    {
+      *ret_io = 1;
+      return parse_error("Cannot open %s\n", filename);
+    }
+
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0) &&
+      ((map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED))
+    {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      err = parse_text(list, map, st.st_size, nthreads, filename);
+      munmap(map, st.st_size);
+    }
+  else
+    {
+      /* read a block at a time, parse the complete lines, keep the rest */
+      alloc = (long) STREAM_BLOCK * nthreads;
+      n     = 0;
+      buf   = (char *) malloc(alloc);
+      if (buf == NULL)
+        {
+          fprintf(stderr,"No space\n");
+          exit(EXIT_FAILURE);
+        }
+      do
+        {
+          if (n == alloc) /* a line longer than the buffer */
+            grow((void **) &buf, &alloc, n + 1, 1);
+          nread = read(fd, buf + n, alloc - n);
+          if (nread == -1)
+            {
+              err = parse_error("Cannot read %s\n", filename);
+              *ret_io = 1;
+              break;
+            }
+          n += nread;
+          if ((nread > 0) && (n < alloc))
+            continue;
+
+          if (nread == 0)
+            parsed = n; /* end of file, the final line may have no newline */
+          else
+            {
+              for (parsed = n; (parsed > 0) && (buf[parsed-1] != '\n'); parsed--)
+                ;
+            }
+          if (parsed > 0)
+            {
+              err = parse_text(list, buf, parsed, nthreads, filename);
+              memmove(buf, buf + parsed, n - parsed);
+              n -= parsed;
+            }
+        }
+      while ((nread > 0) && (err == NULL));
+      free(buf);
+    }
+  if (fd != 0)
+    close(fd);
+
+  return err;
+}
+
+/* Function: intervals_append()
+ * Args:     list:    where to append the record
+ *           name:    its sequence name
+ *           strand:  PLUS or MINUS
+ *           pc:      [0..npieces-1] its pieces, as parse_line() makes them
+ *           npieces: number of pieces
+ *           opttok:  its optional token, or NULL
+ */
+void intervals_append(interval_list *list, const char *name, int strand, const piece *pc, int npieces, const char *opttok) {
+  interval_record *rec;
+  int              id;
+
+  grow((void **) &(list->recordA), &(list->ralloc), list->nrecords + 1, sizeof(interval_record));
+  grow((void **) &(list->pieceA),  &(list->palloc), list->npieces + npieces, sizeof(piece));
+  if (list->strings == NULL)
+    list->strings = arena_create();
+
+  rec = &(list->recordA[list->nrecords]);
+  if ((id = seqhash_lookup(list->names, name)) == -1)
+    id = seqhash_insert(list->names, arena_strdup(list->strings, name, strlen(name)));
+  rec->name    = (char *) list->names->nameA[id];
+  rec->name_id = id;
+  rec->npieces = npieces;
+  rec->start   = pc[0].start;
+  rec->end     = pc[npieces-1].end;
+  rec->pieces  = list->npieces;
+  rec->strand  = strand;
+  rec->opttok  = (opttok != NULL) ? arena_strdup(list->strings, opttok, strlen(opttok)) : NULL;
+  memcpy(list->pieceA + list->npieces, pc, npieces * sizeof(piece));
+  list->npieces += npieces;
+  list->nrecords++;
+}
+
+/* intervals_clear(): empty <list>, keeping its allocated records and pieces */
+void intervals_clear(interval_list *list) {
+  list->nrecords = 0;
+  list->npieces  = 0;
+  list->nbytes   = 0;
+  list->nbefore  = 0;
+  if (list->strings != NULL)
+    arena_clear(list->strings);
+  seqhash_free(list->names);
+  list->names = seqhash_create(16);
+}
+
+void intervals_free(interval_list *list) {
+  if (list == NULL)
+    return;
+  free(list->recordA);
+  free(list->pieceA);
+  arena_free(list->strings);
+  seqhash_free(list->names);
+  free(list);
+}
+
+/* parse_text(): parse the complete lines text[0..len-1], with up to
+ * <nthreads> threads, and append them to <list>; returns NULL, or a
+ * malloc'ed message for the first bad line */
+static char *parse_text(interval_list *list, const char *text, long len, int nthreads, const char *filename) {
+  interval_chunk *chunkA;
+  interval_list   scratch;
+  const char     *p, *end, *eol;
+  long            lineno;
+  int             nchunks, c;
+  char           *err = NULL;
+
+  list->nbytes += len;
+  nchunks = nthreads;
+  if (len / CHUNK_MIN < nchunks)
+    nchunks = (len / CHUNK_MIN > 1) ? (int) (len / CHUNK_MIN) : 1;
+
+  chunkA = (interval_chunk *) malloc(nchunks * sizeof(interval_chunk));
+  if (chunkA == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+
+  /* split at newlines, into chunks of about the same size */
+  p   = text;
+  end = text + len;
+  for (c = 0; c < nchunks; c++)
+    {
+      eol = (c == nchunks - 1) ? end : text + (len / nchunks) * (c + 1);
+      if (eol < p)
+        eol = p;
+      if (eol < end)
+        {
+          eol = (const char *) memchr(eol, '\n', end - eol);
+          eol = (eol == NULL) ? end : eol + 1;
+        }
+      chunkA[c].text     = p;
+      chunkA[c].len      = eol - p;
+      chunkA[c].filename = filename;
+      p = eol;
+    }
+
+  if (nchunks == 1)
+    parse_chunk(&chunkA[0]);
+  else
+    {
+      for (c = 0; c < nchunks; c++)
+        if (pthread_create(&chunkA[c].thread, NULL, parse_chunk, &chunkA[c]) != 0)
+          {
+            fprintf(stderr, "Failed to create thread\n");
+            exit(EXIT_FAILURE);
+          }
+      for (c = 0; c < nchunks; c++)
+        pthread_join(chunkA[c].thread, NULL);
+    }
+
+  for (c = 0; c < nchunks; c++)
+    {
+      if (err != NULL) /* after the bad line, nothing more is kept */
+        free_part(&chunkA[c].part);
+      else if (chunkA[c].err_line != NULL)
+        {
+          lineno = list->nbefore + list->nrecords + chunkA[c].part.nrecords + 1;
+          end = (const char *) memchr(chunkA[c].err_line, '\n', chunkA[c].text + chunkA[c].len - chunkA[c].err_line);
+          if (end == NULL)
+            end = chunkA[c].text + chunkA[c].len;
+          init_list(&scratch);
+          scratch.strings = arena_create();
+          err = parse_line(&scratch, chunkA[c].err_line, end, lineno, filename);
+          free_part(&scratch);
+          free_part(&chunkA[c].part);
+        }
+      else
+        err = append_chunk(list, &chunkA[c]);
+    }
+  free(chunkA);
+  return err;
+}
+
+/* parse_chunk(): thread function, parse the lines of an interval_chunk
+ * into c->part, stopping at the first bad line */
+static void *parse_chunk(void *varg) {
+  interval_chunk *c = (interval_chunk *) varg;
+  const char     *p, *end, *eol;
+  char           *err;
+
+  init_list(&(c->part));
+  c->part.strings = arena_create();
+  c->err_line     = NULL;
+
+  end = c->text + c->len;
+  for (p = c->text; p < end; p = eol + 1)
+    {
+      eol = (const char *) memchr(p, '\n', end - p);
+      if (eol == NULL)
+        eol = end;
+      /* line numbers are relative to the chunk here, only used if there's an error */
+      err = parse_line(&(c->part), p, eol, (long) c->part.nrecords + 1, c->filename);
+      if (err != NULL)
+        {
+          free(err);
+          c->err_line = p;
+          break;
+        }
+    }
+  return NULL;
+}
+
+/* is_space(): TRUE for the characters strtok() used to split lines on */
+#define is_space(c) (((c) == ' ') || ((c) == '\n') || ((c) == '\r') || ((c) == '\t') || ((c) == '\v'))
+
+/* next_token(): return start of the next token at or after *p, before
+ * <end>, and set *p to just after it; NULL if there are no more tokens */
+static inline const char *next_token(const char **p, const char *end) {
+  const char *tok;
+
+  while ((*p < end) && is_space(**p))
+    (*p)++;
+  if (*p == end)
+    return NULL;
+  tok = *p;
+  while ((*p < end) && (! is_space(**p)))
+    (*p)++;
+  return tok;
+}
+
+/* parse_int(): value of the integer token at <tok>, like atoi(): optional
+ * sign then digits, anything after them is ignored, no digits gives 0 */
+static inline int parse_int(const char *tok, const char *end) {
+  long value = 0;
+  int  neg   = 0;
+
+  if ((tok < end) && ((*tok == '-') || (*tok == '+')))
+    neg = (*(tok++) == '-');
+  for (; (tok < end) && (*tok >= '0') && (*tok <= '9'); tok++)
+    if (value <= INT_MAX)
+      value = value * 10 + (*tok - '0');
+  if (value > INT_MAX)
+    value = INT_MAX;
+  return (int) (neg ? -value : value);
+}
+
+/* Function: parse_line()
+ * Args:     list:     where to append the record
+ *           p, end:   the line, without its newline
+ *           lineno:   line number, for error messages
+ *           filename: for error messages
+ * Returns:  NULL on success, or a malloc'ed error message.
+ */
+static char *parse_line(interval_list *list, const char *p, const char *end, long lineno, const char *filename) {
+  interval_record *rec;
+  interval_record *prev;
+  piece           *pc;
+  const char      *tok;
+  long             len;
+  int              np, i;
+
+  grow((void **) &(list->recordA), &(list->ralloc), list->nrecords + 1, sizeof(interval_record));
+  rec = &(list->recordA[list->nrecords]);
+
+  tok = next_token(&p, end);
+  if (tok == NULL)
+    return parse_error("No contig on line %ld of %s\n", lineno, filename);
+  len  = p - tok;
+  prev = (list->nrecords > 0) ? rec - 1 : NULL;
+  if ((prev != NULL) && (strncmp(prev->name, tok, len) == 0) && (prev->name[len] == '\0'))
+    rec->name = prev->name; /* intervals for the same sequence are often together */
+  else
+    rec->name = arena_strdup(list->strings, tok, len);
+  rec->name_id = -1;
+  rec->opttok  = NULL;
+  rec->pieces  = list->npieces;
+
+  tok = next_token(&p, end);
+  if (tok == NULL)
+    {
+      grow((void **) &(list->pieceA), &(list->palloc), list->npieces + 1, sizeof(piece));
+      list->pieceA[list->npieces].start = UNKNOWN;
+      list->pieceA[list->npieces].end   = UNKNOWN;
+      list->npieces++;
+      rec->strand  = PLUS;
+      rec->npieces = 1;
+      rec->start   = UNKNOWN;
+      rec->end     = UNKNOWN;
+      list->nrecords++;
+      return NULL;
+    }
+
+  rec->npieces = np = parse_int(tok, p);
+  /* make sure we have a positive number of pieces */
+  if (np < 1)
+    return parse_error("Less than one piece specified (interval %ld), this is not allowed\n", lineno);
+
+  /* read start and end positions for each piece, making room for each
+   * as it is read, so a bad <n> can't make us allocate a lot */
+  for (i = 0; i < np; i++)
+    {
+      grow((void **) &(list->pieceA), &(list->palloc), list->npieces + 1, sizeof(piece));
+      pc = &(list->pieceA[list->npieces]);
+      list->npieces++;
+
+      /* the start position for this piece */
+      tok = next_token(&p, end);
+      if (tok == NULL)
+        return parse_error("No interval start for piece %d (interval %ld) in file %s \n", i+1, lineno, filename);
+      pc->start = parse_int(tok, p);
+      /* start position must be positive */
+      if (pc->start < 1)
+        return parse_error("Start position < 1; this is not allowed (%s)\n", rec->name);
+
+      /* the end position for this piece */
+      tok = next_token(&p, end);
+      if (tok == NULL)
+        return parse_error("No interval end for piece %d (interval %ld) in file %s \n", i+1, lineno, filename);
+      pc->end = parse_int(tok, p);
+      if (pc->end < 1)
+        return parse_error("End position < 1; this is not allowed (%s)\n", rec->name);
+
+      /* this piece's start <= end, and start > previous piece's end */
+      if (pc->start > pc->end)
+        return parse_error("Interval %ld, piece %d, start > end (%d > %d)\n", lineno, i+1, pc->start, pc->end);
+      if ((i > 0) && (pc[-1].end >= pc->start))
+        return parse_error("Interval %ld, piece %d (%d..%d) does not come after piece %d (%d..%d)\n", lineno,
+                           i+1, pc->start, pc->end, i, pc[-1].start, pc[-1].end);
+    }
+  rec->start = list->pieceA[rec->pieces].start;          /* start of first piece */
+  rec->end   = list->pieceA[rec->pieces + np - 1].end;   /* end of final piece */
+
+  /* the strand for this interval (it applies to all pieces) */
+  tok = next_token(&p, end);
+  if (tok == NULL)
+    return parse_error("No interval strand for interval %ld of %s\n", lineno, filename);
+  rec->strand = (((p - tok) == 1) && (*tok == '+')) ? PLUS : MINUS;
+
+  /* we allow one additional token, but its optional */
+  tok = next_token(&p, end);
+  if (tok != NULL)
+    {
+      rec->opttok = arena_strdup(list->strings, tok, p - tok);
+      if (next_token(&p, end) != NULL)
+        return parse_error("Extra token for interval %ld of %s\n", lineno, filename);
+    }
+
+  list->nrecords++;
+  return NULL;
+}
+
+/* append_chunk(): append the records of a parsed chunk to <list>,
+ * adding their names to list->names, and free the chunk's part;
+ * returns NULL, or a malloc'ed message if <list> would be too big */
+static char *append_chunk(interval_list *list, interval_chunk *c) {
+  interval_record *rec;
+  const char      *prev_name = NULL; /* name of the previous record as parsed */
+  int              id = -1, i;
+
+  if ((long) list->nrecords + c->part.nrecords > INT_MAX)
+    {
+      free_part(&(c->part));
+      return parse_error("Too many intervals in %s\n", c->filename);
+    }
+  grow((void **) &(list->recordA), &(list->ralloc), list->nrecords + c->part.nrecords, sizeof(interval_record));
+  grow((void **) &(list->pieceA),  &(list->palloc), list->npieces  + c->part.npieces,  sizeof(piece));
+
+  for (i = 0; i < c->part.nrecords; i++)
+    {
+      rec = &(list->recordA[list->nrecords + i]);
+      *rec = c->part.recordA[i];
+      if (rec->name != prev_name)
+        {
+          prev_name = rec->name;
+          id = seqhash_lookup(list->names, rec->name);
+          if (id == -1)
+            id = seqhash_insert(list->names, rec->name);
+        }
+      rec->name    = (char *) list->names->nameA[id];
+      rec->name_id = id;
+      rec->pieces += list->npieces;
+    }
+  if (c->part.npieces > 0)
+    memcpy(list->pieceA + list->npieces, c->part.pieceA, c->part.npieces * sizeof(piece));
+  list->nrecords += c->part.nrecords;
+  list->npieces  += c->part.npieces;
+
+  if (list->strings == NULL)
+    list->strings = c->part.strings;
+  else
+    arena_merge(list->strings, c->part.strings);
+  free(c->part.recordA);
+  free(c->part.pieceA);
+  return NULL;
+}
+
+/* free_part(): free what a chunk parsed, when it isn't appended */
+static void free_part(interval_list *part) {
+  free(part->recordA);
+  free(part->pieceA);
+  arena_free(part->strings);
+}
+
+static void init_list(interval_list *list) {
+  list->recordA  = NULL;
+  list->nrecords = 0;
+  list->ralloc   = 0;
+  list->pieceA   = NULL;
+  list->npieces  = 0;
+  list->palloc   = 0;
+  list->strings  = NULL;
+  list->names    = NULL;
+  list->nbytes   = 0;
+  list->nbefore  = 0;
+}
+
+/* grow(): make sure *ptr, of *alloc elements of <size> bytes, has room
+ * for <needed> elements, at least doubling it when it grows */
+static void grow(void **ptr, long *alloc, long needed, size_t size) {
+  long new_alloc;
+
+  if (needed <= *alloc)
+    return;
+  new_alloc = (*alloc < 1024) ? 1024 : *alloc;
+  while (new_alloc < needed)
+    new_alloc *= 2;
+  *ptr = realloc(*ptr, new_alloc * size);
+  if (*ptr == NULL)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  *alloc = new_alloc;
+}
+
+/* parse_error(): return a malloc'ed, printf-formatted error message */
+static char *parse_error(const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr,"No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return msg;
+}
@@ -0,0 +1,64 @@
+/* intervals.h:
+ *
+ * Reading the interval list, one interval per line:
+ *   <defline_token> <n> <start_1> <end_1> ... <start_n> <end_n> +/- [<optional-token>]
+ * or
+ *   <defline_token>
+ *
+ * A regular file is mapped into memory and split at newlines into one
+ * chunk per thread, which are parsed in parallel; anything else (stdin,
+ * given as "-", or a named pipe) is read and parsed a block at a time.
+ * Either way the file is read once, into storage that grows as needed.
+ * Lines already in memory can be added too, and a list can be added to
+ * more than once. Records can also be appended one at a time, as the
+ * external sort (see extsort.h) does with each name's intervals.
+ */
+
+#ifndef INTERVALS_H
+#define INTERVALS_H
+
+#include "arena.h"
+#include "seqhash.h"
+
+#define UNKNOWN -2
+
+#define PLUS   1
+#define MINUS  2
+
+typedef struct {
+  int start;                /* start position of the piece (e.g. exon) */
+  int end;                  /* end position of the piece */
+} piece;
+
+typedef struct {
+  char *name;               /* sequence name, in interval_list strings */
+  int   name_id;            /* id of name in interval_list names */
+  int   npieces;            /* number of 'pieces' subsequences we will join in final output of the sequence */
+  int   start;              /* start position of full region (same as start of first piece) */
+  int   end;                /* end position of full region (same as end of final piece) */
+  long  pieces;             /* pieceA[pieces..pieces+npieces-1] are the pieces, in order */
+  int   strand;             /* PLUS or MINUS, applies to all pieces */
+  char *opttok;             /* optional token to append to end of the name we assign this sequence, read from input, in interval_list strings */
+} interval_record;
+
+typedef struct {
+  interval_record *recordA;  /* [0..nrecords-1] one per line, in file order */
+  int              nrecords;
+  long             ralloc;   /* allocated size of recordA */
+  piece           *pieceA;   /* [0..npieces-1] pieces of all records */
+  long             npieces;
+  long             palloc;   /* allocated size of pieceA */
+  arena_t         *strings;  /* names and optional tokens */
+  seqhash_t       *names;    /* distinct names, each stored once */
+  long             nbytes;   /* number of bytes of interval lines parsed */
+  long             nbefore;  /* number of lines of its source parsed into earlier lists, for error messages */
+} interval_list;
+
+interval_list *intervals_create(void);
+char          *intervals_add(interval_list *list, const char *text, long len, int nthreads, const char *filename);
+char          *intervals_read(interval_list *list, char *filename, int nthreads, int *ret_io);
+void           intervals_append(interval_list *list, const char *name, int strand, const piece *pc, int npieces, const char *opttok);
+void           intervals_clear(interval_list *list);
+void           intervals_free(interval_list *list);
+
+#endif /* INTERVALS_H */
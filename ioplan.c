@@ -0,0 +1,284 @@
+/* ioplan.c:
+ *
+ * Planned, merged reads through a .fai index, see ioplan.h.
+ *
+ * Once merged, all ranges of a plan are handed to the kernel together
+ * with posix_fadvise(POSIX_FADV_WILLNEED), so it can have them all in
+ * flight on the device while we pread() them one after another.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "faidx.h"
+#include "ioplan.h"
+
+#define RADIX_BITS 11
+#define RADIX_MIN  256 /* fewer pieces than this are sorted with qsort() */
+
+static void  sort_spans(ioplan_span *spanA, ioplan_span *tmpA, int n);
+static int   compare_spans(const void *a, const void *b);
+static void *grow(void *p, size_t size);
+
+/* Function: ioplan_create()
+ * Args:     fai: index to read with, must stay open while the plan is used
+ *           e:   index of the sequence in fai->entryA
+ *           gap: ranges less than <gap> bytes apart are read together
+ * Returns:  a new, empty plan; free with ioplan_free().
+ */
+ioplan_t *ioplan_create(faidx_t *fai, int e, long gap) {
+  ioplan_t *plan = (ioplan_t *) grow(NULL, sizeof(ioplan_t));
+
+  memset(plan, 0, sizeof(ioplan_t));
+  plan->fai = fai;
+  plan->e   = e;
+  plan->gap = gap;
+  return plan;
+}
+
+/* Function: ioplan_add()
+ * Args:     plan:  plan, not yet read
+ *           start: first residue of the piece, 0-based
+ *           end:   final residue of the piece, 0-based, must be < length
+ * Returns:  TRUE once the pieces added come to IOPLAN_MAX_BYTES or more,
+ *           and the plan should be read before more are added.
+ */
+int ioplan_add(ioplan_t *plan, int start, int end) {
+  faidx_entry *entry = &(plan->fai->entryA[plan->e]);
+  ioplan_span *sp;
+
+  if (plan->npieces == plan->palloc)
+    {
+      plan->palloc = (plan->palloc == 0) ? 64 : 2 * plan->palloc;
+      plan->pieceA = (ioplan_span *) grow(plan->pieceA, plan->palloc * sizeof(ioplan_span));
+    }
+  sp = &(plan->pieceA[plan->npieces++]);
+  sp->first = entry->offset + FAIDX_OFFSET(start, entry->line_bases, entry->line_bytes);
+  sp->last  = entry->offset + FAIDX_OFFSET(end,   entry->line_bases, entry->line_bytes);
+  plan->nbytes += sp->last - sp->first + 1;
+  return (plan->nbytes >= IOPLAN_MAX_BYTES);
+}
+
+/* Function: ioplan_read()
+ * Args:     plan: plan with the pieces added since it was created or cleared
+ *
+ * Merges the pieces into ranges and reads them. A range that can't be
+ * read (or is past the end of the file) isn't an error here, the pieces
+ * in it are NULL from ioplan_get(), as they would be from faidx_fetch().
+ */
+void ioplan_read(ioplan_t *plan) {
+  ioplan_span  *sp;
+  ioplan_range *r;
+  long    total = 0; /* number of bytes to read */
+  long    len;
+  int     i;
+  ssize_t got;
+
+  plan->nranges = 0;
+  if (plan->npieces == 0)
+    return;
+
+  if (plan->ralloc < plan->npieces)
+    {
+      plan->ralloc = plan->npieces;
+      free(plan->rangeA);
+      plan->rangeA = (ioplan_range *) grow(NULL, plan->ralloc * sizeof(ioplan_range));
+    }
+
+  /* pieces of one interval, and often the intervals, are already in order */
+  for (i = 1; (i < plan->npieces) && (plan->pieceA[i-1].first <= plan->pieceA[i].first); i++)
+    ;
+  if (i < plan->npieces)
+    {
+      if (plan->npieces < RADIX_MIN)
+        qsort(plan->pieceA, plan->npieces, sizeof(ioplan_span), compare_spans);
+      else /* rangeA is only filled below, and has room for npieces spans */
+        sort_spans(plan->pieceA, (ioplan_span *) plan->rangeA, plan->npieces);
+    }
+
+  /* merge */
+  r = NULL;
+  for (i = 0; i < plan->npieces; i++)
+    {
+      sp = &(plan->pieceA[i]);
+      if ((r != NULL) && (sp->first <= r->span.last + plan->gap + 1))
+        {
+          if (sp->last > r->span.last)
+            r->span.last = sp->last;
+        }
+      else
+        {
+          r = &(plan->rangeA[plan->nranges++]);
+          r->span = *sp;
+        }
+    }
+
+  for (i = 0; i < plan->nranges; i++)
+    {
+      plan->rangeA[i].off = total;
+      total += plan->rangeA[i].span.last - plan->rangeA[i].span.first + 1;
+    }
+  if (plan->buf_alloc < total)
+    {
+      plan->buf_alloc = total;
+      free(plan->buf);
+      plan->buf = (char *) grow(NULL, total);
+    }
+
+  if ((plan->nranges > 1) && (plan->fai->gzi == NULL)) /* offsets aren't in the file if it is compressed */
+    for (i = 0; i < plan->nranges; i++)
+      posix_fadvise(plan->fai->fd, plan->rangeA[i].span.first,
+                    plan->rangeA[i].span.last - plan->rangeA[i].span.first + 1, POSIX_FADV_WILLNEED);
+
+  for (i = 0; i < plan->nranges; i++)
+    {
+      r   = &(plan->rangeA[i]);
+      len = r->span.last - r->span.first + 1;
+      r->nread = 0;
+      while (r->nread < len)
+        {
+          got = faidx_pread(plan->fai, plan->buf + r->off + r->nread, len - r->nread, r->span.first + r->nread);
+          if ((got == -1) && (errno == EINTR))
+            continue;
+          if (got <= 0)
+            break;
+          r->nread += got;
+        }
+    }
+}
+
+/* Function: ioplan_get()
+ * Args:     plan:      plan that has been read, with a piece covering <start>..<end>
+ *           start:     first residue to get, 0-based
+ *           end:       final residue to get, 0-based
+ *           ret_buf:   buffer to unwrap residues into if they span lines,
+ *                      grown (realloc'ed) as needed
+ *           ret_alloc: allocated size of *ret_buf
+ * Returns:  pointer to residues <start>..<end>, in the plan or *ret_buf;
+ *           NULL if they weren't all read.
+ */
+char *ioplan_get(ioplan_t *plan, int start, int end, char **ret_buf, long *ret_alloc) {
+  faidx_entry  *entry = &(plan->fai->entryA[plan->e]);
+  ioplan_range *r;
+  long first, last; /* byte offsets of residues <start> and <end> */
+  int  lo, hi, mid;
+  char *src;
+
+  first = entry->offset + FAIDX_OFFSET(start, entry->line_bases, entry->line_bytes);
+  last  = entry->offset + FAIDX_OFFSET(end,   entry->line_bases, entry->line_bytes);
+
+  if (plan->nranges == 0)
+    return NULL;
+
+  /* the final range starting at or before <first> */
+  lo = 0;
+  hi = plan->nranges - 1;
+  while (lo < hi)
+    {
+      mid = (lo + hi + 1) / 2;
+      if (plan->rangeA[mid].span.first <= first)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+  r = &(plan->rangeA[lo]);
+  if ((r->span.first > first) || (last >= r->span.first + r->nread))
+    return NULL;
+
+  src = plan->buf + r->off + (first - r->span.first);
+  if ((entry->line_bytes == entry->line_bases) ||
+      ((start / entry->line_bases) == (end / entry->line_bases)))
+    return src;
+
+  if (*ret_alloc < end - start + 1)
+    {
+      *ret_alloc = end - start + 1;
+      *ret_buf = (char *) grow(*ret_buf, *ret_alloc);
+    }
+  faidx_unwrap(*ret_buf, src, start, end - start + 1, entry->line_bases, entry->line_bytes);
+  return *ret_buf;
+}
+
+/* ioplan_clear(): remove all pieces from <plan>, keeping its buffers */
+void ioplan_clear(ioplan_t *plan) {
+  plan->npieces = 0;
+  plan->nranges = 0;
+  plan->nbytes  = 0;
+}
+
+void ioplan_free(ioplan_t *plan) {
+  if (plan == NULL)
+    return;
+  free(plan->pieceA);
+  free(plan->rangeA);
+  free(plan->buf);
+  free(plan);
+}
+
+/* Function: sort_spans()
+ * Args:     spanA: [0..n-1] spans to sort by their first byte
+ *           tmpA:  [0..n-1] room to sort in
+ *           n:     number of spans
+ *
+ * A radix sort, RADIX_BITS of first (less the smallest) at a time; a
+ * plan can have hundreds of thousands of pieces, where qsort() is slow.
+ */
+static void sort_spans(ioplan_span *spanA, ioplan_span *tmpA, int n) {
+  int           countA[1 << RADIX_BITS];
+  ioplan_span  *from = spanA, *to = tmpA, *swap;
+  long          min, max;
+  unsigned long digit;
+  int           i, shift, sum, c;
+
+  min = max = spanA[0].first;
+  for (i = 1; i < n; i++)
+    {
+      if (spanA[i].first < min) min = spanA[i].first;
+      if (spanA[i].first > max) max = spanA[i].first;
+    }
+
+  for (shift = 0; (shift == 0) || (((unsigned long) (max - min) >> shift) != 0); shift += RADIX_BITS)
+    {
+      memset(countA, 0, sizeof(countA));
+      for (i = 0; i < n; i++)
+        countA[((unsigned long) (from[i].first - min) >> shift) & ((1 << RADIX_BITS) - 1)]++;
+      for (sum = 0, c = 0; c < (1 << RADIX_BITS); c++)
+        {
+          i = countA[c];
+          countA[c] = sum;
+          sum += i;
+        }
+      for (i = 0; i < n; i++)
+        {
+          digit = ((unsigned long) (from[i].first - min) >> shift) & ((1 << RADIX_BITS) - 1);
+          to[countA[digit]++] = from[i];
+        }
+      swap = from; from = to; to = swap;
+    }
+  if (from != spanA)
+    memcpy(spanA, from, n * sizeof(ioplan_span));
+}
+
+/* compare_spans(): sort pieces by their first byte */
+static int compare_spans(const void *a, const void *b) {
+  long x = ((const ioplan_span *) a)->first;
+  long y = ((const ioplan_span *) b)->first;
+
+  return (x > y) - (x < y);
+}
+
+/* grow(): realloc() or die */
+static void *grow(void *p, size_t size) {
+  p = realloc(p, size);
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
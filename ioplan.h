@@ -0,0 +1,55 @@
+/* ioplan.h:
+ *
+ * Planned reads of a sequence through its .fai index (see faidx.h):
+ * the pieces about to be extracted are added to a plan, their byte
+ * ranges are sorted and merged when less than a gap apart, and each
+ * merged range is read with a single pread(), instead of one read per
+ * piece. Pieces are then unwrapped from what was read.
+ *
+ * A plan belongs to one thread; threads extracting at the same time
+ * each have their own, and so read at the same time.
+ */
+
+#ifndef IOPLAN_H
+#define IOPLAN_H
+
+#include "faidx.h"
+
+#define IOPLAN_GAP (16 * 1024)         /* default max number of unneeded bytes read to merge two ranges */
+#define IOPLAN_MAX_BYTES (8 * 1024 * 1024) /* bytes of pieces after which a plan should be read, see ioplan_add() */
+
+/* bytes of the fasta file covering a piece, or a range of them read together */
+typedef struct {
+  long first; /* byte offset in the fasta file of the first byte */
+  long last;  /* byte offset of the final byte */
+} ioplan_span;
+
+typedef struct {
+  ioplan_span span;
+  long        nread; /* number of bytes read, less than the span if the file is short */
+  long        off;   /* offset of the first byte in the plan's buf */
+} ioplan_range;
+
+typedef struct {
+  faidx_t      *fai;
+  int           e;        /* index of the sequence in fai->entryA */
+  long          gap;
+  ioplan_span  *pieceA;   /* [0..npieces-1] the pieces added, sorted once read */
+  int           npieces;
+  int           palloc;   /* allocated size of pieceA */
+  long          nbytes;   /* number of bytes of the pieces added */
+  ioplan_range *rangeA;   /* [0..nranges-1] once read: the merged ranges, in file order */
+  int           nranges;
+  int           ralloc;
+  char         *buf;      /* the ranges read, one after another */
+  long          buf_alloc;
+} ioplan_t;
+
+ioplan_t *ioplan_create(faidx_t *fai, int e, long gap);
+int       ioplan_add(ioplan_t *plan, int start, int end);
+void      ioplan_read(ioplan_t *plan);
+char     *ioplan_get(ioplan_t *plan, int start, int end, char **ret_buf, long *ret_alloc);
+void      ioplan_clear(ioplan_t *plan);
+void      ioplan_free(ioplan_t *plan);
+
+#endif /* IOPLAN_H */
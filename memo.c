@@ -0,0 +1,233 @@
+/* memo.c:
+ *
+ * Memoization of the pieces and intervals of one sequence, see memo.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memo.h"
+
+static memo_interval *find_interval(memo_t *m, uint64_t hash);
+static uint64_t piece_key(int start, int end);
+static void     grow_pieces(memo_t *m);
+static void     grow_intervals(memo_t *m);
+static void    *alloc_slots(uint64_t nslots, size_t size);
+static memo_piece *piece_slots(uint64_t nslots);
+
+/* Function: memo_create()
+ * Args:     nexpected: number of intervals expected, the tables grow as needed
+ * Returns:  new empty memo, free with memo_free()
+ */
+memo_t *memo_create(int nexpected) {
+  memo_t  *m;
+  uint64_t nslots = 16;
+
+  while (nslots < 2 * (uint64_t) nexpected)
+    nslots *= 2;
+
+  m = (memo_t *) alloc_slots(1, sizeof(memo_t)); /* lookups and hits start at 0 */
+  m->use_pieces    = 1;
+  m->use_intervals = 1;
+  m->pieceA      = piece_slots(2 * nslots);
+  m->pmask       = 2 * nslots - 1;
+  m->npieces     = 0;
+  m->intervalA   = (memo_interval *) alloc_slots(nslots, sizeof(memo_interval));
+  m->imask       = nslots - 1;
+  m->nintervals  = 0;
+  m->store       = NULL;
+  m->nstore      = 0;
+  m->store_alloc = 0;
+  return m;
+}
+
+/* memo_get_piece(): residues <start>..<end> (0-based) if they were added, else NULL */
+const char *memo_get_piece(memo_t *m, int start, int end) {
+  uint64_t s;
+
+  m->piece_lookups++;
+  for (s = piece_key(start, end) & m->pmask; m->pieceA[s].start != -1; s = (s + 1) & m->pmask)
+    if ((m->pieceA[s].start == start) && (m->pieceA[s].end == end))
+      {
+        m->piece_hits++;
+        return m->store + m->pieceA[s].off;
+      }
+  if ((m->piece_lookups == MEMO_TRIAL) && (m->piece_hits * MEMO_MIN_HITS < MEMO_TRIAL))
+    m->use_pieces = 0;
+  return NULL;
+}
+
+/* Function: memo_add_piece()
+ * Args:     m:        memo
+ *           start:    0-based first residue of the piece, not already added
+ *           end:      0-based final residue
+ *           residues: the residues, copied
+ *
+ * Once MEMO_MAX_BYTES residues are kept, pieces are no longer added.
+ */
+void memo_add_piece(memo_t *m, int start, int end, const char *residues) {
+  long     len = end - start + 1;
+  uint64_t s;
+
+  if (m->nstore + len > MEMO_MAX_BYTES)
+    return;
+  if (m->nstore + len > m->store_alloc)
+    {
+      m->store_alloc = 2 * (m->nstore + len);
+      if (m->store_alloc > MEMO_MAX_BYTES) m->store_alloc = MEMO_MAX_BYTES;
+      m->store = (char *) realloc(m->store, m->store_alloc);
+      if (m->store == NULL)
+        {
+          fprintf(stderr, "No space\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+  for (s = piece_key(start, end) & m->pmask; m->pieceA[s].start != -1; s = (s + 1) & m->pmask)
+    ;
+  m->pieceA[s].start = start;
+  m->pieceA[s].end   = end;
+  m->pieceA[s].off   = m->nstore;
+  memcpy(m->store + m->nstore, residues, len);
+  m->nstore += len;
+
+  if ((uint64_t) (2 * ++(m->npieces)) > m->pmask + 1)
+    grow_pieces(m);
+}
+
+/* memo_get_interval(): the interval added with <hash>, or NULL; the
+ * caller checks that its pieces are the same */
+memo_interval *memo_get_interval(memo_t *m, uint64_t hash) {
+  memo_interval *iv = find_interval(m, hash);
+
+  m->interval_lookups++;
+  if (iv != NULL)
+    m->interval_hits++;
+  else if ((m->interval_lookups == MEMO_TRIAL) && (m->interval_hits * MEMO_MIN_HITS < MEMO_TRIAL))
+    m->use_intervals = 0;
+  return iv;
+}
+
+/* Function: memo_add_interval()
+ * Args:     m:     memo
+ *           hash:  hash of the interval's strand and pieces, from memo_hash()
+ *           index: the interval
+ *           from:  output position of its sequence lines
+ *           len:   number of bytes of them
+ *
+ * Replaces the interval added with the same <hash>, if there is one.
+ */
+void memo_add_interval(memo_t *m, uint64_t hash, int index, long from, long len) {
+  memo_interval *iv = find_interval(m, hash);
+  uint64_t       s;
+
+  if (iv == NULL)
+    {
+      for (s = hash & m->imask; m->intervalA[s].hash != 0; s = (s + 1) & m->imask)
+        ;
+      iv = &(m->intervalA[s]);
+      m->nintervals++;
+    }
+  iv->hash  = hash;
+  iv->index = index;
+  iv->from  = from;
+  iv->len   = len;
+
+  if ((uint64_t) (2 * m->nintervals) > m->imask + 1)
+    grow_intervals(m);
+}
+
+/* memo_hash(): <hash> with <value> mixed in, never 0; start with 0 */
+uint64_t memo_hash(uint64_t hash, int value) {
+  hash = (hash ^ (uint32_t) value) * 0x9e3779b97f4a7c15ULL;
+  hash ^= hash >> 29;
+  return (hash == 0) ? 1 : hash;
+}
+
+void memo_free(memo_t *m) {
+  if (m == NULL)
+    return;
+  free(m->pieceA);
+  free(m->intervalA);
+  free(m->store);
+  free(m);
+}
+
+/* find_interval(): memo_get_interval() without counting the lookup */
+static memo_interval *find_interval(memo_t *m, uint64_t hash) {
+  uint64_t s;
+
+  for (s = hash & m->imask; m->intervalA[s].hash != 0; s = (s + 1) & m->imask)
+    if (m->intervalA[s].hash == hash)
+      return &(m->intervalA[s]);
+  return NULL;
+}
+
+/* piece_key(): hash of a piece */
+static uint64_t piece_key(int start, int end) {
+  uint64_t key = ((uint64_t) (uint32_t) start << 32) | (uint32_t) end;
+
+  key *= 0x9e3779b97f4a7c15ULL;
+  return key ^ (key >> 32);
+}
+
+/* grow_pieces(): double the number of piece slots, and reinsert all pieces */
+static void grow_pieces(memo_t *m) {
+  memo_piece *old    = m->pieceA;
+  uint64_t    nold   = m->pmask + 1;
+  uint64_t    nslots = 2 * nold;
+  uint64_t    i, s;
+
+  m->pieceA = piece_slots(nslots);
+  m->pmask  = nslots - 1;
+  for (i = 0; i < nold; i++)
+    if (old[i].start != -1)
+      {
+        for (s = piece_key(old[i].start, old[i].end) & m->pmask; m->pieceA[s].start != -1; s = (s + 1) & m->pmask)
+          ;
+        m->pieceA[s] = old[i];
+      }
+  free(old);
+}
+
+/* grow_intervals(): double the number of interval slots, and reinsert all intervals */
+static void grow_intervals(memo_t *m) {
+  memo_interval *old    = m->intervalA;
+  uint64_t       nold   = m->imask + 1;
+  uint64_t       nslots = 2 * nold;
+  uint64_t       i, s;
+
+  m->intervalA = (memo_interval *) alloc_slots(nslots, sizeof(memo_interval));
+  m->imask     = nslots - 1;
+  for (i = 0; i < nold; i++)
+    if (old[i].hash != 0)
+      {
+        for (s = old[i].hash & m->imask; m->intervalA[s].hash != 0; s = (s + 1) & m->imask)
+          ;
+        m->intervalA[s] = old[i];
+      }
+  free(old);
+}
+
+/* alloc_slots(): allocate <nslots> zeroed slots of <size> bytes, an
+ * empty interval slot (hash 0) */
+static void *alloc_slots(uint64_t nslots, size_t size) {
+  void *p = calloc(nslots, size);
+
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space for %ld hash slots\n", (long) nslots);
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
+
+/* piece_slots(): allocate <nslots> empty piece slots (start -1) */
+static memo_piece *piece_slots(uint64_t nslots) {
+  memo_piece *p = (memo_piece *) alloc_slots(nslots, sizeof(memo_piece));
+  uint64_t    s;
+
+  for (s = 0; s < nslots; s++)
+    p[s].start = -1;
+  return p;
+}
@@ -0,0 +1,68 @@
+/* memo.h:
+ *
+ * Memoization of what has been extracted from one sequence, for
+ * interval lists where many intervals (isoforms of a gene) share
+ * pieces (exons), or are duplicated outright:
+ *
+ *   pieces:    residues of a piece that had to be copied to be read
+ *              (unpacked from a 2-bit cache, or unwrapped from lines),
+ *              kept so the next interval with the same piece doesn't
+ *              copy it again
+ *   intervals: where the sequence lines of an interval were output, so
+ *              an interval with the same strand and pieces can repeat
+ *              them (see seqout_repeat()) instead of formatting them again
+ *
+ * Both are open addressing (linear probing) hash tables that grow as
+ * needed; a memo is only used for one sequence. Keeping things that
+ * never come up again only costs time, so each table is given up on
+ * if fewer than 1 in MEMO_MIN_HITS of its first MEMO_TRIAL lookups
+ * find something.
+ */
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdint.h>
+
+#define MEMO_MAX_BYTES (16 * 1024 * 1024) /* max number of residues of pieces kept */
+#define MEMO_TRIAL     256
+#define MEMO_MIN_HITS  8
+
+typedef struct {
+  int  start;  /* 0-based first residue, -1 if the slot is empty */
+  int  end;    /* 0-based final residue */
+  long off;    /* offset of its residues in the memo's store */
+} memo_piece;
+
+typedef struct {
+  uint64_t hash;   /* of the interval's strand and pieces, 0 if the slot is empty */
+  int      index;  /* the interval, to check its pieces against */
+  long     from;   /* output position of its sequence lines, from seqout_tell() */
+  long     len;    /* number of bytes of them */
+} memo_interval;
+
+typedef struct {
+  int            use_pieces;    /* TRUE while pieces are worth keeping */
+  int            use_intervals; /* TRUE while intervals are worth keeping */
+  long           piece_lookups, piece_hits;
+  long           interval_lookups, interval_hits;
+  memo_piece    *pieceA;     /* [0..pmask] slots */
+  uint64_t       pmask;      /* number of slots - 1, a power of 2 - 1 */
+  int            npieces;
+  memo_interval *intervalA;  /* [0..imask] slots */
+  uint64_t       imask;
+  int            nintervals;
+  char          *store;      /* residues of the pieces */
+  long           nstore;
+  long           store_alloc;
+} memo_t;
+
+memo_t        *memo_create(int nexpected);
+const char    *memo_get_piece(memo_t *m, int start, int end);
+void           memo_add_piece(memo_t *m, int start, int end, const char *residues);
+memo_interval *memo_get_interval(memo_t *m, uint64_t hash);
+void           memo_add_interval(memo_t *m, uint64_t hash, int index, long from, long len);
+uint64_t       memo_hash(uint64_t hash, int value);
+void           memo_free(memo_t *m);
+
+#endif /* MEMO_H */
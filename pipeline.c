@@ -0,0 +1,340 @@
+/* pipeline.c:
+ *
+ * Multi-threaded extraction pipeline, see pipeline.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+
+#define SLOT_EMPTY  0 /* no task */
+#define SLOT_QUEUED 1 /* task submitted, not yet finished by a worker */
+#define SLOT_DONE   2 /* task finished, output not yet written */
+
+typedef struct {
+  void     *arg;   /* task, passed to run() and done() */
+  seqout_t *out;   /* task's output, once it has been run */
+  char     *err;   /* task's error message, or NULL */
+  int       state; /* SLOT_EMPTY, SLOT_QUEUED or SLOT_DONE */
+} task_slot;
+
+typedef struct {
+  pthread_mutex_t lock;
+  long           *seqA;  /* ring of task sequence numbers, max_inflight long */
+  int             head;  /* position of the oldest task in seqA */
+  int             count; /* number of tasks in seqA */
+} task_queue;
+
+typedef struct {
+  pipeline_t *pl;
+  int         w;     /* index of this worker */
+} worker_arg;
+
+struct pipeline_s {
+  int               nworkers;
+  int               max_inflight; /* max number of tasks submitted and not yet written */
+  seqout_t         *output;
+  pipeline_run_fn   run;
+  pipeline_done_fn  done;
+  pthread_t        *workerA;      /* [0..nworkers-1] */
+  worker_arg       *wargA;        /* [0..nworkers-1] */
+  task_queue       *queueA;       /* [0..nworkers-1] one queue per worker */
+  pthread_t         writer;
+  task_slot        *slotA;        /* [0..max_inflight-1] task with sequence number s is in slotA[s % max_inflight] */
+
+  pthread_mutex_t   lock;         /* protects everything below, and the state of slots */
+  pthread_cond_t    work_cv;      /* signalled when a task is submitted, or we're finishing */
+  pthread_cond_t    done_cv;      /* signalled when a task is done, or we're finishing */
+  pthread_cond_t    space_cv;     /* signalled when a task has been written */
+  long              nsubmitted;   /* number of tasks submitted */
+  long              nwritten;     /* number of tasks written */
+  int               pending;      /* number of tasks in queues */
+  int               next_queue;   /* queue the next submitted task goes to */
+  int               finished;     /* TRUE once pipeline_finish() is called */
+  int               failed;       /* TRUE once a task has failed, or the output has */
+  char             *err;          /* error message of the first failed task, or NULL */
+};
+
+static void *worker_main(void *varg);
+static void *writer_main(void *varg);
+static long  take_task(pipeline_t *pl, int q);
+static void  die_pthread(const char *what);
+static void *alloc_or_die(size_t size);
+
+/* Function: pipeline_start()
+ * Args:     nworkers:     number of worker threads
+ *           max_inflight: max number of tasks submitted but not yet written
+ *           output:       where the writer writes task output, only the
+ *                         writer thread touches it until pipeline_finish()
+ *           run:          runs a task
+ *           done:         called by the writer after a task's output is written
+ * Returns:  running pipeline, stop it with pipeline_finish()
+ */
+pipeline_t *pipeline_start(int nworkers, int max_inflight, seqout_t *output,
+                           pipeline_run_fn run, pipeline_done_fn done) {
+  pipeline_t *pl;
+  int         w, s;
+
+  pl = (pipeline_t *) alloc_or_die(sizeof(pipeline_t));
+  pl->nworkers     = nworkers;
+  pl->max_inflight = max_inflight;
+  pl->output       = output;
+  pl->run          = run;
+  pl->done         = done;
+  pl->nsubmitted   = 0;
+  pl->nwritten     = 0;
+  pl->pending      = 0;
+  pl->next_queue   = 0;
+  pl->finished     = 0;
+  pl->failed       = 0;
+  pl->err          = NULL;
+
+  pl->slotA = (task_slot *) alloc_or_die(max_inflight * sizeof(task_slot));
+  for (s = 0; s < max_inflight; s++)
+    pl->slotA[s].state = SLOT_EMPTY;
+
+  if ((pthread_mutex_init(&pl->lock, NULL) != 0) ||
+      (pthread_cond_init(&pl->work_cv, NULL) != 0) ||
+      (pthread_cond_init(&pl->done_cv, NULL) != 0) ||
+      (pthread_cond_init(&pl->space_cv, NULL) != 0))
+    die_pthread("initialize lock");
+
+  pl->queueA  = (task_queue *) alloc_or_die(nworkers * sizeof(task_queue));
+  pl->workerA = (pthread_t *)  alloc_or_die(nworkers * sizeof(pthread_t));
+  pl->wargA   = (worker_arg *) alloc_or_die(nworkers * sizeof(worker_arg));
+  for (w = 0; w < nworkers; w++)
+    {
+      if (pthread_mutex_init(&pl->queueA[w].lock, NULL) != 0)
+        die_pthread("initialize lock");
+      pl->queueA[w].seqA  = (long *) alloc_or_die(max_inflight * sizeof(long));
+      pl->queueA[w].head  = 0;
+      pl->queueA[w].count = 0;
+    }
+  for (w = 0; w < nworkers; w++)
+    {
+      pl->wargA[w].pl = pl;
+      pl->wargA[w].w  = w;
+      if (pthread_create(&pl->workerA[w], NULL, worker_main, &pl->wargA[w]) != 0)
+        die_pthread("create thread");
+    }
+  if (pthread_create(&pl->writer, NULL, writer_main, pl) != 0)
+    die_pthread("create thread");
+
+  return pl;
+}
+
+/* Function: pipeline_submit()
+ * Args:     pl:  pipeline
+ *           arg: task, passed to run() by a worker and then to done()
+ *                by the writer
+ * Returns:  0, or -1 once a task or the output has failed; the task is
+ *           accepted either way (it is not run, but done() is called), and
+ *           the caller should stop submitting.
+ * Note:     waits while <max_inflight> tasks are submitted but not written.
+ */
+int pipeline_submit(pipeline_t *pl, void *arg) {
+  task_queue *queue;
+  task_slot  *slot;
+  long        seq;
+  int         failed;
+
+  pthread_mutex_lock(&pl->lock);
+  while ((pl->nsubmitted - pl->nwritten) >= pl->max_inflight)
+    pthread_cond_wait(&pl->space_cv, &pl->lock);
+  seq   = pl->nsubmitted++;
+  slot  = &(pl->slotA[seq % pl->max_inflight]);
+  slot->arg   = arg;
+  slot->out   = NULL;
+  slot->err   = NULL;
+  slot->state = SLOT_QUEUED;
+  queue = &(pl->queueA[pl->next_queue]);
+  pl->next_queue = (pl->next_queue + 1) % pl->nworkers;
+  pthread_mutex_unlock(&pl->lock);
+
+  pthread_mutex_lock(&queue->lock);
+  queue->seqA[(queue->head + queue->count) % pl->max_inflight] = seq;
+  queue->count++;
+  pthread_mutex_unlock(&queue->lock);
+
+  pthread_mutex_lock(&pl->lock);
+  pl->pending++;
+  failed = pl->failed;
+  pthread_cond_signal(&pl->work_cv);
+  pthread_mutex_unlock(&pl->lock);
+  return failed ? -1 : 0;
+}
+
+/* Function: pipeline_wait()
+ * Args:     pl: pipeline
+ * Note:     waits until all tasks submitted so far have been written,
+ *           so that whatever they refer to can be released.
+ */
+void pipeline_wait(pipeline_t *pl) {
+  pthread_mutex_lock(&pl->lock);
+  while (pl->nwritten < pl->nsubmitted)
+    pthread_cond_wait(&pl->space_cv, &pl->lock);
+  pthread_mutex_unlock(&pl->lock);
+}
+
+/* Function: pipeline_finish()
+ * Args:     pl: pipeline, freed
+ * Returns:  NULL, or the malloc'ed error message of the first failed task;
+ *           whether the output failed is up to the caller to check.
+ * Note:     waits until all submitted tasks have been run and written.
+ */
+char *pipeline_finish(pipeline_t *pl) {
+  char *err;
+  int   w;
+
+  pthread_mutex_lock(&pl->lock);
+  pl->finished = 1;
+  pthread_cond_broadcast(&pl->work_cv);
+  pthread_cond_broadcast(&pl->done_cv);
+  pthread_mutex_unlock(&pl->lock);
+
+  for (w = 0; w < pl->nworkers; w++)
+    pthread_join(pl->workerA[w], NULL);
+  pthread_join(pl->writer, NULL);
+
+  for (w = 0; w < pl->nworkers; w++)
+    {
+      pthread_mutex_destroy(&pl->queueA[w].lock);
+      free(pl->queueA[w].seqA);
+    }
+  pthread_mutex_destroy(&pl->lock);
+  pthread_cond_destroy(&pl->work_cv);
+  pthread_cond_destroy(&pl->done_cv);
+  pthread_cond_destroy(&pl->space_cv);
+  free(pl->queueA);
+  free(pl->workerA);
+  free(pl->wargA);
+  free(pl->slotA);
+  err = pl->err;
+  free(pl);
+  return err;
+}
+
+static void *worker_main(void *varg) {
+  pipeline_t *pl = ((worker_arg *) varg)->pl;
+  int         w  = ((worker_arg *) varg)->w;
+  task_slot  *slot;
+  seqout_t   *out;
+  char       *err;
+  long        seq;
+  int         i, skip;
+
+  for (;;)
+    {
+      /* our own queue first, then steal from the others */
+      seq = take_task(pl, w);
+      for (i = 1; (seq == -1) && (i < pl->nworkers); i++)
+        seq = take_task(pl, (w + i) % pl->nworkers);
+
+      if (seq != -1)
+        {
+          pthread_mutex_lock(&pl->lock);
+          pl->pending--;
+          slot = &(pl->slotA[seq % pl->max_inflight]);
+          skip = pl->failed;
+          pthread_mutex_unlock(&pl->lock);
+
+          /* once something has failed, output after it is thrown away */
+          out = seqout_create(-1, pl->output->width);
+          err = skip ? NULL : pl->run(slot->arg, out);
+
+          pthread_mutex_lock(&pl->lock);
+          slot->out   = out;
+          slot->err   = err;
+          slot->state = SLOT_DONE;
+          pthread_cond_signal(&pl->done_cv);
+          pthread_mutex_unlock(&pl->lock);
+          continue;
+        }
+
+      /* nothing to do, wait for more tasks */
+      pthread_mutex_lock(&pl->lock);
+      while ((pl->pending <= 0) && (! pl->finished))
+        pthread_cond_wait(&pl->work_cv, &pl->lock);
+      if ((pl->pending <= 0) && pl->finished)
+        {
+          pthread_mutex_unlock(&pl->lock);
+          break;
+        }
+      pthread_mutex_unlock(&pl->lock);
+    }
+  return NULL;
+}
+
+static void *writer_main(void *varg) {
+  pipeline_t *pl = (pipeline_t *) varg;
+  task_slot  *slot;
+  int         failed;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&pl->lock);
+      slot = &(pl->slotA[pl->nwritten % pl->max_inflight]);
+      while ((slot->state != SLOT_DONE) && (! (pl->finished && (pl->nwritten == pl->nsubmitted))))
+        pthread_cond_wait(&pl->done_cv, &pl->lock);
+      if (slot->state != SLOT_DONE)
+        {
+          pthread_mutex_unlock(&pl->lock);
+          break;
+        }
+      failed = pl->failed;
+      pthread_mutex_unlock(&pl->lock);
+
+      /* output of all earlier tasks, and of a failed task up to its error */
+      if (! failed)
+        seqout_write(pl->output, slot->out->buf, slot->out->n);
+      seqout_close(slot->out);
+      pl->done(slot->arg);
+
+      pthread_mutex_lock(&pl->lock);
+      if ((slot->err != NULL) && (pl->err == NULL))
+        pl->err = slot->err;
+      else
+        free(slot->err);
+      if ((slot->err != NULL) || pl->output->failed)
+        pl->failed = 1;
+      slot->state = SLOT_EMPTY;
+      pl->nwritten++;
+      pthread_cond_signal(&pl->space_cv);
+      pthread_mutex_unlock(&pl->lock);
+    }
+  return NULL;
+}
+
+/* take_task(): remove and return the oldest task sequence number from queue <q>, -1 if it's empty */
+static long take_task(pipeline_t *pl, int q) {
+  task_queue *queue = &(pl->queueA[q]);
+  long        seq = -1;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count > 0)
+    {
+      seq = queue->seqA[queue->head];
+      queue->head = (queue->head + 1) % pl->max_inflight;
+      queue->count--;
+    }
+  pthread_mutex_unlock(&queue->lock);
+  return seq;
+}
+
+static void die_pthread(const char *what) {
+  fprintf(stderr, "Failed to %s\n", what);
+  exit(EXIT_FAILURE);
+}
+
+static void *alloc_or_die(size_t size) {
+  void *p = malloc(size);
+
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
@@ -0,0 +1,38 @@
+/* pipeline.h:
+ *
+ * A multi-threaded extraction pipeline: the calling thread reads
+ * records and submits tasks, a pool of worker threads runs the tasks
+ * (each formats its output into its own in-memory seqout_t) and a
+ * writer thread writes the results to the real output in the order
+ * the tasks were submitted, so output is the same as with one thread.
+ *
+ * Tasks are handed out round-robin to per-worker queues; a worker
+ * whose queue is empty takes (steals) the oldest task from another
+ * worker's queue, so one expensive record doesn't hold up the others.
+ * At most <max_inflight> tasks can be submitted and not yet written,
+ * pipeline_submit() waits when that many are, which bounds memory.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "seqout.h"
+
+/* runs a task, writing its output to <out>; returns NULL on success
+ * or a malloc'ed error message. The writer writes the output of all
+ * earlier tasks, and this task's output so far, then nothing more:
+ * later tasks aren't run, and pipeline_finish() returns the message */
+typedef char *(*pipeline_run_fn)(void *arg, seqout_t *out);
+
+/* called by the writer once a task's output has been written */
+typedef void (*pipeline_done_fn)(void *arg);
+
+typedef struct pipeline_s pipeline_t;
+
+pipeline_t *pipeline_start(int nworkers, int max_inflight, seqout_t *output,
+                           pipeline_run_fn run, pipeline_done_fn done);
+int         pipeline_submit(pipeline_t *pl, void *arg);
+void        pipeline_wait(pipeline_t *pl);
+char       *pipeline_finish(pipeline_t *pl);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,168 @@
+/* revcomp.c:
+ *
+ * Reverse complementing of nucleotide sequence, see revcomp.h.
+ *
+ * The SIMD variants complement with two 16-entry byte shuffles (one
+ * for each half of the alphabet, selected by bit 4 of the character,
+ * bits 0..3 index the table), restore the case bit, replace anything
+ * that is not an IUPAC letter with 'N', then reverse the bytes of the
+ * vector with one more shuffle.
+ */
+
+#include <string.h>
+
+#include "revcomp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REVCOMP_X86
+#include <immintrin.h>
+#endif
+
+/* spelled out in full, rows of 16 characters, anything not an IUPAC
+ * letter is 'N' (U complements to A) */
+const unsigned char revcomp_table[256] = {
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /*   0.. 15 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /*  16.. 31 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /*  32.. 47 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /*  48.. 63 */
+  'N','T','V','G','H','N','N','C','D','N','N','M','N','K','N','N', /*  64.. 79 */
+  'N','N','Y','S','A','A','B','W','N','R','N','N','N','N','N','N', /*  80.. 95 */
+  'N','t','v','g','h','N','N','c','d','N','N','m','N','k','n','N', /*  96..111 */
+  'N','N','y','s','a','a','b','w','N','r','N','N','N','N','N','N', /* 112..127 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 128..143 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 144..159 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 160..175 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 176..191 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 192..207 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 208..223 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N', /* 224..239 */
+  'N','N','N','N','N','N','N','N','N','N','N','N','N','N','N','N'  /* 240..255 */
+};
+
+static void revcomp_resolve(char *dst, const char *src, long n);
+
+/* the variant revcomp() calls, set on the first call */
+static void (*revcomp_best)(char *, const char *, long) = revcomp_resolve;
+
+/* Function: revcomp()
+ * Args:     dst: destination, room for <n> characters, must not overlap <src>
+ *           src: sequence to reverse complement
+ *           n:   number of residues in <src>
+ */
+void revcomp(char *dst, const char *src, long n) {
+  __atomic_load_n(&revcomp_best, __ATOMIC_RELAXED)(dst, src, n);
+}
+
+/* Function: revcomp_supported()
+ * Args:     variant: "scalar", "sse4" or "avx2"
+ * Returns:  TRUE if this CPU can run <variant>
+ */
+int revcomp_supported(const char *variant) {
+  if (strcmp(variant, "scalar") == 0)
+    return 1;
+#ifdef REVCOMP_X86
+  __builtin_cpu_init();
+  if (strcmp(variant, "sse4") == 0)
+    return __builtin_cpu_supports("sse4.1");
+  if (strcmp(variant, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+#endif
+  return 0;
+}
+
+void revcomp_scalar(char *dst, const char *src, long n) {
+  long i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = revcomp_table[(unsigned char) src[n-1-i]];
+}
+
+#ifdef REVCOMP_X86
+
+__attribute__((target("sse4.1")))
+void revcomp_sse4(char *dst, const char *src, long n) {
+  const __m128i tlo  = _mm_setr_epi8(0, 'T', 'V', 'G', 'H', 0, 0, 'C', 'D', 0, 0, 'M', 0, 'K', 'N', 0);
+  const __m128i thi  = _mm_setr_epi8(0, 0, 'Y', 'S', 'A', 'A', 'B', 'W', 0, 'R', 0, 0, 0, 0, 0, 0);
+  const __m128i rev  = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i m0f  = _mm_set1_epi8(0x0f);
+  const __m128i m10  = _mm_set1_epi8(0x10);
+  const __m128i m20  = _mm_set1_epi8(0x20);
+  const __m128i lo_a = _mm_set1_epi8('a' - 1);
+  const __m128i hi_z = _mm_set1_epi8('z' + 1);
+  const __m128i nn   = _mm_set1_epi8('N');
+  const __m128i zero = _mm_setzero_si128();
+  __m128i x, low, r, lc, ok;
+  long    i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      x   = _mm_loadu_si128((const __m128i *) (src + n - i - 16));
+      low = _mm_and_si128(x, m0f);
+      r   = _mm_blendv_epi8(_mm_shuffle_epi8(tlo, low), _mm_shuffle_epi8(thi, low),
+                            _mm_cmpeq_epi8(_mm_and_si128(x, m10), m10));
+      lc  = _mm_or_si128(x, m20); /* lower case, letters are 'a'..'z' */
+      ok  = _mm_andnot_si128(_mm_cmpeq_epi8(r, zero),
+                             _mm_and_si128(_mm_cmpgt_epi8(lc, lo_a), _mm_cmplt_epi8(lc, hi_z)));
+      r   = _mm_or_si128(r, _mm_and_si128(x, m20));
+      r   = _mm_blendv_epi8(nn, r, ok);
+      _mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(r, rev));
+    }
+  revcomp_scalar(dst + i, src, n - i);
+}
+
+__attribute__((target("avx2")))
+void revcomp_avx2(char *dst, const char *src, long n) {
+  const __m256i tlo  = _mm256_setr_epi8(0, 'T', 'V', 'G', 'H', 0, 0, 'C', 'D', 0, 0, 'M', 0, 'K', 'N', 0,
+                                        0, 'T', 'V', 'G', 'H', 0, 0, 'C', 'D', 0, 0, 'M', 0, 'K', 'N', 0);
+  const __m256i thi  = _mm256_setr_epi8(0, 0, 'Y', 'S', 'A', 'A', 'B', 'W', 0, 'R', 0, 0, 0, 0, 0, 0,
+                                        0, 0, 'Y', 'S', 'A', 'A', 'B', 'W', 0, 'R', 0, 0, 0, 0, 0, 0);
+  const __m256i rev  = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i m0f  = _mm256_set1_epi8(0x0f);
+  const __m256i m10  = _mm256_set1_epi8(0x10);
+  const __m256i m20  = _mm256_set1_epi8(0x20);
+  const __m256i lo_a = _mm256_set1_epi8('a' - 1);
+  const __m256i hi_z = _mm256_set1_epi8('z' + 1);
+  const __m256i nn   = _mm256_set1_epi8('N');
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i x, low, r, lc, ok;
+  long    i;
+
+  for (i = 0; i + 32 <= n; i += 32)
+    {
+      x   = _mm256_loadu_si256((const __m256i *) (src + n - i - 32));
+      low = _mm256_and_si256(x, m0f);
+      r   = _mm256_blendv_epi8(_mm256_shuffle_epi8(tlo, low), _mm256_shuffle_epi8(thi, low),
+                               _mm256_cmpeq_epi8(_mm256_and_si256(x, m10), m10));
+      lc  = _mm256_or_si256(x, m20);
+      ok  = _mm256_andnot_si256(_mm256_cmpeq_epi8(r, zero),
+                                _mm256_and_si256(_mm256_cmpgt_epi8(lc, lo_a), _mm256_cmpgt_epi8(hi_z, lc)));
+      r   = _mm256_or_si256(r, _mm256_and_si256(x, m20));
+      r   = _mm256_blendv_epi8(nn, r, ok);
+      r   = _mm256_shuffle_epi8(r, rev);                  /* reverse within each 16 byte lane */
+      r   = _mm256_permute2x128_si256(r, r, 0x01);        /* then swap the lanes */
+      _mm256_storeu_si256((__m256i *) (dst + i), r);
+    }
+  revcomp_sse4(dst + i, src, n - i);
+}
+
+#else /* ! REVCOMP_X86 */
+
+void revcomp_sse4(char *dst, const char *src, long n) { revcomp_scalar(dst, src, n); }
+void revcomp_avx2(char *dst, const char *src, long n) { revcomp_scalar(dst, src, n); }
+
+#endif
+
+/* revcomp_resolve(): pick the variant for revcomp() to use, then call it */
+static void revcomp_resolve(char *dst, const char *src, long n) {
+  void (*best)(char *, const char *, long);
+
+  if (revcomp_supported("avx2"))
+    best = revcomp_avx2;
+  else if (revcomp_supported("sse4"))
+    best = revcomp_sse4;
+  else
+    best = revcomp_scalar;
+  __atomic_store_n(&revcomp_best, best, __ATOMIC_RELAXED); /* threads may race to set it, to the same value */
+  best(dst, src, n);
+}
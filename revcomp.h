@@ -0,0 +1,26 @@
+/* revcomp.h:
+ *
+ * Reverse complementing of nucleotide sequence. All IUPAC codes are
+ * complemented (A<->T, C<->G, U->A, R<->Y, K<->M, B<->V, D<->H;
+ * S, W and N are their own complements), in upper or lower case,
+ * case is preserved. Any other character becomes 'N'.
+ *
+ * revcomp() uses the fastest variant this CPU supports, chosen the
+ * first time it is called: AVX2 (32 residues per instruction),
+ * SSE4.1 (16 residues per instruction) or a scalar table lookup.
+ */
+
+#ifndef REVCOMP_H
+#define REVCOMP_H
+
+extern const unsigned char revcomp_table[256]; /* complement of each character */
+
+void revcomp(char *dst, const char *src, long n);
+
+/* the individual variants, for testing; only call the SIMD ones if revcomp_supported() says so */
+void revcomp_scalar(char *dst, const char *src, long n);
+void revcomp_sse4(char *dst, const char *src, long n);
+void revcomp_avx2(char *dst, const char *src, long n);
+int  revcomp_supported(const char *variant);
+
+#endif /* REVCOMP_H */
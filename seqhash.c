@@ -0,0 +1,147 @@
+/* seqhash.c:
+ *
+ * Hash table of sequence names, see seqhash.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqhash.h"
+
+static void grow_slots(seqhash_t *h);
+
+/* Function: seqhash_create()
+ * Args:     nexpected: number of distinct names expected, the table grows as needed
+ * Returns:  new empty table, free with seqhash_free()
+ */
+seqhash_t *seqhash_create(int nexpected) {
+  seqhash_t *h;
+  long       nslots = 16;
+  long       s;
+
+  while (nslots < 2 * (long) nexpected)
+    nslots *= 2;
+
+  h = (seqhash_t *) malloc(sizeof(seqhash_t));
+  if (h == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  h->nnames = 0;
+  h->nalloc = (nexpected > 16) ? nexpected : 16;
+  h->nameA  = (const char **) malloc(h->nalloc * sizeof(char *));
+  h->hashA  = (uint64_t *)    malloc(h->nalloc * sizeof(uint64_t));
+  h->slotA  = (int *)         malloc(nslots * sizeof(int));
+  h->mask   = nslots - 1;
+  if ((h->nameA == NULL) || (h->hashA == NULL) || (h->slotA == NULL))
+    {
+      fprintf(stderr, "No space for %ld hash slots\n", nslots);
+      exit(EXIT_FAILURE);
+    }
+  for (s = 0; s < nslots; s++)
+    h->slotA[s] = -1;
+  return h;
+}
+
+/* Function: seqhash_insert()
+ * Args:     h:    table
+ *           name: name to insert, not copied
+ * Returns:  id of <name>, a new one if it wasn't in the table already
+ */
+int seqhash_insert(seqhash_t *h, const char *name) {
+  uint64_t hash = seqhash_hash(name);
+  uint64_t s;
+  int      id;
+
+  for (s = hash & h->mask; h->slotA[s] != -1; s = (s + 1) & h->mask)
+    {
+      id = h->slotA[s];
+      if ((h->hashA[id] == hash) && (strcmp(h->nameA[id], name) == 0))
+        return id;
+    }
+
+  if (h->nnames == h->nalloc)
+    {
+      h->nalloc *= 2;
+      h->nameA = (const char **) realloc(h->nameA, h->nalloc * sizeof(char *));
+      h->hashA = (uint64_t *)    realloc(h->hashA, h->nalloc * sizeof(uint64_t));
+      if ((h->nameA == NULL) || (h->hashA == NULL))
+        {
+          fprintf(stderr, "No space for %d names\n", h->nalloc);
+          exit(EXIT_FAILURE);
+        }
+    }
+  id = h->nnames++;
+  h->nameA[id] = name;
+  h->hashA[id] = hash;
+  h->slotA[s]  = id;
+
+  if ((uint64_t) (2 * h->nnames) > h->mask + 1)
+    grow_slots(h);
+  return id;
+}
+
+/* Function: seqhash_lookup()
+ * Returns:  id of <name>, or -1 if it isn't in the table
+ */
+int seqhash_lookup(const seqhash_t *h, const char *name) {
+  uint64_t hash = seqhash_hash(name);
+  uint64_t s;
+  int      id;
+
+  for (s = hash & h->mask; h->slotA[s] != -1; s = (s + 1) & h->mask)
+    {
+      id = h->slotA[s];
+      if ((h->hashA[id] == hash) && (strcmp(h->nameA[id], name) == 0))
+        return id;
+    }
+  return -1;
+}
+
+/* seqhash_hash(): 64-bit FNV-1a hash of <name> */
+uint64_t seqhash_hash(const char *name) {
+  const unsigned char *p = (const unsigned char *) name;
+  uint64_t             hash = 0xcbf29ce484222325ULL;
+
+  for (; *p != '\0'; p++)
+    {
+      hash ^= *p;
+      hash *= 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+void seqhash_free(seqhash_t *h) {
+  if (h == NULL)
+    return;
+  free(h->nameA);
+  free(h->hashA);
+  free(h->slotA);
+  free(h);
+}
+
+/* grow_slots(): double the number of slots, and reinsert all names */
+static void grow_slots(seqhash_t *h) {
+  uint64_t nslots = 2 * (h->mask + 1);
+  uint64_t s;
+  int      id;
+
+  free(h->slotA);
+  h->slotA = (int *) malloc(nslots * sizeof(int));
+  if (h->slotA == NULL)
+    {
+      fprintf(stderr, "No space for %ld hash slots\n", (long) nslots);
+      exit(EXIT_FAILURE);
+    }
+  h->mask = nslots - 1;
+  for (s = 0; s < nslots; s++)
+    h->slotA[s] = -1;
+  for (id = 0; id < h->nnames; id++)
+    {
+      for (s = h->hashA[id] & h->mask; h->slotA[s] != -1; s = (s + 1) & h->mask)
+        ;
+      h->slotA[s] = id;
+    }
+}
@@ -0,0 +1,29 @@
+/* seqhash.h:
+ *
+ * An open addressing (linear probing) hash table of sequence names,
+ * each distinct name inserted gets an integer id, 0, 1, 2... in the
+ * order names are first inserted. Names are not copied, they must
+ * stay valid as long as the table is used.
+ */
+
+#ifndef SEQHASH_H
+#define SEQHASH_H
+
+#include <stdint.h>
+
+typedef struct {
+  const char **nameA;  /* [0..nnames-1] name with each id */
+  uint64_t    *hashA;  /* [0..nnames-1] hash of each name */
+  int          nnames; /* number of distinct names inserted */
+  int          nalloc; /* allocated size of nameA and hashA */
+  int         *slotA;  /* [0..nslots-1] id of the name in each slot, or -1 if empty */
+  uint64_t     mask;   /* nslots-1, nslots is a power of 2 */
+} seqhash_t;
+
+seqhash_t  *seqhash_create(int nexpected);
+int         seqhash_insert(seqhash_t *h, const char *name);
+int         seqhash_lookup(const seqhash_t *h, const char *name);
+uint64_t    seqhash_hash(const char *name);
+void        seqhash_free(seqhash_t *h);
+
+#endif /* SEQHASH_H */
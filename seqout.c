@@ -0,0 +1,269 @@
+/* seqout.c:
+ *
+ * Buffered output of fasta records, see seqout.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "seqout.h"
+#include "revcomp.h"
+
+static seqout_t *new_seqout(int fd, seqout_write_fn fn, void *fn_arg, int width);
+static void make_room(seqout_t *out, long need);
+static void write_all(seqout_t *out, const char *s, long len);
+
+/* TRUE if <out> writes its buffer out, rather than collecting output in memory */
+#define WRITES(out) (((out)->fd >= 0) || ((out)->fn != NULL))
+
+/* Function: seqout_create()
+ * Args:     fd:    descriptor to write to, or -1 to collect output in memory
+ *           width: number of residues per output line, 0 for no line wrapping
+ * Returns:  newly allocated seqout_t, free with seqout_close()
+ */
+seqout_t *seqout_create(int fd, int width) {
+  return new_seqout(fd, NULL, NULL, width);
+}
+
+/* Function: seqout_create_fn()
+ * Args:     fn:     function the buffer is written with whenever it fills
+ *           fn_arg: passed to <fn>
+ *           width:  number of residues per output line, 0 for no line wrapping
+ * Returns:  newly allocated seqout_t, free with seqout_close()
+ */
+seqout_t *seqout_create_fn(seqout_write_fn fn, void *fn_arg, int width) {
+  return new_seqout(-1, fn, fn_arg, width);
+}
+
+/* seqout_write(): append <len> bytes */
+void seqout_write(seqout_t *out, const char *s, long len) {
+  if (WRITES(out) && (len > out->size))
+    {
+      seqout_flush(out);
+      write_all(out, s, len);
+      out->flushed += len;
+      return;
+    }
+  make_room(out, len);
+  memcpy(out->buf + out->n, s, len);
+  out->n += len;
+}
+
+/* seqout_puts(): append a '\0'-terminated string */
+void seqout_puts(seqout_t *out, const char *s) {
+  seqout_write(out, s, strlen(s));
+}
+
+/* seqout_int(): append the decimal representation of <value> */
+void seqout_int(seqout_t *out, long value) {
+  char  digits[24];
+  char *p = digits + sizeof(digits);
+  unsigned long v = (value < 0) ? -((unsigned long) value) : (unsigned long) value;
+
+  do {
+    *(--p) = '0' + (v % 10);
+    v /= 10;
+  } while (v > 0);
+  if (value < 0)
+    *(--p) = '-';
+  seqout_write(out, p, digits + sizeof(digits) - p);
+}
+
+/* seqout_uint(): append the low <nbytes> bytes of <value>, little-endian */
+void seqout_uint(seqout_t *out, unsigned long value, int nbytes) {
+  char bytes[8];
+  int  i;
+
+  for (i = 0; i < nbytes; i++)
+    bytes[i] = (char) ((value >> (8 * i)) & 0xff);
+  seqout_write(out, bytes, nbytes);
+}
+
+/* Function: seqout_residues()
+ * Args:     out:   output
+ *           s:     residues to write
+ *           len:   number of residues in <s>
+ *           count: number of residues of the current record written so
+ *                  far, used for line wrapping; updated
+ */
+void seqout_residues(seqout_t *out, const char *s, long len, long *count) {
+  long run;
+
+  if (out->width <= 0)
+    {
+      seqout_write(out, s, len);
+      *count += len;
+      return;
+    }
+
+  while (len > 0)
+    {
+      run = out->width - (*count % out->width);
+      if (run > len) run = len;
+      make_room(out, run + 1);
+      memcpy(out->buf + out->n, s, run);
+      out->n += run;
+      *count += run;
+      s      += run;
+      len    -= run;
+      if ((*count % out->width) == 0)
+        out->buf[out->n++] = '\n';
+    }
+}
+
+/* Function: seqout_revcomp()
+ * Args:     out:   output
+ *           s:     residues to write the reverse complement of
+ *           len:   number of residues in <s>
+ *           count: number of residues of the current record written so
+ *                  far, used for line wrapping; updated
+ */
+void seqout_revcomp(seqout_t *out, const char *s, long len, long *count) {
+  long run;
+
+  while (len > 0)
+    {
+      run = (out->width <= 0) ? len : out->width - (*count % out->width);
+      if (run > len) run = len;
+      make_room(out, run + 1);
+      revcomp(out->buf + out->n, s + len - run, run); /* final <run> residues of s, reversed, come first */
+      out->n += run;
+      *count += run;
+      len    -= run;
+      if ((out->width > 0) && ((*count % out->width) == 0))
+        out->buf[out->n++] = '\n';
+    }
+}
+
+/* seqout_end_record(): finish the final line of a record of <count> residues */
+void seqout_end_record(seqout_t *out, long count) {
+  if ((out->width <= 0) ? (count > 0) : ((count % out->width) != 0))
+    seqout_putc(out, '\n');
+}
+
+/* Function: seqout_repeat()
+ * Args:     out:  output
+ *           from: position (from seqout_tell()) of earlier output to append again
+ *           len:  number of bytes of it
+ * Returns:  0, or -1 if they have been written since, or can't be appended
+ *           without writing them; then nothing is appended.
+ */
+int seqout_repeat(seqout_t *out, long from, long len) {
+  if (from < out->flushed)
+    return -1;
+  if (! WRITES(out))
+    make_room(out, len); /* keeps what is in the buffer */
+  if (out->size - out->n < len)
+    return -1;
+  memcpy(out->buf + out->n, out->buf + (from - out->flushed), len);
+  out->n += len;
+  return 0;
+}
+
+/* seqout_flush(): write everything in the buffer; for an in-memory
+ * seqout_t, make the buffer bigger instead */
+void seqout_flush(seqout_t *out) {
+  if (! WRITES(out))
+    {
+      make_room(out, out->size);
+      return;
+    }
+  write_all(out, out->buf, out->n);
+  out->flushed += out->n;
+  out->n = 0;
+}
+
+/* seqout_close(): flush and free <out>, the descriptor (if any) is left
+ * open; returns 0, or -1 if any write failed */
+int seqout_close(seqout_t *out) {
+  int failed;
+
+  if (out == NULL)
+    return 0;
+  if (WRITES(out))
+    seqout_flush(out);
+  failed = out->failed;
+  free(out->buf);
+  free(out);
+  return failed ? -1 : 0;
+}
+
+/* make_room(): make sure there's room for <need> more bytes in the buffer */
+static void make_room(seqout_t *out, long need) {
+  if ((out->size - out->n) >= need)
+    return;
+  if (WRITES(out))
+    {
+      write_all(out, out->buf, out->n);
+      out->flushed += out->n;
+      out->n = 0;
+      if (out->size >= need)
+        return;
+    }
+  while ((out->size - out->n) < need)
+    out->size *= 2;
+  out->buf = (char *) realloc(out->buf, out->size);
+  if (out->buf == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+}
+
+/* write_all(): write <len> bytes, or mark <out> failed; nothing more
+ * is written once it has failed */
+static void write_all(seqout_t *out, const char *s, long len) {
+  ssize_t w;
+
+  if (out->failed || (len == 0))
+    return;
+  if (out->fd < 0)
+    {
+      if (out->fn(out->fn_arg, s, len) != 0)
+        out->failed = 1;
+      return;
+    }
+  while (len > 0)
+    {
+      w = write(out->fd, s, len);
+      if (w == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          out->failed = 1;
+          return;
+        }
+      s   += w;
+      len -= w;
+    }
+}
+
+/* new_seqout(): shared by seqout_create() and seqout_create_fn() */
+static seqout_t *new_seqout(int fd, seqout_write_fn fn, void *fn_arg, int width) {
+  seqout_t *out;
+
+  out = (seqout_t *) malloc(sizeof(seqout_t));
+  if (out == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  out->fd     = fd;
+  out->fn     = fn;
+  out->fn_arg = fn_arg;
+  out->failed = 0;
+  out->size   = WRITES(out) ? SEQOUT_BUFSIZE : 64 * 1024;
+  out->n      = 0;
+  out->flushed = 0;
+  out->width  = width;
+  out->buf    = (char *) malloc(out->size);
+  if (out->buf == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return out;
+}
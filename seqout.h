@@ -0,0 +1,60 @@
+/* seqout.h:
+ *
+ * Buffered output of fasta records. Output is collected in a large
+ * buffer and written with write(2) when the buffer fills, sequence
+ * is wrapped into lines of a fixed width by copying whole lines at a
+ * time.
+ *
+ * A seqout_t can write to a file descriptor or hand its buffer to a
+ * write function. One created with neither (fd < 0 and no function)
+ * never writes, its buffer grows instead and the caller takes the
+ * bytes from buf[0..n-1].
+ *
+ * Write errors don't stop the program: the seqout_t is marked failed,
+ * later output is dropped, and seqout_close() reports it.
+ */
+
+#ifndef SEQOUT_H
+#define SEQOUT_H
+
+#define SEQOUT_BUFSIZE (4 * 1024 * 1024)
+
+/* writes <len> bytes, returns 0 on success */
+typedef int (*seqout_write_fn)(void *arg, const char *s, long len);
+
+typedef struct {
+  int   fd;     /* descriptor to write to, or -1 */
+  seqout_write_fn fn; /* if fd is -1: function to write with, or NULL to collect output in memory */
+  void *fn_arg; /* passed to fn */
+  int   failed; /* TRUE once a write has failed */
+  char *buf;    /* output buffer */
+  long  size;   /* allocated size of buf */
+  long  n;      /* number of bytes in buf */
+  long  flushed; /* number of bytes of output before buf[0], already written */
+  int   width;  /* number of residues per output line, 0 for no line wrapping */
+} seqout_t;
+
+seqout_t *seqout_create(int fd, int width);
+seqout_t *seqout_create_fn(seqout_write_fn fn, void *fn_arg, int width);
+void      seqout_write(seqout_t *out, const char *s, long len);
+void      seqout_puts(seqout_t *out, const char *s);
+void      seqout_int(seqout_t *out, long value);
+void      seqout_uint(seqout_t *out, unsigned long value, int nbytes);
+void      seqout_residues(seqout_t *out, const char *s, long len, long *count);
+void      seqout_revcomp(seqout_t *out, const char *s, long len, long *count);
+void      seqout_end_record(seqout_t *out, long count);
+int       seqout_repeat(seqout_t *out, long from, long len);
+void      seqout_flush(seqout_t *out);
+int       seqout_close(seqout_t *out);
+
+/* seqout_putc(): append a single character */
+#define seqout_putc(out, c)                                       \
+  do {                                                            \
+    if ((out)->n == (out)->size) seqout_flush(out);               \
+    (out)->buf[(out)->n++] = (c);                                 \
+  } while (0)
+
+/* seqout_tell(): number of bytes of output so far, written or in the buffer */
+#define seqout_tell(out) ((out)->flushed + (out)->n)
+
+#endif /* SEQOUT_H */
@@ -0,0 +1,382 @@
+/* serve.c:
+ *
+ * extract_fasta_multi_exon --serve, see serve.h.
+ *
+ * Each reference is opened once, in a context of its own; a request is
+ * extracted in another context that shares it (ef_share_reference()),
+ * so only the names in the request are looked up and nothing is read
+ * through. Requests from stdin are tasks of a pipeline (see pipeline.h),
+ * which already runs tasks in threads and writes their output in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "extractfasta.h"
+#include "seqout.h"
+#include "pipeline.h"
+#include "serve.h"
+
+#define REQUESTS_PER_THREAD 4 /* from stdin, max number of requests in flight per thread */
+#define LISTEN_BACKLOG 64
+
+typedef struct {
+  int      nrefs;
+  char   **nameA; /* [0..nrefs-1] fasta file of each reference, as given */
+  ef_ctx **refA;  /* [0..nrefs-1] context each reference is open in */
+  int      width;
+  int      genetic_code; /* see ef_set_genetic_code() */
+} server;
+
+typedef struct {
+  char     *text;    /* interval lines of the request */
+  long      len;
+  long      alloc;   /* allocated size of text */
+  int       ref;     /* reference to extract from, index in refA, or -1 if unknown */
+  char     *bad_ref; /* if ref is -1: the name asked for, malloc'ed */
+  server   *srv;
+  seqout_t *output;  /* from stdin: where responses go, flushed after each */
+} request;
+
+typedef struct {
+  server *srv;
+  int     fd;
+} connection;
+
+static int   serve_stdin(server *srv, int nthreads);
+static int   serve_socket(server *srv, char *socket_path);
+static void *connection_main(void *varg);
+static int   read_request(FILE *fp, server *srv, request *req, char **line, size_t *line_alloc);
+static void  answer(server *srv, ef_ctx *ctx, request *req, seqout_t *out);
+static char *run_request(void *arg, seqout_t *out);
+static void  done_request(void *arg);
+static int   collect(void *arg, const char *s, long len);
+static void *alloc_or_die(size_t size);
+
+/* Function: serve()
+ * Args:     fa_fileA:    [0..nfiles-1] reference fasta files
+ *           nfiles:      number of references, at least 1
+ *           socket_path: Unix domain socket to listen on, or NULL to
+ *                        read requests from stdin
+ *           nthreads:    from stdin, number of requests handled at a time
+ *           width:       number of residues per output line, 0 for no line wrapping
+ *           use_index:   non-zero to read the references through their .fai index
+ *           id_field:    header field that names the sequences, see ef_set_id_field()
+ *           genetic_code: to output proteins, see ef_set_genetic_code(), 0 for nucleotides
+ * Returns:  exit status, once stdin ends; with a socket, only if it fails.
+ */
+int serve(char **fa_fileA, int nfiles, char *socket_path, int nthreads, int width, int use_index, int id_field, int genetic_code) {
+  server srv;
+  int    r, status;
+
+  signal(SIGPIPE, SIG_IGN); /* a client going away is a write error, not the end of the server */
+
+  srv.nrefs = nfiles;
+  srv.nameA = fa_fileA;
+  srv.width = width;
+  srv.genetic_code = genetic_code;
+  srv.refA  = (ef_ctx **) alloc_or_die(nfiles * sizeof(ef_ctx *));
+  for (r = 0; r < nfiles; r++)
+    {
+      srv.refA[r] = ef_create();
+      ef_set_index(srv.refA[r], use_index);
+      ef_set_id_field(srv.refA[r], id_field);
+      if (ef_set_genetic_code(srv.refA[r], genetic_code) != EF_OK) /* so requests can't fail to */
+        {
+          fprintf(stderr, "%s\n", ef_error(srv.refA[r]));
+          return EXIT_FAILURE;
+        }
+      if (ef_open_reference(srv.refA[r], fa_fileA[r]) != EF_OK)
+        {
+          fprintf(stderr, "%s\n", ef_error(srv.refA[r]));
+          return EXIT_FAILURE;
+        }
+    }
+
+  status = (socket_path == NULL) ? serve_stdin(&srv, nthreads) : serve_socket(&srv, socket_path);
+
+  for (r = 0; r < nfiles; r++)
+    ef_free(srv.refA[r]);
+  free(srv.refA);
+  return status;
+}
+
+/* serve_stdin(): answer requests from stdin on stdout, <nthreads> at a time */
+static int serve_stdin(server *srv, int nthreads) {
+  pipeline_t *pl;
+  seqout_t   *output;
+  request    *req;
+  char       *line = NULL;
+  size_t      line_alloc = 0;
+  int         status = EXIT_SUCCESS;
+
+  output = seqout_create(1, srv->width);
+  pl = pipeline_start(nthreads, nthreads * REQUESTS_PER_THREAD, output, run_request, done_request);
+  for (;;)
+    {
+      req = (request *) alloc_or_die(sizeof(request));
+      memset(req, 0, sizeof(request));
+      if (! read_request(stdin, srv, req, &line, &line_alloc))
+        {
+          free(req->text);
+          free(req);
+          break;
+        }
+      req->srv    = srv;
+      req->output = output;
+      if (pipeline_submit(pl, req) != 0) /* stdout has failed */
+        break;
+    }
+  free(pipeline_finish(pl)); /* requests don't fail, their errors are responses */
+  if (seqout_close(output) != 0)
+    {
+      fprintf(stderr, "Error writing output\n");
+      status = EXIT_FAILURE;
+    }
+  free(line);
+  return status;
+}
+
+/* serve_socket(): accept connections on <socket_path> and answer each in
+ * a thread of its own; returns only if the socket can't be set up */
+static int serve_socket(server *srv, char *socket_path) {
+  struct sockaddr_un addr;
+  struct stat        st;
+  pthread_attr_t     attr;
+  pthread_t          thread;
+  connection        *conn;
+  int                fd, cfd;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+      fprintf(stderr, "Socket path %s is too long\n", socket_path);
+      return EXIT_FAILURE;
+    }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+
+  /* a socket left behind by a server that was killed */
+  if ((stat(socket_path, &st) == 0) && S_ISSOCK(st.st_mode))
+    unlink(socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((fd == -1) ||
+      (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) ||
+      (listen(fd, LISTEN_BACKLOG) == -1))
+    {
+      fprintf(stderr, "Cannot listen on %s\n", socket_path);
+      return EXIT_FAILURE;
+    }
+
+  if ((pthread_attr_init(&attr) != 0) ||
+      (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) != 0))
+    {
+      fprintf(stderr, "Failed to initialize thread attributes\n");
+      exit(EXIT_FAILURE);
+    }
+  for (;;)
+    {
+      cfd = accept(fd, NULL, NULL);
+      if (cfd == -1)
+        {
+          if ((errno == EINTR) || (errno == ECONNABORTED))
+            continue;
+          fprintf(stderr, "Cannot accept connections on %s\n", socket_path);
+          return EXIT_FAILURE;
+        }
+      conn = (connection *) alloc_or_die(sizeof(connection));
+      conn->srv = srv;
+      conn->fd  = cfd;
+      if (pthread_create(&thread, &attr, connection_main, conn) != 0)
+        {
+          fprintf(stderr, "Failed to create thread\n");
+          exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* connection_main(): thread answering the requests of one connection, in order */
+static void *connection_main(void *varg) {
+  connection *conn = (connection *) varg;
+  server     *srv  = conn->srv;
+  request     req;
+  seqout_t   *out;
+  ef_ctx     *ctx;
+  FILE       *fp;
+  char       *line = NULL;
+  size_t      line_alloc = 0;
+
+  fp = fdopen(conn->fd, "r");
+  if (fp == NULL)
+    {
+      close(conn->fd);
+      free(conn);
+      return NULL;
+    }
+  out = seqout_create(conn->fd, srv->width);
+  ctx = ef_create();
+  ef_set_width(ctx, srv->width);
+  ef_set_genetic_code(ctx, srv->genetic_code);
+  memset(&req, 0, sizeof(request));
+  while ((! out->failed) && read_request(fp, srv, &req, &line, &line_alloc))
+    {
+      answer(srv, ctx, &req, out);
+      seqout_flush(out);
+    }
+
+  ef_free(ctx);
+  seqout_close(out);
+  fclose(fp);
+  free(req.text);
+  free(req.bad_ref);
+  free(line);
+  free(conn);
+  return NULL;
+}
+
+/* Function: read_request()
+ * Args:     fp:         where requests come from
+ *           srv:        server, for the reference names
+ *           req:        set to the request read, its text buffer is reused
+ *           line:       buffer for getline(), reused
+ *           line_alloc: allocated size of *line
+ * Returns:  TRUE if a request was read; FALSE at the end of <fp>, if
+ *           there is nothing more. A request not ended by a '.' line
+ *           before the end of <fp> is still a request.
+ */
+static int read_request(FILE *fp, server *srv, request *req, char **line, size_t *line_alloc) {
+  ssize_t n;
+  long    len;
+  int     r, seen = 0; /* TRUE once there is a line of the request */
+
+  req->len = 0;
+  req->ref = 0;
+  free(req->bad_ref);
+  req->bad_ref = NULL;
+  while ((n = getline(line, line_alloc, fp)) != -1)
+    {
+      for (len = n; (len > 0) && (((*line)[len-1] == '\n') || ((*line)[len-1] == '\r')); len--)
+        ;
+      if ((len == 1) && ((*line)[0] == '.'))
+        return 1;
+      if ((! seen) && (len > 0) && ((*line)[0] == '@'))
+        {
+          (*line)[len] = '\0';
+          for (r = 0; (r < srv->nrefs) && (strcmp(srv->nameA[r], *line + 1) != 0); r++)
+            ;
+          req->ref = (r < srv->nrefs) ? r : -1;
+          if (req->ref == -1)
+            req->bad_ref = strdup(*line + 1);
+          seen = 1;
+          continue;
+        }
+      seen = 1;
+      if (req->len + n > req->alloc)
+        {
+          req->alloc = 2 * (req->len + n);
+          req->text = (char *) realloc(req->text, req->alloc);
+          if (req->text == NULL)
+            {
+              fprintf(stderr, "No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      memcpy(req->text + req->len, *line, n);
+      req->len += n;
+    }
+  return seen;
+}
+
+/* Function: answer()
+ * Args:     srv: server
+ *           ctx: context to extract in, its intervals are replaced
+ *           req: the request
+ *           out: where the response is appended
+ */
+static void answer(server *srv, ef_ctx *ctx, request *req, seqout_t *out) {
+  seqout_t *body;
+  int       i;
+
+  if (req->ref == -1)
+    {
+      seqout_puts(out, "ERROR Unknown reference ");
+      seqout_puts(out, req->bad_ref);
+      seqout_putc(out, '\n');
+      return;
+    }
+
+  ef_share_reference(ctx, srv->refA[req->ref]);
+  ef_clear_intervals(ctx);
+  body = seqout_create(-1, 0);
+  if ((ef_add_intervals(ctx, req->text, req->len, "request") != EF_OK) ||
+      (ef_extract(ctx, NULL, collect, body) != EF_OK))
+    {
+      seqout_puts(out, "ERROR ");
+      seqout_puts(out, ef_error(ctx));
+      seqout_putc(out, '\n');
+      seqout_close(body);
+      return;
+    }
+
+  seqout_puts(out, "OK ");
+  seqout_int(out, body->n);
+  seqout_putc(out, ' ');
+  seqout_int(out, ef_nmissing(ctx));
+  seqout_putc(out, '\n');
+  for (i = 0; i < ef_nmissing(ctx); i++)
+    {
+      seqout_puts(out, ef_missing_name(ctx, i));
+      seqout_putc(out, '\n');
+    }
+  seqout_write(out, body->buf, body->n);
+  seqout_close(body);
+}
+
+/* run_request(): pipeline_run_fn for requests from stdin */
+static char *run_request(void *arg, seqout_t *out) {
+  request *req = (request *) arg;
+  ef_ctx  *ctx;
+
+  ctx = ef_create();
+  ef_set_width(ctx, req->srv->width);
+  ef_set_genetic_code(ctx, req->srv->genetic_code);
+  answer(req->srv, ctx, req, out);
+  ef_free(ctx);
+  return NULL;
+}
+
+/* done_request(): pipeline_done_fn for requests from stdin, only called
+ * by the writer thread, so it can flush the output */
+static void done_request(void *arg) {
+  request *req = (request *) arg;
+
+  seqout_flush(req->output);
+  free(req->text);
+  free(req->bad_ref);
+  free(req);
+}
+
+/* collect(): ef_write_fn that appends to an in-memory seqout_t */
+static int collect(void *arg, const char *s, long len) {
+  seqout_write((seqout_t *) arg, s, len);
+  return 0;
+}
+
+static void *alloc_or_die(size_t size) {
+  void *p = malloc(size);
+
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
@@ -0,0 +1,34 @@
+/* serve.h:
+ *
+ * extract_fasta_multi_exon --serve: keep one or more reference fasta
+ * files open (see ef_open_reference()) and answer extraction requests,
+ * read from stdin or from connections to a Unix domain socket, until
+ * stdin ends (the socket server runs until it is killed).
+ *
+ * A request is lines in the interval list format, ended by a line
+ * with just a '.':
+ *   [@<fa_file>]       reference to extract from, as named on the command
+ *                      line; the first one if there is no such line
+ *   <interval line>
+ *   ...
+ *   .
+ *
+ * Each request gets one response:
+ *   OK <nbytes> <nmissing>
+ *   <name not found>   (<nmissing> lines)
+ *   <nbytes bytes of output, exactly what extract_fasta_multi_exon writes>
+ * or, if the request can't be extracted:
+ *   ERROR <message>
+ *
+ * From stdin, requests are handled by the -t threads at the same time
+ * and responses written in request order. With a socket, each
+ * connection is handled by its own thread and gets its responses in
+ * the order of its requests.
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+int serve(char **fa_fileA, int nfiles, char *socket_path, int nthreads, int width, int use_index, int id_field, int genetic_code);
+
+#endif /* SERVE_H */
@@ -1 +1,4 @@
+gcc -O2 -o test_revcomp test_revcomp.c revcomp.c && ./test_revcomp
+gcc -O2 -o test_translate test_translate.c translate.c revcomp.c && ./test_translate
+gcc -O2 -o test_extractfasta test_extractfasta.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz && ./test_extractfasta
 perl test_extract_fasta_multi_exon.pl . test-files 1
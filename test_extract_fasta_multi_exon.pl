@@ -156,7 +156,19 @@ for($n = 0; $n < $nofail_ntests; $n++) {
   # make sure output file is what we expect
   CompareFilesWithDiff($stdout, $nofail_outputA[$n], $nofail_descA[$n]);
 
-  for my $file ($stderr, $stdout, $idfetch_in) { 
+  # run again, reading the sequences from an indexed fasta file with -i,
+  # output should be identical
+  my $fafile = "nofail." . ($n+1) . ".fa";
+  $cmd = "idfetch -t 5 -c 1 -G $idfetch_in | $id_fasta > $fafile";
+  RunCommand($cmd, 0, "fasta file creation", 0);
+  $cmd = "$extract_fasta --build-index $fafile";
+  RunCommand($cmd, 0, "fasta index creation", 0);
+  $cmd = "$extract_fasta -i $nofail_inputA[$n] $fafile 2> $stderr > $stdout";
+  RunCommand($cmd, 0, $nofail_descA[$n] . " [indexed]", $be_verbose); # '0' says: failure is NOT expected
+  CheckNumLinesInFile($stderr, 0,                      $nofail_descA[$n] . " [indexed]");
+  CompareFilesWithDiff($stdout, $nofail_outputA[$n], $nofail_descA[$n] . " [indexed]");
+
+  for my $file ($stderr, $stdout, $idfetch_in, $fafile, $fafile . ".fai") { 
     if(-e $file) { unlink $file; }
   }
 }
@@ -0,0 +1,801 @@
+/* test_extractfasta.c:
+ *
+ * Tests of the library API in extractfasta.h.
+ *
+ * Writes a small fasta file, adds intervals from memory and checks the
+ * output of ef_extract_buffer() reading the file, with its index, with
+ * threads, from its 2-bit cache and from a reference kept open (mapped,
+ * indexed and cached, and shared between contexts), read as a stream
+ * keeping only the residues of pieces far apart, translated, and
+ * with sequences named by a header field, and from several files at
+ * once (ef_extract_files()), as binary records and with an index of
+ * the output, and with the intervals sorted externally, answered by
+ * serve(), then that each kind of error comes back as its code rather
+ * than ending the program.
+ *
+ * To compile and run:
+ *    gcc -O2 -o test_extractfasta test_extractfasta.c extractfasta.c faidx.c seqout.c revcomp.c pipeline.c seqhash.c arena.c intervals.c twobit.c ioplan.c memo.c translate.c bgzf.c extsort.c serve.c -lpthread -lz && ./test_extractfasta
+ *
+ * If all tests pass, final line of output is PASS [...].
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "extractfasta.h"
+#include "serve.h"
+
+#define OUTSIZE 4096
+
+static int ntests = 0;
+
+/* the second s1 must be ignored, s1's lines are not all the same length */
+static const char *fasta =
+  ">s1 first\nACGTACGTAC\nGTACGT\n"
+  ">s2\nAAAACCCCGG\n"
+  ">s1 second\nTTTT\n";
+
+static const char *intervals =
+  "s1 1 2 5 +\n"
+  "s3 1 1 1 +\n"
+  "s2\n"
+  "s1 2 1 2 15 16 -";
+
+static const char *expected =
+  ">s1:<1_2:15_>16:-\nACGT\n"
+  ">s1:2_5:+\nCGTA\n"
+  ">s2:<1_>10:+\nAAAACCCCGG\n";
+
+static char fa_file[] = "/tmp/test_extractfastaXXXXXX";
+static char cache_file[sizeof(fa_file) + 5];
+static char gz_file[sizeof(fa_file) + 3];
+static char out_fai[sizeof(fa_file) + 8];
+
+/* expected as binary records, and the .fai of each */
+static const char expected_bin[] =
+  "\x10\0\0\0" "s1:<1_2:15_>16:-" "\x04\0\0\0\0\0\0\0" "ACGT"
+  "\x08\0\0\0" "s1:2_5:+"         "\x04\0\0\0\0\0\0\0" "CGTA"
+  "\x0b\0\0\0" "s2:<1_>10:+"      "\x0a\0\0\0\0\0\0\0" "AAAACCCCGG";
+
+static const char *expected_fai =
+  "s1:<1_2:15_>16:-\t4\t18\t4\t5\n"
+  "s1:2_5:+\t4\t33\t4\t5\n"
+  "s2:<1_>10:+\t10\t51\t10\t11\n";
+
+static const char *expected_bin_fai =
+  "s1:<1_2:15_>16:-\t4\t28\t4\t4\n"
+  "s1:2_5:+\t4\t52\t4\t4\n"
+  "s2:<1_>10:+\t10\t79\t10\t10\n";
+
+static void fail(const char *desc) {
+  fprintf(stderr, "ERROR, the following test failed: %s\n", desc);
+  unlink(fa_file);
+  unlink(cache_file);
+  unlink(gz_file);
+  unlink(out_fai);
+  exit(EXIT_FAILURE);
+}
+
+/* check_extract(): extract from <file> (NULL for the reference), and compare to <expected> */
+static void check_extract(ef_ctx *ctx, const char *file, const char *desc) {
+  char out[OUTSIZE];
+  long len;
+
+  if (ef_extract_buffer(ctx, file, out, OUTSIZE, &len) != EF_OK)
+    fail(desc);
+  if ((len != (long) strlen(expected)) || (memcmp(out, expected, len) != 0))
+    fail(desc);
+  if ((ef_nmissing(ctx) != 1) || (strcmp(ef_missing_name(ctx, 0), "s3") != 0))
+    fail(desc);
+  ntests++;
+}
+
+static ef_ctx *new_ctx(void) {
+  ef_ctx *ctx = ef_create();
+
+  if (ef_add_intervals(ctx, intervals, strlen(intervals), "intervals") != EF_OK)
+    fail("intervals added from memory");
+  if (ef_interval_count(ctx) != 4)
+    fail("intervals added from memory");
+  return ctx;
+}
+
+static int failing_write(void *arg, const char *buf, long len) {
+  return -1;
+}
+
+static void test_extract(void) {
+  ef_ctx *ctx = new_ctx();
+  ef_ctx *other;
+
+  check_extract(ctx, fa_file, "extract from a mapped fasta file");
+  check_extract(ctx, fa_file, "extract the same intervals again");
+  ef_set_threads(ctx, 4);
+  check_extract(ctx, fa_file, "extract with threads");
+  ef_set_threads(ctx, 1);
+
+  if (ef_build_index(ctx, fa_file) != EF_OK)
+    fail("build an index");
+  ef_set_index(ctx, 1);
+  check_extract(ctx, fa_file, "extract with an index");
+  ef_set_read_gap(ctx, 0);
+  check_extract(ctx, fa_file, "extract with an index, reading each piece on its own");
+  if (ef_open_reference(ctx, fa_file) != EF_OK)
+    fail("open an indexed reference");
+  check_extract(ctx, NULL, "extract from an indexed reference");
+  ef_set_index(ctx, 0);
+
+  if (ef_build_cache(ctx, fa_file, cache_file) != EF_OK)
+    fail("build a 2-bit cache");
+  check_extract(ctx, cache_file, "extract from a 2-bit cache");
+  if (ef_open_reference(ctx, cache_file) != EF_OK)
+    fail("open a 2-bit cache as the reference");
+  check_extract(ctx, NULL, "extract from a 2-bit cache reference");
+
+  if (ef_open_reference(ctx, fa_file) != EF_OK)
+    fail("open a mapped reference");
+  check_extract(ctx, NULL, "extract from a mapped reference");
+  ef_set_threads(ctx, 3);
+  check_extract(ctx, NULL, "extract from a mapped reference with threads");
+
+  other = new_ctx();
+  if (ef_share_reference(other, ctx) != EF_OK)
+    fail("share a reference");
+  ef_free(ctx);
+  check_extract(other, NULL, "extract from a shared reference after its opener is freed");
+  ef_free(other);
+}
+
+/* intervals that share pieces, or are duplicated, come from a memo (see memo.h) */
+static void test_memo(void) {
+  ef_ctx *ctx = ef_create();
+  char    out[OUTSIZE];
+  long    len;
+  const char *shared =
+    "s1 2 1 12 14 16 -\n"
+    "s1 2 1 12 14 16 - again\n"
+    "s1 1 1 12 -\n";
+  const char *shared_expected =
+    ">s1:<1_12:-\nACGTACGTAC\nGT\n"
+    ">s1:<1_12:14_>16:-\nACGACGTACG\nTACGT\n"
+    ">s1:<1_12:14_>16:-:again\nACGACGTACG\nTACGT\n";
+
+  ef_add_intervals(ctx, shared, strlen(shared), "shared");
+  ef_set_width(ctx, 10);
+  if ((ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_OK) ||
+      (len != (long) strlen(shared_expected)) || (memcmp(out, shared_expected, len) != 0))
+    fail("extract intervals that share pieces");
+  ntests++;
+  if ((ef_extract_buffer(ctx, cache_file, out, OUTSIZE, &len) != EF_OK) ||
+      (len != (long) strlen(shared_expected)) || (memcmp(out, shared_expected, len) != 0))
+    fail("extract intervals that share pieces from a 2-bit cache");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* the proteins of intervals, with a codon that spans two pieces */
+static void test_translate(void) {
+  ef_ctx *ctx = ef_create();
+  char    out[OUTSIZE];
+  long    len;
+  const char *cds = "s2 2 1 4 6 10 +\ns2 2 1 4 6 10 -\n";
+  const char *cds_expected = ">s2:<1_4:6_>10:+\nKTR\n>s2:<1_4:6_>10:-\nPGF\n";
+
+  ef_add_intervals(ctx, cds, strlen(cds), "cds");
+  if (ef_set_genetic_code(ctx, 1) != EF_OK)
+    fail("translate with the standard genetic code");
+  if ((ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_OK) ||
+      (len != (long) strlen(cds_expected)) || (memcmp(out, cds_expected, len) != 0))
+    fail("translate intervals on both strands");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* sequences named by a field of their header, as id_fasta.pl renames them */
+static void test_id_field(void) {
+  ef_ctx *ctx = ef_create();
+  char    out[OUTSIZE];
+  long    len;
+  FILE   *fp;
+  const char *idfetch = ">gi|1|gb|A1.1| first\nACGT\n>x|B2 second\nGGCC\n";
+  const char *id_intervals = "A1.1 1 1 2 +\nB2\n";
+  const char *id_expected = ">A1.1:<1_2:+\nAC\n>B2:<1_>4:+\nGGCC\n";
+
+  if (((fp = fopen(cache_file, "w")) == NULL) || (fputs(idfetch, fp) == EOF) || (fclose(fp) != 0))
+    fail("write a fasta file with idfetch headers");
+  ef_add_intervals(ctx, id_intervals, strlen(id_intervals), "ids");
+  if (ef_set_id_field(ctx, EF_ID_FASTA) != EF_OK)
+    fail("name sequences as id_fasta.pl does");
+  if ((ef_extract_buffer(ctx, cache_file, out, OUTSIZE, &len) != EF_OK) ||
+      (len != (long) strlen(id_expected)) || (memcmp(out, id_expected, len) != 0))
+    fail("name sequences as id_fasta.pl does");
+  ntests++;
+
+  ef_set_id_field(ctx, 4);
+  if ((ef_extract_buffer(ctx, cache_file, out, OUTSIZE, &len) != EF_OK) ||
+      (ef_nmissing(ctx) != 1) || (strcmp(ef_missing_name(ctx, 0), "B2") != 0))
+    fail("name sequences by a field, keeping the first word if there are fewer fields");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* ef_write_fn that appends to an output_text */
+typedef struct {
+  char buf[OUTSIZE];
+  long n;
+} output_text;
+
+static int append_output(void *arg, const char *buf, long len) {
+  output_text *out = (output_text *) arg;
+
+  if (out->n + len > OUTSIZE)
+    return -1;
+  memcpy(out->buf + out->n, buf, len);
+  out->n += len;
+  return 0;
+}
+
+/* several files at once, each sequence from the first file that has it */
+static void test_files(void) {
+  ef_ctx     *ctx = new_ctx();
+  output_text out;
+  FILE       *fp;
+  const char *fileA[3];
+  const char *shard = ">s2\nGGGGGGGGGG\n";
+  const char *shard_expected =
+    ">s2:<1_>10:+\nGGGGGGGGGG\n"
+    ">s1:<1_2:15_>16:-\nACGT\n"
+    ">s1:2_5:+\nCGTA\n";
+
+  if (((fp = fopen(cache_file, "w")) == NULL) || (fputs(shard, fp) == EOF) || (fclose(fp) != 0))
+    fail("write a second fasta file");
+  ef_set_threads(ctx, 2);
+  fileA[0] = fa_file;
+  fileA[1] = cache_file;
+  out.n = 0;
+  if ((ef_extract_files(ctx, fileA, 2, append_output, &out) != EF_OK) ||
+      (out.n != (long) strlen(expected)) || (memcmp(out.buf, expected, out.n) != 0) ||
+      (ef_nmissing(ctx) != 1) || (strcmp(ef_missing_name(ctx, 0), "s3") != 0))
+    fail("extract from two files, in the order of the files");
+  ntests++;
+
+  fileA[0] = cache_file;
+  fileA[1] = fa_file;
+  out.n = 0;
+  if ((ef_extract_files(ctx, fileA, 2, append_output, &out) != EF_OK) ||
+      (out.n != (long) strlen(shard_expected)) || (memcmp(out.buf, shard_expected, out.n) != 0))
+    fail("extract from two files, a sequence in both from the first");
+  ntests++;
+
+  ef_set_unordered(ctx, 1);
+  fileA[0] = fa_file;
+  fileA[1] = fa_file;
+  fileA[2] = fa_file;
+  out.n = 0;
+  if ((ef_extract_files(ctx, fileA, 3, append_output, &out) != EF_OK) ||
+      (out.n != (long) strlen(expected)) || (memcmp(out.buf, expected, out.n) != 0))
+    fail("extract from the same file three times, unordered");
+  ntests++;
+
+  fileA[1] = "-";
+  if (ef_extract_files(ctx, fileA, 2, append_output, &out) != EF_ERR_USAGE)
+    fail("stdin can't be one of several files");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* put_block(): write <len> bytes of <data> to <fp> as one BGZF block */
+static void put_block(FILE *fp, const char *data, long len) {
+  unsigned char block[1024];
+  z_stream      zs;
+  uint32_t      crc = crc32(0, (const unsigned char *) data, len);
+  long          size, i;
+
+  memset(&zs, 0, sizeof(z_stream));
+  deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  zs.next_in   = (unsigned char *) data;
+  zs.avail_in  = len;
+  zs.next_out  = block + 18;
+  zs.avail_out = sizeof(block) - 26;
+  deflate(&zs, Z_FINISH);
+  size = 18 + zs.total_out + 8;
+  deflateEnd(&zs);
+
+  /* gzip header with the 'BC' extra field, the block size - 1 */
+  memcpy(block, "\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0", 16);
+  block[16] = (size - 1) & 0xff;
+  block[17] = (size - 1) >> 8;
+  for (i = 0; i < 4; i++) /* then the CRC and length, little-endian */
+    {
+      block[size - 8 + i] = (crc >> (8 * i)) & 0xff;
+      block[size - 4 + i] = (len >> (8 * i)) & 0xff;
+    }
+  fwrite(block, 1, size, fp);
+}
+
+/* write_bgzf(): write <text> to <filename> BGZF compressed, <block>
+ * bytes to a block (bgzip's are 64kb), then the empty block that ends
+ * a BGZF file */
+static void write_bgzf(const char *filename, const char *text, long block) {
+  FILE *fp = fopen(filename, "w");
+  long  len = strlen(text);
+  long  off;
+
+  if (fp == NULL)
+    fail("write a BGZF file");
+  for (off = 0; off < len; off += block)
+    put_block(fp, text + off, (len - off < block) ? len - off : block);
+  put_block(fp, "", 0);
+  if (fclose(fp) != 0)
+    fail("write a BGZF file");
+}
+
+/* gzip and BGZF compressed fasta files, the latter also indexed */
+static void test_gzip(void) {
+  ef_ctx *ctx = new_ctx();
+  gzFile  gz;
+
+  if (((gz = gzopen(gz_file, "wb")) == NULL) || (gzputs(gz, fasta) == -1) || (gzclose(gz) != Z_OK))
+    fail("write a gzip file");
+  check_extract(ctx, gz_file, "extract from a gzip compressed fasta file");
+  if (ef_build_index(ctx, gz_file) != EF_ERR_FASTA)
+    fail("only BGZF can be indexed");
+  ntests++;
+
+  write_bgzf(gz_file, fasta, 7);
+  check_extract(ctx, gz_file, "extract from a BGZF file");
+  ef_set_threads(ctx, 3);
+  check_extract(ctx, gz_file, "extract from a BGZF file, inflated by threads");
+  if (ef_build_index(ctx, gz_file) != EF_OK)
+    fail("index a BGZF file");
+  ef_set_index(ctx, 1);
+  check_extract(ctx, gz_file, "extract from a BGZF file with its index");
+  if (ef_open_reference(ctx, gz_file) != EF_OK)
+    fail("open a BGZF file as the reference");
+  check_extract(ctx, NULL, "extract from an indexed BGZF reference");
+  ef_free(ctx);
+}
+
+/* long_record(): a malloc'ed fasta record "w" of 1,000,000 residues,
+ * LONG_RESIDUE(0..999999), in lines of 60; *ret_len is its length */
+#define LONG_RESIDUE(i) ("ACGT"[((i) + (i) / 7) % 4])
+
+static char *long_record(long *ret_len) {
+  char *seq = (char *) malloc(1000000 + 1000000 / 60 + 10);
+  long  n, i;
+
+  if (seq == NULL)
+    fail("allocate a long record");
+  n = sprintf(seq, ">w\n");
+  for (i = 0; i < 1000000; i++)
+    {
+      seq[n++] = LONG_RESIDUE(i);
+      if ((i % 60 == 59) || (i == 999999))
+        seq[n++] = '\n';
+    }
+  *ret_len = n;
+  return seq;
+}
+
+/* a record read as a stream, with the pieces of its intervals far apart:
+ * only their residues are kept */
+static void test_window(void) {
+  static const char *window_intervals =
+    "w 2 1 101 500000 500100 +\n"
+    "w 2 400000 400100 999900 1000000 +\n";
+  ef_ctx  *ctx = ef_create();
+  ef_stats stats;
+  gzFile   gz;
+  char    *seq, *expect, *out;
+  long     len, n, i;
+  int      nthreads;
+
+  seq    = long_record(&n);
+  expect = (char *) malloc(1024);
+  out    = (char *) malloc(1024);
+  if ((expect == NULL) || (out == NULL))
+    fail("allocate a long record");
+  if (((gz = gzopen(gz_file, "wb")) == NULL) || (gzwrite(gz, seq, n) != n) || (gzclose(gz) != Z_OK))
+    fail("write a gzip file with a long record");
+
+  n = sprintf(expect, ">w:<1_101:500000_500100:+\n");
+  for (i = 0; i < 101; i++)
+    expect[n++] = LONG_RESIDUE(i);
+  for (i = 499999; i < 500100; i++)
+    expect[n++] = LONG_RESIDUE(i);
+  n += sprintf(expect + n, "\n>w:400000_400100:999900_>1000000:+\n");
+  for (i = 399999; i < 400100; i++)
+    expect[n++] = LONG_RESIDUE(i);
+  for (i = 999899; i < 1000000; i++)
+    expect[n++] = LONG_RESIDUE(i);
+  expect[n++] = '\n';
+
+  ef_set_width(ctx, 0);
+  ef_set_stats(ctx, 1);
+  if (ef_add_intervals(ctx, window_intervals, strlen(window_intervals), "window") != EF_OK)
+    fail("intervals with pieces far apart");
+  for (nthreads = 1; nthreads <= 3; nthreads += 2)
+    {
+      ef_set_threads(ctx, nthreads);
+      if ((ef_extract_buffer(ctx, gz_file, out, 1024, &len) != EF_OK) || (len != n) || (memcmp(out, expect, n) != 0))
+        fail("extract pieces far apart in a record read as a stream");
+      ef_get_stats(ctx, &stats);
+      if (stats.bytes_copied > 4 * 404) /* not the 1,000,000 residues between them */
+        fail("only the residues of pieces are kept in the window");
+      ntests++;
+    }
+  free(seq);
+  free(expect);
+  free(out);
+  ef_free(ctx);
+}
+
+/* count_output(): ef_write_fn that counts the bytes */
+static int count_output(void *arg, const char *buf, long len) {
+  *((long *) arg) += len;
+  return 0;
+}
+
+/* count_progress(): ef_progress_fn that counts its calls */
+static void count_progress(void *arg, const ef_stats *stats) {
+  (*((int *) arg))++;
+}
+
+static void test_stats(void) {
+  ef_ctx  *ctx = ef_create();
+  ef_stats stats;
+  int      ncalls = 0;
+
+  ef_set_stats(ctx, 1);
+  if (ef_add_intervals(ctx, intervals, strlen(intervals), "intervals") != EF_OK)
+    fail("intervals added from memory, with stats");
+  check_extract(ctx, fa_file, "extract with stats");
+  ef_get_stats(ctx, &stats);
+  if ((stats.interval_bytes != (long) strlen(intervals)) || (stats.fasta_bytes != (long) strlen(fasta)) ||
+      (stats.bytes_written != (long) strlen(expected)))
+    fail("stats count bytes read and written");
+  if ((stats.records_seen != 3) || (stats.records_matched != 2) ||
+      (stats.intervals_plus != 2) || (stats.intervals_minus != 1))
+    fail("stats count records and intervals");
+  if ((stats.buffer_grows != 0) || (stats.bytes_copied != 0)) /* no piece spans lines of the mapped file */
+    fail("stats count copies");
+  if ((stats.read_seconds < 0) || (stats.scan_seconds < 0) || (stats.extract_seconds < 0) || (stats.peak_rss_kb <= 0))
+    fail("stats time phases");
+  ntests++;
+
+  if (ef_set_progress(ctx, 0, count_progress, &ncalls) != EF_ERR_USAGE)
+    fail("a progress interval must be positive");
+  if (ef_set_progress(ctx, 1e-9, count_progress, &ncalls) != EF_OK)
+    fail("set a progress function");
+  check_extract(ctx, fa_file, "extract with a progress function");
+  if (ncalls == 0)
+    fail("the progress function is called");
+  ntests++;
+
+  ef_set_stats(ctx, 0);
+  check_extract(ctx, fa_file, "extract without stats");
+  ef_get_stats(ctx, &stats);
+  if ((stats.records_seen != 0) || (stats.bytes_written != 0))
+    fail("no stats once they are off");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* with threads, the workers' extracting is timed as extracting, not as
+ * scanning the fasta file */
+static void test_thread_stats(void) {
+  char     long_file[sizeof(fa_file) + 5];
+  ef_ctx  *ctx = ef_create();
+  ef_stats stats;
+  FILE    *fp;
+  char    *seq;
+  long     n, nbytes = 0;
+  int      i, threads, ncalls;
+
+  seq = long_record(&n);
+  sprintf(long_file, "%s.long", fa_file);
+  if (((fp = fopen(long_file, "w")) == NULL) || (fwrite(seq, 1, n, fp) != (size_t) n) || (fclose(fp) != 0))
+    fail("write a fasta file with a long record");
+  free(seq);
+
+  ef_set_stats(ctx, 1);
+  ef_set_threads(ctx, 3);
+  for (i = 0; i < 20; i++)
+    if (ef_add_intervals(ctx, "w\n", 2, "whole") != EF_OK)
+      fail("intervals for a whole long record");
+  if (ef_extract(ctx, long_file, count_output, &nbytes) != EF_OK)
+    fail("extract a long record 20 times with threads");
+  ef_get_stats(ctx, &stats);
+  if ((nbytes != stats.bytes_written) || (stats.extract_seconds <= 0) || (stats.extract_cpu <= stats.scan_cpu))
+    fail("with threads, stats time extracting in the worker threads");
+  ntests++;
+
+  /* the one record is a single header and lookup, so the progress function
+   * is called as its intervals are written, with and without threads */
+  for (threads = 1; threads <= 3; threads += 2)
+    {
+      ncalls = 0;
+      ef_set_threads(ctx, threads);
+      if (ef_set_progress(ctx, 1e-9, count_progress, &ncalls) != EF_OK)
+        fail("set a progress function");
+      if (ef_extract(ctx, long_file, count_output, &nbytes) != EF_OK)
+        fail("extract a long record 20 times with a progress function");
+      if (ncalls < ((threads == 1) ? 20 : 2))
+        fail("the progress function is called within a record");
+      ntests++;
+    }
+  unlink(long_file);
+  ef_free(ctx);
+}
+
+/* same_file(): TRUE if <filename> holds <text> */
+static int same_file(const char *filename, const char *text) {
+  char  buf[OUTSIZE];
+  FILE *fp;
+  long  len;
+
+  if ((fp = fopen(filename, "r")) == NULL)
+    return 0;
+  len = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  return (len == (long) strlen(text)) && (memcmp(buf, text, len) == 0);
+}
+
+/* binary records, see extractfasta.h, and the .fai of the output */
+static void test_output(void) {
+  ef_ctx *ctx = new_ctx();
+  char    out[OUTSIZE];
+  long    len;
+
+  ef_set_output_index(ctx, out_fai);
+  check_extract(ctx, fa_file, "extract with an index of the output");
+  if (! same_file(out_fai, expected_fai))
+    fail("the index of the output");
+  ntests++;
+
+  if (ef_set_format(ctx, EF_FORMAT_BINARY) != EF_OK)
+    fail("set binary output");
+  ef_set_threads(ctx, 3);
+  if ((ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_OK) ||
+      (len != (long) sizeof(expected_bin) - 1) || (memcmp(out, expected_bin, len) != 0))
+    fail("extract binary records");
+  if (! same_file(out_fai, expected_bin_fai))
+    fail("the index of binary output");
+  ntests++;
+
+  ef_set_output_index(ctx, "/nonexistent/out.fai");
+  if (ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_ERR_IO)
+    fail("an index of the output that can't be written is EF_ERR_IO");
+  if (ef_set_format(ctx, 2) != EF_ERR_USAGE)
+    fail("a bad output format is EF_ERR_USAGE");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* intervals sorted externally, see ef_set_sort_memory() */
+static void test_sort_memory(void) {
+  ef_ctx     *ctx = ef_create();
+  const char *fa_fileA[2];
+  char        out[OUTSIZE];
+  long        len;
+  FILE       *fp;
+
+  if ((ef_set_sort_memory(ctx, 1000, NULL) != EF_ERR_USAGE) || (ef_set_sort_memory(ctx, 64 * 1024, NULL) != EF_OK))
+    fail("set a memory budget for the intervals");
+  if ((ef_add_intervals(ctx, intervals, strlen(intervals), "intervals") != EF_OK) || (ef_interval_count(ctx) != 4))
+    fail("intervals added to an external sort");
+  if (ef_set_sort_memory(ctx, 0, NULL) != EF_ERR_USAGE)
+    fail("a budget set once intervals are added is EF_ERR_USAGE");
+  ntests++;
+
+  check_extract(ctx, fa_file, "extract intervals sorted externally");
+  check_extract(ctx, fa_file, "extract intervals sorted externally again");
+  ef_set_threads(ctx, 3);
+  check_extract(ctx, fa_file, "extract intervals sorted externally with threads");
+  ef_set_index(ctx, 1);
+  check_extract(ctx, fa_file, "extract intervals sorted externally with an index");
+  ef_set_index(ctx, 0);
+  if (ef_build_cache(ctx, fa_file, cache_file) != EF_OK)
+    fail("build a 2-bit cache");
+  check_extract(ctx, cache_file, "extract intervals sorted externally from a 2-bit cache");
+
+  if (ef_open_reference(ctx, fa_file) != EF_OK)
+    fail("open a reference to extract intervals sorted externally from");
+  check_extract(ctx, NULL, "extract intervals sorted externally from a reference");
+
+  fa_fileA[0] = fa_file;
+  fa_fileA[1] = fa_file;
+  if (ef_extract_files(ctx, fa_fileA, 2, failing_write, NULL) != EF_ERR_USAGE)
+    fail("several fasta files with intervals sorted externally is EF_ERR_USAGE");
+  ntests++;
+
+  /* s1 is given up as missing when s2 comes first */
+  if (((fp = fopen(cache_file, "w")) == NULL) || (fputs(">s2\nAC\n>s1\nGT\n", fp) == EOF) || (fclose(fp) != 0))
+    fail("write a fasta file out of name order");
+  if ((ef_extract_buffer(ctx, cache_file, out, OUTSIZE, &len) != EF_ERR_FASTA) ||
+      (strstr(ef_error(ctx), "Sequence s1 comes after s2") == NULL))
+    fail("a sequence out of name order with intervals sorted externally is EF_ERR_FASTA");
+  ntests++;
+  ef_free(ctx);
+
+  /* a list that fits in one run needs no temporary file, also once
+   * more lines are added after an extraction */
+  ctx = ef_create();
+  if ((ef_set_sort_memory(ctx, 1 << 20, "/nonexistent") != EF_OK) ||
+      (ef_add_intervals(ctx, intervals, 11, "intervals") != EF_OK) ||
+      (ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_OK) ||
+      (ef_add_intervals(ctx, intervals + 11, strlen(intervals) - 11, "intervals") != EF_OK))
+    fail("intervals sorted in memory, with no temporary directory");
+  ntests++;
+  check_extract(ctx, fa_file, "extract intervals sorted in memory");
+  check_extract(ctx, fa_file, "extract intervals sorted in memory again");
+  ef_free(ctx);
+
+  /* a run that can't be written, or a list that can't be read, is EF_ERR_IO; a bad line isn't */
+  ctx = ef_create();
+  if ((ef_set_sort_memory(ctx, 64 * 1024, "/nonexistent") != EF_OK) ||
+      (ef_add_intervals(ctx, intervals, strlen(intervals), "intervals") != EF_ERR_IO) ||
+      (ef_read_intervals(ctx, "/nonexistent/intervals") != EF_ERR_IO) ||
+      (ef_add_intervals(ctx, "s1 1 0 2 +\n", 11, "intervals") != EF_ERR_INTERVAL))
+    fail("errors adding intervals sorted externally");
+  ntests++;
+  ef_free(ctx);
+}
+
+/* serve() answering requests from a file, one with a bad interval */
+static void test_serve(void) {
+  static const char *requests =
+    "s1 1 -100000 10 +\n.\n"
+    "s2 1 1 4 +\n.\n";
+  static const char *expected_ok = "OK 16 0\n>s2:<1_4:+\nAAAA\n";
+  char  req_file[] = "/tmp/test_extractfasta.reqXXXXXX";
+  char  resp_file[] = "/tmp/test_extractfasta.respXXXXXX";
+  char *fa_fileA[1] = { fa_file };
+  char  buf[OUTSIZE], *ok;
+  FILE *fp;
+  long  len;
+  int   fd, stdout_fd, status;
+
+  fd = mkstemp(req_file);
+  if ((fd == -1) || (write(fd, requests, strlen(requests)) != (long) strlen(requests)))
+    fail("write a file of requests");
+  close(fd);
+  if ((fd = mkstemp(resp_file)) == -1)
+    fail("create a file for responses");
+
+  /* serve() reads stdin and writes stdout */
+  fflush(stdout);
+  stdout_fd = dup(1);
+  if ((freopen(req_file, "r", stdin) == NULL) || (dup2(fd, 1) == -1))
+    fail("redirect stdin and stdout");
+  status = serve(fa_fileA, 1, NULL, 1, 80, 0, 0, 0);
+  dup2(stdout_fd, 1);
+  close(stdout_fd);
+  close(fd);
+
+  fp = fopen(resp_file, "r");
+  len = (fp == NULL) ? 0 : (long) fread(buf, 1, sizeof(buf) - 1, fp);
+  if (fp != NULL)
+    fclose(fp);
+  buf[len] = '\0';
+  unlink(req_file);
+  unlink(resp_file);
+  if ((status != EXIT_SUCCESS) || (strncmp(buf, "ERROR ", 6) != 0) || (strstr(buf, "Start position < 1") == NULL))
+    fail("serve answers a request with a start < 1 with an ERROR line");
+  if (((ok = strstr(buf, "\nOK ")) == NULL) || (strcmp(ok + 1, expected_ok) != 0))
+    fail("serve answers the request after a bad one");
+  ntests++;
+}
+
+static void test_errors(void) {
+  ef_ctx *ctx = ef_create();
+  char    out[OUTSIZE];
+  long    len;
+  FILE   *fp;
+
+  if (ef_add_intervals(ctx, "s1 2 1 2 +\n", 11, "bad") != EF_ERR_INTERVAL)
+    fail("a bad interval line is EF_ERR_INTERVAL");
+  if (ef_interval_count(ctx) != 0)
+    fail("a bad interval line clears the intervals");
+  ntests++;
+
+  if ((ef_add_intervals(ctx, "s1 1 -5 2 +\n", 12, "bad") != EF_ERR_INTERVAL) ||
+      (ef_add_intervals(ctx, "s1 1 0 2 +\n", 11, "bad") != EF_ERR_INTERVAL) ||
+      (ef_add_intervals(ctx, "s1 1 5 2 +\n", 11, "bad") != EF_ERR_INTERVAL))
+    fail("a single piece starting before 1 or after its end is EF_ERR_INTERVAL");
+  ntests++;
+
+  if (ef_read_intervals(ctx, "/nonexistent/intervals") != EF_ERR_IO)
+    fail("a missing interval list is EF_ERR_IO");
+  ntests++;
+
+  ef_add_intervals(ctx, "s2 1 5 11 +\n", 12, "long");
+  if (ef_extract_buffer(ctx, fa_file, out, OUTSIZE, &len) != EF_ERR_RANGE)
+    fail("an interval past the end of its sequence is EF_ERR_RANGE");
+  if (strstr(ef_error(ctx), "End position exceeds sequence length") == NULL)
+    fail("an interval past the end of its sequence is EF_ERR_RANGE");
+  ntests++;
+
+  if (ef_extract_buffer(ctx, "/nonexistent/fasta", out, OUTSIZE, &len) != EF_ERR_IO)
+    fail("a missing fasta file is EF_ERR_IO");
+  ntests++;
+
+  ef_clear_intervals(ctx);
+  ef_add_intervals(ctx, "s2\n", 3, "short");
+  if ((ef_extract_buffer(ctx, fa_file, out, 10, &len) != EF_ERR_NOSPACE) || (len != 24) ||
+      (memcmp(out, ">s2:<1_>10", 10) != 0))
+    fail("a buffer too small is EF_ERR_NOSPACE, with the size needed");
+  ntests++;
+
+  if (ef_extract(ctx, fa_file, failing_write, NULL) != EF_ERR_IO)
+    fail("a failing write function is EF_ERR_IO");
+  ntests++;
+
+  if ((ef_set_width(ctx, -1) != EF_ERR_USAGE) || (ef_set_threads(ctx, 0) != EF_ERR_USAGE) ||
+      (ef_set_read_gap(ctx, -1) != EF_ERR_USAGE) || (ef_set_id_field(ctx, -2) != EF_ERR_USAGE) ||
+      (ef_set_genetic_code(ctx, 7) != EF_ERR_USAGE) ||
+      (ef_extract_buffer(ctx, NULL, out, OUTSIZE, &len) != EF_ERR_USAGE))
+    fail("bad arguments are EF_ERR_USAGE");
+  ntests++;
+
+  ef_set_index(ctx, 1);
+  if (ef_open_reference(ctx, "/nonexistent/fasta") != EF_ERR_FASTA)
+    fail("a missing index is EF_ERR_FASTA");
+  ntests++;
+
+  if (((fp = fopen(cache_file, "w")) == NULL) || (fputs(">s1\nACGTRYN\n", fp) == EOF) || (fclose(fp) != 0))
+    fail("write a fasta file that can't be 2-bit packed");
+  if ((ef_build_cache(ctx, cache_file, "/tmp/test_extractfasta.2bit") != EF_ERR_FASTA) ||
+      (strstr(ef_error(ctx), "Cannot cache residue 'R'") == NULL) ||
+      (access("/tmp/test_extractfasta.2bit", F_OK) == 0)) /* no partial cache left behind */
+    fail("a fasta file that can't be 2-bit packed is EF_ERR_FASTA");
+  ntests++;
+
+  ef_free(ctx);
+}
+
+int main(void) {
+  char  fai_file[sizeof(gz_file) + 4];
+  FILE *fp;
+  int   fd;
+
+  fd = mkstemp(fa_file);
+  if ((fd == -1) || ((fp = fdopen(fd, "w")) == NULL))
+    fail("write a fasta file");
+  fputs(fasta, fp);
+  fclose(fp);
+  sprintf(cache_file, "%s.2bit", fa_file);
+  sprintf(gz_file, "%s.gz", fa_file);
+  sprintf(out_fai, "%s.out.fai", fa_file);
+
+  test_extract();
+  test_memo();
+  test_translate();
+  test_id_field();
+  test_files();
+  test_gzip();
+  test_window();
+  test_stats();
+  test_thread_stats();
+  test_output();
+  test_sort_memory();
+  test_serve();
+  test_errors();
+
+  unlink(fa_file);
+  sprintf(fai_file, "%s.fai", fa_file);
+  unlink(fai_file);
+  unlink(cache_file);
+  unlink(gz_file);
+  unlink(out_fai);
+  sprintf(fai_file, "%s.fai", gz_file);
+  unlink(fai_file);
+  sprintf(fai_file, "%s.gzi", gz_file);
+  unlink(fai_file);
+  printf("PASS [%d tests]\n", ntests);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/* test_revcomp.c:
+ *
+ * Unit tests for the reverse complement kernels in revcomp.c.
+ *
+ * Checks that revcomp_scalar() gives the same result as the original
+ * per-base switch in print_fasta() for ACGTacgt, that IUPAC codes are
+ * complemented, and that each SIMD variant this CPU supports agrees
+ * with revcomp_scalar() on every byte value and on sequences of many
+ * lengths (so all tail lengths are covered).
+ *
+ * To compile and run:
+ *    gcc -O2 -o test_revcomp test_revcomp.c revcomp.c && ./test_revcomp
+ *
+ * If all tests pass, final line of output is PASS [...].
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "revcomp.h"
+
+#define MAXLEN 1000
+
+static int ntests = 0;
+
+/* original_complement(): the complement print_fasta() used to output for <c> */
+static char original_complement(char c) {
+  switch(c) {
+  case 'A': return 'T';
+  case 'C': return 'G';
+  case 'G': return 'C';
+  case 'T': return 'A';
+  case 'a': return 't';
+  case 'c': return 'g';
+  case 'g': return 'c';
+  case 't': return 'a';
+  default:  return 'N';
+  }
+}
+
+static void fail(const char *desc) {
+  fprintf(stderr, "ERROR, the following test failed: %s\n", desc);
+  exit(EXIT_FAILURE);
+}
+
+static void test_against_original(void) {
+  const char *alphabet = "ACGTacgt";
+  char  src[MAXLEN], dst[MAXLEN];
+  int   n, i;
+
+  for (n = 0; n < MAXLEN; n++)
+    {
+      for (i = 0; i < n; i++)
+        src[i] = alphabet[rand() % 8];
+      revcomp_scalar(dst, src, n);
+      for (i = 0; i < n; i++)
+        if (dst[i] != original_complement(src[n-1-i]))
+          fail("scalar reverse complement of ACGTacgt matches original print_fasta()");
+    }
+  ntests++;
+}
+
+static void test_iupac(void) {
+  const char *codes = "ACGTURYKMSWBDHVNacgturykmswbdhvn-*.X0";
+  const char *comps = "TGCAAYRMKSWVHDBNtgcaayrmkswvhdbnNNNNN";
+  char  dst[64];
+  int   n = strlen(codes);
+  int   i;
+
+  revcomp_scalar(dst, codes, n);
+  for (i = 0; i < n; i++)
+    if (dst[n-1-i] != comps[i])
+      fail("IUPAC codes are complemented");
+  ntests++;
+}
+
+static void test_variant(const char *name, void (*variant)(char *, const char *, long)) {
+  char  src[MAXLEN], expected[MAXLEN], actual[MAXLEN];
+  char  desc[128];
+  int   n, i;
+
+  if (! revcomp_supported(name))
+    {
+      printf("skipping %s variant, not supported by this CPU\n", name);
+      return;
+    }
+  sprintf(desc, "%s variant agrees with scalar on all byte values", name);
+  for (i = 0; i < 256; i++)
+    src[i] = (char) i;
+  revcomp_scalar(expected, src, 256);
+  variant(actual, src, 256);
+  if (memcmp(expected, actual, 256) != 0)
+    fail(desc);
+  ntests++;
+
+  sprintf(desc, "%s variant agrees with scalar on all lengths", name);
+  for (n = 0; n < MAXLEN; n++)
+    {
+      for (i = 0; i < n; i++)
+        src[i] = "ACGTNRYacgtnry-"[rand() % 15];
+      revcomp_scalar(expected, src, n);
+      variant(actual, src, n);
+      if (memcmp(expected, actual, n) != 0)
+        fail(desc);
+    }
+  ntests++;
+}
+
+int main(void) {
+  char src[] = "AACCGTRn";
+  char dst[sizeof(src)];
+
+  srand(7);
+  test_against_original();
+  test_iupac();
+  test_variant("sse4", revcomp_sse4);
+  test_variant("avx2", revcomp_avx2);
+
+  /* and the dispatching version */
+  revcomp(dst, src, 8);
+  if (memcmp(dst, "nYACGGTT", 8) != 0)
+    fail("revcomp() dispatches to a working variant");
+  ntests++;
+
+  printf("PASS [%d tests]\n", ntests);
+  return 0;
+}
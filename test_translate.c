@@ -0,0 +1,154 @@
+/* test_translate.c:
+ *
+ * Unit tests for the translation kernels in translate.c.
+ *
+ * Checks a few codons of some genetic codes, that codons with IUPAC
+ * codes translate to what they have in common, that each SIMD variant
+ * this CPU supports agrees with translate_scalar() on random sequence
+ * (some of it ambiguous) of many lengths, and that a translator_t
+ * carries codons across pieces and translates the - strand.
+ *
+ * To compile and run:
+ *    gcc -O2 -o test_translate test_translate.c translate.c revcomp.c && ./test_translate
+ *
+ * If all tests pass, final line of output is PASS [...].
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "translate.h"
+
+#define MAXCODONS 400
+
+static int ntests = 0;
+
+static void fail(const char *desc) {
+  fprintf(stderr, "ERROR, the following test failed: %s\n", desc);
+  exit(EXIT_FAILURE);
+}
+
+static void test_tables(void) {
+  const char *standard = translate_table(1);
+  const char *vert_mito = translate_table(2);
+
+  if ((standard == NULL) || (vert_mito == NULL) || (translate_table(7) != NULL))
+    fail("genetic codes 1 and 2 exist, 7 doesn't");
+  if ((translate_codon("ATG", standard) != 'M') || (translate_codon("TGG", standard) != 'W') ||
+      (translate_codon("TAA", standard) != '*') || (translate_codon("GGG", standard) != 'G') ||
+      (translate_codon("TTT", standard) != 'F') || (translate_codon("aug", standard) != 'M'))
+    fail("codons of the standard code");
+  if ((translate_codon("TGA", vert_mito) != 'W') || (translate_codon("AGA", vert_mito) != '*') ||
+      (translate_codon("ATA", vert_mito) != 'M'))
+    fail("codons of the vertebrate mitochondrial code");
+  if (strcmp(translate_table(11), standard) != 0)
+    fail("the bacterial code translates like the standard code");
+  ntests++;
+}
+
+static void test_ambiguous(void) {
+  const char *standard = translate_table(1);
+
+  if ((translate_codon("GCN", standard) != 'A') || (translate_codon("YTR", standard) != 'L') ||
+      (translate_codon("ATH", standard) != 'I') || (translate_codon("TAR", standard) != '*') ||
+      (translate_codon("gcn", standard) != 'A'))
+    fail("ambiguous codons that can only be one amino acid");
+  if ((translate_codon("NNN", standard) != 'X') || (translate_codon("ATN", standard) != 'X') ||
+      (translate_codon("AT-", standard) != 'X') || (translate_codon("A*G", standard) != 'X'))
+    fail("ambiguous codons that can be more than one, or aren't bases, are X");
+  ntests++;
+}
+
+static void test_variant(const char *name, void (*variant)(char *, const char *, long, const char *)) {
+  const char *standard = translate_table(1);
+  char  src[3 * MAXCODONS], expected[MAXCODONS], actual[MAXCODONS];
+  char  desc[128];
+  int   n, i;
+
+  if (! translate_supported(name))
+    {
+      printf("skipping %s variant, not supported by this CPU\n", name);
+      return;
+    }
+  sprintf(desc, "%s variant agrees with scalar on all codons", name);
+  for (i = 0; i < 64; i++)
+    {
+      src[3*i]   = "TCAG"[i >> 4];
+      src[3*i+1] = "tcag"[(i >> 2) & 3];
+      src[3*i+2] = "UCAG"[i & 3];
+    }
+  variant(actual, src, 64, standard);
+  if (memcmp(actual, standard, 64) != 0)
+    fail(desc);
+  ntests++;
+
+  sprintf(desc, "%s variant agrees with scalar on all lengths", name);
+  for (n = 0; n < MAXCODONS; n++)
+    {
+      for (i = 0; i < 3 * n; i++)
+        src[i] = (rand() % 200 == 0) ? "NRYnry-*"[rand() % 8] : "ACGTUacgtu"[rand() % 10];
+      translate_scalar(expected, src, n, standard);
+      variant(actual, src, n, standard);
+      if (memcmp(expected, actual, n) != 0)
+        fail(desc);
+    }
+  ntests++;
+}
+
+static void test_translator(void) {
+  translator_t *tr = translator_create(translate_table(1));
+  const char   *aa;
+  long          n;
+
+  /* ATG GCC TAA, split 2, 3, 4 */
+  translator_start(tr);
+  aa = translator_add(tr, "AT", 2, 0, &n);
+  if (n != 0)
+    fail("a piece shorter than a codon");
+  aa = translator_add(tr, "GGC", 3, 0, &n);
+  if ((n != 1) || (aa[0] != 'M'))
+    fail("a codon split between pieces");
+  aa = translator_add(tr, "CTAA", 4, 0, &n);
+  if ((n != 2) || (memcmp(aa, "A*", 2) != 0))
+    fail("a codon split between pieces");
+  ntests++;
+
+  /* the - strand, pieces in reverse order: TTAGG CCAT */
+  translator_start(tr);
+  aa = translator_add(tr, "CCAT", 4, 1, &n);
+  if ((n != 1) || (aa[0] != 'M'))
+    fail("the reverse complement of a piece");
+  aa = translator_add(tr, "TTAGG", 5, 1, &n);
+  if ((n != 2) || (memcmp(aa, "A*", 2) != 0))
+    fail("the reverse complement of a piece");
+
+  /* a new interval drops the unfinished codon */
+  translator_add(tr, "A", 1, 0, &n);
+  translator_start(tr);
+  aa = translator_add(tr, "TGG", 3, 0, &n);
+  if ((n != 1) || (aa[0] != 'W'))
+    fail("translator_start() drops an unfinished codon");
+  ntests++;
+  translator_free(tr);
+}
+
+int main(void) {
+  const char *src = "ATGGCCTAAggg";
+  char dst[4];
+
+  srand(7);
+  test_tables();
+  test_ambiguous();
+  test_variant("sse4", translate_sse4);
+  test_translator();
+
+  /* and the dispatching version */
+  translate(dst, src, 4, translate_table(1));
+  if (memcmp(dst, "MA*G", 4) != 0)
+    fail("translate() dispatches to a working variant");
+  ntests++;
+
+  printf("PASS [%d tests]\n", ntests);
+  return 0;
+}
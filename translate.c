@@ -0,0 +1,347 @@
+/* translate.c:
+ *
+ * Translation with the NCBI genetic codes, see translate.h.
+ *
+ * The SSE4.1 variant takes 48 bases (16 codons) at a time: each base
+ * is turned into its 2-bit code with a byte shuffle on its low 4 bits
+ * (which differ for A, C, G, T and U) and checked against the letter
+ * those bits should be, the first, second and third bases of the
+ * codons are gathered with three shuffles each, and the 6-bit codon is
+ * looked up in the 64-entry table as four 16-entry shuffles, two blends
+ * choosing between them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "translate.h"
+#include "revcomp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSLATE_X86
+#include <immintrin.h>
+#endif
+
+#define AMBIGUOUS 4 /* base_code[] of anything but A, C, G, T and U */
+
+/* NCBI genetic codes, the amino acids of codons TTT, TTC, TTA, TTG, TCT ... GGG */
+static const struct {
+  int         code;
+  const char *aaA;
+} tableA[] = {
+  {  1, "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* standard */
+  {  2, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSS**VVVVAAAADDEEGGGG" }, /* vertebrate mitochondrial */
+  {  3, "FFLLSSSSYY**CCWWTTTTPPPPHHQQRRRRIIMMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* yeast mitochondrial */
+  {  4, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* mold, protozoan, coelenterate mitochondrial; mycoplasma */
+  {  5, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSSSSVVVVAAAADDEEGGGG" }, /* invertebrate mitochondrial */
+  {  6, "FFLLSSSSYYQQCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* ciliate, dasycladacean, hexamita nuclear */
+  {  9, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNNKSSSSVVVVAAAADDEEGGGG" }, /* echinoderm, flatworm mitochondrial */
+  { 10, "FFLLSSSSYY**CCCWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* euplotid nuclear */
+  { 11, "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* bacterial, archaeal, plant plastid */
+  { 12, "FFLLSSSSYY**CC*WLLLSPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* alternative yeast nuclear */
+  { 13, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSSGGVVVVAAAADDEEGGGG" }, /* ascidian mitochondrial */
+  { 14, "FFLLSSSSYYY*CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNNKSSSSVVVVAAAADDEEGGGG" }, /* alternative flatworm mitochondrial */
+  { 16, "FFLLSSSSYY*LCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* chlorophycean mitochondrial */
+  { 21, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNNKSSSSVVVVAAAADDEEGGGG" }, /* trematode mitochondrial */
+  { 22, "FFLLSS*SYY*LCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* scenedesmus obliquus mitochondrial */
+  { 23, "FF*LSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* thraustochytrium mitochondrial */
+  { 24, "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSSKVVVVAAAADDEEGGGG" }, /* rhabdopleuridae mitochondrial */
+  { 25, "FFLLSSSSYY**CCGWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* candidate division SR1, gracilibacteria */
+  { 26, "FFLLSSSSYY**CC*WLLLAPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* pachysolen tannophilus nuclear */
+  { 27, "FFLLSSSSYYQQCCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* karyorelict nuclear */
+  { 28, "FFLLSSSSYYQQCCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* condylostoma nuclear */
+  { 29, "FFLLSSSSYYYYCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* mesodinium nuclear */
+  { 30, "FFLLSSSSYYEECC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* peritrich nuclear */
+  { 31, "FFLLSSSSYYEECCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG" }, /* blastocrithidia nuclear */
+  { 33, "FFLLSSSSYYY*CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSSKVVVVAAAADDEEGGGG" }, /* cephalodiscidae mitochondrial */
+  {  0, NULL }
+};
+
+/* 2-bit code of each base, X for AMBIGUOUS, which is anything else */
+#define X AMBIGUOUS
+static const unsigned char base_code[256] = {
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*   0.. 15 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  16.. 31 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  32.. 47 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  48.. 63 */
+  X,2,X,1,X,X,X,3,X,X,X,X,X,X,X,X, /*  64.. 79 */
+  X,X,X,X,0,0,X,X,X,X,X,X,X,X,X,X, /*  80.. 95 */
+  X,2,X,1,X,X,X,3,X,X,X,X,X,X,X,X, /*  96..111 */
+  X,X,X,X,0,0,X,X,X,X,X,X,X,X,X,X, /* 112..127 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 128..143 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 144..159 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 160..175 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 176..191 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 192..207 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 208..223 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 224..239 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X  /* 240..255 */
+};
+#undef X
+
+/* the bases each IUPAC code could be, bit <code> for each, 0 if not a base */
+static const unsigned char base_mask[256] = {
+  ['T'] = 0x1, ['U'] = 0x1, ['C'] = 0x2, ['A'] = 0x4, ['G'] = 0x8,
+  ['Y'] = 0x3, ['W'] = 0x5, ['M'] = 0x6, ['H'] = 0x7, ['K'] = 0x9, ['S'] = 0xa,
+  ['B'] = 0xb, ['R'] = 0xc, ['D'] = 0xd, ['V'] = 0xe, ['N'] = 0xf,
+  ['t'] = 0x1, ['u'] = 0x1, ['c'] = 0x2, ['a'] = 0x4, ['g'] = 0x8,
+  ['y'] = 0x3, ['w'] = 0x5, ['m'] = 0x6, ['h'] = 0x7, ['k'] = 0x9, ['s'] = 0xa,
+  ['b'] = 0xb, ['r'] = 0xc, ['d'] = 0xd, ['v'] = 0xe, ['n'] = 0xf
+};
+
+static void  translate_resolve(char *dst, const char *src, long ncodons, const char *table);
+static void *grow(void *p, size_t size);
+
+/* the variant translate() calls, set on the first call */
+static void (*translate_best)(char *, const char *, long, const char *) = translate_resolve;
+
+/* translate_table(): the table of NCBI genetic code <code>, or NULL if we don't have it */
+const char *translate_table(int code) {
+  int i;
+
+  for (i = 0; tableA[i].aaA != NULL; i++)
+    if (tableA[i].code == code)
+      return tableA[i].aaA;
+  return NULL;
+}
+
+/* Function: translate_codon()
+ * Args:     codon: 3 bases
+ *           table: from translate_table()
+ * Returns:  the amino acid, 'X' if the codon could be more than one
+ *           or isn't made of IUPAC codes.
+ */
+char translate_codon(const char *codon, const char *table) {
+  unsigned int c0 = base_code[(unsigned char) codon[0]];
+  unsigned int c1 = base_code[(unsigned char) codon[1]];
+  unsigned int c2 = base_code[(unsigned char) codon[2]];
+  int  m0, m1, m2, b0, b1, b2;
+  char aa = 0;
+
+  if ((c0 | c1 | c2) < AMBIGUOUS)
+    return table[(c0 << 4) | (c1 << 2) | c2];
+
+  m0 = base_mask[(unsigned char) codon[0]];
+  m1 = base_mask[(unsigned char) codon[1]];
+  m2 = base_mask[(unsigned char) codon[2]];
+  for (b0 = 0; b0 < 4; b0++)
+    for (b1 = 0; b1 < 4; b1++)
+      for (b2 = 0; b2 < 4; b2++)
+        if ((m0 & (1 << b0)) && (m1 & (1 << b1)) && (m2 & (1 << b2)))
+          {
+            if (aa == 0)
+              aa = table[(b0 << 4) | (b1 << 2) | b2];
+            else if (aa != table[(b0 << 4) | (b1 << 2) | b2])
+              return 'X';
+          }
+  return (aa == 0) ? 'X' : aa;
+}
+
+/* Function: translate()
+ * Args:     dst:     destination, room for <ncodons> amino acids
+ *           src:     3 * <ncodons> bases
+ *           ncodons: number of codons
+ *           table:   from translate_table()
+ */
+void translate(char *dst, const char *src, long ncodons, const char *table) {
+  __atomic_load_n(&translate_best, __ATOMIC_RELAXED)(dst, src, ncodons, table);
+}
+
+/* Function: translate_supported()
+ * Args:     variant: "scalar" or "sse4"
+ * Returns:  TRUE if this CPU can run <variant>
+ */
+int translate_supported(const char *variant) {
+  if (strcmp(variant, "scalar") == 0)
+    return 1;
+#ifdef TRANSLATE_X86
+  __builtin_cpu_init();
+  if (strcmp(variant, "sse4") == 0)
+    return __builtin_cpu_supports("sse4.1");
+#endif
+  return 0;
+}
+
+void translate_scalar(char *dst, const char *src, long ncodons, const char *table) {
+  long i;
+
+  for (i = 0; i < ncodons; i++, src += 3)
+    dst[i] = translate_codon(src, table);
+}
+
+#ifdef TRANSLATE_X86
+
+/* gatherA[j][r]: shuffle taking base <j> of codons 0..15 from the <r>th 16 bytes of 48 */
+static const signed char gatherA[3][3][16] __attribute__((aligned(16))) = {
+  { {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+  { {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+  { {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+    { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } }
+};
+
+__attribute__((target("sse4.1")))
+void translate_sse4(char *dst, const char *src, long ncodons, const char *table) {
+  /* by the low 4 bits of a base: its code, and the upper case letter it must be */
+  const __m128i code   = _mm_setr_epi8(0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i letter = _mm_setr_epi8(-1, 'A', -1, 'C', 'T', 'U', -1, 'G', -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i m0f    = _mm_set1_epi8(0x0f);
+  const __m128i mdf    = _mm_set1_epi8((char) 0xdf);
+  __m128i t0 = _mm_loadu_si128((const __m128i *) table);
+  __m128i t1 = _mm_loadu_si128((const __m128i *) (table + 16));
+  __m128i t2 = _mm_loadu_si128((const __m128i *) (table + 32));
+  __m128i t3 = _mm_loadu_si128((const __m128i *) (table + 48));
+  __m128i x[3], c[3], base[3], g, idx, lo, hi;
+  int     ok, j, r;
+  long    i;
+
+  for (i = 0; i + 16 <= ncodons; i += 16, src += 48)
+    {
+      ok = 0xffff;
+      for (r = 0; r < 3; r++)
+        {
+          x[r] = _mm_loadu_si128((const __m128i *) (src + 16 * r));
+          lo   = _mm_and_si128(x[r], m0f);
+          c[r] = _mm_shuffle_epi8(code, lo);
+          ok  &= _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x[r], mdf), _mm_shuffle_epi8(letter, lo)));
+        }
+      if (ok != 0xffff)
+        {
+          translate_scalar(dst + i, src, 16, table);
+          continue;
+        }
+
+      for (j = 0; j < 3; j++)
+        {
+          base[j] = _mm_setzero_si128();
+          for (r = 0; r < 3; r++)
+            {
+              g = _mm_load_si128((const __m128i *) gatherA[j][r]);
+              base[j] = _mm_or_si128(base[j], _mm_shuffle_epi8(c[r], g));
+            }
+        }
+      /* codons are < 64, so shifting 16 bits at a time never carries into the next byte */
+      idx = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(base[0], 4), _mm_slli_epi16(base[1], 2)), base[2]);
+
+      /* bit 4 of the codon, then bit 5, moved to bit 7 choose the table */
+      lo = _mm_blendv_epi8(_mm_shuffle_epi8(t0, idx), _mm_shuffle_epi8(t1, idx), _mm_slli_epi16(idx, 3));
+      hi = _mm_blendv_epi8(_mm_shuffle_epi8(t2, idx), _mm_shuffle_epi8(t3, idx), _mm_slli_epi16(idx, 3));
+      _mm_storeu_si128((__m128i *) (dst + i), _mm_blendv_epi8(lo, hi, _mm_slli_epi16(idx, 2)));
+    }
+  translate_scalar(dst + i, src, ncodons - i, table);
+}
+
+#else /* ! TRANSLATE_X86 */
+
+void translate_sse4(char *dst, const char *src, long ncodons, const char *table) { translate_scalar(dst, src, ncodons, table); }
+
+#endif
+
+/* Function: translator_create()
+ * Args:     table: from translate_table()
+ * Returns:  a new translator, free with translator_free()
+ */
+translator_t *translator_create(const char *table) {
+  translator_t *tr = (translator_t *) grow(NULL, sizeof(translator_t));
+
+  memset(tr, 0, sizeof(translator_t));
+  tr->table = table;
+  return tr;
+}
+
+/* translator_start(): start a new interval, dropping the bases of an
+ * unfinished codon at the end of the previous one */
+void translator_start(translator_t *tr) {
+  tr->ncodon = 0;
+}
+
+/* Function: translator_add()
+ * Args:     tr:      translator
+ *           s:       residues of the next piece
+ *           len:     number of residues in <s>
+ *           reverse: TRUE to translate the reverse complement of <s>
+ *           ret_n:   RETURN: number of amino acids
+ * Returns:  the amino acids of the codons finished in this piece, in
+ *           <tr>, good until the next call.
+ */
+const char *translator_add(translator_t *tr, const char *s, long len, int reverse, long *ret_n) {
+  long n = 0, ncodons, k;
+
+  if (reverse)
+    {
+      if (tr->rc_alloc < len)
+        {
+          tr->rc_alloc = len;
+          tr->rc = (char *) grow(tr->rc, tr->rc_alloc);
+        }
+      revcomp(tr->rc, s, len);
+      s = tr->rc;
+    }
+  if (tr->aa_alloc < len / 3 + 1)
+    {
+      tr->aa_alloc = len / 3 + 1;
+      tr->aa = (char *) grow(tr->aa, tr->aa_alloc);
+    }
+
+  /* a codon that spans the boundary between pieces */
+  if (tr->ncodon > 0)
+    {
+      k = (3 - tr->ncodon < len) ? 3 - tr->ncodon : len;
+      memcpy(tr->codon + tr->ncodon, s, k);
+      tr->ncodon += k;
+      s   += k;
+      len -= k;
+      if (tr->ncodon < 3)
+        {
+          *ret_n = 0;
+          return tr->aa;
+        }
+      tr->aa[n++] = translate_codon(tr->codon, tr->table);
+      tr->ncodon = 0;
+    }
+
+  ncodons = len / 3;
+  translate(tr->aa + n, s, ncodons, tr->table);
+  n += ncodons;
+  tr->ncodon = len - 3 * ncodons; /* the start of a codon, to finish in the next piece */
+  memcpy(tr->codon, s + 3 * ncodons, tr->ncodon);
+
+  *ret_n = n;
+  return tr->aa;
+}
+
+void translator_free(translator_t *tr) {
+  if (tr == NULL)
+    return;
+  free(tr->rc);
+  free(tr->aa);
+  free(tr);
+}
+
+/* translate_resolve(): pick the variant for translate() to use, then call it */
+static void translate_resolve(char *dst, const char *src, long ncodons, const char *table) {
+  void (*best)(char *, const char *, long, const char *);
+
+  if (translate_supported("sse4"))
+    best = translate_sse4;
+  else
+    best = translate_scalar;
+  __atomic_store_n(&translate_best, best, __ATOMIC_RELAXED); /* threads may race to set it, to the same value */
+  best(dst, src, ncodons, table);
+}
+
+/* grow(): realloc() or die */
+static void *grow(void *p, size_t size) {
+  p = realloc(p, size);
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
@@ -0,0 +1,50 @@
+/* translate.h:
+ *
+ * Translation of nucleotide sequence to protein with the NCBI genetic
+ * codes. Each code is a table of the 64 codons' amino acids, indexed
+ * by the codon packed 2 bits per base, T=0 C=1 A=2 G=3 (the order of
+ * the NCBI tables, and of the bases in a 2-bit cache, see twobit.h),
+ * first base in the high bits. Stop codons are '*'.
+ *
+ * Bases may be in upper or lower case, U is T. A codon with other IUPAC
+ * codes is the amino acid all the codons it could be have in common
+ * (GCN is A), or 'X'; anything else makes it 'X'. Start codons are
+ * translated like any other codon.
+ *
+ * translate() uses the fastest variant this CPU supports, chosen the
+ * first time it is called: SSE4.1 (16 codons at a time, falling back
+ * to the scalar variant for any 16 with a base that isn't A, C, G, T or
+ * U) or a scalar table lookup.
+ *
+ * A translator_t translates the pieces of an interval one after another,
+ * carrying a codon split between two pieces over to the next one.
+ */
+
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+typedef struct {
+  const char *table;  /* [0..63] amino acid of each codon, from translate_table() */
+  char  codon[3];     /* bases of a codon started in an earlier piece */
+  int   ncodon;
+  char *rc;           /* a piece on the - strand, reverse complemented */
+  long  rc_alloc;
+  char *aa;           /* amino acids of the current piece */
+  long  aa_alloc;
+} translator_t;
+
+const char *translate_table(int code);
+char        translate_codon(const char *codon, const char *table);
+void        translate(char *dst, const char *src, long ncodons, const char *table);
+
+translator_t *translator_create(const char *table);
+void          translator_start(translator_t *tr);
+const char   *translator_add(translator_t *tr, const char *s, long len, int reverse, long *ret_n);
+void          translator_free(translator_t *tr);
+
+/* the individual variants, for testing; only call the SIMD one if translate_supported() says so */
+void translate_scalar(char *dst, const char *src, long ncodons, const char *table);
+void translate_sse4(char *dst, const char *src, long ncodons, const char *table);
+int  translate_supported(const char *variant);
+
+#endif /* TRANSLATE_H */
@@ -0,0 +1,573 @@
+/* twobit.c:
+ *
+ * Building and reading 2-bit packed sequence caches, see twobit.h.
+ *
+ * twobit_build() maps the FASTA file into memory and reads through it
+ * twice: once to find the records and the size of each (number of
+ * residues, N blocks and mask blocks), so the index can be written
+ * first, and once more to pack each record and write it.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "twobit.h"
+#include "seqhash.h"
+#include "bgzf.h"
+
+#define TB_WHITE_SPACE " \n\r\t\v"
+#define TB_BAD 0xff     /* code_table[] for characters that can't be cached */
+#define TB_N   4        /* code_table[] for 'N' and 'n' */
+#define TB_MAX_LENGTH 0xffffffffUL /* most residues a record can have */
+
+/* packed code of each character, T=0 C=1 A=2 G=3, N for TB_N and X for TB_BAD */
+#define N TB_N
+#define X TB_BAD
+static const unsigned char code_table[256] = {
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*   0.. 15 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  16.. 31 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  32.. 47 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /*  48.. 63 */
+  X,2,X,1,X,X,X,3,X,X,X,X,X,X,N,X, /*  64.. 79 */
+  X,X,X,X,0,X,X,X,X,X,X,X,X,X,X,X, /*  80.. 95 */
+  X,2,X,1,X,X,X,3,X,X,X,X,X,X,N,X, /*  96..111 */
+  X,X,X,X,0,X,X,X,X,X,X,X,X,X,X,X, /* 112..127 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 128..143 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 144..159 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 160..175 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 176..191 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 192..207 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 208..223 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, /* 224..239 */
+  X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X  /* 240..255 */
+};
+#undef N
+#undef X
+
+/* the 4 residues each packed byte holds, first one in the high bits */
+#define TB_BASE(c) (((c) == 0) ? 'T' : ((c) == 1) ? 'C' : ((c) == 2) ? 'A' : 'G')
+#define TB_UNPACK1(b)  { TB_BASE(((b) >> 6) & 3), TB_BASE(((b) >> 4) & 3), TB_BASE(((b) >> 2) & 3), TB_BASE((b) & 3) }
+#define TB_UNPACK4(b)  TB_UNPACK1(b), TB_UNPACK1((b) + 1), TB_UNPACK1((b) + 2), TB_UNPACK1((b) + 3)
+#define TB_UNPACK16(b) TB_UNPACK4(b), TB_UNPACK4((b) + 4), TB_UNPACK4((b) + 8), TB_UNPACK4((b) + 12)
+#define TB_UNPACK64(b) TB_UNPACK16(b), TB_UNPACK16((b) + 16), TB_UNPACK16((b) + 32), TB_UNPACK16((b) + 48)
+static const char unpack_table[256][4] = {
+  TB_UNPACK64(0), TB_UNPACK64(64), TB_UNPACK64(128), TB_UNPACK64(192)
+};
+
+/* a record of the FASTA file, while building */
+typedef struct {
+  const char *name;
+  const char *seq_start; /* first byte after the header line */
+  long        length;    /* number of residues */
+  long        nblocks;   /* number of N blocks */
+  long        nmasks;    /* number of lower case blocks */
+  uint64_t    offset;    /* where its record goes in the cache */
+} build_entry;
+
+/* a record being packed, the arrays are sized by the counts in its build_entry */
+typedef struct {
+  unsigned char *dna;
+  uint32_t      *nstartA, *nsizeA;
+  uint32_t      *mstartA, *msizeA;
+} packed_record;
+
+static char *scan_record(const char *fa_file, build_entry *ent, const char *file_end, packed_record *pk);
+static const char *next_header(const char *p, const char *end);
+static int   write_u32(FILE *fp, uint32_t value);
+static uint32_t get_u32(const unsigned char *p, long i);
+static long  first_block(const unsigned char *starts, const unsigned char *sizes, long n, long pos);
+static char *tb_error(const char *fmt, ...);
+static void *tb_alloc(size_t size);
+
+/* Function: twobit_build()
+ * Args:     fa_file:     FASTA file to cache
+ *           twobit_file: cache to write
+ * Returns:  NULL on success, or a malloc'ed error message if <fa_file>
+ *           can't be read, <twobit_file> can't be written, or <fa_file>
+ *           has a residue that can't be cached, or is compressed; no
+ *           partial cache is left behind.
+ */
+char *twobit_build(char *fa_file, char *twobit_file) {
+  struct stat   st;
+  int           fd;
+  char         *map;
+  const char   *p, *eol, *next, *hdr, *file_end;
+  build_entry  *entA = NULL;
+  long          nent = 0, nalloc = 0, e, name_len;
+  seqhash_t    *names;
+  arena_t      *strings;
+  uint64_t      offset;
+  int           version;
+  packed_record pk;
+  FILE         *fp = NULL;
+  char         *err = NULL;
+
+  if (bgzf_is_gzip(fa_file))
+    return tb_error("%s is compressed, decompress it to cache it\n", fa_file);
+  fd = open(fa_file, O_RDONLY);
+  if (fd == -1)
+    return tb_error("Cannot open %s\n", fa_file);
+  if ((fstat(fd, &st) == -1) || (! S_ISREG(st.st_mode)))
+    {
+      close(fd);
+      return tb_error("Cannot map %s into memory\n", fa_file);
+    }
+  map = NULL;
+  if ((st.st_size > 0) &&
+      ((map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED))
+    {
+      close(fd);
+      return tb_error("Cannot map %s into memory\n", fa_file);
+    }
+  close(fd);
+  if (map != NULL)
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  /* find the records, the first one with each name */
+  names   = seqhash_create(1024);
+  strings = arena_create();
+  file_end = map + st.st_size;
+  p = map;
+  while ((err == NULL) && (p < file_end))
+    {
+      eol  = (const char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      if (*p != '>') /* text before the first header line */
+        {
+          p = next;
+          continue;
+        }
+      for (name_len = 0; ((p + 1 + name_len) < next) && (strchr(TB_WHITE_SPACE, p[1+name_len]) == NULL); name_len++)
+        ;
+      hdr = p;
+      p   = next_header(next, file_end);
+      if (nent == nalloc)
+        {
+          nalloc = (nalloc == 0) ? 1024 : 2 * nalloc;
+          entA = (build_entry *) realloc(entA, nalloc * sizeof(build_entry));
+          if (entA == NULL)
+            {
+              fprintf(stderr, "No space\n");
+              exit(EXIT_FAILURE);
+            }
+        }
+      entA[nent].name      = arena_strdup(strings, hdr + 1, name_len);
+      entA[nent].seq_start = next;
+      if (seqhash_lookup(names, entA[nent].name) != -1) /* only the first sequence with each name is used */
+        continue;
+      seqhash_insert(names, entA[nent].name);
+      if (name_len > 255)
+        err = tb_error("Sequence name %s is too long for a 2-bit cache\n", entA[nent].name);
+      else
+        err = scan_record(fa_file, &(entA[nent]), file_end, NULL);
+      nent++;
+    }
+
+  /* where each record goes: after the header and the index */
+  version = 0;
+  offset  = 16;
+  for (e = 0; e < nent; e++)
+    offset += 1 + strlen(entA[e].name) + 4;
+  for (e = 0; e < nent; e++)
+    {
+      entA[e].offset = offset;
+      offset += 16 + 8 * (entA[e].nblocks + entA[e].nmasks) + (entA[e].length + 3) / 4;
+    }
+  if (offset > 0xffffffffUL) /* offsets need 64 bits */
+    {
+      version = 1;
+      for (e = 0; e < nent; e++)
+        entA[e].offset += 4 * nent;
+    }
+
+  if ((err == NULL) && ((fp = fopen(twobit_file, "w")) == NULL))
+    err = tb_error("Cannot open %s for writing\n", twobit_file);
+  if ((err == NULL) &&
+      ((write_u32(fp, TWOBIT_SIGNATURE) != 0) || (write_u32(fp, version) != 0) ||
+       (write_u32(fp, nent) != 0) || (write_u32(fp, 0) != 0)))
+    err = tb_error("Error writing %s\n", twobit_file);
+  for (e = 0; (err == NULL) && (e < nent); e++)
+    {
+      name_len = strlen(entA[e].name);
+      if ((fputc(name_len, fp) == EOF) || (fwrite(entA[e].name, 1, name_len, fp) != (size_t) name_len) ||
+          ((version == 0) && (write_u32(fp, entA[e].offset) != 0)) ||
+          ((version == 1) && (fwrite(&(entA[e].offset), 8, 1, fp) != 1)))
+        err = tb_error("Error writing %s\n", twobit_file);
+    }
+
+  /* pack and write each record */
+  for (e = 0; (err == NULL) && (e < nent); e++)
+    {
+      pk.dna     = (unsigned char *) tb_alloc((entA[e].length + 3) / 4 + 1);
+      pk.nstartA = (uint32_t *) tb_alloc((entA[e].nblocks + 1) * sizeof(uint32_t));
+      pk.nsizeA  = (uint32_t *) tb_alloc((entA[e].nblocks + 1) * sizeof(uint32_t));
+      pk.mstartA = (uint32_t *) tb_alloc((entA[e].nmasks + 1) * sizeof(uint32_t));
+      pk.msizeA  = (uint32_t *) tb_alloc((entA[e].nmasks + 1) * sizeof(uint32_t));
+      memset(pk.dna, 0, (entA[e].length + 3) / 4 + 1);
+      scan_record(fa_file, &(entA[e]), file_end, &pk);
+      if ((write_u32(fp, entA[e].length) != 0) ||
+          (write_u32(fp, entA[e].nblocks) != 0) ||
+          (fwrite(pk.nstartA, sizeof(uint32_t), entA[e].nblocks, fp) != (size_t) entA[e].nblocks) ||
+          (fwrite(pk.nsizeA,  sizeof(uint32_t), entA[e].nblocks, fp) != (size_t) entA[e].nblocks) ||
+          (write_u32(fp, entA[e].nmasks) != 0) ||
+          (fwrite(pk.mstartA, sizeof(uint32_t), entA[e].nmasks, fp) != (size_t) entA[e].nmasks) ||
+          (fwrite(pk.msizeA,  sizeof(uint32_t), entA[e].nmasks, fp) != (size_t) entA[e].nmasks) ||
+          (write_u32(fp, 0) != 0) ||
+          (fwrite(pk.dna, 1, (entA[e].length + 3) / 4, fp) != (size_t) ((entA[e].length + 3) / 4)))
+        err = tb_error("Error writing %s\n", twobit_file);
+      free(pk.dna);
+      free(pk.nstartA);
+      free(pk.nsizeA);
+      free(pk.mstartA);
+      free(pk.msizeA);
+    }
+
+  if ((fp != NULL) && (fclose(fp) != 0) && (err == NULL))
+    err = tb_error("Error writing %s\n", twobit_file);
+  if ((err != NULL) && (fp != NULL))
+    unlink(twobit_file); /* don't leave a partial cache behind */
+  if (map != NULL)
+    munmap(map, st.st_size);
+  seqhash_free(names);
+  arena_free(strings);
+  free(entA);
+  return err;
+}
+
+/* Function: scan_record()
+ * Args:     fa_file:  name of the FASTA file, for error messages
+ *           ent:      record, its name and seq_start are set; the counts
+ *                     are set if <pk> is NULL
+ *           file_end: end of the mapped FASTA file
+ *           pk:       NULL to count, else where the record is packed
+ * Returns:  NULL, or a malloc'ed error message if a residue can't be
+ *           cached or there are too many.
+ */
+static char *scan_record(const char *fa_file, build_entry *ent, const char *file_end, packed_record *pk) {
+  const char   *p, *eol, *next;
+  long          clen, i;
+  long          pos = 0;               /* residues so far */
+  long          nblocks = 0, nmasks = 0;
+  long          n_start = -1, m_start = -1; /* start of the N block and mask block we're in, or -1 */
+  unsigned char c, code;
+
+  for (p = ent->seq_start; (p < file_end) && (*p != '>'); p = next)
+    {
+      eol  = (const char *) memchr(p, '\n', file_end - p);
+      next = (eol == NULL) ? file_end : eol + 1;
+      clen = ((eol == NULL) ? file_end : eol) - p;
+      if ((clen > 0) && (p[clen-1] == '\r')) clen--;
+      for (i = 0; (i < clen) && (strchr(TB_WHITE_SPACE, p[i]) != NULL); i++)
+        ;
+      if (i == clen) /* blank line */
+        continue;
+
+      for (i = 0; i < clen; i++, pos++)
+        {
+          c    = (unsigned char) p[i];
+          code = code_table[c];
+          if (code == TB_BAD)
+            return tb_error("Cannot cache residue '%c' of sequence %s in %s, only ACGTN can be 2-bit packed\n", c, ent->name, fa_file);
+          if ((code == TB_N) != (n_start != -1))
+            {
+              if (n_start == -1)
+                n_start = pos;
+              else
+                {
+                  if (pk != NULL)
+                    {
+                      pk->nstartA[nblocks] = n_start;
+                      pk->nsizeA[nblocks]  = pos - n_start;
+                    }
+                  nblocks++;
+                  n_start = -1;
+                }
+            }
+          if ((c >= 'a') != (m_start != -1))
+            {
+              if (m_start == -1)
+                m_start = pos;
+              else
+                {
+                  if (pk != NULL)
+                    {
+                      pk->mstartA[nmasks] = m_start;
+                      pk->msizeA[nmasks]  = pos - m_start;
+                    }
+                  nmasks++;
+                  m_start = -1;
+                }
+            }
+          if ((pk != NULL) && (code != TB_N))
+            pk->dna[pos >> 2] |= code << (6 - 2 * (pos & 3));
+        }
+      if (pos > (long) TB_MAX_LENGTH)
+        return tb_error("Sequence %s in %s is too long for a 2-bit cache\n", ent->name, fa_file);
+    }
+  if (n_start != -1)
+    {
+      if (pk != NULL)
+        {
+          pk->nstartA[nblocks] = n_start;
+          pk->nsizeA[nblocks]  = pos - n_start;
+        }
+      nblocks++;
+    }
+  if (m_start != -1)
+    {
+      if (pk != NULL)
+        {
+          pk->mstartA[nmasks] = m_start;
+          pk->msizeA[nmasks]  = pos - m_start;
+        }
+      nmasks++;
+    }
+  ent->length  = pos;
+  ent->nblocks = nblocks;
+  ent->nmasks  = nmasks;
+  return NULL;
+}
+
+/* next_header(): return start of the first header line at or after <p>,
+ * which is at the start of a line, or <end> if there are none */
+static const char *next_header(const char *p, const char *end) {
+  if ((p < end) && (*p == '>'))
+    return p;
+  while ((p < end) && ((p = (const char *) memchr(p, '>', end - p)) != NULL))
+    {
+      if (p[-1] == '\n')
+        return p;
+      p++;
+    }
+  return end;
+}
+
+/* twobit_is_file(): TRUE if <filename> is a regular file that starts
+ * with the 2-bit signature */
+int twobit_is_file(const char *filename) {
+  struct stat st;
+  uint32_t    signature;
+  int         fd, is = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+      (read(fd, &signature, 4) == 4) && (signature == TWOBIT_SIGNATURE))
+    is = 1;
+  close(fd);
+  return is;
+}
+
+/* Function: twobit_open()
+ * Args:     filename: 2-bit cache to open
+ *           ret_err:  set to a malloc'ed error message on failure
+ * Returns:  the cache, mapped into memory, with its index read; caller
+ *           frees with twobit_free(). NULL if it can't be read, or is
+ *           not a 2-bit cache in our byte order.
+ */
+twobit_t *twobit_open(const char *filename, char **ret_err) {
+  struct stat st;
+  twobit_t   *tb;
+  const unsigned char *p, *end;
+  uint32_t    version, n;
+  int         fd, e, name_len;
+
+  *ret_err = NULL;
+  fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    {
+      *ret_err = tb_error("Cannot open %s\n", filename);
+      return NULL;
+    }
+  tb = (twobit_t *) tb_alloc(sizeof(twobit_t));
+  tb->map = NULL;
+  if ((fstat(fd, &st) == -1) || (! S_ISREG(st.st_mode)) || (st.st_size < 16) ||
+      ((tb->map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED))
+    {
+      close(fd);
+      free(tb);
+      *ret_err = tb_error("Cannot map %s into memory, or it is not a 2-bit cache\n", filename);
+      return NULL;
+    }
+  close(fd);
+  tb->map_size = st.st_size;
+  tb->entryA   = NULL;
+  tb->nentries = 0;
+  tb->strings  = arena_create();
+
+  p   = (const unsigned char *) tb->map;
+  end = p + tb->map_size;
+  version = get_u32(p, 1);
+  n       = get_u32(p, 2);
+  if ((get_u32(p, 0) != TWOBIT_SIGNATURE) || (version > 1) || (n > (uint32_t) (tb->map_size / 6)))
+    {
+      *ret_err = tb_error("%s is not a 2-bit cache we can read\n", filename);
+      twobit_free(tb);
+      return NULL;
+    }
+  tb->entryA = (twobit_entry *) tb_alloc((n + 1) * sizeof(twobit_entry));
+  p += 16;
+  for (e = 0; e < (int) n; e++)
+    {
+      name_len = (p < end) ? *p : 0;
+      if ((p + 1 + name_len + ((version == 0) ? 4 : 8)) > end)
+        {
+          *ret_err = tb_error("Index of %s is truncated\n", filename);
+          twobit_free(tb);
+          return NULL;
+        }
+      tb->entryA[e].name = arena_strdup(tb->strings, (const char *) p + 1, name_len);
+      p += 1 + name_len;
+      if (version == 0)
+        tb->entryA[e].offset = get_u32(p, 0);
+      else
+        memcpy(&(tb->entryA[e].offset), p, 8);
+      p += (version == 0) ? 4 : 8;
+      tb->nentries++;
+    }
+  madvise(tb->map, tb->map_size, MADV_RANDOM);
+  return tb;
+}
+
+/* Function: twobit_get()
+ * Args:     tb:  2-bit cache
+ *           e:   index of the sequence in tb->entryA
+ *           seq: set to the sequence
+ * Returns:  NULL, or a malloc'ed error message if its record is bad.
+ */
+char *twobit_get(twobit_t *tb, int e, twobit_seq *seq) {
+  const unsigned char *p   = (const unsigned char *) tb->map + tb->entryA[e].offset;
+  const unsigned char *end = (const unsigned char *) tb->map + tb->map_size;
+
+  if ((tb->entryA[e].offset > (uint64_t) tb->map_size) || (end - p < 8))
+    return tb_error("Record for sequence %s of the 2-bit cache is truncated\n", tb->entryA[e].name);
+  seq->length  = get_u32(p, 0);
+  seq->nblocks = get_u32(p, 1);
+  if (end - p < 12 + 8 * seq->nblocks)
+    return tb_error("Record for sequence %s of the 2-bit cache is truncated\n", tb->entryA[e].name);
+  seq->nstarts = p + 8;
+  seq->nsizes  = seq->nstarts + 4 * seq->nblocks;
+  p = seq->nsizes + 4 * seq->nblocks;
+  seq->nmasks  = get_u32(p, 0);
+  if (end - p < 8 + 8 * seq->nmasks)
+    return tb_error("Record for sequence %s of the 2-bit cache is truncated\n", tb->entryA[e].name);
+  seq->mstarts = p + 4;
+  seq->msizes  = seq->mstarts + 4 * seq->nmasks;
+  seq->dna     = seq->msizes + 4 * seq->nmasks + 4; /* after the reserved word */
+  if (end - seq->dna < (seq->length + 3) / 4)
+    return tb_error("Record for sequence %s of the 2-bit cache is truncated\n", tb->entryA[e].name);
+  return NULL;
+}
+
+/* Function: twobit_unpack()
+ * Args:     dst:   destination, room for <nres> characters
+ *           seq:   sequence to unpack from
+ *           start: position (0-based) of the first residue to unpack
+ *           nres:  number of residues to unpack
+ */
+void twobit_unpack(char *dst, const twobit_seq *seq, long start, long nres) {
+  long pos = start, o = 0, b, s, e;
+
+  /* residues, 4 at a time once we're at a byte boundary */
+  for (; (o < nres) && (pos & 3); o++, pos++)
+    dst[o] = unpack_table[seq->dna[pos >> 2]][pos & 3];
+  for (; nres - o >= 4; o += 4, pos += 4)
+    memcpy(dst + o, unpack_table[seq->dna[pos >> 2]], 4);
+  for (; o < nres; o++, pos++)
+    dst[o] = unpack_table[seq->dna[pos >> 2]][pos & 3];
+
+  /* then the N blocks and lower case blocks that overlap them */
+  for (b = first_block(seq->nstarts, seq->nsizes, seq->nblocks, start); b < seq->nblocks; b++)
+    {
+      s = get_u32(seq->nstarts, b);
+      if (s >= start + nres)
+        break;
+      e = s + get_u32(seq->nsizes, b);
+      if (s < start) s = start;
+      if (e > start + nres) e = start + nres;
+      memset(dst + (s - start), 'N', e - s);
+    }
+  for (b = first_block(seq->mstarts, seq->msizes, seq->nmasks, start); b < seq->nmasks; b++)
+    {
+      s = get_u32(seq->mstarts, b);
+      if (s >= start + nres)
+        break;
+      e = s + get_u32(seq->msizes, b);
+      if (s < start) s = start;
+      if (e > start + nres) e = start + nres;
+      for (; s < e; s++)
+        dst[s - start] |= 0x20; /* lower case */
+    }
+}
+
+/* twobit_free(): free <tb> and unmap its file */
+void twobit_free(twobit_t *tb) {
+  if (tb == NULL)
+    return;
+  if (tb->map != NULL)
+    munmap(tb->map, tb->map_size);
+  free(tb->entryA);
+  arena_free(tb->strings);
+  free(tb);
+}
+
+/* first_block(): index of the first of the <n> sorted blocks that ends after <pos> */
+static long first_block(const unsigned char *starts, const unsigned char *sizes, long n, long pos) {
+  long lo = 0, hi = n, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if ((long) get_u32(starts, mid) + (long) get_u32(sizes, mid) <= pos)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* get_u32(): the <i>th 32 bit integer of <p>, which may not be aligned */
+static uint32_t get_u32(const unsigned char *p, long i) {
+  uint32_t value;
+
+  memcpy(&value, p + 4 * i, 4);
+  return value;
+}
+
+static int write_u32(FILE *fp, uint32_t value) {
+  return (fwrite(&value, 4, 1, fp) == 1) ? 0 : -1;
+}
+
+/* tb_error(): return a malloc'ed, printf-formatted error message */
+static char *tb_error(const char *fmt, ...) {
+  va_list ap;
+  char   *msg;
+
+  va_start(ap, fmt);
+  if (vasprintf(&msg, fmt, ap) == -1)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  va_end(ap);
+  return msg;
+}
+
+static void *tb_alloc(size_t size) {
+  void *p = malloc(size);
+
+  if (p == NULL)
+    {
+      fprintf(stderr, "No space\n");
+      exit(EXIT_FAILURE);
+    }
+  return p;
+}
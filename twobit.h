@@ -0,0 +1,71 @@
+/* twobit.h:
+ *
+ * 2-bit packed sequence caches, in the UCSC .2bit format, built from a
+ * FASTA file with twobit_build() and then extracted from instead of it.
+ * All integers are 32 bits in the byte order of the machine that wrote
+ * the file (we only read files in our own byte order):
+ *
+ *   header:   signature 0x1A412743, version (0, or 1 if offsets are
+ *             64 bits), number of sequences, reserved (0)
+ *   index:    for each sequence: length of its name (1 byte), the name,
+ *             offset of its record in the file (64 bits if version 1)
+ *   record:   number of residues
+ *             number of N blocks, their starts (0-based), their sizes
+ *             number of mask (lower case) blocks, their starts, their sizes
+ *             reserved (0)
+ *             residues, 4 per byte, first in the high bits, T=0 C=1 A=2 G=3
+ *
+ * N blocks are stored as 'T' in the packed residues. So only A, C, G,
+ * T and N (in either case) can be cached, twobit_build() refuses a
+ * FASTA file with anything else, and extracting from the cache gives
+ * exactly what extracting from the FASTA file does. Like the rest of
+ * extract_fasta_multi_exon, only the first sequence with each name is
+ * cached; a trailing '\r' and lines with nothing but whitespace are
+ * not residues.
+ *
+ * The cache is mapped into memory and residues are unpacked (4 at a
+ * time, with a lookup table) only for the requested pieces.
+ */
+
+#ifndef TWOBIT_H
+#define TWOBIT_H
+
+#include <stdint.h>
+
+#include "arena.h"
+
+#define TWOBIT_SIGNATURE 0x1A412743
+
+typedef struct {
+  char    *name;   /* sequence name, in strings */
+  uint64_t offset; /* offset of its record in the file */
+} twobit_entry;
+
+typedef struct {
+  char         *map;      /* the mapped file */
+  long          map_size;
+  twobit_entry *entryA;   /* [0..nentries-1] one per sequence, in file order */
+  int           nentries;
+  arena_t      *strings;  /* names */
+} twobit_t;
+
+/* a sequence in a 2-bit cache, pointing into the mapped file */
+typedef struct {
+  long                 length;  /* number of residues */
+  const unsigned char *dna;     /* packed residues */
+  long                 nblocks; /* number of N blocks */
+  const unsigned char *nstarts; /* [0..nblocks-1] 32 bit starts of N blocks */
+  const unsigned char *nsizes;  /* [0..nblocks-1] 32 bit sizes of N blocks */
+  long                 nmasks;  /* number of lower case blocks */
+  const unsigned char *mstarts;
+  const unsigned char *msizes;
+} twobit_seq;
+
+char     *twobit_build(char *fa_file, char *twobit_file);
+int       twobit_is_file(const char *filename);
+twobit_t *twobit_open(const char *filename, char **ret_err);
+char     *twobit_get(twobit_t *tb, int e, twobit_seq *seq);
+void      twobit_unpack(char *dst, const twobit_seq *seq, long start, long nres);
+void      twobit_free(twobit_t *tb);
+
+#endif /* TWOBIT_H */